@@ -18,68 +18,44 @@ uint8_t pkt_payload[6] = { 0x50, 0x51, 0x52, 0x53, 0x54, 0x55 }; // Payload that
 int station_pkt_payload_length = 6; // Length of the payload the stations will send to each other
 
 // Variables used in the code, no changes necessary to work
-int counter = 0; // Counter for stations to keep track of the number of received packets to trigger sending a packet
 uint8_t mac[6]; // Holder for this ESP-32's MAC address
 uint8_t target_mac[6]; // Holder for the target MAC address
-wifi_mac_data_frame_t* station_pkt; // Pointer to the allocated packet that the stations send out
 
-// Create the callback for when we get a packet as the middle man device
-static void receive_middle_man_general_callback(wifi_mac_data_frame_t* packet, int payload_length)
-{
-    ESP_LOGI(LOGGING_TAG, "Packet Received");
-    // Check if the packet is targeting this device (the middle-man)
-    if(packet->address_1[0] == mac[0] && packet->address_1[1] == mac[1] && packet->address_1[2] == mac[2] 
-    && packet->address_1[3] == mac[3] && packet->address_1[4] == mac[4] && packet->address_1[5] == mac[5])
-    {
-        ESP_LOGI(LOGGING_TAG, "Packet To Forward Received"); // Log that we got a packet to forward to a station
-        /*  Generate the packet to send to the station
-            This includes:
-                Setting ADDR_1(Receiving MAC) to the target MAC in ADDR_3
-                Setting ADDR_2(Sending MAC) to our MAC address
-                Setting ADDR_3(Originator MAC) to the MAC in ADDR_2 since we only do station to station forwarding
-                Copying the payload into this new packet
-        */ 
-        wifi_mac_data_frame_t* pkt = alloc_packet_custom(
-            0x0008, // bits are read in opposite order, this denotes a general data packet
-            0xFA, 
-            packet->address_3,
-            mac,
-            packet->address_2,
-            0xFA,
-            (uint8_t []){ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
-            payload_length,
-            packet->payload
-        );
+// State the station callback works on, handed to it as its callback context rather than kept in globals
+typedef struct {
+    int counter; // Counter to keep track of the number of received packets to trigger sending a packet
+    wifi_mac_data_frame_t* station_pkt; // Pointer to the allocated packet that the station sends out
+} station_context_t;
+station_context_t station_context = { .counter = 0, .station_pkt = NULL };
 
-        log_packet_annotated(pkt, payload_length, LOGGING_TAG);// Log packet with annotated logging helper
-        send_packet_simple(pkt, payload_length); // Send the packet
-        ESP_LOGI(LOGGING_TAG, "Packet Sent");
-        free(pkt); // Free the allocated packet space for the next packet
-    }
-}
-
-// Create the callback for when we get a packet as one of the two stations
-static void receive_station_general_callback(wifi_mac_data_frame_t* packet, int payload_length)
+// Create the callback for when we get a packet as one of the two stations, it gets the packet as a frame view with the address roles already worked out
+static void receive_station_general_callback(const wifi_frame_view_t* view, void* ctx)
 {
-    ESP_LOGI(LOGGING_TAG, "Packet Received %d", counter);
-    counter++;  // Increment each time a packet is received by the station
+    station_context_t* station = (station_context_t*)ctx;
+    ESP_LOGI(LOGGING_TAG, "Packet Received %d", station->counter);
+    station->counter++;  // Increment each time a packet is received by the station
     // Send a packet for every 32 packet we receive. This provides continuous packets being sent back and forth between the stations
-    if(counter % 32 == 0)
+    if(station->counter % 32 == 0)
     {
         ESP_LOGI(LOGGING_TAG, "SENDING PACKET");
-        send_packet_simple(station_pkt, station_pkt_payload_length); // Send the packet 'station_pkt' generated in 'advanced_interdevice_communication'. This allows use to only have to generate the packet once, reusing it.
-        counter = 0;
+        send_packet_simple(station->station_pkt, station_pkt_payload_length); // Send the packet 'station_pkt' generated in 'advanced_interdevice_communication'. This allows use to only have to generate the packet once, reusing it.
+        station->counter = 0;
         ESP_LOGI(LOGGING_TAG, "PACKET SENT");
     }
 
-    // Log packets received from the middle-man ESP-32 if they are for use
-    if(packet->address_2[0] == middle_monitor_mac[0] && packet->address_2[1] == middle_monitor_mac[1] && packet->address_2[2] == middle_monitor_mac[2] 
-    && packet->address_2[3] == middle_monitor_mac[3] && packet->address_2[4] == middle_monitor_mac[4] && packet->address_2[5] == middle_monitor_mac[5]
-    && packet->address_1[0] == mac[0] && packet->address_1[1] == mac[1] && packet->address_1[2] == mac[2] 
-    && packet->address_1[3] == mac[3] && packet->address_1[4] == mac[4] && packet->address_1[5] == mac[5])
+    // Log packets received from the middle-man ESP-32 if they are for use (the transmitter and receiver are NULL for frames too short to carry them)
+    if(view->transmitter == NULL || view->receiver == NULL)
+    {
+        return;
+    }
+    if(view->transmitter[0] == middle_monitor_mac[0] && view->transmitter[1] == middle_monitor_mac[1] && view->transmitter[2] == middle_monitor_mac[2] 
+    && view->transmitter[3] == middle_monitor_mac[3] && view->transmitter[4] == middle_monitor_mac[4] && view->transmitter[5] == middle_monitor_mac[5]
+    && view->receiver[0] == mac[0] && view->receiver[1] == mac[1] && view->receiver[2] == mac[2] 
+    && view->receiver[3] == mac[3] && view->receiver[4] == mac[4] && view->receiver[5] == mac[5])
     {
         ESP_LOGI(LOGGING_TAG, "PACKET RECEIVED FROM MIDDLE_MONITOR");
-        log_packet_annotated(packet, payload_length, LOGGING_TAG); // Log the packet with annotations
+        ESP_LOGI(LOGGING_TAG, "HEADER LENGTH %d, PAYLOAD LENGTH %d", view->header_length, view->payload_length);
+        log_packet_annotated((wifi_mac_data_frame_t*)view->frame, view->frame_length - (int)sizeof(wifi_mac_data_frame_t), LOGGING_TAG); // Log the packet with annotations
     }
 }
 
@@ -101,8 +77,29 @@ static void advanced_interdevice_communication(void)
 
     if(MIDDLE_MONITOR) 
     {
-        // If we are the middle monitor, all we care about is running the middle-man general callback.
-        ESP_ERROR_CHECK(setup_promiscuous_simple_with_general_callback(&receive_middle_man_general_callback));
+        // If we are the middle monitor, all we do is forward. Only pass on packets targeting this device (ADDR_1 is our MAC), the rest are dropped before anything else runs.
+        frame_filter_term_t to_middle_man[] = { FRAME_FILTER_TERM_ADDRESS(FRAME_FILTER_ADDRESS_1, mac) };
+        ESP_ERROR_CHECK(add_frame_filter(to_middle_man, 1, NULL));
+        /*  Add a route to each station, looked up by the target MAC the sending station put in ADDR_3. Each packet is rewritten in the receive buffer and sent straight back out:
+                Setting ADDR_1(Receiving MAC) to the target MAC in ADDR_3
+                Setting ADDR_2(Sending MAC) to our MAC address
+                Setting ADDR_3(Originator MAC) to the MAC in ADDR_2 since we only do station to station forwarding
+                Making it a general data packet (0x0008, bits are read in opposite order) with a 0xFA duration
+        */
+        for(int station = 0; station < 2; station++)
+        {
+            forwarding_route_t route = {
+                .address_3 = FORWARD_ADDRESS_3_SOURCE,
+                .frame_control_clear = 0xFFFF,
+                .frame_control_set = 0x0008,
+                .duration_id = 0xFA
+            };
+            memcpy(route.destination, station_target_macs[station], 6);
+            memcpy(route.next_hop, station_target_macs[station], 6);
+            ESP_ERROR_CHECK(add_forwarding_route(&route));
+        }
+        ESP_ERROR_CHECK(setup_forwarding((forwarding_config_t)FORWARDING_CONFIG_DEFAULT()));
+        ESP_ERROR_CHECK(setup_promiscuous_simple());
     }
     else 
     {
@@ -128,7 +125,7 @@ static void advanced_interdevice_communication(void)
         }
 
         // Allocate the packet that we are going to be sending to the other station through the middle-man ESP-32
-        station_pkt = alloc_packet_custom(
+        station_context.station_pkt = alloc_packet_custom(
             0x0008, // bits are read in opposite order 
             0xFA, 
             middle_monitor_mac,
@@ -140,8 +137,9 @@ static void advanced_interdevice_communication(void)
             pkt_payload
         );
 
-        // Setup the promiscuous capabilities to receive packets and run the station callback
-        ESP_ERROR_CHECK(setup_promiscuous_simple_with_general_callback(&receive_station_general_callback));
+        // Add the station callback with its context, then setup the promiscuous capabilities to receive packets and run it
+        ESP_ERROR_CHECK(add_receive_callback_general(&receive_station_general_callback, &station_context, NULL));
+        ESP_ERROR_CHECK(setup_promiscuous_simple());
     }
 }
 
@@ -134,7 +134,7 @@ static void basic_callbacks(void)
         {
             ESP_ERROR_CHECK(set_send_callback_duration_id(&set_duration_id_callback));
             ESP_ERROR_CHECK(set_send_callback_address_1(&double_address_1_callback));
-            ESP_ERROR_CHECK(set_send_callback_payload(&payload_callback)); // Payload includes FCS which is not included in the send setup causing a size disparity between what was sent and received
+            ESP_ERROR_CHECK(set_send_callback_payload(&payload_callback)); // The received payload length leaves off the FCS, so it matches the length sent here
         }
 
         // Setup the general callback if it is enabled
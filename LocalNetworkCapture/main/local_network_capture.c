@@ -23,19 +23,12 @@ esp_err_t log_captured_packet(wifi_mac_data_frame_t* packet, int payload_length,
         packet->address_4[0], packet->address_4[1], packet->address_4[2], packet->address_4[3], packet->address_4[4], packet->address_4[5]
     );
 
-    // If the packet we are logging has a payload, generate the payload output string by dynamically generating the hex values. 
-    if(payload_length){
-        uint8_t* payload_buffer = (uint8_t*)malloc(payload_length*2); // Times 2 for 2 hex per byte
-        char temp_buffer[3];
-        // // Generate the payload string
-        for(int counter = 0; counter < payload_length; counter++)
-        {
-            snprintf(temp_buffer, 3, "%02X", (packet->payload)[counter]);
-            memcpy(&payload_buffer[counter*2], temp_buffer, 2);
-        }
-
-        ESP_LOGI(TAG, "Payload: 0x%.*s", payload_length*2, payload_buffer);
-        free(payload_buffer);
+    // If the packet we are logging has a payload, generate the payload output string with the component hex formatter (no allocation, cut at the configured maximum)
+    if(payload_length > 0){
+        char payload_buffer[PACKET_LIBRARY_LOG_PAYLOAD_MAX_BYTES * 2 + 1];
+        int printed_length = payload_length < get_log_payload_max_length() ? payload_length : get_log_payload_max_length();
+        format_payload_hex(packet->payload, printed_length, payload_buffer, sizeof(payload_buffer));
+        ESP_LOGI(TAG, "Payload: 0x%s%s", payload_buffer, printed_length < payload_length ? "..." : "");
     }
     return ESP_OK;    
 }
@@ -0,0 +1,36 @@
+/* Packet Library Benchmark
+    This runs the component benchmark suite (packetlibrarycomponent/host/benchmark) on the ESP-32, timing with the CPU cycle counter.
+    Results are printed as one JSON object per line, the same format the host build writes, so they can be collected from the monitor output.
+*/
+
+#include <esp_wifi.h>
+#include <esp_log.h>
+#include <esp_rom_sys.h>
+#include <nvs_flash.h>
+#include "packet_library.h"
+#include "packet_library_benchmark.h"
+
+void app_main(void)
+{
+    // Initialize NVS (Not part of wifi library functionality)
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    // Make sure nvs got setup properly
+    ESP_ERROR_CHECK( ret );
+
+    // The send benchmarks need the radio up as a station, the receive benchmarks call the component callback directly
+    ESP_ERROR_CHECK(setup_wifi_station_simple());
+    ESP_ERROR_CHECK(setup_sta_default());
+    ESP_ERROR_CHECK(setup_promiscuous_simple());
+
+    packet_library_benchmark_config_t config = PACKET_LIBRARY_BENCHMARK_CONFIG_DEFAULT();
+    config.output = stdout;
+    config.platform = "esp32";
+    config.min_time_us = 100000;
+    config.cycles_per_ns = esp_rom_get_cpu_ticks_per_us() / 1000.0;
+    int results = run_packet_library_benchmarks(config);
+    ESP_LOGI(LOGGING_TAG, "BENCHMARK DONE (%d RESULTS)", results);
+}
@@ -0,0 +1,787 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "packet_library.h"
+#include "pcap_file.h"
+
+/*
+    Summarizes a pcap capture (raw 802.11 or radiotap, such as one written by the capture sink) on every core.
+    The file is memory mapped and split into one byte range per thread. A range starts at the first offset from which a run of
+    plausible record headers follows, each thread decodes the records in its range with parse_frame_view into counters of its
+    own, and the counters are merged in file order. A range start found this way is checked once the threads are done: the
+    thread before it has to have stopped exactly there, otherwise the range is parsed again from where that thread did stop.
+    After a record header that cannot be right (its length runs past the end of the file) parsing goes on from the next such run.
+    Reported: frame type/subtype and channel histograms, per address counters (as transmitter and as receiver, RSSI, retries),
+    and sequence number gaps, repeats and reordering per transmitter, kept separately for each QoS TID.
+*/
+
+#define PCAP_MAGIC_MICROSECONDS 0xA1B2C3D4
+#define PCAP_MAGIC_NANOSECONDS 0xA1B23C4D
+#define PCAP_FILE_HEADER_LENGTH 24
+#define PCAP_RECORD_HEADER_LENGTH 16
+#define PCAP_LINKTYPE_IEEE802_11 105
+#define PCAP_LINKTYPE_IEEE802_11_RADIOTAP 127
+#define MAX_RECORD_LENGTH 262144 // Largest snaplen libpcap writes
+#define SYNC_RECORDS 8 // Plausible record headers in a row that mark a range start
+#define SEQUENCE_SLOTS 9 // One per QoS TID, and one shared by management and non-QoS data frames
+#define SEQUENCE_NUMBER_COUNT 4096
+#define MAX_THREADS 256
+#define CHANNEL_COUNT 15
+
+typedef struct {
+    const uint8_t* map;
+    size_t size;
+    bool swapped;
+    bool nanoseconds;
+    uint32_t linktype;
+} analyzer_capture_t;
+
+typedef struct {
+    uint16_t first;
+    uint16_t last;
+    bool seen;
+} sequence_track_t;
+
+typedef struct {
+    uint64_t frames; // Frames that took part, fragments after the first are left out
+    uint64_t gaps; // Jumps forward by more than one
+    uint64_t missing; // Sequence numbers skipped over by those jumps
+    uint64_t repeats; // The same number again (retransmissions whose first copy was captured, or duplicates)
+    uint64_t reordered; // The number went backwards
+} sequence_stats_t;
+
+typedef struct {
+    uint8_t address[6];
+    bool used;
+    uint64_t transmitted_frames;
+    uint64_t transmitted_bytes;
+    uint64_t received_frames;
+    uint64_t type_frames[4]; // Transmitted, by enum wifi_frame_type
+    uint64_t retries;
+    int64_t rssi_sum;
+    uint64_t rssi_count; // Transmitted frames with a signal level in their radiotap header
+    uint64_t first_us;
+    uint64_t last_us;
+    sequence_stats_t sequence;
+    sequence_track_t tracks[SEQUENCE_SLOTS];
+} analyzer_address_t;
+
+typedef struct {
+    analyzer_address_t* entries;
+    size_t capacity; // Power of two
+    size_t count;
+} address_table_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t bytes; // 802.11 bytes, without radiotap headers and FCS
+    uint64_t unparsed; // Shorter than their header, or with an unreadable radiotap header
+    uint64_t bytes_skipped; // From a record header with a length past MAX_RECORD_LENGTH or the end of the file to the next plausible one
+    uint64_t type_frames[4][16];
+    uint64_t channel_frames[CHANNEL_COUNT]; // 0 when the file does not say
+    uint64_t retry_frames;
+    uint64_t protected_frames;
+    uint64_t first_us;
+    uint64_t last_us;
+} analyzer_totals_t;
+
+typedef struct {
+    const analyzer_capture_t* capture;
+    size_t start; // Offset of the first record
+    size_t end; // Records starting before this offset belong to the range
+    size_t stopped_at; // Offset after the last record parsed
+    analyzer_totals_t totals;
+    address_table_t addresses;
+} analyzer_range_t;
+
+static const char* const management_subtype_names[16] = {
+    "association request", "association response", "reassociation request", "reassociation response", "probe request",
+    "probe response", "timing advertisement", NULL, "beacon", "ATIM", "disassociation", "authentication", "deauthentication",
+    "action", "action no ack", NULL
+};
+static const char* const control_subtype_names[16] = {
+    NULL, NULL, "trigger", "TACK", "beamforming report poll", "NDP announcement", "control frame extension", "control wrapper",
+    "block ack request", "block ack", "PS-Poll", "RTS", "CTS", "ACK", "CF-End", "CF-End + CF-Ack"
+};
+static const char* const data_subtype_names[16] = {
+    "data", "data + CF-Ack", "data + CF-Poll", "data + CF-Ack + CF-Poll", "null", "CF-Ack", "CF-Poll", "CF-Ack + CF-Poll",
+    "QoS data", "QoS data + CF-Ack", "QoS data + CF-Poll", "QoS data + CF-Ack + CF-Poll", "QoS null", NULL, "QoS CF-Poll",
+    "QoS CF-Ack + CF-Poll"
+};
+static const char* const type_names[4] = { "management", "control", "data", "extension" };
+
+static void print_usage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s [options] capture.pcap\n"
+        "  -j THREADS  threads to parse with (default: one per online core, at most %d)\n"
+        "  -n COUNT    addresses to list, busiest transmitters first (default 20, 0 for all)\n"
+        "  -m OUTPUT   also write the counters of every address to OUTPUT as CSV\n",
+        program, MAX_THREADS);
+}
+
+static uint32_t read_u32(const uint8_t* bytes, bool swapped)
+{
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return swapped ? __builtin_bswap32(value) : value;
+}
+
+static double elapsed_seconds(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// True if a record header at 'offset' could start a record and its frame looks like the file's link type, '*next' is the record after it
+static bool record_plausible(const analyzer_capture_t* capture, size_t offset, size_t* next)
+{
+    if(offset + PCAP_RECORD_HEADER_LENGTH > capture->size)
+    {
+        return false;
+    }
+    const uint8_t* record = capture->map + offset;
+    uint32_t fraction = read_u32(record + 4, capture->swapped);
+    uint32_t captured_length = read_u32(record + 8, capture->swapped);
+    uint32_t original_length = read_u32(record + 12, capture->swapped);
+    if(fraction >= (capture->nanoseconds ? 1000000000u : 1000000u) || captured_length < 2 || captured_length > MAX_RECORD_LENGTH ||
+       original_length < captured_length || original_length > MAX_RECORD_LENGTH ||
+       captured_length > capture->size - offset - PCAP_RECORD_HEADER_LENGTH)
+    {
+        return false;
+    }
+    const uint8_t* frame = record + PCAP_RECORD_HEADER_LENGTH;
+    if(capture->linktype == PCAP_LINKTYPE_IEEE802_11_RADIOTAP)
+    {
+        // Radiotap version 0, and a header length that fits the record
+        uint32_t radiotap_length = frame[2] | (frame[3] << 8);
+        if(captured_length < 8 || frame[0] != 0 || radiotap_length < 8 || radiotap_length > captured_length)
+        {
+            return false;
+        }
+    }
+    else if((frame[0] & 0x03) != 0) // 802.11 protocol version 0
+    {
+        return false;
+    }
+    *next = offset + PCAP_RECORD_HEADER_LENGTH + captured_length;
+    return true;
+}
+
+// First offset at or after 'offset' followed by SYNC_RECORDS plausible records (or fewer that end exactly at the end of the file)
+static size_t find_range_start(const analyzer_capture_t* capture, size_t offset)
+{
+    for(; offset + PCAP_RECORD_HEADER_LENGTH <= capture->size; offset++)
+    {
+        size_t record = offset;
+        int count = 0;
+        while(count < SYNC_RECORDS && record != capture->size && record_plausible(capture, record, &record))
+        {
+            count++;
+        }
+        if(count == SYNC_RECORDS || (count > 0 && record == capture->size))
+        {
+            return offset;
+        }
+    }
+    return capture->size;
+}
+
+static size_t hash_address(const uint8_t address[6])
+{
+    uint64_t key = 0;
+    memcpy(&key, address, 6);
+    return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+static esp_err_t setup_address_table(address_table_t* table, size_t capacity)
+{
+    table->entries = calloc(capacity, sizeof(analyzer_address_t));
+    table->capacity = capacity;
+    table->count = 0;
+    return table->entries != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static void free_address_table(address_table_t* table)
+{
+    free(table->entries);
+    table->entries = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+static analyzer_address_t* find_address_slot(address_table_t* table, const uint8_t address[6])
+{
+    size_t mask = table->capacity - 1;
+    for(size_t slot = hash_address(address) & mask;; slot = (slot + 1) & mask)
+    {
+        analyzer_address_t* entry = &table->entries[slot];
+        if(!entry->used || memcmp(entry->address, address, 6) == 0)
+        {
+            return entry;
+        }
+    }
+}
+
+// Entry for 'address', added if it is new. NULL only if the table could not grow.
+static analyzer_address_t* get_address(address_table_t* table, const uint8_t address[6])
+{
+    analyzer_address_t* entry = find_address_slot(table, address);
+    if(entry->used)
+    {
+        return entry;
+    }
+    if((table->count + 1) * 4 > table->capacity * 3)
+    {
+        address_table_t grown;
+        if(setup_address_table(&grown, table->capacity * 2) != ESP_OK)
+        {
+            return NULL;
+        }
+        for(size_t i = 0; i < table->capacity; i++)
+        {
+            if(table->entries[i].used)
+            {
+                *find_address_slot(&grown, table->entries[i].address) = table->entries[i];
+            }
+        }
+        grown.count = table->count;
+        free_address_table(table);
+        *table = grown;
+        entry = find_address_slot(table, address);
+    }
+    memset(entry, 0, sizeof(analyzer_address_t));
+    memcpy(entry->address, address, 6);
+    entry->used = true;
+    entry->first_us = UINT64_MAX;
+    table->count++;
+    return entry;
+}
+
+// Classifies the step from 'previous' to 'current' sequence number
+static void account_sequence_step(sequence_stats_t* stats, uint16_t previous, uint16_t current)
+{
+    uint16_t step = (current - previous) & (SEQUENCE_NUMBER_COUNT - 1);
+    if(step == 0)
+    {
+        stats->repeats++;
+    }
+    else if(step >= SEQUENCE_NUMBER_COUNT / 2)
+    {
+        stats->reordered++;
+    }
+    else if(step > 1)
+    {
+        stats->gaps++;
+        stats->missing += step - 1;
+    }
+}
+
+static void account_frame(analyzer_range_t* range, analyzer_totals_t* totals, const wifi_frame_view_t* view, uint64_t timestamp_us)
+{
+    totals->frames++;
+    totals->bytes += view->frame_length;
+    totals->type_frames[view->type][view->subtype]++;
+    totals->channel_frames[view->channel < CHANNEL_COUNT ? view->channel : 0]++;
+    totals->retry_frames += view->retry;
+    totals->protected_frames += view->protected_frame;
+    totals->first_us = timestamp_us < totals->first_us ? timestamp_us : totals->first_us;
+    totals->last_us = timestamp_us > totals->last_us ? timestamp_us : totals->last_us;
+
+    if(view->receiver != NULL)
+    {
+        analyzer_address_t* receiver = get_address(&range->addresses, view->receiver);
+        if(receiver != NULL)
+        {
+            receiver->received_frames++;
+            receiver->first_us = timestamp_us < receiver->first_us ? timestamp_us : receiver->first_us;
+            receiver->last_us = timestamp_us > receiver->last_us ? timestamp_us : receiver->last_us;
+        }
+    }
+    analyzer_address_t* transmitter = view->transmitter != NULL ? get_address(&range->addresses, view->transmitter) : NULL;
+    if(transmitter == NULL)
+    {
+        return;
+    }
+    transmitter->transmitted_frames++;
+    transmitter->transmitted_bytes += view->frame_length;
+    transmitter->type_frames[view->type]++;
+    transmitter->retries += view->retry;
+    transmitter->first_us = timestamp_us < transmitter->first_us ? timestamp_us : transmitter->first_us;
+    transmitter->last_us = timestamp_us > transmitter->last_us ? timestamp_us : transmitter->last_us;
+    if(view->rx_ctrl != NULL && view->rx_ctrl->rssi != 0)
+    {
+        transmitter->rssi_sum += view->rx_ctrl->rssi;
+        transmitter->rssi_count++;
+    }
+
+    // Control frames carry no sequence control, later fragments repeat the number of the first
+    if(view->type == WIFI_FRAME_TYPE_CONTROL || view->type == WIFI_FRAME_TYPE_EXTENSION || view->fragment_number != 0)
+    {
+        return;
+    }
+    int slot = view->has_qos && (view->qos_control & 0x0F) < 8 ? (view->qos_control & 0x0F) : SEQUENCE_SLOTS - 1;
+    sequence_track_t* track = &transmitter->tracks[slot];
+    if(track->seen)
+    {
+        account_sequence_step(&transmitter->sequence, track->last, view->sequence_number);
+    }
+    else
+    {
+        track->first = view->sequence_number;
+        track->seen = true;
+    }
+    track->last = view->sequence_number;
+    transmitter->sequence.frames++;
+}
+
+// Thread body, parses the records from range->start up to the first one at or after range->end
+static void* analyze_range(void* arg)
+{
+    analyzer_range_t* range = arg;
+    const analyzer_capture_t* capture = range->capture;
+    analyzer_totals_t totals; // On the stack so the per frame counts of neighbouring ranges do not share cache lines
+    memset(&totals, 0, sizeof(totals));
+    totals.first_us = UINT64_MAX;
+
+    size_t offset = range->start;
+    while(offset < range->end && offset + PCAP_RECORD_HEADER_LENGTH <= capture->size)
+    {
+        const uint8_t* record = capture->map + offset;
+        uint32_t captured_length = read_u32(record + 8, capture->swapped);
+        if(captured_length > MAX_RECORD_LENGTH || captured_length > capture->size - offset - PCAP_RECORD_HEADER_LENGTH)
+        {
+            // Same search as for a range start, so a range that runs into the next one stops on that one's start
+            size_t next = find_range_start(capture, offset + 1);
+            totals.bytes_skipped += next - offset;
+            offset = next;
+            continue;
+        }
+        offset += PCAP_RECORD_HEADER_LENGTH + captured_length;
+
+        uint32_t fraction = read_u32(record + 4, capture->swapped);
+        uint64_t timestamp_us = (uint64_t)read_u32(record, capture->swapped) * 1000000 + (capture->nanoseconds ? fraction / 1000 : fraction);
+        const uint8_t* frame = record + PCAP_RECORD_HEADER_LENGTH;
+        uint32_t frame_length = captured_length;
+        wifi_pkt_rx_ctrl_t rx_ctrl;
+        memset(&rx_ctrl, 0, sizeof(rx_ctrl));
+        bool has_fcs = false;
+        if(capture->linktype == PCAP_LINKTYPE_IEEE802_11_RADIOTAP)
+        {
+            int radiotap_length = parse_pcap_radiotap(frame, captured_length, &rx_ctrl, &has_fcs);
+            if(radiotap_length < 0)
+            {
+                totals.unparsed++;
+                continue;
+            }
+            frame += radiotap_length;
+            frame_length -= radiotap_length;
+        }
+
+        // parse_frame_view only reads the frame, the mapping stays read only
+        wifi_frame_view_t view;
+        if(parse_frame_view((uint8_t*)frame, (int)frame_length, has_fcs, &view) != ESP_OK)
+        {
+            totals.unparsed++;
+            continue;
+        }
+        view.rx_ctrl = &rx_ctrl;
+        view.channel = rx_ctrl.channel;
+        account_frame(range, &totals, &view, timestamp_us);
+    }
+    range->stopped_at = offset;
+    range->totals = totals;
+    return NULL;
+}
+
+// Every field before first_us is a count
+static void merge_totals(analyzer_totals_t* merged, const analyzer_totals_t* totals)
+{
+    const uint64_t* source = (const uint64_t*)totals;
+    uint64_t* destination = (uint64_t*)merged;
+    for(size_t i = 0; i < offsetof(analyzer_totals_t, first_us) / sizeof(uint64_t); i++)
+    {
+        destination[i] += source[i];
+    }
+    merged->first_us = totals->first_us < merged->first_us ? totals->first_us : merged->first_us;
+    merged->last_us = totals->last_us > merged->last_us ? totals->last_us : merged->last_us;
+}
+
+// Adds the counters of a range to those of the ranges before it, joining up the sequence numbers where the two meet
+static esp_err_t merge_addresses(address_table_t* merged, const address_table_t* addresses)
+{
+    for(size_t i = 0; i < addresses->capacity; i++)
+    {
+        const analyzer_address_t* later = &addresses->entries[i];
+        if(!later->used)
+        {
+            continue;
+        }
+        analyzer_address_t* entry = get_address(merged, later->address);
+        if(entry == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        entry->transmitted_frames += later->transmitted_frames;
+        entry->transmitted_bytes += later->transmitted_bytes;
+        entry->received_frames += later->received_frames;
+        for(int type = 0; type < 4; type++)
+        {
+            entry->type_frames[type] += later->type_frames[type];
+        }
+        entry->retries += later->retries;
+        entry->rssi_sum += later->rssi_sum;
+        entry->rssi_count += later->rssi_count;
+        entry->first_us = later->first_us < entry->first_us ? later->first_us : entry->first_us;
+        entry->last_us = later->last_us > entry->last_us ? later->last_us : entry->last_us;
+        entry->sequence.frames += later->sequence.frames;
+        entry->sequence.gaps += later->sequence.gaps;
+        entry->sequence.missing += later->sequence.missing;
+        entry->sequence.repeats += later->sequence.repeats;
+        entry->sequence.reordered += later->sequence.reordered;
+        for(int slot = 0; slot < SEQUENCE_SLOTS; slot++)
+        {
+            const sequence_track_t* track = &later->tracks[slot];
+            if(!track->seen)
+            {
+                continue;
+            }
+            if(entry->tracks[slot].seen)
+            {
+                account_sequence_step(&entry->sequence, entry->tracks[slot].last, track->first);
+                entry->tracks[slot].last = track->last;
+            }
+            else
+            {
+                entry->tracks[slot] = *track;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+static int compare_transmitted_frames(const void* a, const void* b)
+{
+    const analyzer_address_t* first = *(const analyzer_address_t* const*)a;
+    const analyzer_address_t* second = *(const analyzer_address_t* const*)b;
+    if(first->transmitted_frames != second->transmitted_frames)
+    {
+        return first->transmitted_frames < second->transmitted_frames ? 1 : -1;
+    }
+    if(first->received_frames != second->received_frames)
+    {
+        return first->received_frames < second->received_frames ? 1 : -1;
+    }
+    return memcmp(first->address, second->address, 6);
+}
+
+static void print_report(const analyzer_totals_t* totals, analyzer_address_t* const* sorted, size_t address_count, size_t list_count)
+{
+    printf("%llu frames, %llu bytes, %llu unparsed, %.1f%% retries, %.1f%% protected\n", (unsigned long long)totals->frames,
+        (unsigned long long)totals->bytes, (unsigned long long)totals->unparsed,
+        totals->frames > 0 ? 100.0 * totals->retry_frames / totals->frames : 0.0,
+        totals->frames > 0 ? 100.0 * totals->protected_frames / totals->frames : 0.0);
+    if(totals->frames > 0)
+    {
+        printf("%.6f to %.6f s\n", totals->first_us / 1e6, totals->last_us / 1e6);
+    }
+
+    printf("\nframe types\n");
+    const char* const* subtype_names[4] = { management_subtype_names, control_subtype_names, data_subtype_names, NULL };
+    for(int type = 0; type < 4; type++)
+    {
+        for(int subtype = 0; subtype < 16; subtype++)
+        {
+            uint64_t frames = totals->type_frames[type][subtype];
+            if(frames == 0)
+            {
+                continue;
+            }
+            const char* name = subtype_names[type] != NULL ? subtype_names[type][subtype] : NULL;
+            if(name != NULL)
+            {
+                printf("  %-10s %-28s %12llu  %5.1f%%\n", type_names[type], name, (unsigned long long)frames, 100.0 * frames / totals->frames);
+            }
+            else
+            {
+                printf("  %-10s subtype %-20d %12llu  %5.1f%%\n", type_names[type], subtype, (unsigned long long)frames, 100.0 * frames / totals->frames);
+            }
+        }
+    }
+
+    printf("\nchannels\n");
+    for(int channel = 0; channel < CHANNEL_COUNT; channel++)
+    {
+        if(totals->channel_frames[channel] > 0)
+        {
+            printf(channel == 0 ? "  unknown %12llu\n" : "  %7d %12llu\n", channel, (unsigned long long)totals->channel_frames[channel]);
+        }
+    }
+
+    sequence_stats_t sequence = { 0 };
+    for(size_t i = 0; i < address_count; i++)
+    {
+        sequence.frames += sorted[i]->sequence.frames;
+        sequence.gaps += sorted[i]->sequence.gaps;
+        sequence.missing += sorted[i]->sequence.missing;
+        sequence.repeats += sorted[i]->sequence.repeats;
+        sequence.reordered += sorted[i]->sequence.reordered;
+    }
+    printf("\nsequence numbers: %llu frames, %llu gaps (%llu numbers missing), %llu repeats, %llu reordered\n",
+        (unsigned long long)sequence.frames, (unsigned long long)sequence.gaps, (unsigned long long)sequence.missing,
+        (unsigned long long)sequence.repeats, (unsigned long long)sequence.reordered);
+
+    printf("\n%zu addresses%s\n", address_count, list_count < address_count ? ", busiest transmitters:" : ":");
+    printf("  %-17s %10s %12s %10s %8s %8s %8s %6s %5s %8s %8s %8s %8s\n", "address", "tx frames", "tx bytes", "rx frames",
+        "mgmt", "ctrl", "data", "retry%", "rssi", "gaps", "missing", "repeats", "reorder");
+    for(size_t i = 0; i < list_count && i < address_count; i++)
+    {
+        const analyzer_address_t* entry = sorted[i];
+        printf("  %02x:%02x:%02x:%02x:%02x:%02x %10llu %12llu %10llu %8llu %8llu %8llu %6.1f ",
+            entry->address[0], entry->address[1], entry->address[2], entry->address[3], entry->address[4], entry->address[5],
+            (unsigned long long)entry->transmitted_frames, (unsigned long long)entry->transmitted_bytes,
+            (unsigned long long)entry->received_frames, (unsigned long long)entry->type_frames[WIFI_FRAME_TYPE_MANAGEMENT],
+            (unsigned long long)entry->type_frames[WIFI_FRAME_TYPE_CONTROL], (unsigned long long)entry->type_frames[WIFI_FRAME_TYPE_DATA],
+            entry->transmitted_frames > 0 ? 100.0 * entry->retries / entry->transmitted_frames : 0.0);
+        if(entry->rssi_count > 0)
+        {
+            printf("%5.0f ", (double)entry->rssi_sum / entry->rssi_count);
+        }
+        else
+        {
+            printf("%5s ", "-");
+        }
+        printf("%8llu %8llu %8llu %8llu\n", (unsigned long long)entry->sequence.gaps, (unsigned long long)entry->sequence.missing,
+            (unsigned long long)entry->sequence.repeats, (unsigned long long)entry->sequence.reordered);
+    }
+}
+
+static int write_address_csv(const char* path, analyzer_address_t* const* sorted, size_t address_count)
+{
+    FILE* output = fopen(path, "w");
+    if(output == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", path);
+        return 1;
+    }
+    fprintf(output, "address,tx_frames,tx_bytes,rx_frames,management,control,data,extension,retries,rssi_mean,first_us,last_us,"
+        "sequence_frames,sequence_gaps,sequence_missing,sequence_repeats,sequence_reordered\n");
+    for(size_t i = 0; i < address_count; i++)
+    {
+        const analyzer_address_t* entry = sorted[i];
+        fprintf(output, "%02x:%02x:%02x:%02x:%02x:%02x,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,",
+            entry->address[0], entry->address[1], entry->address[2], entry->address[3], entry->address[4], entry->address[5],
+            (unsigned long long)entry->transmitted_frames, (unsigned long long)entry->transmitted_bytes,
+            (unsigned long long)entry->received_frames, (unsigned long long)entry->type_frames[0], (unsigned long long)entry->type_frames[1],
+            (unsigned long long)entry->type_frames[2], (unsigned long long)entry->type_frames[3], (unsigned long long)entry->retries);
+        if(entry->rssi_count > 0)
+        {
+            fprintf(output, "%.1f", (double)entry->rssi_sum / entry->rssi_count);
+        }
+        fprintf(output, ",%llu,%llu,%llu,%llu,%llu,%llu,%llu\n", (unsigned long long)entry->first_us, (unsigned long long)entry->last_us,
+            (unsigned long long)entry->sequence.frames, (unsigned long long)entry->sequence.gaps, (unsigned long long)entry->sequence.missing,
+            (unsigned long long)entry->sequence.repeats, (unsigned long long)entry->sequence.reordered);
+    }
+    return fclose(output) == 0 ? 0 : 1;
+}
+
+// Runs the ranges on their threads, then re-parses, in file order, every range whose start the range before it did not end on
+static esp_err_t analyze_ranges(analyzer_range_t* ranges, int range_count)
+{
+    pthread_t threads[MAX_THREADS];
+    for(int i = 1; i < range_count; i++)
+    {
+        if(pthread_create(&threads[i], NULL, &analyze_range, &ranges[i]) != 0)
+        {
+            for(int j = 1; j < i; j++)
+            {
+                pthread_join(threads[j], NULL);
+            }
+            return ESP_FAIL;
+        }
+    }
+    analyze_range(&ranges[0]);
+    for(int i = 1; i < range_count; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    for(int i = 1; i < range_count; i++)
+    {
+        if(ranges[i - 1].stopped_at == ranges[i].start)
+        {
+            continue;
+        }
+        fprintf(stderr, "Range %d did not start on a record (%zu, the one before ended at %zu), parsing it again\n", i,
+            ranges[i].start, ranges[i - 1].stopped_at);
+        free_address_table(&ranges[i].addresses);
+        if(setup_address_table(&ranges[i].addresses, 1024) != ESP_OK)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        ranges[i].start = ranges[i - 1].stopped_at;
+        analyze_range(&ranges[i]);
+    }
+    return ESP_OK;
+}
+
+int main(int argc, char* argv[])
+{
+    long online_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_count = online_cores > 0 ? (online_cores < MAX_THREADS ? (int)online_cores : MAX_THREADS) : 1;
+    size_t list_count = 20;
+    const char* csv_path = NULL;
+
+    int option;
+    while((option = getopt(argc, argv, "j:n:m:")) != -1)
+    {
+        switch(option)
+        {
+            case 'j': thread_count = atoi(optarg); break;
+            case 'n': list_count = (size_t)atol(optarg); break;
+            case 'm': csv_path = optarg; break;
+            default:
+                print_usage(argv[0]);
+                return 2;
+        }
+    }
+    if(optind != argc - 1 || thread_count < 1 || thread_count > MAX_THREADS)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+    list_count = list_count == 0 ? SIZE_MAX : list_count;
+
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    int descriptor = open(argv[optind], O_RDONLY);
+    struct stat file_status;
+    if(descriptor < 0 || fstat(descriptor, &file_status) != 0)
+    {
+        fprintf(stderr, "Could not open %s\n", argv[optind]);
+        return 1;
+    }
+    analyzer_capture_t capture = { .size = (size_t)file_status.st_size };
+    if(capture.size < PCAP_FILE_HEADER_LENGTH)
+    {
+        fprintf(stderr, "%s is not a pcap file\n", argv[optind]);
+        close(descriptor);
+        return 1;
+    }
+    void* map = mmap(NULL, capture.size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if(map == MAP_FAILED)
+    {
+        fprintf(stderr, "Could not map %s\n", argv[optind]);
+        return 1;
+    }
+    // Every thread reads its own range front to back
+    madvise(map, capture.size, MADV_SEQUENTIAL);
+    capture.map = map;
+
+    uint32_t magic = read_u32(capture.map, false);
+    capture.swapped = magic == __builtin_bswap32(PCAP_MAGIC_MICROSECONDS) || magic == __builtin_bswap32(PCAP_MAGIC_NANOSECONDS);
+    magic = capture.swapped ? __builtin_bswap32(magic) : magic;
+    capture.nanoseconds = magic == PCAP_MAGIC_NANOSECONDS;
+    capture.linktype = read_u32(capture.map + 20, capture.swapped) & 0x0FFFFFFF;
+    if(magic != PCAP_MAGIC_MICROSECONDS && magic != PCAP_MAGIC_NANOSECONDS)
+    {
+        fprintf(stderr, "%s is not a pcap file\n", argv[optind]);
+        munmap(map, capture.size);
+        return 1;
+    }
+    if(capture.linktype != PCAP_LINKTYPE_IEEE802_11 && capture.linktype != PCAP_LINKTYPE_IEEE802_11_RADIOTAP)
+    {
+        fprintf(stderr, "%s has link type %u, only 802.11 (105) and radiotap (127) are read\n", argv[optind], (unsigned)capture.linktype);
+        munmap(map, capture.size);
+        return 1;
+    }
+
+    // Small files are not worth a thread per core
+    size_t records_size = capture.size - PCAP_FILE_HEADER_LENGTH;
+    int range_count = records_size / thread_count >= 65536 ? thread_count : (int)(records_size / 65536) + 1;
+    analyzer_range_t* ranges = calloc(range_count, sizeof(analyzer_range_t));
+    int result = ranges != NULL ? 0 : 1;
+    for(int i = 0; i < range_count && result == 0; i++)
+    {
+        ranges[i].capture = &capture;
+        ranges[i].start = i == 0 ? PCAP_FILE_HEADER_LENGTH : find_range_start(&capture, PCAP_FILE_HEADER_LENGTH + records_size / range_count * i);
+        result = setup_address_table(&ranges[i].addresses, 1024) == ESP_OK ? 0 : 1;
+    }
+    for(int i = 0; i < range_count && result == 0; i++)
+    {
+        ranges[i].end = i + 1 < range_count ? ranges[i + 1].start : capture.size;
+    }
+    if(result == 0 && analyze_ranges(ranges, range_count) != ESP_OK)
+    {
+        result = 1;
+    }
+
+    analyzer_totals_t totals = { .first_us = UINT64_MAX };
+    address_table_t addresses = { 0 };
+    if(result == 0)
+    {
+        result = setup_address_table(&addresses, 1024) == ESP_OK ? 0 : 1;
+    }
+    for(int i = 0; i < range_count && result == 0; i++)
+    {
+        merge_totals(&totals, &ranges[i].totals);
+        result = merge_addresses(&addresses, &ranges[i].addresses) == ESP_OK ? 0 : 1;
+    }
+    for(int i = 0; ranges != NULL && i < range_count; i++)
+    {
+        free_address_table(&ranges[i].addresses);
+    }
+    free(ranges);
+    if(result != 0)
+    {
+        fprintf(stderr, "Out of memory\n");
+        free_address_table(&addresses);
+        munmap(map, capture.size);
+        return 1;
+    }
+    double seconds = elapsed_seconds(&start_time);
+
+    analyzer_address_t** sorted = malloc((addresses.count > 0 ? addresses.count : 1) * sizeof(analyzer_address_t*));
+    if(sorted == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        free_address_table(&addresses);
+        munmap(map, capture.size);
+        return 1;
+    }
+    size_t address_count = 0;
+    for(size_t i = 0; i < addresses.capacity; i++)
+    {
+        if(addresses.entries[i].used)
+        {
+            sorted[address_count++] = &addresses.entries[i];
+        }
+    }
+    qsort(sorted, address_count, sizeof(analyzer_address_t*), &compare_transmitted_frames);
+
+    printf("%s: link type %u, %zu bytes, %d thread%s, %.3f s (%.1f MB/s, %.0f frames/s)\n", argv[optind], (unsigned)capture.linktype,
+        capture.size, range_count, range_count == 1 ? "" : "s", seconds, seconds > 0 ? capture.size / seconds / 1e6 : 0.0,
+        seconds > 0 ? (totals.frames + totals.unparsed) / seconds : 0.0);
+    if(totals.bytes_skipped > 0)
+    {
+        printf("%llu bytes skipped over unreadable record headers\n", (unsigned long long)totals.bytes_skipped);
+    }
+    print_report(&totals, sorted, address_count, list_count);
+    if(csv_path != NULL)
+    {
+        result = write_address_csv(csv_path, sorted, address_count);
+    }
+    free(sorted);
+    free_address_table(&addresses);
+    munmap(map, capture.size);
+    return result;
+}
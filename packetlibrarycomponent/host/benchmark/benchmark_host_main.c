@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "packet_library.h"
+#include "packet_library_benchmark.h"
+
+/*
+    Host entry point of the benchmark suite. Allocations are counted by wrapping the glibc allocator,
+    so the allocations/frame column covers everything the component (and the shim) allocates.
+*/
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+
+static _Atomic uint32_t allocation_count;
+
+void *malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+
+static uint32_t get_allocation_count()
+{
+    return atomic_load_explicit(&allocation_count, memory_order_relaxed);
+}
+
+static int log_to_stderr(const char* format, va_list args)
+{
+    return vfprintf(stderr, format, args);
+}
+
+int main(int argc, char* argv[])
+{
+    packet_library_benchmark_config_t config = PACKET_LIBRARY_BENCHMARK_CONFIG_DEFAULT();
+    config.output = stdout;
+    config.allocation_counter = &get_allocation_count;
+
+    int option;
+    while((option = getopt(argc, argv, "o:t:")) != -1)
+    {
+        switch(option)
+        {
+            case 'o':
+                config.output = fopen(optarg, "w");
+                if(config.output == NULL)
+                {
+                    fprintf(stderr, "Could not open %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 't':
+                config.min_time_us = (uint32_t)atoi(optarg) * 1000;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-o results.jsonl] [-t min_ms_per_case]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    // Log lines from the setup go to stderr so stdout only carries the results
+    esp_log_set_vprintf(&log_to_stderr);
+    ESP_ERROR_CHECK(setup_wifi_station_simple());
+    ESP_ERROR_CHECK(setup_sta_default());
+    ESP_ERROR_CHECK(setup_promiscuous_simple());
+    int results = run_packet_library_benchmarks(config);
+    results += run_typed_api_benchmarks(config);
+    fprintf(stderr, "%d results\n", results);
+    if(config.output != stdout)
+    {
+        fclose(config.output);
+    }
+    return 0;
+}
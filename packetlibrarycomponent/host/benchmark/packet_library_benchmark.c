@@ -0,0 +1,298 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_cpu.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+#include "packet_library_benchmark.h"
+
+/*
+    Benchmark suite for the receive dispatch, transmit, packet build and logging paths.
+    Each case runs its operation in batches until config.min_time_us has passed, timing the batches with the CPU cycle counter,
+    and writes one JSON line with ns/frame, frames/s, cycles/frame and heap allocations/frame so results can be diffed across releases.
+    Log output is formatted but discarded while the suite runs, so the logging cases measure formatting and not the UART or terminal.
+    The same source builds on the host (packetlibrarycomponent/host) and on target (PacketLibraryBenchmark).
+*/
+
+#define BENCHMARK_BATCH_SIZE 64
+#define BENCHMARK_WARMUP_ITERATIONS 16
+
+static const int benchmark_payload_lengths[] = { 0, 64, 256, 1024, PACKET_LIBRARY_MAX_PAYLOAD_LENGTH };
+#define BENCHMARK_PAYLOAD_LENGTH_COUNT (int)(sizeof(benchmark_payload_lengths) / sizeof(benchmark_payload_lengths[0]))
+
+typedef void (* benchmark_operation_t)(int payload_length);
+
+// Receive buffer laid out like the driver's (rx_ctrl then the frame with its FCS) and a send packet, both sized for the largest payload
+static uint32_t benchmark_rx_buffer[(sizeof(wifi_promiscuous_pkt_t) + PACKET_LIBRARY_MAX_FRAME_LENGTH + 4 + 3) / 4];
+static uint32_t benchmark_tx_buffer[(PACKET_LIBRARY_MAX_FRAME_LENGTH + 3) / 4];
+static uint8_t benchmark_payload[PACKET_LIBRARY_MAX_PAYLOAD_LENGTH];
+static char benchmark_hex_output[PACKET_LIBRARY_MAX_PAYLOAD_LENGTH * 2 + 1];
+static uint8_t benchmark_address_1[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+static uint8_t benchmark_address_2[6] = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01 };
+static uint8_t benchmark_address_3[6] = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0xAA };
+static volatile uint32_t benchmark_sink; // Callbacks write here so they are not optimized away
+
+static void benchmark_general_callback(wifi_mac_data_frame_t* packet, int payload_length)
+{
+    benchmark_sink += packet->frame_control;
+}
+
+static void benchmark_frame_control_callback(uint16_t* frame_control)
+{
+    benchmark_sink += *frame_control;
+}
+
+static void benchmark_duration_id_callback(uint16_t* duration_id)
+{
+    benchmark_sink += *duration_id;
+}
+
+static void benchmark_address_callback(uint8_t address[6])
+{
+    benchmark_sink += address[5];
+}
+
+static void benchmark_sequence_control_callback(uint16_t* sequence_control)
+{
+    benchmark_sink += *sequence_control;
+}
+
+static void benchmark_payload_callback(uint8_t payload[], int payload_length)
+{
+    benchmark_sink += payload_length;
+}
+
+// Formats the log line like the real output would, then drops it
+static int benchmark_discard_vprintf(const char* format, va_list args)
+{
+    char line[256];
+    return vsnprintf(line, sizeof(line), format, args);
+}
+
+static void set_all_receive_callbacks()
+{
+    set_receive_callback_general(&benchmark_general_callback);
+    set_receive_callback_frame_control(&benchmark_frame_control_callback);
+    set_receive_callback_duration_id(&benchmark_duration_id_callback);
+    set_receive_callback_address_1(&benchmark_address_callback);
+    set_receive_callback_address_2(&benchmark_address_callback);
+    set_receive_callback_address_3(&benchmark_address_callback);
+    set_receive_callback_address_4(&benchmark_address_callback);
+    set_receive_callback_sequence_control(&benchmark_sequence_control_callback);
+    set_receive_callback_payload(&benchmark_payload_callback);
+}
+
+static void remove_all_receive_callbacks()
+{
+    remove_receive_callback_general();
+    remove_receive_callback_frame_control();
+    remove_receive_callback_duration_id();
+    remove_receive_callback_address_1();
+    remove_receive_callback_address_2();
+    remove_receive_callback_address_3();
+    remove_receive_callback_address_4();
+    remove_receive_callback_sequence_control();
+    remove_receive_callback_payload();
+    set_receive_pre_callback_print(DISABLE);
+    set_receive_post_callback_print(DISABLE);
+}
+
+static void set_all_send_callbacks()
+{
+    set_send_callback_general(&benchmark_general_callback);
+    set_send_callback_frame_control(&benchmark_frame_control_callback);
+    set_send_callback_duration_id(&benchmark_duration_id_callback);
+    set_send_callback_address_1(&benchmark_address_callback);
+    set_send_callback_address_2(&benchmark_address_callback);
+    set_send_callback_address_3(&benchmark_address_callback);
+    set_send_callback_address_4(&benchmark_address_callback);
+    set_send_callback_sequence_control(&benchmark_sequence_control_callback);
+    set_send_callback_payload(&benchmark_payload_callback);
+}
+
+static void remove_all_send_callbacks()
+{
+    remove_send_callback_general();
+    remove_send_callback_frame_control();
+    remove_send_callback_duration_id();
+    remove_send_callback_address_1();
+    remove_send_callback_address_2();
+    remove_send_callback_address_3();
+    remove_send_callback_address_4();
+    remove_send_callback_sequence_control();
+    remove_send_callback_payload();
+}
+
+// Writes a data frame with 'payload_length' payload bytes into the receive buffer, sig_len counts the FCS like the driver does
+static void prepare_rx_frame(int payload_length)
+{
+    wifi_promiscuous_pkt_t *packet = (wifi_promiscuous_pkt_t *)benchmark_rx_buffer;
+    memset(&packet->rx_ctrl, 0, sizeof(wifi_pkt_rx_ctrl_t));
+    packet->rx_ctrl.rssi = -50;
+    packet->rx_ctrl.channel = 1;
+    packet->rx_ctrl.sig_len = sizeof(wifi_mac_data_frame_t) + payload_length + 4;
+    fill_packet_custom((wifi_mac_data_frame_t *)packet->payload, 0x0208, 0, benchmark_address_1, benchmark_address_2, benchmark_address_3, 0x0010, benchmark_address_3, payload_length, benchmark_payload);
+}
+
+static void operation_rx_dispatch(int payload_length)
+{
+    promisc_simple_callback(benchmark_rx_buffer, WIFI_PKT_DATA);
+}
+
+// With the BINARY print option every frame also takes a record out of the ring again, so the ring never fills and takes the lost record path
+static void operation_rx_dispatch_binary_log(int payload_length)
+{
+    binary_log_record_t record;
+    promisc_simple_callback(benchmark_rx_buffer, WIFI_PKT_DATA);
+    read_binary_log_records(&record, 1);
+}
+
+static void operation_send_packet_simple(int payload_length)
+{
+    send_packet_simple((wifi_mac_data_frame_t *)benchmark_tx_buffer, payload_length);
+}
+
+static void operation_alloc_packet_custom(int payload_length)
+{
+    wifi_mac_data_frame_t *packet = alloc_packet_custom(0x0208, 0, benchmark_address_1, benchmark_address_2, benchmark_address_3, 0, benchmark_address_3, payload_length, benchmark_payload);
+    free(packet);
+}
+
+static void operation_alloc_packet_custom_pooled(int payload_length)
+{
+    wifi_mac_data_frame_t *packet = alloc_packet_custom_pooled(0x0208, 0, benchmark_address_1, benchmark_address_2, benchmark_address_3, 0, benchmark_address_3, payload_length, benchmark_payload);
+    free_packet_pooled(packet);
+}
+
+static void operation_log_packet_annotated(int payload_length)
+{
+    log_packet_annotated((wifi_mac_data_frame_t *)benchmark_tx_buffer, payload_length, "benchmark");
+}
+
+static void operation_log_packet_hex(int payload_length)
+{
+    log_packet_hex((wifi_mac_data_frame_t *)benchmark_tx_buffer, payload_length, "benchmark");
+}
+
+static void operation_format_payload_hex(int payload_length)
+{
+    format_payload_hex(benchmark_payload, payload_length, benchmark_hex_output, sizeof(benchmark_hex_output));
+}
+
+// The per byte snprintf loop the logging helpers used before format_payload_hex, kept as the baseline it is compared against
+static void operation_snprintf_payload_hex(int payload_length)
+{
+    for(int i = 0; i < payload_length; i++)
+    {
+        snprintf(&benchmark_hex_output[i * 2], 3, "%02X", benchmark_payload[i]);
+    }
+}
+
+static void run_benchmark_case(packet_library_benchmark_config_t* config, const char* case_name, const char* variant, benchmark_operation_t operation, int payload_length)
+{
+    for(int i = 0; i < BENCHMARK_WARMUP_ITERATIONS; i++)
+    {
+        operation(payload_length);
+    }
+
+    uint32_t allocations_before = config->allocation_counter != NULL ? config->allocation_counter() : 0;
+    uint64_t iterations = 0;
+    uint64_t cycles = 0;
+    int64_t start_us = esp_timer_get_time();
+    do
+    {
+        // Batches are short enough that the 32 bit cycle counter cannot wrap more than once inside one
+        esp_cpu_cycle_count_t batch_start = esp_cpu_get_cycle_count();
+        for(int i = 0; i < BENCHMARK_BATCH_SIZE; i++)
+        {
+            operation(payload_length);
+        }
+        cycles += (esp_cpu_cycle_count_t)(esp_cpu_get_cycle_count() - batch_start);
+        iterations += BENCHMARK_BATCH_SIZE;
+    } while(esp_timer_get_time() - start_us < config->min_time_us);
+    uint32_t allocations = config->allocation_counter != NULL ? config->allocation_counter() - allocations_before : 0;
+
+    double cycles_per_frame = (double)cycles / iterations;
+    double ns_per_frame = cycles_per_frame / config->cycles_per_ns;
+    fprintf(config->output, "{\"suite\":\"packet_library\",\"platform\":\"%s\",\"case\":\"%s\",\"variant\":\"%s\",\"payload_bytes\":%d,"
+        "\"iterations\":%llu,\"ns_per_frame\":%.2f,\"frames_per_sec\":%.0f,\"cycles_per_frame\":%.1f,",
+        config->platform, case_name, variant, payload_length, (unsigned long long)iterations, ns_per_frame,
+        ns_per_frame > 0 ? 1e9 / ns_per_frame : 0.0, cycles_per_frame);
+    if(config->allocation_counter != NULL)
+    {
+        fprintf(config->output, "\"allocations_per_frame\":%.3f}\n", (double)allocations / iterations);
+    }
+    else
+    {
+        fprintf(config->output, "\"allocations_per_frame\":null}\n");
+    }
+    fflush(config->output);
+    vTaskDelay(1); // Let the idle task run between cases, on target it feeds the task watchdog
+}
+
+int run_packet_library_benchmarks(packet_library_benchmark_config_t config)
+{
+    int results = 0;
+    for(int i = 0; i < PACKET_LIBRARY_MAX_PAYLOAD_LENGTH; i++)
+    {
+        benchmark_payload[i] = (uint8_t)(i * 7 + 3);
+    }
+    fill_packet_custom((wifi_mac_data_frame_t *)benchmark_tx_buffer, 0x0208, 0, benchmark_address_1, benchmark_address_2, benchmark_address_3, 0x0010, benchmark_address_3, PACKET_LIBRARY_MAX_PAYLOAD_LENGTH, benchmark_payload);
+    vprintf_like_t previous_vprintf = esp_log_set_vprintf(&benchmark_discard_vprintf);
+    // Either may already be setup by the application, which is just as good
+    esp_err_t binary_log_status = setup_binary_log(256);
+    bool binary_log_ready = binary_log_status == ESP_OK || binary_log_status == ESP_ERR_INVALID_STATE;
+    esp_err_t frame_pool_status = setup_frame_pool((frame_pool_config_t)FRAME_POOL_CONFIG_DEFAULT());
+    bool frame_pool_ready = frame_pool_status == ESP_OK || frame_pool_status == ESP_ERR_INVALID_STATE;
+
+    for(int size_index = 0; size_index < BENCHMARK_PAYLOAD_LENGTH_COUNT; size_index++)
+    {
+        int payload_length = benchmark_payload_lengths[size_index];
+        prepare_rx_frame(payload_length);
+
+        remove_all_receive_callbacks();
+        run_benchmark_case(&config, "rx_dispatch", "no_callbacks", &operation_rx_dispatch, payload_length);
+        set_receive_callback_general(&benchmark_general_callback);
+        run_benchmark_case(&config, "rx_dispatch", "general_callback", &operation_rx_dispatch, payload_length);
+        set_all_receive_callbacks();
+        run_benchmark_case(&config, "rx_dispatch", "all_callbacks", &operation_rx_dispatch, payload_length);
+        set_receive_pre_callback_print(HEX);
+        run_benchmark_case(&config, "rx_dispatch", "all_callbacks_hex_print", &operation_rx_dispatch, payload_length);
+        results += 4;
+        if(binary_log_ready)
+        {
+            set_receive_pre_callback_print(BINARY);
+            run_benchmark_case(&config, "rx_dispatch", "all_callbacks_binary_print", &operation_rx_dispatch_binary_log, payload_length);
+            results++;
+        }
+        remove_all_receive_callbacks();
+
+        remove_all_send_callbacks();
+        run_benchmark_case(&config, "tx_send_packet_simple", "no_callbacks", &operation_send_packet_simple, payload_length);
+        set_send_callback_general(&benchmark_general_callback);
+        run_benchmark_case(&config, "tx_send_packet_simple", "general_callback", &operation_send_packet_simple, payload_length);
+        set_all_send_callbacks();
+        run_benchmark_case(&config, "tx_send_packet_simple", "all_callbacks", &operation_send_packet_simple, payload_length);
+        remove_all_send_callbacks();
+
+        run_benchmark_case(&config, "alloc_packet", "alloc_packet_custom", &operation_alloc_packet_custom, payload_length);
+        results += 4;
+        if(frame_pool_ready)
+        {
+            run_benchmark_case(&config, "alloc_packet", "alloc_packet_custom_pooled", &operation_alloc_packet_custom_pooled, payload_length);
+            results++;
+        }
+
+        run_benchmark_case(&config, "log", "log_packet_annotated", &operation_log_packet_annotated, payload_length);
+        run_benchmark_case(&config, "log", "log_packet_hex", &operation_log_packet_hex, payload_length);
+        run_benchmark_case(&config, "log", "format_payload_hex", &operation_format_payload_hex, payload_length);
+        run_benchmark_case(&config, "log", "snprintf_payload_hex_baseline", &operation_snprintf_payload_hex, payload_length);
+        results += 4;
+    }
+
+    esp_log_set_vprintf(previous_vprintf);
+    return results;
+}
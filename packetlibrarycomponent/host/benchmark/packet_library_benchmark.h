@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#ifndef PACKET_LIBRARY_BENCHMARK_H
+#define PACKET_LIBRARY_BENCHMARK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t (* benchmark_allocation_counter_t)(); // Heap allocations made so far by the whole program
+
+typedef struct {
+    FILE* output; // Gets one JSON object per line per result
+    const char* platform; // Reported with every result, e.g. "host" or "esp32"
+    uint32_t min_time_us; // Each case repeats until it has run at least this long
+    double cycles_per_ns; // esp_cpu_get_cycle_count rate, the CPU clock on target and 1.0 on the host (where it counts nanoseconds)
+    benchmark_allocation_counter_t allocation_counter; // NULL where allocations cannot be counted, reported as null
+} packet_library_benchmark_config_t;
+
+#define PACKET_LIBRARY_BENCHMARK_CONFIG_DEFAULT() { \
+    .output = NULL, \
+    .platform = "host", \
+    .min_time_us = 200000, \
+    .cycles_per_ns = 1.0, \
+    .allocation_counter = NULL \
+}
+
+// Runs every benchmark case at payload sizes from 0 to PACKET_LIBRARY_MAX_PAYLOAD_LENGTH and returns the number of results written.
+// The component must already be setup as a station (setup_wifi_station_simple and setup_sta_default) so send_packet_simple transmits.
+int run_packet_library_benchmarks(packet_library_benchmark_config_t config);
+
+// The C++ interface (packet_library.hpp) against the C calls it replaces, same setup and result format. Host build only, in typed_api_benchmark.cpp.
+int run_typed_api_benchmarks(packet_library_benchmark_config_t config);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,172 @@
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <esp_cpu.h>
+#include <esp_timer.h>
+#include <host_shim.h>
+#include "packet_library.hpp"
+#include "packet_library_benchmark.h"
+
+/*
+    Compares the C++ interface of packet_library.hpp with the C calls it stands in for, in the result format of the main suite:
+    - typed_api_tx: alloc_packet_custom, send_packet_simple and free against a stack_frame built from a constexpr header.
+    - typed_api_rx_dispatch: four context callbacks (general, address 2, sequence control, payload) against one callback_set
+      holding the same four handlers, with frames delivered through the host shim's promiscuous callback.
+    Host build only, the receive cases need host_shim_deliver_rx.
+*/
+
+namespace
+{
+
+constexpr int benchmark_batch_size = 64;
+constexpr int benchmark_warmup_iterations = 16;
+constexpr int benchmark_payload_lengths[] = { 0, 64, 256, 1024, PACKET_LIBRARY_MAX_PAYLOAD_LENGTH };
+
+constexpr packet_library::mac_address benchmark_destination{ { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x02 } };
+constexpr packet_library::mac_address benchmark_bssid{ { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0xAA } };
+constexpr packet_library::mac_address benchmark_source{ { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01 } };
+constexpr packet_library::frame_header benchmark_header = packet_library::data_from_ds_header(benchmark_destination, benchmark_bssid, benchmark_source);
+
+uint8_t benchmark_payload[PACKET_LIBRARY_MAX_PAYLOAD_LENGTH];
+uint32_t benchmark_rx_buffer[(sizeof(wifi_promiscuous_pkt_t) + PACKET_LIBRARY_MAX_FRAME_LENGTH + 4 + 3) / 4];
+volatile uint32_t benchmark_sink; // Callbacks write here so they are not optimized away
+
+// Same loop as run_benchmark_case in packet_library_benchmark.c, with the operation as a functor so the C++ cases inline into it
+template <typename Operation>
+void run_typed_api_case(const packet_library_benchmark_config_t& config, const char* case_name, const char* variant, int payload_length, Operation operation)
+{
+    for(int i = 0; i < benchmark_warmup_iterations; i++)
+    {
+        operation(payload_length);
+    }
+
+    uint32_t allocations_before = config.allocation_counter != nullptr ? config.allocation_counter() : 0;
+    uint64_t iterations = 0;
+    uint64_t cycles = 0;
+    int64_t start_us = esp_timer_get_time();
+    do
+    {
+        esp_cpu_cycle_count_t batch_start = esp_cpu_get_cycle_count();
+        for(int i = 0; i < benchmark_batch_size; i++)
+        {
+            operation(payload_length);
+        }
+        cycles += static_cast<esp_cpu_cycle_count_t>(esp_cpu_get_cycle_count() - batch_start);
+        iterations += benchmark_batch_size;
+    } while(esp_timer_get_time() - start_us < config.min_time_us);
+    uint32_t allocations = config.allocation_counter != nullptr ? config.allocation_counter() - allocations_before : 0;
+
+    double cycles_per_frame = static_cast<double>(cycles) / iterations;
+    double ns_per_frame = cycles_per_frame / config.cycles_per_ns;
+    std::fprintf(config.output, "{\"suite\":\"packet_library\",\"platform\":\"%s\",\"case\":\"%s\",\"variant\":\"%s\",\"payload_bytes\":%d,"
+        "\"iterations\":%llu,\"ns_per_frame\":%.2f,\"frames_per_sec\":%.0f,\"cycles_per_frame\":%.1f,",
+        config.platform, case_name, variant, payload_length, static_cast<unsigned long long>(iterations), ns_per_frame,
+        ns_per_frame > 0 ? 1e9 / ns_per_frame : 0.0, cycles_per_frame);
+    if(config.allocation_counter != nullptr)
+    {
+        std::fprintf(config.output, "\"allocations_per_frame\":%.3f}\n", static_cast<double>(allocations) / iterations);
+    }
+    else
+    {
+        std::fprintf(config.output, "\"allocations_per_frame\":null}\n");
+    }
+    std::fflush(config.output);
+}
+
+void benchmark_general_callback(const wifi_frame_view_t* view, void* ctx)
+{
+    benchmark_sink += view->frame_length;
+}
+
+void benchmark_address_callback(uint8_t address[6], const wifi_frame_view_t* view, void* ctx)
+{
+    benchmark_sink += address[5];
+}
+
+void benchmark_sequence_control_callback(uint16_t* sequence_control, const wifi_frame_view_t* view, void* ctx)
+{
+    benchmark_sink += *sequence_control;
+}
+
+void benchmark_payload_callback(uint8_t payload[], int payload_length, const wifi_frame_view_t* view, void* ctx)
+{
+    benchmark_sink += payload_length;
+}
+
+// Writes a data frame with 'payload_length' payload bytes into the receive buffer, sig_len counts the FCS like the driver does
+void prepare_rx_frame(int payload_length)
+{
+    wifi_promiscuous_pkt_t* packet = reinterpret_cast<wifi_promiscuous_pkt_t*>(benchmark_rx_buffer);
+    std::memset(&packet->rx_ctrl, 0, sizeof(wifi_pkt_rx_ctrl_t));
+    packet->rx_ctrl.rssi = -50;
+    packet->rx_ctrl.channel = 1;
+    packet->rx_ctrl.sig_len = sizeof(wifi_mac_data_frame_t) + payload_length + 4;
+    benchmark_header.write_to(packet->payload);
+    std::memcpy(packet->payload + sizeof(wifi_mac_data_frame_t), benchmark_payload, payload_length);
+}
+
+void deliver_rx_frame(int payload_length)
+{
+    host_shim_deliver_rx(reinterpret_cast<wifi_promiscuous_pkt_t*>(benchmark_rx_buffer), WIFI_PKT_DATA);
+}
+
+}
+
+int run_typed_api_benchmarks(packet_library_benchmark_config_t config)
+{
+    int results = 0;
+    for(int i = 0; i < PACKET_LIBRARY_MAX_PAYLOAD_LENGTH; i++)
+    {
+        benchmark_payload[i] = static_cast<uint8_t>(i * 7 + 3);
+    }
+    vprintf_like_t previous_vprintf = esp_log_set_vprintf([](const char* format, va_list args) { return 0; });
+    uint8_t destination[6];
+    uint8_t bssid[6];
+    uint8_t source[6];
+    std::memcpy(destination, benchmark_destination.octets, 6);
+    std::memcpy(bssid, benchmark_bssid.octets, 6);
+    std::memcpy(source, benchmark_source.octets, 6);
+
+    for(int payload_length : benchmark_payload_lengths)
+    {
+        run_typed_api_case(config, "typed_api_tx", "alloc_packet_custom", payload_length, [&](int length)
+        {
+            wifi_mac_data_frame_t* packet = alloc_packet_custom(0x0208, 0xFA, destination, bssid, source, 0, source, length, benchmark_payload);
+            send_packet_simple(packet, length);
+            std::free(packet);
+        });
+        run_typed_api_case(config, "typed_api_tx", "stack_frame", payload_length, [](int length)
+        {
+            packet_library::stack_frame<PACKET_LIBRARY_MAX_PAYLOAD_LENGTH> frame(benchmark_header);
+            frame.send(benchmark_payload, length);
+        });
+        results += 2;
+
+        prepare_rx_frame(payload_length);
+        callback_subscription_t subscriptions[4];
+        add_receive_callback_general(&benchmark_general_callback, nullptr, &subscriptions[0]);
+        add_receive_callback_address(CALLBACK_FIELD_ADDRESS_2, &benchmark_address_callback, nullptr, &subscriptions[1]);
+        add_receive_callback_u16_field(CALLBACK_FIELD_SEQUENCE_CONTROL, &benchmark_sequence_control_callback, nullptr, &subscriptions[2]);
+        add_receive_callback_payload(&benchmark_payload_callback, nullptr, &subscriptions[3]);
+        run_typed_api_case(config, "typed_api_rx_dispatch", "context_callbacks", payload_length, &deliver_rx_frame);
+        for(callback_subscription_t subscription : subscriptions)
+        {
+            remove_receive_callback_subscription(subscription);
+        }
+
+        {
+            packet_library::callback_set callbacks(
+                [](const wifi_frame_view_t& view) { benchmark_sink += view.frame_length; },
+                packet_library::on_address<2>([](uint8_t* address, const wifi_frame_view_t&) { benchmark_sink += address[5]; }),
+                packet_library::on_sequence_control([](uint16_t& sequence_control, const wifi_frame_view_t&) { benchmark_sink += sequence_control; }),
+                packet_library::on_payload([](uint8_t*, int length, const wifi_frame_view_t&) { benchmark_sink += length; }));
+            callbacks.subscribe_receive();
+            run_typed_api_case(config, "typed_api_rx_dispatch", "callback_set", payload_length, &deliver_rx_frame);
+        }
+        results += 2;
+    }
+
+    esp_log_set_vprintf(previous_vprintf);
+    return results;
+}
@@ -0,0 +1,485 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "packet_library.h"
+
+/*
+    Converts between pcap and the compressed capture format (CAPTURE_FORMAT_COMPRESSED), picking the direction from the input.
+    pcap to compressed packs the records into blocks and writes the index, as the capture sink does on the device.
+    Compressed to pcap can keep only a time range and/or the frames of one MAC address. It reads the index (or, in a capture cut
+    short without one, the block headers) and seeks past every block whose time range or address filter rules it out, so only
+    the blocks that can hold wanted frames are read and decompressed.
+*/
+
+#define PCAP_MAGIC_MICROSECONDS 0xA1B2C3D4
+#define PCAP_MAGIC_NANOSECONDS 0xA1B23C4D
+#define PCAP_RECORD_HEADER_LENGTH 16
+#define PCAP_SNAPLEN 65535
+
+typedef struct {
+    uint64_t start_us;
+    uint64_t end_us;
+    bool has_address;
+    uint8_t address[6];
+} capture_selection_t;
+
+typedef struct {
+    uint32_t blocks_read;
+    uint32_t blocks_skipped;
+    uint32_t frames_written;
+} capture_convert_stats_t;
+
+static void print_usage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s [options] input output\n"
+        "       %s -l input.plcz\n"
+        "  pcap input: writes a compressed capture\n"
+        "    -b BYTES    block size (default 32768, at most %d)\n"
+        "    -i ENTRIES  index entries (default 1024)\n"
+        "  compressed input: writes pcap\n"
+        "    -s SECONDS  only frames at or after this capture time\n"
+        "    -e SECONDS  only frames at or before this capture time\n"
+        "    -a MAC      only frames with this address in their header (aa:bb:cc:dd:ee:ff)\n"
+        "  -l            list the file header, index and block headers of a compressed capture\n",
+        program, program, COMPRESSED_CAPTURE_MAX_BLOCK_SIZE);
+}
+
+static uint32_t read_u32(const uint8_t* bytes, bool swapped)
+{
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return swapped ? __builtin_bswap32(value) : value;
+}
+
+static uint64_t get_record_timestamp_us(const uint8_t* record)
+{
+    return (uint64_t)read_u32(record, false) * 1000000 + read_u32(record + 4, false);
+}
+
+static esp_err_t write_output(void* context, const uint8_t* data, size_t length)
+{
+    return fwrite(data, 1, length, (FILE *)context) == length ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t compress_block(uint8_t* records, size_t length, uint32_t linktype, uint8_t* workspace, uint8_t* output,
+                                compressed_capture_index_t* index, uint64_t* offset, FILE* output_file)
+{
+    size_t output_length;
+    esp_err_t status = compress_capture_block(records, length, linktype, index->block_count, workspace, output, &output_length);
+    if(status == ESP_OK)
+    {
+        status = write_output(output_file, output, output_length);
+    }
+    if(status == ESP_OK)
+    {
+        status = add_compressed_capture_index_block(index, (const compressed_capture_block_header_t *)output, *offset);
+        *offset += output_length;
+    }
+    return status;
+}
+
+// pcap (either byte order, micro or nanosecond stamps) to a compressed capture, the records are stored little endian in microseconds
+static int compress_pcap(FILE* input, FILE* output, uint32_t block_size, uint32_t index_entries)
+{
+    uint8_t file_header[24];
+    if(fread(file_header, sizeof(file_header), 1, input) != 1)
+    {
+        fprintf(stderr, "Input is too short for a pcap header\n");
+        return 1;
+    }
+    uint32_t magic = read_u32(file_header, false);
+    bool swapped = magic == __builtin_bswap32(PCAP_MAGIC_MICROSECONDS) || magic == __builtin_bswap32(PCAP_MAGIC_NANOSECONDS);
+    bool nanoseconds = read_u32(file_header, swapped) == PCAP_MAGIC_NANOSECONDS;
+    if(read_u32(file_header, swapped) != PCAP_MAGIC_MICROSECONDS && !nanoseconds)
+    {
+        fprintf(stderr, "Input is neither pcap nor a compressed capture\n");
+        return 1;
+    }
+    uint32_t linktype = read_u32(file_header + 20, swapped) & 0x0FFFFFFF;
+
+    uint8_t* records = malloc(block_size);
+    uint8_t* workspace = malloc(COMPRESSED_CAPTURE_WORKSPACE_SIZE(block_size));
+    uint8_t* block = malloc(sizeof(compressed_capture_block_header_t) + block_size);
+    compressed_capture_index_t index = { 0 };
+    if(records == NULL || workspace == NULL || block == NULL || setup_compressed_capture_index(&index, index_entries) != ESP_OK)
+    {
+        fprintf(stderr, "Out of memory\n");
+        free(records);
+        free(workspace);
+        free(block);
+        free_compressed_capture_index(&index);
+        return 1;
+    }
+
+    compressed_capture_file_header_t header = {
+        .magic = COMPRESSED_CAPTURE_FILE_MAGIC,
+        .version = COMPRESSED_CAPTURE_VERSION,
+        .header_size = sizeof(compressed_capture_file_header_t),
+        .linktype = linktype,
+        .block_size = block_size
+    };
+    esp_err_t status = write_output(output, (const uint8_t *)&header, sizeof(header));
+    uint64_t offset = sizeof(header);
+    uint64_t input_bytes = sizeof(file_header);
+    uint32_t frames = 0;
+    uint32_t frames_truncated = 0;
+    size_t fill = 0;
+    uint8_t record_header[PCAP_RECORD_HEADER_LENGTH];
+    while(status == ESP_OK && fread(record_header, sizeof(record_header), 1, input) == 1)
+    {
+        uint32_t captured_length = read_u32(record_header + 8, swapped);
+        uint32_t original_length = read_u32(record_header + 12, swapped);
+        uint32_t fraction = read_u32(record_header + 4, swapped);
+        uint32_t record_fields[4] = { read_u32(record_header, swapped), nanoseconds ? fraction / 1000 : fraction, captured_length, original_length };
+        uint32_t stored_length = captured_length;
+        if(stored_length > block_size - PCAP_RECORD_HEADER_LENGTH)
+        {
+            stored_length = block_size - PCAP_RECORD_HEADER_LENGTH;
+            record_fields[2] = stored_length;
+            frames_truncated++;
+        }
+        if(fill + PCAP_RECORD_HEADER_LENGTH + stored_length > block_size)
+        {
+            status = compress_block(records, fill, linktype, workspace, block, &index, &offset, output);
+            fill = 0;
+        }
+        memcpy(records + fill, record_fields, PCAP_RECORD_HEADER_LENGTH);
+        if(fread(records + fill + PCAP_RECORD_HEADER_LENGTH, 1, stored_length, input) != stored_length ||
+           (captured_length > stored_length && fseek(input, captured_length - stored_length, SEEK_CUR) != 0))
+        {
+            fprintf(stderr, "Input ends inside record %u\n", (unsigned)frames);
+            break;
+        }
+        fill += PCAP_RECORD_HEADER_LENGTH + stored_length;
+        input_bytes += PCAP_RECORD_HEADER_LENGTH + captured_length;
+        frames++;
+    }
+    if(status == ESP_OK && fill > 0)
+    {
+        status = compress_block(records, fill, linktype, workspace, block, &index, &offset, output);
+    }
+    if(status == ESP_OK)
+    {
+        status = write_compressed_capture_index(&index, offset, &write_output, output);
+    }
+    if(status == ESP_OK)
+    {
+        fprintf(stderr, "%u frames (%u truncated to the block size) in %u blocks, %llu pcap bytes to %llu (%.1f%%), index %u entries of %u blocks\n",
+            (unsigned)frames, (unsigned)frames_truncated, (unsigned)index.block_count, (unsigned long long)input_bytes, (unsigned long long)offset,
+            input_bytes > 0 ? 100.0 * offset / input_bytes : 0.0, (unsigned)index.entry_count, (unsigned)index.blocks_per_entry);
+    }
+    else
+    {
+        fprintf(stderr, "Could not write the output (0x%x)\n", status);
+    }
+    free(records);
+    free(workspace);
+    free(block);
+    free_compressed_capture_index(&index);
+    return status == ESP_OK ? 0 : 1;
+}
+
+static bool overlaps_selection(uint64_t first_us, uint64_t last_us, uint32_t frame_count, const uint8_t* address_filter, const capture_selection_t* selection)
+{
+    if(frame_count == 0 || last_us < selection->start_us || first_us > selection->end_us)
+    {
+        return false;
+    }
+    return !selection->has_address || compressed_capture_may_contain_address(address_filter, selection->address);
+}
+
+// Whether the 802.11 header of a record carries the selected address, radiotap skipped for linktype 127
+static bool record_has_address(const uint8_t* record, uint32_t linktype, const uint8_t address[6])
+{
+    uint32_t captured_length = read_u32(record + 8, false);
+    const uint8_t* frame = record + PCAP_RECORD_HEADER_LENGTH;
+    if(linktype == 127)
+    {
+        uint32_t radiotap_length = captured_length >= 4 ? (frame[2] | (frame[3] << 8)) : captured_length;
+        if(radiotap_length > captured_length)
+        {
+            return false;
+        }
+        frame += radiotap_length;
+        captured_length -= radiotap_length;
+    }
+    bool four_addresses = captured_length >= 2 && (frame[1] & 0x03) == 0x03 && ((frame[0] >> 2) & 0x3) == 2;
+    static const int offsets[4] = { 4, 10, 16, 24 };
+    for(int i = 0; i < (four_addresses ? 4 : 3); i++)
+    {
+        if(offsets[i] + 6 <= (int)captured_length && memcmp(frame + offsets[i], address, 6) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Reads the block headers from 'offset' up to 'end_offset' (or the end of the file), decompressing the blocks the selection can match
+static esp_err_t convert_blocks(FILE* input, uint64_t offset, uint64_t end_offset, const compressed_capture_file_header_t* file_header,
+                                const capture_selection_t* selection, uint8_t* workspace, uint8_t* data, uint8_t* records,
+                                FILE* output, capture_convert_stats_t* stats)
+{
+    if(fseeko(input, offset, SEEK_SET) != 0)
+    {
+        return ESP_FAIL;
+    }
+    while(offset < end_offset)
+    {
+        compressed_capture_block_header_t header;
+        if(fread(&header, sizeof(header), 1, input) != 1)
+        {
+            break; // End of a capture without an index
+        }
+        if(header.magic != COMPRESSED_CAPTURE_BLOCK_MAGIC || header.raw_length > file_header->block_size || header.compressed_length > file_header->block_size)
+        {
+            if(header.magic == COMPRESSED_CAPTURE_INDEX_MAGIC || end_offset == UINT64_MAX)
+            {
+                break; // Reached the index, or garbage after the last block of a capture cut short
+            }
+            fprintf(stderr, "Bad block header at offset %llu\n", (unsigned long long)offset);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        offset += sizeof(header) + header.compressed_length;
+        if(!overlaps_selection(header.first_timestamp_us, header.last_timestamp_us, header.frame_count, header.address_filter, selection))
+        {
+            stats->blocks_skipped++;
+            if(fseeko(input, header.compressed_length, SEEK_CUR) != 0)
+            {
+                return ESP_FAIL;
+            }
+            continue;
+        }
+        if(fread(data, 1, header.compressed_length, input) != header.compressed_length)
+        {
+            fprintf(stderr, "Block %u is cut short\n", (unsigned)header.block_number);
+            break;
+        }
+        esp_err_t status = decompress_capture_block(&header, data, file_header->linktype, workspace, records, file_header->block_size);
+        if(status != ESP_OK)
+        {
+            fprintf(stderr, "Block %u does not decompress (0x%x)\n", (unsigned)header.block_number, status);
+            return status;
+        }
+        stats->blocks_read++;
+        for(size_t position = 0; position + PCAP_RECORD_HEADER_LENGTH <= header.raw_length;)
+        {
+            const uint8_t* record = records + position;
+            size_t record_length = PCAP_RECORD_HEADER_LENGTH + read_u32(record + 8, false);
+            if(record_length > header.raw_length - position)
+            {
+                break;
+            }
+            uint64_t timestamp_us = get_record_timestamp_us(record);
+            if(timestamp_us >= selection->start_us && timestamp_us <= selection->end_us &&
+               (!selection->has_address || record_has_address(record, file_header->linktype, selection->address)))
+            {
+                if(write_output(output, record, record_length) != ESP_OK)
+                {
+                    return ESP_FAIL;
+                }
+                stats->frames_written++;
+            }
+            position += record_length;
+        }
+    }
+    return ESP_OK;
+}
+
+// Reads the index of a complete capture into 'trailer_holder' and a newly allocated entry array, NULL if there is none
+static compressed_capture_index_entry_t* read_index(FILE* input, compressed_capture_index_trailer_t* trailer_holder)
+{
+    if(fseeko(input, -(off_t)sizeof(compressed_capture_index_trailer_t), SEEK_END) != 0)
+    {
+        return NULL;
+    }
+    off_t trailer_offset = ftello(input);
+    if(fread(trailer_holder, sizeof(*trailer_holder), 1, input) != 1 || trailer_holder->magic != COMPRESSED_CAPTURE_INDEX_MAGIC ||
+       trailer_holder->index_offset + (uint64_t)trailer_holder->entry_count * sizeof(compressed_capture_index_entry_t) != (uint64_t)trailer_offset)
+    {
+        return NULL;
+    }
+    compressed_capture_index_entry_t* entries = malloc((trailer_holder->entry_count > 0 ? trailer_holder->entry_count : 1) * sizeof(compressed_capture_index_entry_t));
+    if(entries == NULL || fseeko(input, trailer_holder->index_offset, SEEK_SET) != 0 ||
+       fread(entries, sizeof(compressed_capture_index_entry_t), trailer_holder->entry_count, input) != trailer_holder->entry_count)
+    {
+        free(entries);
+        return NULL;
+    }
+    return entries;
+}
+
+static int decompress_capture(FILE* input, FILE* output, const compressed_capture_file_header_t* file_header, const capture_selection_t* selection)
+{
+    uint8_t* workspace = malloc(COMPRESSED_CAPTURE_WORKSPACE_SIZE(file_header->block_size));
+    uint8_t* data = malloc(file_header->block_size);
+    uint8_t* records = malloc(file_header->block_size);
+    if(workspace == NULL || data == NULL || records == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        free(workspace);
+        free(data);
+        free(records);
+        return 1;
+    }
+    uint32_t pcap_header[6] = { PCAP_MAGIC_MICROSECONDS, 2 | (4 << 16), 0, 0, PCAP_SNAPLEN, file_header->linktype };
+    esp_err_t status = write_output(output, (const uint8_t *)pcap_header, sizeof(pcap_header));
+
+    capture_convert_stats_t stats = { 0 };
+    compressed_capture_index_trailer_t trailer;
+    compressed_capture_index_entry_t* entries = read_index(input, &trailer);
+    uint32_t entries_skipped = 0;
+    if(entries != NULL)
+    {
+        for(uint32_t entry = 0; entry < trailer.entry_count && status == ESP_OK; entry++)
+        {
+            const compressed_capture_index_entry_t* index_entry = &entries[entry];
+            if(!overlaps_selection(index_entry->first_timestamp_us, index_entry->last_timestamp_us, index_entry->frame_count, index_entry->address_filter, selection))
+            {
+                entries_skipped++;
+                stats.blocks_skipped += index_entry->block_count;
+                continue;
+            }
+            uint64_t end_offset = entry + 1 < trailer.entry_count ? entries[entry + 1].offset : trailer.index_offset;
+            status = convert_blocks(input, index_entry->offset, end_offset, file_header, selection, workspace, data, records, output, &stats);
+        }
+        free(entries);
+    }
+    else
+    {
+        fprintf(stderr, "No index (capture cut short?), walking the block headers\n");
+        status = status == ESP_OK ? convert_blocks(input, file_header->header_size, UINT64_MAX, file_header, selection, workspace, data, records, output, &stats) : status;
+    }
+    fprintf(stderr, "%u frames written, %u blocks decompressed, %u skipped (%u index entries skipped)\n",
+        (unsigned)stats.frames_written, (unsigned)stats.blocks_read, (unsigned)stats.blocks_skipped, (unsigned)entries_skipped);
+    free(workspace);
+    free(data);
+    free(records);
+    return status == ESP_OK ? 0 : 1;
+}
+
+static int list_capture(FILE* input, const compressed_capture_file_header_t* file_header)
+{
+    printf("linktype %u, block size %u\n", (unsigned)file_header->linktype, (unsigned)file_header->block_size);
+    compressed_capture_index_trailer_t trailer;
+    compressed_capture_index_entry_t* entries = read_index(input, &trailer);
+    uint64_t end_offset = UINT64_MAX;
+    if(entries != NULL)
+    {
+        printf("index: %u entries, %u blocks, %u blocks per entry, at offset %llu\n", (unsigned)trailer.entry_count,
+            (unsigned)trailer.block_count, (unsigned)trailer.blocks_per_entry, (unsigned long long)trailer.index_offset);
+        for(uint32_t entry = 0; entry < trailer.entry_count; entry++)
+        {
+            printf("  entry %u: offset %llu, %u blocks, %u frames, %.6f to %.6f s\n", (unsigned)entry, (unsigned long long)entries[entry].offset,
+                (unsigned)entries[entry].block_count, (unsigned)entries[entry].frame_count,
+                entries[entry].first_timestamp_us / 1e6, entries[entry].last_timestamp_us / 1e6);
+        }
+        end_offset = trailer.index_offset;
+        free(entries);
+    }
+    else
+    {
+        printf("no index\n");
+    }
+    uint64_t offset = file_header->header_size;
+    compressed_capture_block_header_t header;
+    while(offset < end_offset && fseeko(input, offset, SEEK_SET) == 0 && fread(&header, sizeof(header), 1, input) == 1 && header.magic == COMPRESSED_CAPTURE_BLOCK_MAGIC)
+    {
+        printf("  block %u: offset %llu, %u frames, %u -> %u bytes%s, %u addresses, %.6f to %.6f s\n", (unsigned)header.block_number,
+            (unsigned long long)offset, (unsigned)header.frame_count, (unsigned)header.raw_length, (unsigned)header.compressed_length,
+            (header.flags & COMPRESSED_CAPTURE_BLOCK_STORED) ? " (stored)" : "", (unsigned)header.address_count,
+            header.first_timestamp_us / 1e6, header.last_timestamp_us / 1e6);
+        offset += sizeof(header) + header.compressed_length;
+    }
+    return 0;
+}
+
+static bool parse_address(const char* text, uint8_t address_holder[6])
+{
+    unsigned octets[6];
+    if(sscanf(text, "%x:%x:%x:%x:%x:%x", &octets[0], &octets[1], &octets[2], &octets[3], &octets[4], &octets[5]) != 6)
+    {
+        return false;
+    }
+    for(int i = 0; i < 6; i++)
+    {
+        address_holder[i] = (uint8_t)octets[i];
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t block_size = 32768;
+    uint32_t index_entries = 1024;
+    bool list = false;
+    capture_selection_t selection = { .start_us = 0, .end_us = UINT64_MAX, .has_address = false };
+
+    int option;
+    while((option = getopt(argc, argv, "b:i:s:e:a:l")) != -1)
+    {
+        switch(option)
+        {
+            case 'b': block_size = (uint32_t)atoi(optarg); break;
+            case 'i': index_entries = (uint32_t)atoi(optarg); break;
+            case 's': selection.start_us = (uint64_t)(atof(optarg) * 1e6); break;
+            case 'e': selection.end_us = (uint64_t)(atof(optarg) * 1e6); break;
+            case 'a':
+                if(!parse_address(optarg, selection.address))
+                {
+                    print_usage(argv[0]);
+                    return 2;
+                }
+                selection.has_address = true;
+                break;
+            case 'l': list = true; break;
+            default:
+                print_usage(argv[0]);
+                return 2;
+        }
+    }
+    if(optind != argc - (list ? 1 : 2) || block_size < 256 || block_size > COMPRESSED_CAPTURE_MAX_BLOCK_SIZE || index_entries < 2)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+    FILE* input = fopen(argv[optind], "rb");
+    if(input == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", argv[optind]);
+        return 1;
+    }
+    compressed_capture_file_header_t file_header;
+    bool compressed = fread(&file_header, sizeof(file_header), 1, input) == 1 && file_header.magic == COMPRESSED_CAPTURE_FILE_MAGIC;
+    if(compressed && (file_header.version != COMPRESSED_CAPTURE_VERSION || file_header.header_size < sizeof(file_header) ||
+                      file_header.block_size > COMPRESSED_CAPTURE_MAX_BLOCK_SIZE))
+    {
+        fprintf(stderr, "%s has compressed capture version %u with %u byte blocks, this reads version %u\n", argv[optind],
+            (unsigned)file_header.version, (unsigned)file_header.block_size, COMPRESSED_CAPTURE_VERSION);
+        fclose(input);
+        return 1;
+    }
+    if(list)
+    {
+        int result = compressed ? list_capture(input, &file_header) : (fprintf(stderr, "%s is not a compressed capture\n", argv[optind]), 1);
+        fclose(input);
+        return result;
+    }
+    rewind(input);
+    FILE* output = fopen(argv[optind + 1], "wb");
+    if(output == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", argv[optind + 1]);
+        fclose(input);
+        return 1;
+    }
+    int result = compressed ? decompress_capture(input, output, &file_header, &selection) : compress_pcap(input, output, block_size, index_entries);
+    fclose(input);
+    if(fclose(output) != 0)
+    {
+        result = 1;
+    }
+    return result;
+}
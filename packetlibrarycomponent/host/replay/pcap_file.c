@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "pcap_file.h"
+#include "host_shim.h"
+
+#define PCAP_MAGIC_MICROSECONDS 0xA1B2C3D4
+#define PCAP_MAGIC_NANOSECONDS 0xA1B23C4D
+#define PCAP_LINKTYPE_IEEE802_11 105
+#define PCAP_LINKTYPE_IEEE802_11_RADIOTAP 127
+#define FCS_LENGTH 4
+#define MAX_SIG_LEN 4095 // rx_ctrl.sig_len is 12 bits
+
+// Alignment and size of the radiotap fields, indexed by present bit, up to the last one the replay reads (MCS) and the fields before the first unknown one
+static const uint8_t radiotap_field_align[] = { 8, 1, 1, 2, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 2, 2, 1, 1, 4, 1, 4, 2, 8 };
+static const uint8_t radiotap_field_size[] = { 8, 1, 1, 4, 2, 1, 1, 2, 2, 2, 1, 1, 1, 1, 2, 2, 1, 1, 8, 3, 8, 12, 12 };
+#define RADIOTAP_KNOWN_FIELDS (int)sizeof(radiotap_field_size)
+
+// Radiotap rate (500 kbps units) to wifi_phy_rate_t, long preamble for the DSSS/CCK rates
+static const struct { uint8_t rate_500kbps; uint8_t phy_rate; } legacy_rates[] = {
+    { 2, 0x00 }, { 4, 0x01 }, { 11, 0x02 }, { 22, 0x03 },
+    { 12, 0x0B }, { 18, 0x0F }, { 24, 0x0A }, { 36, 0x0E }, { 48, 0x09 }, { 72, 0x0D }, { 96, 0x08 }, { 108, 0x0C }
+};
+
+static uint32_t read_u32(const uint8_t* bytes, bool swapped)
+{
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return swapped ? __builtin_bswap32(value) : value;
+}
+
+static uint16_t read_le16(const uint8_t* bytes)
+{
+    return bytes[0] | (bytes[1] << 8);
+}
+
+static uint32_t read_le32(const uint8_t* bytes)
+{
+    return read_le16(bytes) | ((uint32_t)read_le16(bytes + 2) << 16);
+}
+
+// Fills rx_ctrl from a radiotap header and returns the header length, or -1 if it is malformed
+int parse_pcap_radiotap(const uint8_t* header, uint32_t length, wifi_pkt_rx_ctrl_t* rx_ctrl, bool* has_fcs)
+{
+    if(length < 8 || header[0] != 0)
+    {
+        return -1;
+    }
+    uint16_t header_length = read_le16(header + 2);
+    if(header_length > length)
+    {
+        return -1;
+    }
+
+    // Extra present words (bit 31 set) come before the fields, only the first word's standard fields are read
+    uint32_t present = read_le32(header + 4);
+    uint32_t offset = 8;
+    for(uint32_t word = present; word & (1u << 31); offset += 4)
+    {
+        if(offset + 4 > header_length)
+        {
+            return -1;
+        }
+        word = read_le32(header + offset);
+    }
+
+    for(int bit = 0; bit < RADIOTAP_KNOWN_FIELDS; bit++)
+    {
+        if(!(present & (1u << bit)))
+        {
+            continue;
+        }
+        offset = (offset + radiotap_field_align[bit] - 1) & ~(uint32_t)(radiotap_field_align[bit] - 1);
+        if(offset + radiotap_field_size[bit] > header_length)
+        {
+            break;
+        }
+        const uint8_t* field = header + offset;
+        switch(bit)
+        {
+            case 1: // Flags
+                *has_fcs = (field[0] & 0x10) != 0;
+                break;
+            case 2: // Rate
+                for(size_t i = 0; i < sizeof(legacy_rates) / sizeof(legacy_rates[0]); i++)
+                {
+                    if(legacy_rates[i].rate_500kbps == field[0])
+                    {
+                        rx_ctrl->rate = legacy_rates[i].phy_rate;
+                    }
+                }
+                break;
+            case 3: // Channel
+            {
+                uint16_t frequency = read_le16(field);
+                if(frequency == 2484)
+                {
+                    rx_ctrl->channel = 14;
+                }
+                else if(frequency >= 2412 && frequency <= 2472)
+                {
+                    rx_ctrl->channel = (frequency - 2407) / 5;
+                }
+                break;
+            }
+            case 5: // dBm antenna signal
+                rx_ctrl->rssi = (int8_t)field[0];
+                break;
+            case 6: // dBm antenna noise
+                rx_ctrl->noise_floor = (int8_t)field[0];
+                break;
+            case 11: // Antenna
+                rx_ctrl->ant = field[0] & 0x01;
+                break;
+            case 19: // MCS: known, flags, index
+                rx_ctrl->sig_mode = 1;
+                rx_ctrl->mcs = field[2] & 0x7F;
+                rx_ctrl->cwb = (field[1] & 0x03) == 1;
+                rx_ctrl->sgi = (field[1] & 0x04) != 0;
+                break;
+        }
+        offset += radiotap_field_size[bit];
+    }
+    return header_length;
+}
+
+esp_err_t load_pcap_replay_file(const char* path, pcap_replay_file_t* file_holder)
+{
+    memset(file_holder, 0, sizeof(pcap_replay_file_t));
+    FILE* input = fopen(path, "rb");
+    if(input == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    fseek(input, 0, SEEK_END);
+    long file_size = ftell(input);
+    fseek(input, 0, SEEK_SET);
+    uint8_t* contents = malloc(file_size > 0 ? file_size : 1);
+    if(contents == NULL)
+    {
+        fclose(input);
+        return ESP_ERR_NO_MEM;
+    }
+    size_t contents_size = fread(contents, 1, file_size, input);
+    fclose(input);
+
+    uint32_t magic = contents_size >= 24 ? read_u32(contents, false) : 0;
+    bool swapped = magic == __builtin_bswap32(PCAP_MAGIC_MICROSECONDS) || magic == __builtin_bswap32(PCAP_MAGIC_NANOSECONDS);
+    magic = swapped ? __builtin_bswap32(magic) : magic;
+    if(magic != PCAP_MAGIC_MICROSECONDS && magic != PCAP_MAGIC_NANOSECONDS)
+    {
+        free(contents);
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool nanoseconds = magic == PCAP_MAGIC_NANOSECONDS;
+    file_holder->linktype = read_u32(contents + 20, swapped) & 0x0FFFFFFF;
+    if(file_holder->linktype != PCAP_LINKTYPE_IEEE802_11 && file_holder->linktype != PCAP_LINKTYPE_IEEE802_11_RADIOTAP)
+    {
+        free(contents);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // First pass counts records so the frame array and packet storage are each one allocation
+    int record_count = 0;
+    size_t storage_size = 0;
+    for(size_t offset = 24; offset + 16 <= contents_size; record_count++)
+    {
+        uint32_t captured_length = read_u32(contents + offset + 8, swapped);
+        storage_size += (sizeof(wifi_promiscuous_pkt_t) + (captured_length < MAX_SIG_LEN ? captured_length : MAX_SIG_LEN) + FCS_LENGTH + 3) & ~(size_t)3;
+        offset += 16 + captured_length;
+    }
+    file_holder->frames = calloc(record_count > 0 ? record_count : 1, sizeof(pcap_replay_frame_t));
+    file_holder->storage = calloc(storage_size > 0 ? storage_size : 1, 1);
+    if(file_holder->frames == NULL || file_holder->storage == NULL)
+    {
+        free(contents);
+        free_pcap_replay_file(file_holder);
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t storage_used = 0;
+    for(size_t offset = 24; offset + 16 <= contents_size;)
+    {
+        const uint8_t* record = contents + offset;
+        uint32_t seconds = read_u32(record, swapped);
+        uint32_t fraction = read_u32(record + 4, swapped);
+        uint32_t captured_length = read_u32(record + 8, swapped);
+        offset += 16 + captured_length;
+        if(offset > contents_size)
+        {
+            file_holder->frames_skipped++;
+            break;
+        }
+
+        wifi_promiscuous_pkt_t* packet = (wifi_promiscuous_pkt_t*)(file_holder->storage + storage_used);
+        const uint8_t* frame = record + 16;
+        uint32_t frame_length = captured_length;
+        bool has_fcs = false;
+        uint64_t timestamp_us = (uint64_t)seconds * 1000000 + (nanoseconds ? fraction / 1000 : fraction);
+        packet->rx_ctrl.timestamp = (uint32_t)timestamp_us;
+        packet->rx_ctrl.channel = 1;
+        packet->rx_ctrl.rate = 0x0B; // 6 Mbps OFDM when the file does not say
+        packet->rx_ctrl.rssi = -50;
+        packet->rx_ctrl.noise_floor = -95;
+        if(file_holder->linktype == PCAP_LINKTYPE_IEEE802_11_RADIOTAP)
+        {
+            int radiotap_length = parse_pcap_radiotap(frame, captured_length, &packet->rx_ctrl, &has_fcs);
+            if(radiotap_length < 0)
+            {
+                file_holder->frames_skipped++;
+                memset(packet, 0, sizeof(wifi_promiscuous_pkt_t));
+                continue;
+            }
+            frame += radiotap_length;
+            frame_length -= radiotap_length;
+        }
+        if(frame_length < 2)
+        {
+            file_holder->frames_skipped++;
+            memset(packet, 0, sizeof(wifi_promiscuous_pkt_t));
+            continue;
+        }
+
+        // The driver always hands over the FCS, add a zero one when the capture stripped it
+        uint32_t copy_length = frame_length < MAX_SIG_LEN ? frame_length : MAX_SIG_LEN;
+        memcpy(packet->payload, frame, copy_length);
+        uint32_t sig_len = has_fcs ? copy_length : copy_length + FCS_LENGTH;
+        packet->rx_ctrl.sig_len = sig_len < MAX_SIG_LEN ? sig_len : MAX_SIG_LEN;
+
+        pcap_replay_frame_t* replay_frame = &file_holder->frames[file_holder->frame_count++];
+        replay_frame->timestamp_us = timestamp_us;
+        replay_frame->type = host_shim_frame_type(packet->payload, copy_length);
+        replay_frame->packet = packet;
+        storage_used += (sizeof(wifi_promiscuous_pkt_t) + copy_length + FCS_LENGTH + 3) & ~(size_t)3;
+    }
+    file_holder->storage_size = storage_used;
+    free(contents);
+    return ESP_OK;
+}
+
+void free_pcap_replay_file(pcap_replay_file_t* file)
+{
+    free(file->frames);
+    free(file->storage);
+    file->frames = NULL;
+    file->storage = NULL;
+    file->frame_count = 0;
+}
@@ -0,0 +1,32 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include <esp_wifi.h>
+
+#ifndef PCAP_FILE_H
+#define PCAP_FILE_H
+
+// One frame from the file, laid out the way the WiFi driver hands it to the promiscuous callback
+typedef struct {
+    uint64_t timestamp_us; // Capture time from the pcap record
+    wifi_promiscuous_pkt_type_t type;
+    wifi_promiscuous_pkt_t* packet; // rx_ctrl followed by the frame (FCS included, sig_len is the frame length)
+} pcap_replay_frame_t;
+
+typedef struct {
+    pcap_replay_frame_t* frames;
+    int frame_count;
+    uint8_t* storage; // Backing memory for every packet, so replay does no file IO or allocation
+    size_t storage_size;
+    uint32_t linktype;
+    int frames_skipped; // Records that were not usable 802.11 frames
+} pcap_replay_file_t;
+
+// Reads a whole pcap file (LINKTYPE_IEEE802_11 or LINKTYPE_IEEE802_11_RADIOTAP, either byte order, micro or nanosecond stamps) into memory.
+// Radiotap fields (channel, rate/MCS, signal, noise, antenna, FCS flag) are carried into rx_ctrl, frames without an FCS get 4 zero bytes so sig_len matches the hardware.
+esp_err_t load_pcap_replay_file(const char* path, pcap_replay_file_t* file_holder);
+void free_pcap_replay_file(pcap_replay_file_t* file);
+// Fills the rx_ctrl fields named above from the radiotap header at the start of a record and returns its length, or -1 if it is malformed
+int parse_pcap_radiotap(const uint8_t* header, uint32_t length, wifi_pkt_rx_ctrl_t* rx_ctrl, bool* has_fcs);
+
+#endif
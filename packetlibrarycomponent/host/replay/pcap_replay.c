@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <esp_timer.h>
+#include "packet_library.h"
+#include "host_shim.h"
+#include "pcap_file.h"
+
+/*
+    Replays a pcap file into the packet_library promiscuous callback through the esp_wifi stand-in,
+    as fast as possible or at the recorded timing, and reports the receive path throughput.
+*/
+
+static const char *TAG = "pcap_replay";
+static volatile uint32_t general_callback_frames = 0;
+static volatile uint32_t section_callback_calls = 0;
+
+static void count_general_callback(wifi_mac_data_frame_t* packet, int payload_length)
+{
+    general_callback_frames++;
+}
+
+static void count_address_callback(uint8_t address[6])
+{
+    section_callback_calls++;
+}
+
+static void count_sequence_control_callback(uint16_t* sequence_control)
+{
+    section_callback_calls++;
+}
+
+static void count_payload_callback(uint8_t payload[], int payload_length)
+{
+    section_callback_calls++;
+}
+
+static bool parse_print_option(const char* name, enum callback_print_option* option)
+{
+    static const struct { const char* name; enum callback_print_option option; } options[] = {
+        { "disable", DISABLE }, { "annotated", ANNOTATED }, { "hex", HEX }, { "denote", DENOTE }, { "binary", BINARY }
+    };
+    for(size_t i = 0; i < sizeof(options) / sizeof(options[0]); i++)
+    {
+        if(strcasecmp(name, options[i].name) == 0)
+        {
+            *option = options[i].option;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void print_usage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s [options] file.pcap\n"
+        "  -t          replay at the recorded timing (default: as fast as possible)\n"
+        "  -l LOOPS    replay the file LOOPS times (default 1)\n"
+        "  -s          run counting section callbacks (addresses, sequence control, payload) as well as the general one\n"
+        "  -d          run the callbacks on the deferred RX worker (setup_promiscuous_deferred)\n"
+        "  -p OPTION   receive pre-callback print: disable, annotated, hex, denote, binary\n"
+        "  -c OUTPUT   also write every frame to OUTPUT with the capture sink\n"
+        "  -z          write the -c capture compressed (capture_convert turns it back into pcap)\n"
+        "  -e OUTPUT   record an event trace and write it to OUTPUT at the end, for trace_export\n", program);
+}
+
+// Sleeps until 'target_us' (esp_timer time), spinning for the last stretch so recorded gaps are kept to a few microseconds
+static void wait_until(int64_t target_us)
+{
+    int64_t remaining_us = target_us - esp_timer_get_time();
+    if(remaining_us > 200)
+    {
+        usleep(remaining_us - 100);
+    }
+    while(esp_timer_get_time() < target_us)
+    {
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    bool recorded_timing = false;
+    bool section_callbacks = false;
+    bool deferred = false;
+    int loops = 1;
+    enum callback_print_option print_option = DISABLE;
+    const char* capture_path = NULL;
+    bool capture_compressed = false;
+    const char* trace_path = NULL;
+
+    int option;
+    while((option = getopt(argc, argv, "tl:sdp:c:ze:")) != -1)
+    {
+        switch(option)
+        {
+            case 't': recorded_timing = true; break;
+            case 'l': loops = atoi(optarg); break;
+            case 's': section_callbacks = true; break;
+            case 'd': deferred = true; break;
+            case 'p':
+                if(!parse_print_option(optarg, &print_option))
+                {
+                    print_usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'c': capture_path = optarg; break;
+            case 'z': capture_compressed = true; break;
+            case 'e': trace_path = optarg; break;
+            default:
+                print_usage(argv[0]);
+                return 2;
+        }
+    }
+    if(optind != argc - 1 || loops < 1)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    pcap_replay_file_t file;
+    esp_err_t status = load_pcap_replay_file(argv[optind], &file);
+    if(status != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not load %s (0x%x)", argv[optind], status);
+        return 1;
+    }
+    ESP_LOGI(TAG, "Loaded %d frames (%d skipped, linktype %u)", file.frame_count, file.frames_skipped, (unsigned)file.linktype);
+
+    ESP_ERROR_CHECK(setup_sta_and_promiscuous_simple_with_promisc_general_callback(&count_general_callback));
+    if(section_callbacks)
+    {
+        set_receive_callback_address_1(&count_address_callback);
+        set_receive_callback_address_2(&count_address_callback);
+        set_receive_callback_address_3(&count_address_callback);
+        set_receive_callback_sequence_control(&count_sequence_control_callback);
+        set_receive_callback_payload(&count_payload_callback);
+    }
+    if(print_option == BINARY)
+    {
+        ESP_ERROR_CHECK(setup_binary_log(1024));
+    }
+    set_receive_pre_callback_print(print_option);
+    if(deferred)
+    {
+        ESP_ERROR_CHECK(setup_promiscuous_deferred((deferred_rx_config_t)DEFERRED_RX_CONFIG_DEFAULT()));
+    }
+    if(trace_path != NULL)
+    {
+        ESP_ERROR_CHECK(setup_event_trace(65536));
+    }
+    FILE* capture_file = NULL;
+    if(capture_path != NULL)
+    {
+        capture_file = fopen(capture_path, "wb");
+        if(capture_file == NULL)
+        {
+            ESP_LOGE(TAG, "Could not open %s", capture_path);
+            return 1;
+        }
+        capture_sink_config_t capture_config = CAPTURE_SINK_CONFIG_DEFAULT();
+        capture_config.write = &capture_output_file;
+        capture_config.context = capture_file;
+        capture_config.format = capture_compressed ? CAPTURE_FORMAT_COMPRESSED : CAPTURE_FORMAT_PCAP;
+        ESP_ERROR_CHECK(setup_capture_sink(capture_config));
+    }
+
+    uint64_t frames_delivered = 0;
+    uint64_t frames_filtered = 0;
+    uint64_t bytes_delivered = 0;
+    int64_t start_us = esp_timer_get_time();
+    for(int loop = 0; loop < loops; loop++)
+    {
+        int64_t loop_start_us = esp_timer_get_time();
+        for(int i = 0; i < file.frame_count; i++)
+        {
+            pcap_replay_frame_t* frame = &file.frames[i];
+            if(recorded_timing)
+            {
+                wait_until(loop_start_us + (int64_t)(frame->timestamp_us - file.frames[0].timestamp_us));
+            }
+            if(host_shim_deliver_rx(frame->packet, frame->type))
+            {
+                frames_delivered++;
+                bytes_delivered += frame->packet->rx_ctrl.sig_len;
+            }
+            else
+            {
+                frames_filtered++;
+            }
+        }
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+
+    if(deferred)
+    {
+        // Let the worker drain the ring before reporting, the replay only measured the driver side
+        deferred_rx_stats_t deferred_stats;
+        do
+        {
+            vTaskDelay(1);
+            get_deferred_rx_stats(&deferred_stats);
+        } while(deferred_stats.frames_processed + deferred_stats.frames_dropped < deferred_stats.frames_received);
+        ESP_LOGI(TAG, "Deferred: received %u, processed %u, dropped %u, truncated %u, high water mark %u/%u",
+            (unsigned)deferred_stats.frames_received, (unsigned)deferred_stats.frames_processed, (unsigned)deferred_stats.frames_dropped,
+            (unsigned)deferred_stats.frames_truncated, (unsigned)deferred_stats.ring_high_water_mark, (unsigned)deferred_stats.ring_capacity);
+        disable_promiscuous_deferred();
+    }
+    if(capture_file != NULL)
+    {
+        stop_capture_sink();
+        capture_stats_t capture_stats;
+        get_capture_stats(&capture_stats);
+        ESP_LOGI(TAG, "Capture: %u frames, %u dropped, %llu bytes written for %llu captured", (unsigned)capture_stats.frames_captured,
+            (unsigned)capture_stats.frames_dropped, (unsigned long long)capture_stats.bytes_written, (unsigned long long)capture_stats.bytes_captured);
+        fclose(capture_file);
+    }
+
+    if(trace_path != NULL)
+    {
+        FILE* trace_file = fopen(trace_path, "wb");
+        if(trace_file == NULL)
+        {
+            ESP_LOGE(TAG, "Could not open %s", trace_path);
+            return 1;
+        }
+        status = write_event_trace(&capture_output_file, trace_file);
+        fclose(trace_file);
+        stop_event_trace();
+        if(status != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Could not write the event trace (0x%x)", status);
+            return 1;
+        }
+    }
+
+    double elapsed_s = elapsed_us / 1e6;
+    ESP_LOGI(TAG, "Delivered %llu frames (%llu bytes), %llu filtered, general callback ran %u times, section callbacks %u times",
+        (unsigned long long)frames_delivered, (unsigned long long)bytes_delivered, (unsigned long long)frames_filtered,
+        (unsigned)general_callback_frames, (unsigned)section_callback_calls);
+    ESP_LOGI(TAG, "%.3f s, %.0f frames/s, %.1f ns/frame, %.1f MB/s", elapsed_s,
+        elapsed_s > 0 ? frames_delivered / elapsed_s : 0.0,
+        frames_delivered > 0 ? elapsed_us * 1000.0 / frames_delivered : 0.0,
+        elapsed_s > 0 ? bytes_delivered / elapsed_s / 1e6 : 0.0);
+    free_pcap_replay_file(&file);
+    return 0;
+}
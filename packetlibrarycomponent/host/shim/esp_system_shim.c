@@ -0,0 +1,317 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+/*
+    Host stand-ins for the FreeRTOS task, notification and mutex calls, esp_timer and esp_log, built on pthreads and stdio.
+    Tasks are detached threads (priority and core are ignored), each with a counting notification value.
+*/
+
+struct host_task {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notification_value;
+    TaskFunction_t function;
+    void *parameter;
+};
+
+struct host_semaphore {
+    pthread_mutex_t lock;
+};
+
+struct host_timer {
+    esp_timer_create_args_t args;
+    pthread_t thread;
+    _Atomic bool running;
+    _Atomic uint32_t generation; // Bumped on every start, so a thread still sleeping out a stopped run never fires
+    uint64_t period_us;
+    bool periodic;
+};
+
+struct host_timer_run {
+    struct host_timer *timer;
+    uint32_t generation;
+};
+
+static __thread struct host_task *current_task = NULL;
+static vprintf_like_t log_vprintf = &vprintf;
+
+static void *host_task_entry(void *arg)
+{
+    current_task = (struct host_task *)arg;
+    current_task->function(current_task->parameter);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *param, UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id)
+{
+    struct host_task *task = calloc(1, sizeof(struct host_task));
+    if(task == NULL)
+    {
+        return pdFAIL;
+    }
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->notified, NULL);
+    task->function = fn;
+    task->parameter = param;
+    if(created_task != NULL)
+    {
+        *created_task = task;
+    }
+    if(pthread_create(&task->thread, NULL, &host_task_entry, task) != 0)
+    {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+// Only deleting the calling task is supported, which is the only way the component uses it.
+// The task struct is left allocated since other threads may still hold the handle.
+void vTaskDelete(TaskHandle_t task)
+{
+    if(task == NULL || task == current_task)
+    {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep((useconds_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notification_value++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    pthread_mutex_lock(&task->lock);
+    if(task->notification_value == 0 && ticks_to_wait > 0)
+    {
+        if(ticks_to_wait == portMAX_DELAY)
+        {
+            pthread_cond_wait(&task->notified, &task->lock);
+        }
+        else
+        {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            long nanoseconds = deadline.tv_nsec + (long)ticks_to_wait * portTICK_PERIOD_MS * 1000000L;
+            deadline.tv_sec += nanoseconds / 1000000000L;
+            deadline.tv_nsec = nanoseconds % 1000000000L;
+            pthread_cond_timedwait(&task->notified, &task->lock, &deadline);
+        }
+    }
+    uint32_t value = task->notification_value;
+    if(clear_on_exit)
+    {
+        task->notification_value = 0;
+    }
+    else if(value > 0)
+    {
+        task->notification_value--;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+// Threads the shim did not start (main, esp_timer callbacks) get a task struct on first use, so every caller has a distinct handle
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if(current_task == NULL)
+    {
+        struct host_task *task = calloc(1, sizeof(struct host_task));
+        if(task == NULL)
+        {
+            abort();
+        }
+        pthread_mutex_init(&task->lock, NULL);
+        pthread_cond_init(&task->notified, NULL);
+        task->thread = pthread_self();
+        current_task = task;
+    }
+    return current_task;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    int cpu = sched_getcpu();
+    return cpu < 0 ? 0 : cpu % portNUM_PROCESSORS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    struct host_semaphore *semaphore = calloc(1, sizeof(struct host_semaphore));
+    if(semaphore != NULL)
+    {
+        pthread_mutex_init(&semaphore->lock, NULL);
+    }
+    return semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    if(ticks_to_wait == 0)
+    {
+        return pthread_mutex_trylock(&semaphore->lock) == 0 ? pdTRUE : pdFALSE;
+    }
+    pthread_mutex_lock(&semaphore->lock);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    pthread_mutex_unlock(&semaphore->lock);
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    pthread_mutex_destroy(&semaphore->lock);
+    free(semaphore);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+// The host has no fixed CPU clock to count, so this counts nanoseconds (wrapping like the 32 bit CCOUNT register)
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (esp_cpu_cycle_count_t)((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec);
+}
+
+// Like esp_timer, a one shot timer is no longer armed once it fires, so its callback can start it again
+static void *host_timer_entry(void *arg)
+{
+    struct host_timer_run run = *(struct host_timer_run *)arg;
+    struct host_timer *timer = run.timer;
+    free(arg);
+    do
+    {
+        usleep(timer->period_us);
+        if(atomic_load(&timer->generation) != run.generation)
+        {
+            break;
+        }
+        if(timer->periodic)
+        {
+            if(atomic_load(&timer->running))
+            {
+                timer->args.callback(timer->args.arg);
+            }
+        }
+        else if(atomic_exchange(&timer->running, false))
+        {
+            timer->args.callback(timer->args.arg);
+        }
+    } while(timer->periodic && atomic_load(&timer->running) && atomic_load(&timer->generation) == run.generation);
+    return NULL;
+}
+
+static esp_err_t host_timer_start(esp_timer_handle_t timer, uint64_t period_us, bool periodic)
+{
+    if(atomic_load(&timer->running))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    struct host_timer_run *run = malloc(sizeof(struct host_timer_run));
+    if(run == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->period_us = period_us;
+    timer->periodic = periodic;
+    run->timer = timer;
+    run->generation = atomic_fetch_add(&timer->generation, 1) + 1;
+    atomic_store(&timer->running, true);
+    if(pthread_create(&timer->thread, NULL, &host_timer_entry, run) != 0)
+    {
+        atomic_store(&timer->running, false);
+        free(run);
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_detach(timer->thread);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle)
+{
+    struct host_timer *timer = calloc(1, sizeof(struct host_timer));
+    if(timer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->args = *args;
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return host_timer_start(timer, timeout_us, false);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    return host_timer_start(timer, period, true);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if(!atomic_exchange(&timer->running, false))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return ESP_OK;
+}
+
+// The timer thread may still be sleeping out its last period, so the timer struct is not freed here
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    return atomic_load(&timer->running) ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func)
+{
+    vprintf_like_t previous = log_vprintf;
+    log_vprintf = func;
+    return previous;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    log_vprintf(format, args);
+    va_end(args);
+}
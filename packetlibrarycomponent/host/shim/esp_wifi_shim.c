@@ -0,0 +1,205 @@
+#include <string.h>
+#include <stdatomic.h>
+#include "esp_wifi.h"
+#include "esp_event.h"
+#include "nvs_flash.h"
+#include "host_shim.h"
+
+/*
+    Host stand-in for the ESP-IDF WiFi driver.
+    Setup calls succeed without doing anything, the promiscuous callback and type filter are kept so host_shim_deliver_rx
+    can play the part of the driver task, and esp_wifi_80211_tx counts (and optionally hands to a hook) instead of transmitting.
+*/
+
+static const uint8_t host_station_mac[6] = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01 };
+static const uint8_t host_access_point_mac[6] = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x02 };
+static const uint8_t host_connected_bssid[6] = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0xAA };
+
+static wifi_promiscuous_cb_t promiscuous_callback = NULL;
+static bool promiscuous_enabled = false;
+static uint32_t promiscuous_filter_mask = WIFI_PROMIS_FILTER_MASK_ALL;
+static _Atomic uint8_t current_channel = 1; // Set from the channel hopper timer while frames are delivered from other threads
+static _Atomic uint32_t tx_count;
+static esp_err_t tx_result = ESP_OK;
+static host_shim_tx_hook_t tx_hook = NULL;
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void)
+{
+    static int station_netif;
+    return (esp_netif_t *)&station_netif;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_ap(void)
+{
+    static int access_point_netif;
+    return (esp_netif_t *)&access_point_netif;
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6])
+{
+    memcpy(mac, ifx == WIFI_IF_AP ? host_access_point_mac : host_station_mac, 6);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_protocol(wifi_interface_t ifx, uint8_t protocol_bitmap)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    memset(ap_info, 0, sizeof(wifi_ap_record_t));
+    memcpy(ap_info->bssid, host_connected_bssid, 6);
+    ap_info->primary = current_channel;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_ap_get_sta_list(wifi_sta_list_t *sta)
+{
+    memset(sta, 0, sizeof(wifi_sta_list_t));
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second)
+{
+    if(primary < 1 || primary > 14)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    current_channel = primary;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second)
+{
+    *primary = current_channel;
+    if(second != NULL)
+    {
+        *second = WIFI_SECOND_CHAN_NONE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter)
+{
+    promiscuous_filter_mask = filter->filter_mask;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb)
+{
+    promiscuous_callback = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous(bool en)
+{
+    promiscuous_enabled = en;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_80211_tx(wifi_interface_t ifx, const void *buffer, int len, bool en_sys_seq)
+{
+    atomic_fetch_add_explicit(&tx_count, 1, memory_order_relaxed);
+    if(tx_hook != NULL)
+    {
+        tx_hook(buffer, len);
+    }
+    return tx_result;
+}
+
+bool host_shim_deliver_rx(wifi_promiscuous_pkt_t* packet, wifi_promiscuous_pkt_type_t type)
+{
+    if(!promiscuous_enabled || promiscuous_callback == NULL || !(promiscuous_filter_mask & (1 << type)))
+    {
+        return false;
+    }
+    promiscuous_callback(packet, type);
+    return true;
+}
+
+// Only hands the frame over when the radio is tuned to 'channel', as the driver would, and stamps rx_ctrl.channel with it
+bool host_shim_deliver_rx_on_channel(wifi_promiscuous_pkt_t* packet, wifi_promiscuous_pkt_type_t type, uint8_t channel)
+{
+    if(channel != current_channel)
+    {
+        return false;
+    }
+    packet->rx_ctrl.channel = channel;
+    return host_shim_deliver_rx(packet, type);
+}
+
+wifi_promiscuous_pkt_type_t host_shim_frame_type(const uint8_t* frame, int frame_length)
+{
+    if(frame_length < 2)
+    {
+        return WIFI_PKT_MISC;
+    }
+    switch((frame[0] >> 2) & 0x03)
+    {
+        case 0: return WIFI_PKT_MGMT;
+        case 1: return WIFI_PKT_CTRL;
+        case 2: return WIFI_PKT_DATA;
+        default: return WIFI_PKT_MISC;
+    }
+}
+
+uint32_t host_shim_get_tx_count()
+{
+    return atomic_load_explicit(&tx_count, memory_order_relaxed);
+}
+
+void host_shim_set_tx_result(esp_err_t result)
+{
+    tx_result = result;
+}
+
+void host_shim_set_tx_hook(host_shim_tx_hook_t hook)
+{
+    tx_hook = hook;
+}
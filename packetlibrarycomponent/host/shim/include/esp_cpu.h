@@ -0,0 +1,14 @@
+#pragma once
+// Host stand-in for the ESP-IDF header of the same name, only what packet_library and the host tools use
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t esp_cpu_cycle_count_t;
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void);
+
+#ifdef __cplusplus
+}
+#endif
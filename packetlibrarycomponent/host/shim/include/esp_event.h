@@ -0,0 +1,15 @@
+#pragma once
+// Host stand-in for the ESP-IDF header of the same name, only what packet_library and the host tools use
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t esp_event_loop_create_default(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,134 @@
+#pragma once
+// Host stand-in for the ESP-IDF header of the same name, only what packet_library and the host tools use
+// Types keep the ESP-IDF names and layouts (wifi_pkt_rx_ctrl_t matches the ESP32 bitfields), so the component compiles unchanged.
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { WIFI_IF_STA = 0, WIFI_IF_AP = 1 } wifi_interface_t;
+typedef enum { WIFI_MODE_NULL = 0, WIFI_MODE_STA, WIFI_MODE_AP, WIFI_MODE_APSTA } wifi_mode_t;
+typedef enum { WIFI_PKT_MGMT, WIFI_PKT_CTRL, WIFI_PKT_DATA, WIFI_PKT_MISC } wifi_promiscuous_pkt_type_t;
+
+typedef struct {
+    signed rssi:8;
+    unsigned rate:5;
+    unsigned :1;
+    unsigned sig_mode:2;
+    unsigned :16;
+    unsigned mcs:7;
+    unsigned cwb:1;
+    unsigned :16;
+    unsigned smoothing:1;
+    unsigned not_sounding:1;
+    unsigned :1;
+    unsigned aggregation:1;
+    unsigned stbc:2;
+    unsigned fec_coding:1;
+    unsigned sgi:1;
+    signed noise_floor:8;
+    unsigned ampdu_cnt:8;
+    unsigned channel:4;
+    unsigned secondary_channel:4;
+    unsigned :8;
+    unsigned timestamp:32;
+    unsigned :32;
+    unsigned :31;
+    unsigned ant:1;
+    unsigned sig_len:12;
+    unsigned :12;
+    unsigned rx_state:8;
+} wifi_pkt_rx_ctrl_t;
+
+typedef struct {
+    wifi_pkt_rx_ctrl_t rx_ctrl;
+    uint8_t payload[0];
+} wifi_promiscuous_pkt_t;
+
+typedef void (*wifi_promiscuous_cb_t)(void *buf, wifi_promiscuous_pkt_type_t type);
+
+#define WIFI_PROMIS_FILTER_MASK_ALL 0xFFFFFFFF
+#define WIFI_PROMIS_FILTER_MASK_MGMT (1)
+#define WIFI_PROMIS_FILTER_MASK_CTRL (1<<1)
+#define WIFI_PROMIS_FILTER_MASK_DATA (1<<2)
+#define WIFI_PROMIS_FILTER_MASK_MISC (1<<3)
+typedef struct { uint32_t filter_mask; } wifi_promiscuous_filter_t;
+
+typedef enum { WIFI_SECOND_CHAN_NONE = 0, WIFI_SECOND_CHAN_ABOVE, WIFI_SECOND_CHAN_BELOW } wifi_second_chan_t;
+typedef enum { WIFI_AUTH_OPEN = 0, WIFI_AUTH_WPA2_PSK = 3 } wifi_auth_mode_t;
+typedef enum { WIFI_FAST_SCAN = 0, WIFI_ALL_CHANNEL_SCAN } wifi_scan_method_t;
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t ssid[33];
+    uint8_t primary;
+    int8_t rssi;
+    wifi_auth_mode_t authmode;
+} wifi_ap_record_t;
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t password[64];
+    uint8_t ssid_len;
+    uint8_t channel;
+    wifi_auth_mode_t authmode;
+    uint8_t ssid_hidden;
+    uint8_t max_connection;
+    uint16_t beacon_interval;
+} wifi_ap_config_t;
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t password[64];
+    wifi_scan_method_t scan_method;
+    bool bssid_set;
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_sta_config_t;
+
+typedef union {
+    wifi_ap_config_t ap;
+    wifi_sta_config_t sta;
+} wifi_config_t;
+
+#define ESP_WIFI_MAX_CONN_NUM 10 // As in the ESP-IDF 4.x esp_wifi_types.h, get_current_ap_connected_sta_macs fills a [10][6] array
+typedef struct { uint8_t mac[6]; int8_t rssi; } wifi_sta_info_t;
+typedef struct { wifi_sta_info_t sta[ESP_WIFI_MAX_CONN_NUM]; int num; } wifi_sta_list_t;
+
+typedef struct { int magic; } wifi_init_config_t;
+#define WIFI_INIT_CONFIG_DEFAULT() { .magic = 0x1F2F3F4F }
+
+#define WIFI_PROTOCOL_11B 1
+#define WIFI_PROTOCOL_11G 2
+#define WIFI_PROTOCOL_11N 4
+
+typedef struct esp_netif_obj esp_netif_t;
+
+esp_err_t esp_netif_init(void);
+esp_netif_t *esp_netif_create_default_wifi_sta(void);
+esp_netif_t *esp_netif_create_default_wifi_ap(void);
+esp_err_t esp_wifi_init(const wifi_init_config_t *config);
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6]);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_connect(void);
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter);
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb);
+esp_err_t esp_wifi_set_promiscuous(bool en);
+esp_err_t esp_wifi_set_protocol(wifi_interface_t ifx, uint8_t protocol_bitmap);
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf);
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info);
+esp_err_t esp_wifi_80211_tx(wifi_interface_t ifx, const void *buffer, int len, bool en_sys_seq);
+esp_err_t esp_wifi_ap_get_sta_list(wifi_sta_list_t *sta);
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second);
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second);
+
+#ifdef __cplusplus
+}
+#endif
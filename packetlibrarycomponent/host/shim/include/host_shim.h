@@ -0,0 +1,21 @@
+#pragma once
+// Host only controls for the esp_wifi stand-in, used by the replay driver and benchmarks to play the part of the radio
+#include <stdint.h>
+#include "esp_wifi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (* host_shim_tx_hook_t)(const void* buffer, int length); // Sees every frame passed to esp_wifi_80211_tx
+
+bool host_shim_deliver_rx(wifi_promiscuous_pkt_t* packet, wifi_promiscuous_pkt_type_t type); // Calls the registered promiscuous callback, false if promiscuous mode or the type filter drops the frame
+bool host_shim_deliver_rx_on_channel(wifi_promiscuous_pkt_t* packet, wifi_promiscuous_pkt_type_t type, uint8_t channel); // Same, but false unless esp_wifi_set_channel last tuned to 'channel'
+wifi_promiscuous_pkt_type_t host_shim_frame_type(const uint8_t* frame, int frame_length); // Promiscuous packet type for a raw 802.11 frame, from its frame control
+uint32_t host_shim_get_tx_count();
+void host_shim_set_tx_result(esp_err_t result); // What esp_wifi_80211_tx returns, ESP_OK by default
+void host_shim_set_tx_hook(host_shim_tx_hook_t hook);
+
+#ifdef __cplusplus
+}
+#endif
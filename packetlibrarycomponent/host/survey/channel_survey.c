@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <esp_timer.h>
+#include "packet_library.h"
+#include "host_shim.h"
+
+/*
+    Runs the channel hopper against synthetic traffic: every channel given with -c carries frames at a fixed rate from a population
+    of transmitters, plus transmitters that keep appearing, and a frame is only heard while the radio is tuned to its channel.
+    At the end the per channel dwell and yield stats are printed next to what was sent on each channel.
+*/
+
+static const char *TAG = "channel_survey";
+
+typedef struct {
+    uint8_t channel;
+    uint32_t frames_per_second;
+    uint32_t transmitters; // Population the frames come from
+    uint32_t new_transmitters_per_second; // Transmitters that appear and are not heard from again
+    uint64_t frames_sent;
+    uint64_t frames_heard;
+    uint32_t next_new_transmitter;
+} synthetic_channel_t;
+
+static void print_usage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -c CH:FPS:TX:NEW  traffic on channel CH: FPS frames/s from TX transmitters, plus NEW new transmitters/s (repeatable)\n"
+        "                    default: -c 1:2000:20:0 -c 6:300:50:20 -c 11:100:5:0\n"
+        "  -d SECONDS        how long to run (default 10)\n"
+        "  -m MIN_MS         minimum dwell (default 50)\n"
+        "  -M MAX_MS         maximum dwell (default 500)\n", program);
+}
+
+static bool parse_synthetic_channel(const char* text, synthetic_channel_t* channel)
+{
+    unsigned number, frames_per_second, transmitters, new_transmitters_per_second;
+    if(sscanf(text, "%u:%u:%u:%u", &number, &frames_per_second, &transmitters, &new_transmitters_per_second) != 4 || number < 1 || number > 14 || transmitters == 0)
+    {
+        return false;
+    }
+    memset(channel, 0, sizeof(synthetic_channel_t));
+    channel->channel = number;
+    channel->frames_per_second = frames_per_second;
+    channel->transmitters = transmitters;
+    channel->new_transmitters_per_second = new_transmitters_per_second;
+    return true;
+}
+
+// Builds a data frame from transmitter 'id' of 'channel' (the channel number is the second address byte so channels never share transmitters)
+static void build_synthetic_frame(wifi_promiscuous_pkt_t* packet, const synthetic_channel_t* channel, uint32_t id)
+{
+    uint8_t* frame = packet->payload;
+    memset(frame, 0, 24);
+    frame[0] = 0x08;
+    memset(&frame[4], 0xFF, 6);
+    uint8_t transmitter[6] = { 0x02, channel->channel, (id >> 24) & 0xFF, (id >> 16) & 0xFF, (id >> 8) & 0xFF, id & 0xFF };
+    memcpy(&frame[10], transmitter, 6);
+    memcpy(&frame[16], transmitter, 6);
+    packet->rx_ctrl.sig_len = 24 + 32 + 4;
+    packet->rx_ctrl.rssi = -60;
+}
+
+int main(int argc, char* argv[])
+{
+    synthetic_channel_t channels[14];
+    int channel_count = 0;
+    int seconds = 10;
+    channel_hopper_config_t config = CHANNEL_HOPPER_CONFIG_DEFAULT();
+
+    int option;
+    while((option = getopt(argc, argv, "c:d:m:M:")) != -1)
+    {
+        switch(option)
+        {
+            case 'c':
+                if(channel_count == 14 || !parse_synthetic_channel(optarg, &channels[channel_count]))
+                {
+                    print_usage(argv[0]);
+                    return 2;
+                }
+                channel_count++;
+                break;
+            case 'd': seconds = atoi(optarg); break;
+            case 'm': config.min_dwell_us = atoi(optarg) * 1000; break;
+            case 'M': config.max_dwell_us = atoi(optarg) * 1000; break;
+            default:
+                print_usage(argv[0]);
+                return 2;
+        }
+    }
+    if(optind != argc || seconds < 1)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if(channel_count == 0)
+    {
+        parse_synthetic_channel("1:2000:20:0", &channels[channel_count++]);
+        parse_synthetic_channel("6:300:50:20", &channels[channel_count++]);
+        parse_synthetic_channel("11:100:5:0", &channels[channel_count++]);
+    }
+
+    ESP_ERROR_CHECK(setup_sta_and_promiscuous_simple());
+    ESP_ERROR_CHECK(setup_channel_hopper(config));
+
+    static uint8_t buffer[sizeof(wifi_promiscuous_pkt_t) + 64];
+    wifi_promiscuous_pkt_t* packet = (wifi_promiscuous_pkt_t*)buffer;
+    int64_t start_us = esp_timer_get_time();
+    int64_t end_us = start_us + (int64_t)seconds * 1000000;
+    double frame_credit[14] = { 0 };
+    double new_transmitter_credit[14] = { 0 };
+    int64_t last_us = start_us;
+    uint32_t random_state = 1;
+    // Traffic is generated in 1 ms steps, each channel sending what its rates add up to over the step
+    while(last_us < end_us)
+    {
+        usleep(1000);
+        int64_t now_us = esp_timer_get_time();
+        double step_s = (now_us - last_us) / 1e6;
+        last_us = now_us;
+        for(int index = 0; index < channel_count; index++)
+        {
+            synthetic_channel_t* channel = &channels[index];
+            new_transmitter_credit[index] += channel->new_transmitters_per_second * step_s;
+            while(new_transmitter_credit[index] >= 1)
+            {
+                new_transmitter_credit[index] -= 1;
+                build_synthetic_frame(packet, channel, 0x10000 + channel->next_new_transmitter++);
+                channel->frames_sent++;
+                channel->frames_heard += host_shim_deliver_rx_on_channel(packet, WIFI_PKT_DATA, channel->channel);
+            }
+            frame_credit[index] += channel->frames_per_second * step_s;
+            while(frame_credit[index] >= 1)
+            {
+                frame_credit[index] -= 1;
+                random_state = random_state * 1103515245 + 12345;
+                build_synthetic_frame(packet, channel, (random_state >> 8) % channel->transmitters);
+                channel->frames_sent++;
+                channel->frames_heard += host_shim_deliver_rx_on_channel(packet, WIFI_PKT_DATA, channel->channel);
+            }
+        }
+    }
+
+    channel_hopper_stats_t stats;
+    ESP_ERROR_CHECK(get_channel_hopper_stats(&stats));
+    stop_channel_hopper();
+    double elapsed_s = (esp_timer_get_time() - start_us) / 1e6;
+    ESP_LOGI(TAG, "%.1f s, %u hops, %u channel errors", elapsed_s, (unsigned)stats.hops, (unsigned)stats.channel_errors);
+    printf("channel  visits  time_s  share  next_dwell_ms  frames  new_tx  frames/s  new_tx/s  sent  heard\n");
+    for(int index = 0; index < stats.channel_count; index++)
+    {
+        channel_hopper_channel_stats_t* channel = &stats.channels[index];
+        uint64_t sent = 0;
+        uint64_t heard = 0;
+        for(int synthetic = 0; synthetic < channel_count; synthetic++)
+        {
+            if(channels[synthetic].channel == channel->channel)
+            {
+                sent = channels[synthetic].frames_sent;
+                heard = channels[synthetic].frames_heard;
+            }
+        }
+        printf("%7u  %6u  %6.2f  %4.1f%%  %13u  %6u  %6u  %8u  %8u  %6llu  %6llu\n", (unsigned)channel->channel, (unsigned)channel->visits,
+            channel->time_us / 1e6, channel->time_us / 1e4 / elapsed_s, (unsigned)(channel->next_dwell_us / 1000), (unsigned)channel->frames,
+            (unsigned)channel->new_transmitters, (unsigned)channel->frames_per_second, (unsigned)channel->new_transmitters_per_second,
+            (unsigned long long)sent, (unsigned long long)heard);
+    }
+    return 0;
+}
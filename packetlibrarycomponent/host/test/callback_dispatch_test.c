@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <host_shim.h>
+#include "packet_library.h"
+
+/*
+    Adds and removes receive subscriptions from the main thread while another thread delivers frames through the dispatch table
+    without pause. Each subscription's context is poisoned and freed as soon as remove_receive_callback_subscription returns, so a
+    handler still running from an older table sees the poison. A second subscription removes itself from inside its own handler,
+    which has to return without waiting on itself.
+*/
+
+#define TEST_SUBSCRIPTION_ROUNDS 200
+#define TEST_CONTEXT_MAGIC 0x5EB5C71Bu
+
+typedef struct {
+    _Atomic uint32_t magic;
+    _Atomic uint32_t calls;
+} test_context_t;
+
+static _Atomic bool delivering = true;
+static _Atomic uint32_t frames_delivered;
+static _Atomic uint32_t poisoned_calls;
+static _Atomic uint32_t self_removals;
+static _Atomic callback_subscription_t self_removing_subscription;
+
+static void sleep_us(long microseconds)
+{
+    struct timespec duration = { .tv_sec = 0, .tv_nsec = microseconds * 1000 };
+    nanosleep(&duration, NULL);
+}
+
+static void checked_callback(const wifi_frame_view_t* view, void* ctx)
+{
+    test_context_t* context = ctx;
+    // Stays in the handler a while, so a removal lands while it runs
+    sleep_us(20);
+    if(atomic_load(&context->magic) != TEST_CONTEXT_MAGIC)
+    {
+        atomic_fetch_add(&poisoned_calls, 1);
+    }
+    atomic_fetch_add(&context->calls, 1);
+}
+
+static void self_removing_callback(const wifi_frame_view_t* view, void* ctx)
+{
+    callback_subscription_t subscription = atomic_load(&self_removing_subscription);
+    if(subscription != 0 && remove_receive_callback_subscription(subscription) == ESP_OK)
+    {
+        atomic_fetch_add(&self_removals, 1);
+    }
+}
+
+static int discard_log(const char* format, va_list args)
+{
+    return 0;
+}
+
+static void* deliver_frames(void* arg)
+{
+    static uint32_t buffer[(sizeof(wifi_promiscuous_pkt_t) + 128) / 4];
+    wifi_promiscuous_pkt_t* packet = (wifi_promiscuous_pkt_t*)buffer;
+    packet->rx_ctrl.sig_len = sizeof(wifi_mac_data_frame_t) + 32 + 4;
+    packet->rx_ctrl.channel = 1;
+    wifi_mac_data_frame_t* frame = (wifi_mac_data_frame_t*)packet->payload;
+    frame->frame_control = 0x0208;
+    memcpy(frame->address_2, (uint8_t[6]){ 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01 }, 6);
+    for(uint32_t i = 0; atomic_load(&delivering); i++)
+    {
+        frame->sequence_control = (uint16_t)(i << 4);
+        host_shim_deliver_rx(packet, WIFI_PKT_DATA);
+        atomic_fetch_add(&frames_delivered, 1);
+    }
+    return NULL;
+}
+
+int main()
+{
+    esp_log_set_vprintf(&discard_log);
+    ESP_ERROR_CHECK(setup_sta_and_promiscuous_simple());
+    pthread_t deliver_thread;
+    pthread_create(&deliver_thread, NULL, &deliver_frames, NULL);
+
+    uint32_t calls = 0;
+    for(int round = 0; round < TEST_SUBSCRIPTION_ROUNDS; round++)
+    {
+        test_context_t* context = calloc(1, sizeof(test_context_t));
+        atomic_store(&context->magic, TEST_CONTEXT_MAGIC);
+        callback_subscription_t subscription;
+        ESP_ERROR_CHECK(add_receive_callback_general(&checked_callback, context, &subscription));
+        if(round % 10 == 0)
+        {
+            // 0 until the add returns, a frame the handler sees before then removes nothing
+            callback_subscription_t self_removing;
+            atomic_store(&self_removing_subscription, (callback_subscription_t)0);
+            ESP_ERROR_CHECK(add_receive_callback_general(&self_removing_callback, NULL, &self_removing));
+            atomic_store(&self_removing_subscription, self_removing);
+        }
+        sleep_us(200);
+        ESP_ERROR_CHECK(remove_receive_callback_subscription(subscription));
+        calls += atomic_load(&context->calls);
+        atomic_store(&context->magic, 0);
+        free(context);
+    }
+    atomic_store(&delivering, false);
+    pthread_join(deliver_thread, NULL);
+
+    printf("%d rounds, %u frames delivered, %u handler calls, %u after removal, %u self removals\n", TEST_SUBSCRIPTION_ROUNDS,
+        (unsigned)atomic_load(&frames_delivered), (unsigned)calls, (unsigned)atomic_load(&poisoned_calls), (unsigned)atomic_load(&self_removals));
+    int failures = 0;
+    if(atomic_load(&poisoned_calls) != 0)
+    {
+        printf("FAIL: a handler ran after its subscription was removed\n");
+        failures++;
+    }
+    if(calls == 0)
+    {
+        printf("FAIL: no frame reached a subscription\n");
+        failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <esp_timer.h>
+#include <host_shim.h>
+#include "packet_library.h"
+
+/*
+    Drives the deferred receive path (setup_promiscuous_deferred) through host_shim_deliver_rx at about 10k frames/s, in short
+    bursts with pauses in between so the worker drains the ring and goes back to sleep over and over. Every frame has to reach
+    the general callback and none may be dropped. The longest wait in the ring is only reported, since a loaded host can stall
+    the worker for longer than any fixed bound; given a bound in microseconds as the first argument (e.g. the worker's 10 ms
+    notify timeout, which is what a lost wakeup costs), the test also fails when a frame waited that long.
+*/
+
+#define TEST_FRAME_COUNT 20000
+#define TEST_BURST_LENGTH 4
+#define TEST_FRAME_INTERVAL_US 100
+
+static _Atomic uint32_t frames_seen;
+
+static void count_general_callback(const wifi_frame_view_t* view, void* ctx)
+{
+    atomic_fetch_add(&frames_seen, 1);
+}
+
+static int discard_log(const char* format, va_list args)
+{
+    return 0;
+}
+
+static void sleep_us(long microseconds)
+{
+    struct timespec duration = { .tv_sec = 0, .tv_nsec = microseconds * 1000 };
+    nanosleep(&duration, NULL);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t max_wait_us = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 0; // 0 reports the longest wait without checking it
+    esp_log_set_vprintf(&discard_log);
+    ESP_ERROR_CHECK(setup_sta_and_promiscuous_simple());
+    ESP_ERROR_CHECK(add_receive_callback_general(&count_general_callback, NULL, NULL));
+    ESP_ERROR_CHECK(setup_promiscuous_deferred((deferred_rx_config_t)DEFERRED_RX_CONFIG_DEFAULT()));
+
+    static uint32_t buffer[(sizeof(wifi_promiscuous_pkt_t) + 128) / 4];
+    wifi_promiscuous_pkt_t* packet = (wifi_promiscuous_pkt_t*)buffer;
+    packet->rx_ctrl.sig_len = sizeof(wifi_mac_data_frame_t) + 32 + 4;
+    packet->rx_ctrl.channel = 1;
+    wifi_mac_data_frame_t* frame = (wifi_mac_data_frame_t*)packet->payload;
+    frame->frame_control = 0x0208;
+    memcpy(frame->address_2, (uint8_t[6]){ 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01 }, 6);
+
+    int64_t start_us = esp_timer_get_time();
+    for(int i = 0; i < TEST_FRAME_COUNT; i++)
+    {
+        frame->sequence_control = (uint16_t)(i << 4);
+        host_shim_deliver_rx(packet, WIFI_PKT_DATA);
+        if(i % TEST_BURST_LENGTH == TEST_BURST_LENGTH - 1)
+        {
+            sleep_us(TEST_BURST_LENGTH * TEST_FRAME_INTERVAL_US);
+        }
+    }
+    int64_t send_us = esp_timer_get_time() - start_us;
+
+    deferred_rx_stats_t stats;
+    int64_t drain_start_us = esp_timer_get_time();
+    do
+    {
+        sleep_us(100);
+        get_deferred_rx_stats(&stats);
+    } while(stats.frames_processed + stats.frames_dropped < stats.frames_received && esp_timer_get_time() - drain_start_us < 1000000);
+    disable_promiscuous_deferred();
+
+    uint32_t seen = atomic_load(&frames_seen);
+    printf("%d frames in %.2f s: received %u, processed %u, dropped %u, seen %u, longest wait %u us\n",
+        TEST_FRAME_COUNT, send_us / 1e6, (unsigned)stats.frames_received, (unsigned)stats.frames_processed, (unsigned)stats.frames_dropped,
+        (unsigned)seen, (unsigned)stats.queue_wait_max_us);
+    int failures = 0;
+    if(stats.frames_dropped != 0 || seen != TEST_FRAME_COUNT)
+    {
+        printf("FAIL: frames were dropped or did not reach the callback\n");
+        failures++;
+    }
+    if(max_wait_us > 0 && stats.queue_wait_max_us >= max_wait_us)
+    {
+        printf("FAIL: a frame waited %u us or longer, the worker missed a wakeup or was held up\n", (unsigned)max_wait_us);
+        failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}
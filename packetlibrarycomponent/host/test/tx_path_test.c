@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <esp_timer.h>
+#include <host_shim.h>
+#include "packet_library.h"
+
+/*
+    Checks the send path against the host shim's stand-in driver: send_packet_simple hands esp_wifi_80211_tx exactly the
+    frame it was given and passes the driver's result back, and the TX queue retries frames the driver refuses with
+    ESP_ERR_NO_MEM until they go out, in the order they were queued.
+*/
+
+#define TEST_QUEUED_FRAMES 200
+#define TEST_PAYLOAD_LENGTH 16
+
+static _Atomic uint32_t hook_frames;
+static _Atomic int hook_last_length;
+static uint8_t hook_last_frame[PACKET_LIBRARY_MAX_FRAME_LENGTH];
+static _Atomic uint32_t refuse_every; // While not 0, the driver refuses all but every n-th frame with ESP_ERR_NO_MEM
+static _Atomic uint32_t next_expected_index; // Payload index the TX queue should send next
+static _Atomic uint32_t out_of_order_frames;
+static int failures;
+
+static void record_tx_hook(const void* buffer, int length)
+{
+    uint32_t frame_number = atomic_fetch_add(&hook_frames, 1) + 1;
+    atomic_store(&hook_last_length, length);
+    memcpy(hook_last_frame, buffer, length < (int)sizeof(hook_last_frame) ? length : (int)sizeof(hook_last_frame));
+    uint32_t refuse = atomic_load(&refuse_every);
+    if(refuse == 0)
+    {
+        host_shim_set_tx_result(ESP_OK);
+        return;
+    }
+    bool accepted = frame_number % refuse == 0;
+    host_shim_set_tx_result(accepted ? ESP_OK : ESP_ERR_NO_MEM);
+    if(accepted && length >= (int)sizeof(wifi_mac_data_frame_t) + 4)
+    {
+        uint32_t index;
+        memcpy(&index, (const uint8_t*)buffer + sizeof(wifi_mac_data_frame_t), sizeof(index));
+        if(index != atomic_load(&next_expected_index))
+        {
+            atomic_fetch_add(&out_of_order_frames, 1);
+        }
+        atomic_store(&next_expected_index, index + 1);
+    }
+}
+
+static int discard_log(const char* format, va_list args)
+{
+    return 0;
+}
+
+static void sleep_us(long microseconds)
+{
+    struct timespec duration = { .tv_sec = 0, .tv_nsec = microseconds * 1000 };
+    nanosleep(&duration, NULL);
+}
+
+static void check(bool condition, const char* description)
+{
+    if(!condition)
+    {
+        printf("FAIL: %s\n", description);
+        failures++;
+    }
+}
+
+int main()
+{
+    esp_log_set_vprintf(&discard_log);
+    ESP_ERROR_CHECK(setup_sta_and_promiscuous_simple());
+    host_shim_set_tx_hook(&record_tx_hook);
+
+    uint8_t destination[6] = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x02 };
+    uint8_t source[6] = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01 };
+    uint8_t payload[TEST_PAYLOAD_LENGTH];
+    for(int i = 0; i < TEST_PAYLOAD_LENGTH; i++)
+    {
+        payload[i] = (uint8_t)(i * 13 + 1);
+    }
+
+    // send_packet_simple: the driver sees the frame as built, once, and its result comes back
+    wifi_mac_data_frame_t* packet = alloc_packet_custom(0x0208, 0, destination, source, source, 0, source, TEST_PAYLOAD_LENGTH, payload);
+    uint32_t tx_count_before = host_shim_get_tx_count();
+    check(send_packet_simple(packet, TEST_PAYLOAD_LENGTH) == ESP_OK, "send_packet_simple returns ESP_OK");
+    check(host_shim_get_tx_count() == tx_count_before + 1, "send_packet_simple reaches esp_wifi_80211_tx once");
+    check(atomic_load(&hook_last_length) == (int)sizeof(wifi_mac_data_frame_t) + TEST_PAYLOAD_LENGTH, "the driver gets header and payload length");
+    check(memcmp(hook_last_frame, packet, sizeof(wifi_mac_data_frame_t) + TEST_PAYLOAD_LENGTH) == 0, "the driver gets the frame bytes as built");
+    host_shim_set_tx_hook(NULL);
+    host_shim_set_tx_result(ESP_ERR_INVALID_ARG);
+    check(send_packet_simple(packet, TEST_PAYLOAD_LENGTH) == ESP_ERR_INVALID_ARG, "send_packet_simple passes a driver error back");
+    host_shim_set_tx_result(ESP_OK);
+    host_shim_set_tx_hook(&record_tx_hook);
+    free(packet);
+
+    // TX queue: two of every three transmits are refused for lack of buffers, every frame still goes out, in order
+    tx_queue_config_t config = TX_QUEUE_CONFIG_DEFAULT();
+    config.retry_backoff_us = 50;
+    config.max_retry_backoff_us = 200;
+    ESP_ERROR_CHECK(setup_tx_queue(config));
+    atomic_store(&hook_frames, 0);
+    atomic_store(&refuse_every, 3);
+    uint8_t frame[sizeof(wifi_mac_data_frame_t) + sizeof(uint32_t)];
+    memset(frame, 0, sizeof(frame));
+    frame[0] = 0x08;
+    uint32_t last_frame_id = 0;
+    for(uint32_t index = 0; index < TEST_QUEUED_FRAMES; index++)
+    {
+        memcpy(frame + sizeof(wifi_mac_data_frame_t), &index, sizeof(index));
+        while(tx_queue_send(frame, sizeof(frame), true, &last_frame_id) == ESP_ERR_NO_MEM)
+        {
+            sleep_us(100);
+        }
+    }
+    tx_queue_stats_t stats;
+    int64_t wait_start_us = esp_timer_get_time();
+    do
+    {
+        sleep_us(1000);
+        get_tx_queue_stats(&stats);
+    } while(stats.frames_sent + stats.frames_dropped_no_mem + stats.frames_failed < TEST_QUEUED_FRAMES && esp_timer_get_time() - wait_start_us < 5000000);
+    enum tx_frame_status last_status = TX_FRAME_QUEUED;
+    get_tx_frame_status(last_frame_id, &last_status, NULL);
+    stop_tx_queue();
+    host_shim_set_tx_hook(NULL);
+    host_shim_set_tx_result(ESP_OK);
+
+    printf("TX queue: %u sent, %u dropped, %u failed, %u retries, %u transmits, %u out of order\n", (unsigned)stats.frames_sent,
+        (unsigned)stats.frames_dropped_no_mem, (unsigned)stats.frames_failed, (unsigned)stats.retries, (unsigned)atomic_load(&hook_frames),
+        (unsigned)atomic_load(&out_of_order_frames));
+    check(stats.frames_sent == TEST_QUEUED_FRAMES, "every queued frame is sent");
+    check(stats.frames_dropped_no_mem == 0 && stats.frames_failed == 0, "no frame is dropped or failed");
+    check(stats.retries == 2 * TEST_QUEUED_FRAMES, "each refused transmit is retried");
+    check(atomic_load(&hook_frames) == 3 * TEST_QUEUED_FRAMES, "the driver sees three transmits per frame");
+    check(atomic_load(&out_of_order_frames) == 0 && atomic_load(&next_expected_index) == TEST_QUEUED_FRAMES, "frames go out in queue order");
+    check(last_status == TX_FRAME_SENT, "get_tx_frame_status reports the last frame sent");
+    return failures == 0 ? 0 : 1;
+}
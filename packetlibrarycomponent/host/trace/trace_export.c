@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "packet_library.h"
+
+/*
+    Turns a write_event_trace stream (from capture_output_file on the device, or pcap_replay -e) into Chrome trace JSON, which
+    chrome://tracing and ui.perfetto.dev open. Every core is a thread, the spans nest as they ran on it, and a flow arrow goes
+    from each frame's driver event to the start of its callbacks, which crosses cores with the deferred RX worker.
+*/
+
+static const char *const trace_span_names[EVENT_TRACE_TYPE_COUNT] = {
+    [EVENT_TRACE_RX_DRIVER] = "rx driver",
+    [EVENT_TRACE_RX_DROPPED] = "rx dropped",
+    [EVENT_TRACE_RX_CALLBACKS_BEGIN] = "rx callbacks",
+    [EVENT_TRACE_RX_CALLBACKS_END] = "rx callbacks",
+    [EVENT_TRACE_TX_BEGIN] = "send_packet_simple",
+    [EVENT_TRACE_TX_END] = "send_packet_simple",
+    [EVENT_TRACE_TX_DRIVER_BEGIN] = "esp_wifi_80211_tx",
+    [EVENT_TRACE_TX_DRIVER_END] = "esp_wifi_80211_tx",
+    [EVENT_TRACE_TX_PAYLOAD_BEGIN] = "send_payload",
+    [EVENT_TRACE_TX_PAYLOAD_END] = "send_payload",
+};
+
+static const char *const trace_drop_reasons[RX_DROP_REASON_COUNT] = { "frame filter", "duplicate", "deferred ring full" };
+
+static void print_usage(const char* program)
+{
+    fprintf(stderr,
+        "Usage: %s trace.bin [trace.json]\n"
+        "  Writes the event trace as Chrome trace JSON to trace.json, or to stdout\n", program);
+}
+
+// One JSON event. 'phase' is the Chrome trace phase: B/E span, i instant, s/f flow start/finish.
+static void write_trace_event(FILE* output, bool* first, const event_trace_event_t* event, const char* phase, double timestamp_us)
+{
+    fprintf(output, "%s\n{\"name\":\"%s\",\"cat\":\"packet_library\",\"ph\":\"%s\",\"ts\":%.0f,\"pid\":0,\"tid\":%u",
+        *first ? "" : ",", trace_span_names[event->type], phase, timestamp_us, (unsigned)event->core);
+    *first = false;
+    if(phase[0] == 's' || phase[0] == 'f')
+    {
+        fprintf(output, ",\"id\":\"0x%08x\"%s}", (unsigned)event->frame_id, phase[0] == 'f' ? ",\"bp\":\"e\"" : "");
+        return;
+    }
+    if(phase[0] == 'i')
+    {
+        fprintf(output, ",\"s\":\"t\"");
+    }
+    fprintf(output, ",\"args\":{\"frame_id\":\"0x%08x\",\"frame_length\":%u", (unsigned)event->frame_id, (unsigned)event->frame_length);
+    if(event->type == EVENT_TRACE_RX_DROPPED && event->argument >= 0 && event->argument < RX_DROP_REASON_COUNT)
+    {
+        fprintf(output, ",\"reason\":\"%s\"", trace_drop_reasons[event->argument]);
+    }
+    else if(event->type == EVENT_TRACE_TX_END || event->type == EVENT_TRACE_TX_DRIVER_END || event->type == EVENT_TRACE_TX_PAYLOAD_END)
+    {
+        fprintf(output, ",\"result\":\"0x%x\"", (unsigned)event->argument);
+    }
+    fprintf(output, "}}");
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2 || argc > 3)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+    FILE* input = fopen(argv[1], "rb");
+    if(input == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", argv[1]);
+        return 1;
+    }
+    event_trace_file_header_t header;
+    if(fread(&header, sizeof(header), 1, input) != 1 || header.magic != EVENT_TRACE_FILE_MAGIC)
+    {
+        fprintf(stderr, "%s is not an event trace\n", argv[1]);
+        fclose(input);
+        return 1;
+    }
+    if(header.version != EVENT_TRACE_FILE_VERSION || header.event_size != sizeof(event_trace_event_t))
+    {
+        fprintf(stderr, "%s has event trace version %u with %u byte events, this reads version %u with %u byte events\n", argv[1],
+            (unsigned)header.version, (unsigned)header.event_size, EVENT_TRACE_FILE_VERSION, (unsigned)sizeof(event_trace_event_t));
+        fclose(input);
+        return 1;
+    }
+    event_trace_event_t* events = malloc((header.event_count > 0 ? header.event_count : 1) * sizeof(event_trace_event_t));
+    if(events == NULL)
+    {
+        fclose(input);
+        return 1;
+    }
+    size_t event_count = fread(events, sizeof(event_trace_event_t), header.event_count, input);
+    fclose(input);
+    if(event_count != header.event_count)
+    {
+        fprintf(stderr, "%s is cut short: %zu of %u events\n", argv[1], event_count, (unsigned)header.event_count);
+    }
+
+    FILE* output = argc == 3 ? fopen(argv[2], "w") : stdout;
+    if(output == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", argv[2]);
+        free(events);
+        return 1;
+    }
+    fprintf(output, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"events_overwritten\":%u},\"traceEvents\":[", (unsigned)header.events_overwritten);
+    bool first = true;
+    int cores_seen = 0;
+    for(size_t index = 0; index < event_count; index++)
+    {
+        if(events[index].core >= cores_seen)
+        {
+            cores_seen = events[index].core + 1;
+        }
+    }
+    for(int core = 0; core < cores_seen; core++)
+    {
+        fprintf(output, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"core %d\"}}", first ? "" : ",", core, core);
+        first = false;
+    }
+    // Timestamps are the low 32 bits of esp_timer, unwrapped here from the first event on (the events are in timestamp order)
+    double timestamp_us = 0;
+    size_t skipped = 0;
+    for(size_t index = 0; index < event_count; index++)
+    {
+        const event_trace_event_t* event = &events[index];
+        if(index > 0)
+        {
+            timestamp_us += (int32_t)(event->timestamp_us - events[index - 1].timestamp_us);
+        }
+        if(event->type >= EVENT_TRACE_TYPE_COUNT)
+        {
+            skipped++;
+            continue;
+        }
+        switch(event->type)
+        {
+            case EVENT_TRACE_RX_DRIVER:
+                write_trace_event(output, &first, event, "i", timestamp_us);
+                write_trace_event(output, &first, event, "s", timestamp_us);
+                break;
+            case EVENT_TRACE_RX_DROPPED:
+                write_trace_event(output, &first, event, "i", timestamp_us);
+                break;
+            case EVENT_TRACE_RX_CALLBACKS_BEGIN:
+                write_trace_event(output, &first, event, "B", timestamp_us);
+                write_trace_event(output, &first, event, "f", timestamp_us);
+                break;
+            case EVENT_TRACE_TX_BEGIN:
+            case EVENT_TRACE_TX_DRIVER_BEGIN:
+            case EVENT_TRACE_TX_PAYLOAD_BEGIN:
+                write_trace_event(output, &first, event, "B", timestamp_us);
+                break;
+            default:
+                write_trace_event(output, &first, event, "E", timestamp_us);
+                break;
+        }
+    }
+    fprintf(output, "\n]}\n");
+    if(output != stdout)
+    {
+        fclose(output);
+    }
+    fprintf(stderr, "%zu events (%u overwritten on the device, %zu of unknown type skipped)\n", event_count, (unsigned)header.events_overwritten, skipped);
+    free(events);
+    return 0;
+}
@@ -8,7 +8,11 @@
 #ifndef PACKET_LIBRARY_H
 #define PACKET_LIBRARY_H
 
-static const char *LOGGING_TAG = "packet_library";
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static const char *LOGGING_TAG __attribute__((unused)) = "packet_library";
 
 // TypeDefs
 typedef struct {
@@ -17,9 +21,10 @@ typedef struct {
     uint8_t mac_addr[6];
     wifi_interface_t wifi_interface;
     wifi_ap_record_t connected_ap_record;
+    uint32_t configuration_generation; // Bumped whenever the interface, MAC, or AP record changes, so cached frame headers know to rebuild
 } configuration_settings_t;
 
-typedef struct {
+typedef struct wifi_mac_data_frame {
     uint16_t frame_control;
     uint16_t duration_id;
     uint8_t address_1[6];
@@ -30,7 +35,46 @@ typedef struct {
     uint8_t payload[];
 } wifi_mac_data_frame_t;
 
-enum callback_print_option { DISABLE, ANNOTATED, HEX, DENOTE };
+enum wifi_frame_type { WIFI_FRAME_TYPE_MANAGEMENT, WIFI_FRAME_TYPE_CONTROL, WIFI_FRAME_TYPE_DATA, WIFI_FRAME_TYPE_EXTENSION };
+
+// A frame decoded in place by parse_frame_view, nothing is copied out of the frame. Unlike wifi_mac_data_frame_t the header length and address roles follow the frame type and DS bits.
+typedef struct {
+    uint8_t* frame; // Start of the 802.11 header
+    int frame_length; // Frame bytes at 'frame', without the FCS
+    uint16_t frame_control;
+    uint8_t type; // enum wifi_frame_type
+    uint8_t subtype;
+    bool to_ds;
+    bool from_ds;
+    bool retry;
+    bool protected_frame; // The payload starts with the CCMP/TKIP/WEP header
+    bool has_qos;
+    bool has_ht_control;
+    bool is_amsdu; // QoS data frame whose payload is an A-MSDU
+    bool truncated; // Received frame cut short (deferred RX slot size), so the payload ends early and no FCS was there to leave off
+    bool duplicate; // Retransmission of a frame already received, only set while duplicate detection runs
+    uint8_t channel; // Channel the frame was received on (the channel hopper's channel when the driver leaves rx_ctrl.channel 0), 0 for sent packets
+    uint16_t header_length; // 10 to 36 bytes depending on the type, DS bits, QoS and HT control
+    uint16_t sequence_number; // 0 for control frames, which have no sequence control
+    uint8_t fragment_number;
+    uint16_t qos_control; // 0 without QoS
+    uint8_t* receiver; // The address roles point into the frame, NULL when the frame does not carry that role
+    uint8_t* transmitter;
+    uint8_t* destination;
+    uint8_t* source;
+    uint8_t* bssid;
+    uint8_t* payload; // Frame body after the header
+    int payload_length;
+    const wifi_pkt_rx_ctrl_t* rx_ctrl; // Driver metadata for received frames, NULL for sent packets
+} wifi_frame_view_t;
+
+#define PACKET_LIBRARY_MAX_PAYLOAD_LENGTH 2304 // 802.11 MSDU limit
+#define PACKET_LIBRARY_MAX_FRAME_LENGTH (sizeof(wifi_mac_data_frame_t) + PACKET_LIBRARY_MAX_PAYLOAD_LENGTH)
+#ifndef PACKET_LIBRARY_LOG_PAYLOAD_MAX_BYTES
+#define PACKET_LIBRARY_LOG_PAYLOAD_MAX_BYTES 256 // Most payload bytes the logging helpers print, the hex text lives on the caller's stack (2 characters per byte)
+#endif
+
+enum callback_print_option { DISABLE, ANNOTATED, HEX, DENOTE, BINARY }; // BINARY records into the binary log ring instead of printing (see setup_binary_log)
 
 typedef void (* packet_library_simple_callback_t)(wifi_mac_data_frame_t* packet, int payload_length);
 typedef void (* packet_library_frame_control_callback_t)(uint16_t* frame_control);
@@ -42,28 +86,696 @@ typedef void (* packet_library_address_4_callback_t)(uint8_t address_4[6]);
 typedef void (* packet_library_sequence_control_callback_t)(uint16_t* sequence_control);
 typedef void (* packet_library_payload_callback_t)(uint8_t payload[], int payload_length);
 
+// Callback fields, in the order their callbacks run for each packet
+enum packet_library_callback_field {
+    CALLBACK_FIELD_GENERAL,
+    CALLBACK_FIELD_FRAME_CONTROL,
+    CALLBACK_FIELD_DURATION_ID,
+    CALLBACK_FIELD_ADDRESS_1,
+    CALLBACK_FIELD_ADDRESS_2,
+    CALLBACK_FIELD_ADDRESS_3,
+    CALLBACK_FIELD_SEQUENCE_CONTROL,
+    CALLBACK_FIELD_ADDRESS_4,
+    CALLBACK_FIELD_PAYLOAD,
+    CALLBACK_FIELD_COUNT
+};
+
+// Callbacks with a context pointer, any number of them can be added per field with the add_*_callback_* methods.
+// They get the frame view decoded once for the packet, field callbacks only run when the frame's header has that field, and the payload is the view's.
+typedef void (* packet_library_general_ctx_callback_t)(const wifi_frame_view_t* view, void* ctx);
+typedef void (* packet_library_u16_field_ctx_callback_t)(uint16_t* field, const wifi_frame_view_t* view, void* ctx); // Frame control, duration/ID, or sequence control
+typedef void (* packet_library_address_ctx_callback_t)(uint8_t address[6], const wifi_frame_view_t* view, void* ctx);
+typedef void (* packet_library_payload_ctx_callback_t)(uint8_t payload[], int payload_length, const wifi_frame_view_t* view, void* ctx);
+typedef uint32_t callback_subscription_t; // Identifies an added callback for removal, never 0
+
+#ifndef PACKET_LIBRARY_MAX_CALLBACK_SUBSCRIBERS
+#define PACKET_LIBRARY_MAX_CALLBACK_SUBSCRIBERS 16 // Most callbacks (set and added, all fields) per direction
+#endif
+
+typedef struct {
+    int ring_slots; // Number of frame slots in the receive ring, rounded up to a power of two
+    int slot_size; // Largest frame (in bytes) a slot holds, longer frames are cut to this length before the callbacks see them
+    int batch_size; // Most frames the worker task runs callbacks on before handing the slots back to the driver side
+    UBaseType_t task_priority; // FreeRTOS priority of the worker task that runs the callbacks
+    BaseType_t task_core; // Core to pin the worker task to, or tskNO_AFFINITY
+    uint32_t task_stack_size; // Stack size of the worker task, the callbacks run on this stack
+} deferred_rx_config_t;
+
+// The core the WiFi task is not pinned to, so the deferred RX worker takes the callbacks off the driver's core
+#if portNUM_PROCESSORS > 1 && defined(CONFIG_ESP_WIFI_TASK_PINNED_TO_CORE_1)
+#define DEFERRED_RX_WORKER_CORE 0
+#elif portNUM_PROCESSORS > 1
+#define DEFERRED_RX_WORKER_CORE 1
+#else
+#define DEFERRED_RX_WORKER_CORE tskNO_AFFINITY
+#endif
+
+#define DEFERRED_RX_CONFIG_DEFAULT() { \
+    .ring_slots = 32, \
+    .slot_size = 512, \
+    .batch_size = 8, \
+    .task_priority = 5, \
+    .task_core = DEFERRED_RX_WORKER_CORE, \
+    .task_stack_size = 4096 \
+}
+
+typedef struct {
+    uint32_t frames_received; // Frames the driver handed to the component
+    uint32_t frames_dropped; // Frames lost because the ring was full
+    uint32_t frames_truncated; // Frames longer than slot_size
+    uint32_t frames_processed; // Frames the worker task ran the callbacks on
+    uint32_t ring_capacity; // Number of slots in the ring
+    uint32_t ring_occupancy; // Slots in use when the stats were read
+    uint32_t ring_high_water_mark; // Most slots ever in use at once
+    uint32_t driver_stage_cycles; // Running average of CPU cycles the driver callback spends on a queued frame (filter, timestamp, copy)
+    uint32_t worker_stage_cycles; // Running average of CPU cycles per frame the worker spends on the callbacks
+    uint32_t queue_wait_average_us; // Running average time from the copy until the worker picks up the frame's batch
+    uint32_t queue_wait_max_us;
+    int32_t driver_core; // Core each stage last ran on, -1 before its first frame
+    int32_t worker_core;
+} deferred_rx_stats_t;
+
+typedef struct {
+    int capacity; // Most stations kept, the least recently heard one is evicted to make room
+    int rssi_average_shift; // The RSSI average moves 1/2^shift of the way to each new reading
+} station_table_config_t;
+
+#define STATION_TABLE_CONFIG_DEFAULT() { \
+    .capacity = 256, \
+    .rssi_average_shift = 3 \
+}
+
+// What the station table knows about one transmitter address
+typedef struct {
+    uint8_t mac[6];
+    uint8_t bssid[6]; // BSSID of the last frame from the station that carried one, all 0 until then
+    int64_t first_seen_us; // esp_timer_get_time() time
+    int64_t last_seen_us;
+    uint32_t frames[4]; // Indexed by enum wifi_frame_type
+    uint32_t bytes[4]; // Frame bytes without the FCS, indexed by enum wifi_frame_type
+    int8_t rssi_last;
+    int8_t rssi_average; // Moving average, see rssi_average_shift
+    uint8_t channel;
+    uint16_t last_sequence_number;
+} station_table_entry_t;
+
+typedef struct {
+    uint32_t capacity;
+    uint32_t entry_count;
+    uint32_t frames_recorded;
+    uint32_t insertions; // Stations added, including ones added back after an eviction
+    uint32_t evictions;
+} station_table_stats_t;
+
+typedef struct {
+    int capacity; // Transmitter and traffic identifier pairs tracked, the least recently heard is replaced when a set of 4 is full
+    bool drop_duplicates; // Drop duplicates before the prints and callbacks, otherwise they are only marked in the frame view
+} duplicate_detection_config_t;
+
+#define DUPLICATE_DETECTION_CONFIG_DEFAULT() { \
+    .capacity = 64, \
+    .drop_duplicates = true \
+}
+
+typedef struct {
+    uint32_t frames_checked; // Management and data frames, control frames have no sequence number
+    uint32_t retries; // Frames with the retry bit set
+    uint32_t duplicates; // Retries of a frame that was already received
+    uint32_t sequence_gaps; // Sequence numbers skipped over, frames lost or not heard
+    uint32_t out_of_order; // Frames that arrived after a later sequence number but were not duplicates
+    uint32_t evictions;
+} duplicate_detection_stats_t;
+
+#define PACKET_LIBRARY_STATS_CHANNELS 15 // Channels 1 to 14, with 0 for sent frames and anything else
+#define PACKET_LIBRARY_STATS_RSSI_BUCKETS 8 // -30 dBm and stronger, then 10 dB each, the last for -90 dBm and weaker
+
+// Why a received frame did not make it to the callbacks
+enum packet_library_rx_drop_reason { RX_DROP_FRAME_FILTER, RX_DROP_DUPLICATE, RX_DROP_DEFERRED_RING_FULL, RX_DROP_REASON_COUNT };
+
+typedef struct {
+    uint64_t frames;
+    uint64_t bytes; // Without the FCS
+    uint64_t frames_by_type[4]; // Indexed by enum wifi_frame_type
+    uint64_t bytes_by_type[4];
+    uint64_t frames_by_subtype[4][16];
+    uint64_t frames_by_channel[PACKET_LIBRARY_STATS_CHANNELS];
+    uint64_t frames_by_rssi[PACKET_LIBRARY_STATS_RSSI_BUCKETS]; // Received frames only
+} packet_library_direction_stats_t;
+
+typedef struct {
+    packet_library_direction_stats_t receive; // Every frame the driver handed over, before filters and drops
+    packet_library_direction_stats_t send; // Frames esp_wifi_80211_tx accepted
+    uint64_t receive_drops[RX_DROP_REASON_COUNT];
+    uint64_t send_errors; // Frames esp_wifi_80211_tx refused
+    esp_err_t last_send_error;
+} packet_library_stats_t;
+
+// Stage latency profiling is compiled in with PACKET_LIBRARY_PROFILING defined to 1 for the component (e.g. target_compile_definitions), otherwise none of the timing code is built
+#ifndef PACKET_LIBRARY_PROFILING
+#define PACKET_LIBRARY_PROFILING 0
+#endif
+#define PACKET_LIBRARY_PROFILE_BUCKETS 32 // Bucket 0 holds 0 cycle samples and bucket n those of 2^(n-1) to 2^n - 1 cycles, the last bucket also everything longer
+
+// The timed stages of the receive and send paths
+enum packet_library_profile_stage {
+    PROFILE_STAGE_RX_FRAME, // All of a received frame after the frame filters: capture, the station table and other hooks, prints and callbacks
+    PROFILE_STAGE_RX_PRECALLBACK_PRINT,
+    PROFILE_STAGE_RX_CALLBACK, // One stage per enum packet_library_callback_field from here, every handler of the field adds to it
+    PROFILE_STAGE_RX_POSTCALLBACK_PRINT = PROFILE_STAGE_RX_CALLBACK + CALLBACK_FIELD_COUNT,
+    PROFILE_STAGE_TX_PRECALLBACK_PRINT,
+    PROFILE_STAGE_TX_CALLBACK, // One stage per enum packet_library_callback_field, as for receive
+    PROFILE_STAGE_TX_POSTCALLBACK_PRINT = PROFILE_STAGE_TX_CALLBACK + CALLBACK_FIELD_COUNT,
+    PROFILE_STAGE_TX_DRIVER, // esp_wifi_80211_tx
+    PROFILE_STAGE_COUNT
+};
+
+// Times are CPU cycles (esp_cpu_get_cycle_count), nanoseconds in the host build
+typedef struct {
+    uint32_t count;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+    uint32_t buckets[PACKET_LIBRARY_PROFILE_BUCKETS];
+} profile_histogram_t;
+
+#define CHANNEL_HOPPER_MAX_CHANNELS 14
+
+typedef struct {
+    uint8_t channels[CHANNEL_HOPPER_MAX_CHANNELS]; // Visited in this order, over and over
+    int channel_count;
+    uint32_t min_dwell_us; // Dwell on a channel with nothing heard
+    uint32_t max_dwell_us; // Dwell on the busiest channel
+    uint32_t new_transmitter_weight; // A transmitter not heard on the channel recently weighs as much as this many frames
+    int average_shift; // The per channel rates move 1/2^shift of the way to each visit's rate
+} channel_hopper_config_t;
+
+#define CHANNEL_HOPPER_CONFIG_DEFAULT() { \
+    .channels = { 1, 6, 11, 2, 7, 12, 3, 8, 13, 4, 9, 5, 10 }, \
+    .channel_count = 13, \
+    .min_dwell_us = 50000, \
+    .max_dwell_us = 500000, \
+    .new_transmitter_weight = 20, \
+    .average_shift = 2 \
+}
+
+typedef struct {
+    uint8_t channel;
+    uint32_t visits;
+    uint64_t time_us; // Total time spent on the channel
+    uint32_t next_dwell_us; // Dwell for the next visit
+    uint32_t frames; // Frames received on the channel
+    uint32_t new_transmitters; // Transmitters heard on the channel that were not among the last 256 to 512 different ones heard there
+    uint32_t frames_per_second; // Moving averages over the visits
+    uint32_t new_transmitters_per_second;
+} channel_hopper_channel_stats_t;
+
+typedef struct {
+    uint32_t hops;
+    uint32_t channel_errors; // esp_wifi_set_channel calls that failed, the hopper stays on the previous channel for that visit
+    int channel_count;
+    channel_hopper_channel_stats_t channels[CHANNEL_HOPPER_MAX_CHANNELS]; // In the configured order
+} channel_hopper_stats_t;
+
+#ifndef PACKET_LIBRARY_MAX_FRAME_FILTERS
+#define PACKET_LIBRARY_MAX_FRAME_FILTERS 8 // Most frame filters added at once
+#endif
+#ifndef PACKET_LIBRARY_MAX_FRAME_FILTER_TERMS
+#define PACKET_LIBRARY_MAX_FRAME_FILTER_TERMS 16 // Most terms over all the frame filters added at once
+#endif
+
+// What a frame filter term looks at. Header fields are read where the frame view finds them, a field the frame does not have never matches.
+enum frame_filter_field {
+    FRAME_FILTER_TYPE, // enum wifi_frame_type
+    FRAME_FILTER_SUBTYPE,
+    FRAME_FILTER_FRAME_CONTROL, // The whole field, use 'mask' to test flag bits such as ToDS/FromDS
+    FRAME_FILTER_ADDRESS_1, // Addresses are compared against 'bytes' under 'bytes_mask'
+    FRAME_FILTER_ADDRESS_2,
+    FRAME_FILTER_ADDRESS_3,
+    FRAME_FILTER_ADDRESS_4,
+    FRAME_FILTER_SEQUENCE_NUMBER,
+    FRAME_FILTER_FRAME_LENGTH, // Without the FCS
+    FRAME_FILTER_PAYLOAD_LENGTH, // After the actual header of the frame, as in the frame view
+    FRAME_FILTER_PAYLOAD_BYTES, // 'length' (1 to 8) bytes at 'offset' into the payload, compared against 'bytes' under 'bytes_mask'
+    FRAME_FILTER_RSSI // dBm, negative
+};
+
+// One test on a frame, a filter matches a frame when all of its terms do
+typedef struct {
+    enum frame_filter_field field;
+    bool negate; // Match when the test fails instead
+    int32_t min; // Numeric fields match when (value & mask) is within [min, max]
+    int32_t max;
+    uint32_t mask; // 0 keeps the whole value
+    uint8_t bytes[8]; // Address and payload byte fields
+    uint8_t bytes_mask[8]; // All 0 compares every byte exactly
+    int offset; // FRAME_FILTER_PAYLOAD_BYTES only
+    int length;
+} frame_filter_term_t;
+
+#define FRAME_FILTER_TERM_RANGE(term_field, low, high) ((frame_filter_term_t){ .field = (term_field), .min = (low), .max = (high) })
+#define FRAME_FILTER_TERM_EQUAL(term_field, value) FRAME_FILTER_TERM_RANGE(term_field, value, value)
+#define FRAME_FILTER_TERM_ADDRESS(term_field, mac) ((frame_filter_term_t){ .field = (term_field), .bytes = { (mac)[0], (mac)[1], (mac)[2], (mac)[3], (mac)[4], (mac)[5] } })
+
+typedef uint32_t frame_filter_id_t; // Identifies an added frame filter, never 0
+
+typedef struct {
+    uint32_t frames_checked; // Frames run through the filters while at least one was added
+    uint32_t frames_rejected; // Frames no filter matched, dropped before any capture, print, or callback
+    int filter_count;
+    frame_filter_id_t filter_ids[PACKET_LIBRARY_MAX_FRAME_FILTERS]; // In the order the filters are checked
+    uint32_t filter_hits[PACKET_LIBRARY_MAX_FRAME_FILTERS]; // Frames each filter was the first to match
+} frame_filter_stats_t;
+
+#ifndef BINARY_LOG_PAYLOAD_BYTES
+#define BINARY_LOG_PAYLOAD_BYTES 32 // Payload bytes kept per binary log record
+#endif
+
+enum binary_log_source { BINARY_LOG_RX_PRECALLBACK, BINARY_LOG_RX_POSTCALLBACK, BINARY_LOG_TX_PRECALLBACK, BINARY_LOG_TX_POSTCALLBACK };
+
+typedef struct {
+    int64_t timestamp_us; // esp_timer_get_time() when the record was made
+    uint8_t source; // enum binary_log_source
+    uint8_t captured_payload_length; // Payload bytes stored in 'payload'
+    uint16_t payload_length; // Full payload length of the packet
+    uint8_t header[sizeof(wifi_mac_data_frame_t)]; // The fixed header fields as they were in the packet, same layout as wifi_mac_data_frame_t
+    uint8_t payload[BINARY_LOG_PAYLOAD_BYTES];
+} binary_log_record_t;
+
+typedef struct {
+    uint32_t records_written;
+    uint32_t records_lost; // Records dropped because the ring was full (or the binary log was not setup)
+    uint32_t records_read;
+    uint32_t ring_capacity;
+} binary_log_stats_t;
+
+typedef esp_err_t (* capture_output_write_t)(void* context, const uint8_t* data, size_t length); // Writes a block of pcap bytes to the capture output
+
+enum capture_format {
+    CAPTURE_FORMAT_PCAP, // pcap, opens in Wireshark/tcpdump as is
+    CAPTURE_FORMAT_COMPRESSED // Blocks compressed one by one with an index at the end, host/convert/capture_convert turns it into pcap
+};
+
+typedef struct {
+    capture_output_write_t write; // Output the filled blocks are handed to, e.g. capture_output_file or capture_output_memory_ring
+    void* context; // Passed to 'write', e.g. the FILE* or capture_memory_ring_t*
+    size_t block_size; // Bytes per buffer, two are allocated. Frames are cut to fit a block.
+    uint32_t flush_interval_ms; // A partly filled block is written out after this long, 0 waits for full blocks only
+    UBaseType_t task_priority; // Priority of the task that calls 'write'
+    BaseType_t task_core;
+    enum capture_format format;
+    uint32_t index_entries; // CAPTURE_FORMAT_COMPRESSED: index entries kept in RAM, neighbouring entries are merged when it fills
+} capture_sink_config_t;
+
+#define CAPTURE_SINK_CONFIG_DEFAULT() { \
+    .write = NULL, \
+    .context = NULL, \
+    .block_size = 8192, \
+    .flush_interval_ms = 1000, \
+    .task_priority = 3, \
+    .task_core = tskNO_AFFINITY, \
+    .format = CAPTURE_FORMAT_PCAP, \
+    .index_entries = 64 \
+}
+
+typedef struct {
+    uint32_t frames_captured;
+    uint32_t frames_truncated; // Frames cut to fit a block
+    uint32_t frames_dropped; // Frames lost because both blocks were waiting on the output
+    uint32_t blocks_written;
+    uint32_t write_errors; // Blocks the output 'write' returned an error for
+    uint64_t bytes_written;
+    uint64_t bytes_captured; // pcap record bytes the written blocks held, more than bytes_written when compressed
+} capture_stats_t;
+
+typedef struct {
+    uint8_t* buffer;
+    size_t size;
+    volatile size_t head; // Written by the capture task only
+    volatile size_t tail; // Written by the reader only
+    uint32_t bytes_dropped; // Bytes that did not fit, the pcap stream is no longer valid after a drop
+} capture_memory_ring_t;
+
+/*
+    Compressed capture (CAPTURE_FORMAT_COMPRESSED), little endian as the ESP32 and the host are:
+    file header, then blocks (block header and compressed_length bytes), then the index entries and the index trailer.
+    A block decodes on its own to raw_length bytes of pcap records (record header, then the linktype's frame bytes).
+    A capture cut short (power loss) has no index, the blocks can still be walked by their headers.
+*/
+#define COMPRESSED_CAPTURE_FILE_MAGIC 0x5A434C50 // "PLCZ"
+#define COMPRESSED_CAPTURE_BLOCK_MAGIC 0x4B424C50 // "PLBK"
+#define COMPRESSED_CAPTURE_INDEX_MAGIC 0x58494C50 // "PLIX"
+#define COMPRESSED_CAPTURE_VERSION 1
+#define COMPRESSED_CAPTURE_MAX_BLOCK_SIZE 49152 // Keeps every match offset of a block in 16 bits
+#define COMPRESSED_CAPTURE_ADDRESS_FILTER_BYTES 32
+#define COMPRESSED_CAPTURE_BLOCK_STORED 0x0001 // Block flag: the records are stored as they are, compressing did not make them smaller
+// Workspace compress_capture_block and decompress_capture_block need for blocks of up to 'block_size' bytes
+#define COMPRESSED_CAPTURE_WORKSPACE_SIZE(block_size) (8192 + 2048 + (block_size) + (block_size) / 6 + 64)
+
+typedef struct {
+    uint32_t magic; // COMPRESSED_CAPTURE_FILE_MAGIC
+    uint16_t version; // COMPRESSED_CAPTURE_VERSION
+    uint16_t header_size; // sizeof(compressed_capture_file_header_t)
+    uint32_t linktype; // pcap linktype of the records, 127 (radiotap) from the capture sink
+    uint32_t block_size; // Largest raw_length of any block
+} compressed_capture_file_header_t;
+
+typedef struct {
+    uint32_t magic; // COMPRESSED_CAPTURE_BLOCK_MAGIC
+    uint32_t compressed_length; // Bytes following this header
+    uint32_t raw_length; // Bytes of pcap records once decoded
+    uint32_t frame_count;
+    uint64_t first_timestamp_us; // Earliest and latest record timestamps
+    uint64_t last_timestamp_us;
+    uint32_t block_number; // Counts from 0 in each file
+    uint16_t flags; // COMPRESSED_CAPTURE_BLOCK_STORED
+    uint16_t address_count; // Distinct MAC addresses in the headers, at most 254 are counted
+    uint8_t address_filter[COMPRESSED_CAPTURE_ADDRESS_FILTER_BYTES]; // Bloom filter of those addresses, see compressed_capture_may_contain_address
+} compressed_capture_block_header_t;
+
+// One entry covers 'block_count' consecutive blocks starting at 'offset'
+typedef struct {
+    uint64_t offset; // File offset of the first block header
+    uint64_t first_timestamp_us;
+    uint64_t last_timestamp_us;
+    uint32_t block_count;
+    uint32_t frame_count;
+    uint8_t address_filter[COMPRESSED_CAPTURE_ADDRESS_FILTER_BYTES]; // The blocks' filters ORed together
+} compressed_capture_index_entry_t;
+
+// The last bytes of a complete compressed capture, the entries sit right before it
+typedef struct {
+    uint32_t magic; // COMPRESSED_CAPTURE_INDEX_MAGIC
+    uint32_t entry_count;
+    uint32_t block_count;
+    uint32_t blocks_per_entry; // Doubles every time the writer merged its entries, the last entry can hold fewer
+    uint64_t index_offset; // File offset of the first entry
+} compressed_capture_index_trailer_t;
+
+// Fixed size index a writer fills block by block, merging neighbouring entries pairwise when it runs out, so long captures stay indexed in bounded RAM
 typedef struct {
-    bool general_callback_is_set;
-    packet_library_simple_callback_t general_callback;
-    bool frame_control_callback_is_set;
-    packet_library_frame_control_callback_t frame_control_callback;
-    bool duration_id_callback_is_set;
-    packet_library_duration_id_callback_t duration_id_callback;
-    bool address_1_callback_is_set;
-    packet_library_address_1_callback_t address_1_callback;
-    bool address_2_callback_is_set;
-    packet_library_address_2_callback_t address_2_callback;
-    bool address_3_callback_is_set;
-    packet_library_address_3_callback_t address_3_callback;
-    bool address_4_callback_is_set;
-    packet_library_address_4_callback_t address_4_callback;
-    bool sequence_control_callback_is_set;
-    packet_library_sequence_control_callback_t sequence_control_callback;
-    bool payload_callback_is_set;
-    packet_library_payload_callback_t payload_callback;
-    enum callback_print_option precallback_print;
-    enum callback_print_option postcallback_print;
-} callback_setup_t;
+    compressed_capture_index_entry_t* entries;
+    uint32_t capacity;
+    uint32_t entry_count;
+    uint32_t block_count;
+    uint32_t blocks_per_entry;
+} compressed_capture_index_t;
+
+// Points on a frame's way through the component, each span has a BEGIN and an END event on the same core
+enum event_trace_type {
+    EVENT_TRACE_RX_DRIVER, // The driver handed the frame over (inline or to the deferred RX ring)
+    EVENT_TRACE_RX_DROPPED, // Frame filter or full deferred RX ring, 'argument' is the enum packet_library_rx_drop_reason
+    EVENT_TRACE_RX_CALLBACKS_BEGIN, // promisc_run_callbacks: capture, the hooks, prints and callbacks
+    EVENT_TRACE_RX_CALLBACKS_END,
+    EVENT_TRACE_TX_BEGIN, // send_packet_simple, its send callbacks run in this span
+    EVENT_TRACE_TX_END, // 'argument' is the esp_err_t result
+    EVENT_TRACE_TX_DRIVER_BEGIN, // esp_wifi_80211_tx, from every send function
+    EVENT_TRACE_TX_DRIVER_END, // 'argument' is the esp_err_t result
+    EVENT_TRACE_TX_PAYLOAD_BEGIN, // A send_payload_* helper, 'frame_id' has the destination and sequence 0
+    EVENT_TRACE_TX_PAYLOAD_END, // 'argument' is the esp_err_t result
+    EVENT_TRACE_TYPE_COUNT
+};
+
+// One 16 byte trace event
+typedef struct {
+    uint32_t timestamp_us; // esp_timer_get_time, low 32 bits
+    uint32_t frame_id; // Hash of address 2 (the transmitter) in the top 16 bits, sequence control in the low 16, see get_event_trace_frame_id
+    int32_t argument; // Per enum event_trace_type, 0 where not listed
+    uint16_t frame_length; // Frame bytes, 0 where the event has no frame
+    uint8_t type; // enum event_trace_type
+    uint8_t core;
+} event_trace_event_t;
+
+#define EVENT_TRACE_FILE_MAGIC 0x52544C50 // "PLTR" as the first 4 bytes of a write_event_trace stream
+#define EVENT_TRACE_FILE_VERSION 1
+
+// Starts a write_event_trace stream, followed by 'event_count' event_trace_event_t in timestamp order. Little endian, as the ESP32 and the host are.
+typedef struct {
+    uint32_t magic; // EVENT_TRACE_FILE_MAGIC
+    uint16_t version; // EVENT_TRACE_FILE_VERSION
+    uint16_t event_size; // sizeof(event_trace_event_t)
+    uint32_t event_count;
+    uint32_t events_overwritten; // Events recorded but gone from the rings before this was written
+} event_trace_file_header_t;
+
+enum send_batch_callback_option { SEND_BATCH_CALLBACKS_EACH_PACKET, SEND_BATCH_CALLBACKS_FIRST_PACKET, SEND_BATCH_CALLBACKS_NONE };
+
+typedef struct {
+    uint32_t inter_frame_interval_us; // Target time between the start of consecutive transmits, 0 sends back to back
+    enum send_batch_callback_option callbacks; // Which packets of the batch the send callbacks and prints run on, FIRST_PACKET suits batches that repeat one packet
+    bool keep_sequence_control; // Send the sequence control field as it is instead of letting the driver number the packets
+} send_batch_pacing_t;
+
+enum tx_frame_status { TX_FRAME_QUEUED, TX_FRAME_SENT, TX_FRAME_DROPPED_NO_MEM, TX_FRAME_ERROR };
+
+typedef void (* tx_queue_completion_callback_t)(uint32_t frame_id, enum tx_frame_status status, esp_err_t result, void* ctx); // 'result' is the last esp_wifi_80211_tx result
+typedef void (* tx_queue_space_callback_t)(int free_slots, void* ctx);
+
+typedef struct {
+    int queue_depth; // Frames the queue holds, rounded up to a power of two
+    int max_frame_length; // Largest frame in bytes, frames are copied into the queue
+    int status_history; // Most recent frames get_tx_frame_status can answer for, rounded up to a power of two and at least queue_depth
+    int max_retries; // Times a frame the driver has no buffer for (ESP_ERR_NO_MEM) is sent again before it is dropped
+    uint32_t retry_backoff_us; // Wait before the first retry, doubled for each retry after it
+    uint32_t max_retry_backoff_us;
+    uint32_t rate_limit_fps; // Token bucket refill rate in frames per second, 0 sends as fast as the driver takes frames
+    uint32_t rate_limit_burst; // Token bucket size, frames that can go back to back after the queue was idle
+    int space_threshold; // Free slots the queue needs before space_callback runs, after a send found the queue full
+    tx_queue_space_callback_t space_callback; // Runs on the sender task, may be NULL
+    tx_queue_completion_callback_t completion_callback; // Runs on the sender task once a frame is sent or given up on, may be NULL
+    void* callback_ctx; // Passed to both callbacks
+    UBaseType_t task_priority; // FreeRTOS priority of the sender task
+    BaseType_t task_core; // Core to pin the sender task to, or tskNO_AFFINITY
+    uint32_t task_stack_size; // The callbacks run on this stack
+} tx_queue_config_t;
+
+#define TX_QUEUE_CONFIG_DEFAULT() { \
+    .queue_depth = 32, \
+    .max_frame_length = 512, \
+    .status_history = 128, \
+    .max_retries = 8, \
+    .retry_backoff_us = 250, \
+    .max_retry_backoff_us = 20000, \
+    .rate_limit_fps = 0, \
+    .rate_limit_burst = 8, \
+    .space_threshold = 8, \
+    .space_callback = NULL, \
+    .completion_callback = NULL, \
+    .callback_ctx = NULL, \
+    .task_priority = 5, \
+    .task_core = tskNO_AFFINITY, \
+    .task_stack_size = 3072 \
+}
+
+typedef struct {
+    uint32_t frames_queued;
+    uint32_t frames_rejected; // Sends that found the queue full
+    uint32_t frames_sent;
+    uint32_t frames_dropped_no_mem; // Frames still refused with ESP_ERR_NO_MEM after max_retries
+    uint32_t frames_failed; // Frames refused with any other error, which are not retried
+    esp_err_t last_error;
+    uint32_t retries;
+    uint32_t rate_limit_waits; // Frames the sender held back for a token
+    uint32_t space_notifications;
+    uint32_t queue_capacity;
+    uint32_t queue_occupancy; // Frames queued or being sent when the stats were read
+    uint32_t queue_high_water_mark;
+} tx_queue_stats_t;
+
+#define FORWARDING_MAX_ROUTES 16
+
+// What a forwarded frame's address 3 becomes, address 1 is always the next hop and address 2 this device
+enum forwarding_address_3 {
+    FORWARD_ADDRESS_3_KEEP,
+    FORWARD_ADDRESS_3_SOURCE, // The received address 2, so the next hop can tell who sent the frame, as station to station relays do
+    FORWARD_ADDRESS_3_DESTINATION // The route's destination
+};
+
+typedef struct {
+    uint8_t destination[6]; // Compared against the frame's match_address
+    uint8_t next_hop[6];
+    enum forwarding_address_3 address_3;
+    uint16_t frame_control_clear; // Frame control bits cleared, before frame_control_set is applied
+    uint16_t frame_control_set;
+    int32_t duration_id; // Written to the duration/ID field, -1 keeps the received value
+} forwarding_route_t;
+
+typedef struct {
+    enum frame_filter_field match_address; // FRAME_FILTER_ADDRESS_1 to _4, the address the routes are looked up by
+    bool only_to_this_device; // Only forward frames whose address 1 is this device's MAC
+    bool deliver_forwarded; // Also run the receive prints and callbacks on forwarded frames, which then see the rewritten header
+    bool keep_sequence_control; // Send the received sequence control instead of letting the driver number the frame
+} forwarding_config_t;
+
+#define FORWARDING_CONFIG_DEFAULT() { \
+    .match_address = FRAME_FILTER_ADDRESS_3, \
+    .only_to_this_device = true, \
+    .deliver_forwarded = false, \
+    .keep_sequence_control = false \
+}
+
+typedef struct {
+    uint32_t frames_forwarded;
+    uint32_t frames_no_route; // Frames for this device (when only_to_this_device is set) with no route for their match_address
+    uint32_t frames_truncated; // Cut short by the deferred RX slot size, never forwarded
+    uint32_t send_errors; // Frames esp_wifi_80211_tx refused
+    esp_err_t last_send_error;
+    uint32_t latency_average_us; // Running average time from the route lookup to esp_wifi_80211_tx returning
+    uint32_t latency_max_us;
+    int route_count;
+} forwarding_stats_t;
+
+typedef struct {
+    int capacity; // Stations the bridge table holds, rounded up to a power of two (at least 4)
+    uint32_t max_age_ms; // A station not heard from for this long is forgotten
+    bool flood_unknown; // Send frames for unknown stations to the broadcast address instead of dropping them
+    bool deliver_bridged; // Also run the receive prints and callbacks on frames passed on to another station, which then see the rewritten header
+} bridge_config_t;
+
+#define BRIDGE_CONFIG_DEFAULT() { \
+    .capacity = 256, \
+    .max_age_ms = 300000, \
+    .flood_unknown = true, \
+    .deliver_bridged = false \
+}
+
+typedef struct {
+    uint8_t mac[6]; // A station the bridge has heard frames from
+    uint8_t neighbor[6]; // The transmitter its frames came through, the station itself when it is in range
+    uint8_t channel;
+    uint32_t age_ms; // Since its last frame
+} bridge_entry_t;
+
+typedef struct {
+    uint32_t frames_bridged; // Sent on to the neighbor of a known station
+    uint32_t frames_flooded; // Sent to the broadcast address, for a group address or an unknown station
+    uint32_t frames_filtered; // Dropped since the destination is behind the neighbor the frame came from
+    uint32_t frames_looped; // Dropped since the source already sent a frame with the same sequence control recently, so it came round again
+    uint32_t frames_dropped_unknown; // Unknown stations with flood_unknown off
+    uint32_t stations_learned;
+    uint32_t stations_moved; // Heard through a different neighbor than before
+    uint32_t evictions; // Stations replaced before they aged out
+    uint32_t send_errors;
+} bridge_stats_t;
+
+#define FUZZER_MAX_SEEDS 16
+
+// Field aware mutators, combined as bits in fuzzer_config_t.mutators
+enum fuzz_mutator {
+    FUZZ_MUTATE_FRAME_CONTROL = 1 << 0, // Protocol version, type, subtype and flag bits
+    FUZZ_MUTATE_DURATION = 1 << 1,
+    FUZZ_MUTATE_ADDRESSES = 1 << 2, // Broadcast, zero, random, swapped, or the target's address in one of the address roles the header has
+    FUZZ_MUTATE_SEQUENCE = 1 << 3, // Sequence and fragment numbers, with the more fragments bit
+    FUZZ_MUTATE_LENGTH = 1 << 4, // Cuts the frame short (down to its header or into it) or pads it out
+    FUZZ_MUTATE_INFORMATION_ELEMENTS = 1 << 5, // Management frame IEs: wrong lengths, unexpected IDs, repeated, oversized and removed elements
+    FUZZ_MUTATE_PAYLOAD_BYTES = 1 << 6, // Bit flips and boundary values after the header
+    FUZZ_MUTATE_ALL = 0x7F
+};
+
+typedef struct {
+    uint64_t seed; // The same seed and corpus (added in the same order) give the same frame for a mutation ID
+    uint32_t first_mutation_id; // Mutation IDs count up from here, so a run can carry on where an earlier one stopped
+    uint32_t frame_count; // Frames to send before the fuzzer stops by itself, 0 runs until stop_fuzzer
+    uint32_t mutators; // enum fuzz_mutator bits
+    int max_mutations_per_frame; // Each frame gets 1 to this many mutations stacked
+    int max_frame_length; // Size of every pre-generated frame buffer, 24 to 1500 (what esp_wifi_80211_tx takes)
+    int batch_size; // Frames per batch, the generator task keeps a second batch ready while one is sent
+    uint32_t inter_frame_interval_us; // 0 sends as fast as the driver takes frames
+    uint8_t target[6]; // Device under test: its management frames are logged as responses and its silence as a possible crash. All 0 turns both off.
+    uint32_t silence_timeout_us; // Target silence that counts as a possible crash
+    int log_capacity; // Log entries, rounded up to a power of two
+    UBaseType_t task_priority; // Priority of the generator and sender tasks
+    BaseType_t generator_core;
+    BaseType_t sender_core;
+} fuzzer_config_t;
+
+#define FUZZER_CONFIG_DEFAULT() { \
+    .seed = 1, \
+    .first_mutation_id = 0, \
+    .frame_count = 0, \
+    .mutators = FUZZ_MUTATE_ALL, \
+    .max_mutations_per_frame = 3, \
+    .max_frame_length = 512, \
+    .batch_size = 32, \
+    .inter_frame_interval_us = 0, \
+    .target = { 0 }, \
+    .silence_timeout_us = 2000000, \
+    .log_capacity = 256, \
+    .task_priority = 5, \
+    .generator_core = tskNO_AFFINITY, \
+    .sender_core = tskNO_AFFINITY \
+}
+
+enum fuzzer_log_event { FUZZER_LOG_RESPONSE, FUZZER_LOG_TARGET_SILENT, FUZZER_LOG_TARGET_RECOVERED };
+
+// One fuzzer log entry, keyed by the last mutation that may have been sent before it, replay it with replay_fuzzer_mutation
+typedef struct {
+    uint32_t mutation_id;
+    uint32_t first_suspect_mutation_id; // Mutations from here to mutation_id are the suspects. TARGET_SILENT: sent after the target was last heard, RESPONSE and TARGET_RECOVERED: the last one of the previous batch and the batch on the air, since frames go to the driver a batch at a time
+    int64_t timestamp_us;
+    uint8_t event; // enum fuzzer_log_event
+    int8_t rssi; // RESPONSE
+    uint16_t frame_control; // RESPONSE: the frame the target sent
+} fuzzer_log_entry_t;
+
+typedef struct {
+    uint32_t mutations_generated;
+    uint32_t frames_sent;
+    uint32_t send_errors; // Frames the driver refused, which includes frame types esp_wifi_80211_tx does not allow
+    esp_err_t last_send_error;
+    uint32_t batches_sent;
+    uint32_t sender_waits; // Times the sender found the next batch not generated yet
+    uint32_t responses;
+    uint32_t silences;
+    uint32_t log_entries_lost;
+    uint32_t next_mutation_id;
+    bool running;
+} fuzzer_stats_t;
+
+enum frame_template_mode { FRAME_TEMPLATE_AP_TO_STATION, FRAME_TEMPLATE_STA_TO_ACCESS_POINT, FRAME_TEMPLATE_STA_THROUGH_ACCESS_POINT };
+
+#define FRAME_TEMPLATE_CACHE_SIZE 4 // Destinations the send_payload_* helpers keep prebuilt headers for
+
+typedef struct {
+    enum frame_template_mode mode;
+    uint8_t destination[6]; // Station (AP_TO_STATION) or final target (STA_THROUGH_ACCESS_POINT), unused for STA_TO_ACCESS_POINT
+    uint32_t configuration_generation; // configuration_generation the header was built from
+    wifi_mac_data_frame_t* buffer; // Reusable send buffer, header followed by up to payload_capacity bytes
+    int payload_capacity;
+    bool buffer_header_stale; // Set when a send callback may have changed the header inside the buffer
+    wifi_mac_data_frame_t header; // Serialized header for this mode and destination, last since its payload[] is a flexible array (C++ only allows that at the end)
+} frame_template_t;
+
+#define FRAME_POOL_MAX_SIZE_CLASSES 4
+
+typedef struct {
+    int frame_size; // Bytes per frame in this class, header included. Classes must be listed smallest first.
+    int frame_count; // Number of frames preallocated for this class, 0 leaves the class unused
+} frame_pool_size_class_t;
+
+typedef struct {
+    frame_pool_size_class_t size_classes[FRAME_POOL_MAX_SIZE_CLASSES];
+} frame_pool_config_t;
+
+#define FRAME_POOL_CONFIG_DEFAULT() { .size_classes = { \
+    { .frame_size = 128, .frame_count = 16 }, \
+    { .frame_size = 512, .frame_count = 8 }, \
+    { .frame_size = 1024, .frame_count = 4 }, \
+    { .frame_size = PACKET_LIBRARY_MAX_FRAME_LENGTH, .frame_count = 2 } \
+} }
+
+typedef struct {
+    int frame_size;
+    int frame_count;
+    uint32_t in_use; // Frames currently acquired from this class
+    uint32_t in_use_high_water_mark; // Most frames ever acquired from this class at once
+    uint32_t acquired; // Total successful acquires
+    uint32_t exhausted; // Acquires that found the class empty and moved on to a larger class or the heap
+} frame_pool_class_stats_t;
+
+typedef struct {
+    int size_class_count;
+    frame_pool_class_stats_t size_classes[FRAME_POOL_MAX_SIZE_CLASSES];
+    uint32_t heap_fallbacks; // Pooled allocations that had to use calloc because no class could serve them
+} frame_pool_stats_t;
 
 // Setup/Configuration Functions
 esp_err_t setup_wifi_station_simple(); // LOC: 11
@@ -81,14 +793,81 @@ esp_err_t setup_sta_and_promiscuous_simple_with_promisc_general_callback(packet_
 esp_err_t setup_wpa_ap(wifi_ap_config_t ap_configuration); // LOC: 6
 esp_err_t setup_wpa_sta(wifi_sta_config_t station_connection_configuration); // LOC: 15
 
+// Deferred Receive Functions
+esp_err_t setup_promiscuous_deferred(deferred_rx_config_t config); // Runs the receive callbacks on a worker task instead of the WiFi driver task
+esp_err_t disable_promiscuous_deferred(); // Goes back to running the receive callbacks in the WiFi driver task
+esp_err_t get_deferred_rx_stats(deferred_rx_stats_t* stats_holder);
+esp_err_t reset_deferred_rx_stats();
+
+// Traffic Counter Functions (always on, counted per core)
+esp_err_t packet_library_get_stats(packet_library_stats_t* stats_holder);
+
+// Profiling Functions (per stage latency histograms, ESP_ERR_NOT_SUPPORTED unless PACKET_LIBRARY_PROFILING is 1)
+esp_err_t get_profile_histogram(enum packet_library_profile_stage stage, profile_histogram_t* histogram_holder);
+esp_err_t reset_profile_histograms();
+esp_err_t log_profile_histograms(const char * TAG); // Every stage with samples: count, average, max and percentiles, then its non-empty buckets
+
+// Frame Filter Functions (checked on every received frame before the deferred RX ring, capture, prints, and callbacks; with none added every frame passes)
+esp_err_t add_frame_filter(const frame_filter_term_t terms[], int term_count, frame_filter_id_t* filter_id_holder); // filter_id_holder may be NULL
+esp_err_t remove_frame_filter(frame_filter_id_t filter_id);
+esp_err_t get_frame_filter_stats(frame_filter_stats_t* stats_holder);
+esp_err_t reset_frame_filter_stats();
+
+// Channel Hopper Functions (cycles the promiscuous radio over a set of channels, dwelling longer where there is more to hear)
+esp_err_t setup_channel_hopper(channel_hopper_config_t config);
+esp_err_t stop_channel_hopper();
+esp_err_t get_channel_hopper_stats(channel_hopper_stats_t* stats_holder);
+
+// Duplicate Detection Functions (retry/duplicate suppression from the sequence control field)
+esp_err_t setup_duplicate_detection(duplicate_detection_config_t config);
+esp_err_t stop_duplicate_detection();
+esp_err_t get_duplicate_detection_stats(duplicate_detection_stats_t* stats_holder);
+esp_err_t reset_duplicate_detection_stats();
+
+// Station Table Functions (fed from the receive path, read without holding it up)
+esp_err_t setup_station_table(station_table_config_t config);
+esp_err_t stop_station_table();
+esp_err_t get_station_entry(const uint8_t mac[6], station_table_entry_t* entry_holder);
+int read_station_table(station_table_entry_t entry_holder[], int max_entries, int* cursor); // Start with *cursor = 0, returns 0 once every entry has been read
+esp_err_t get_station_table_stats(station_table_stats_t* stats_holder);
+
 // Send Full Control
 esp_err_t send_packet_raw_no_callback(const void* buffer, int length, bool en_sys_seq); // Note, doesn't do any callback manipulation // LOC: 1
 esp_err_t send_packet_simple(wifi_mac_data_frame_t* packet, int payload_length); // LOC: 12
+esp_err_t send_packet_batch(wifi_mac_data_frame_t* packets[], int payload_lengths[], int packet_count, send_batch_pacing_t pacing, esp_err_t results_holder[]); // results_holder may be NULL
 esp_err_t send_payload_ap_to_station(uint8_t payload[], int payload_length, uint8_t station_addr[6]); // LOC: 27
 esp_err_t send_payload_ap_broadcast(uint8_t payload[], int payload_length); // Do a broadcast // LOC: 28
 esp_err_t send_payload_sta_to_access_point(uint8_t payload[], int payload_length); // LOC: 27
 esp_err_t send_payload_sta_through_access_point(uint8_t payload[], int payload_length, uint8_t target_mac[6]); // LOC: 27
 
+// Frame Template Functions (a prebuilt header and send buffer for repeated sends to one destination, see frame_template_t)
+esp_err_t setup_frame_template(frame_template_t* frame_template, enum frame_template_mode mode, uint8_t destination[6], int payload_capacity); // destination may be NULL for STA_TO_ACCESS_POINT
+esp_err_t send_payload_with_template(frame_template_t* frame_template, uint8_t payload[], int payload_length); // ESP_ERR_INVALID_SIZE past payload_capacity
+esp_err_t free_frame_template(frame_template_t* frame_template);
+
+// TX Queue Functions (frames are copied into a bounded queue and sent by a task that retries when the driver is out of buffers)
+esp_err_t setup_tx_queue(tx_queue_config_t config);
+esp_err_t stop_tx_queue(); // Frames still queued are discarded without a completion callback
+esp_err_t tx_queue_send(const void* frame, int length, bool en_sys_seq, uint32_t* frame_id_holder); // ESP_ERR_NO_MEM when the queue is full, frame_id_holder may be NULL
+esp_err_t tx_queue_send_packet(wifi_mac_data_frame_t* packet, int payload_length, uint32_t* frame_id_holder); // Runs the send callbacks on the packet before queueing it, like send_packet_simple
+esp_err_t get_tx_frame_status(uint32_t frame_id, enum tx_frame_status* status_holder, esp_err_t* result_holder); // ESP_ERR_NOT_FOUND once the frame is older than status_history, result_holder may be NULL
+esp_err_t get_tx_queue_stats(tx_queue_stats_t* stats_holder);
+
+// Forwarding Functions (rewrites the headers of received frames in place and sends them on, without copying the payload)
+esp_err_t setup_forwarding(forwarding_config_t config);
+esp_err_t stop_forwarding(); // Keeps the routes
+esp_err_t add_forwarding_route(const forwarding_route_t* route); // Replaces the route of the same destination
+esp_err_t remove_forwarding_route(const uint8_t destination[6]);
+esp_err_t get_forwarding_stats(forwarding_stats_t* stats_holder);
+esp_err_t reset_forwarding_stats();
+
+// Bridge Functions (learns which neighbor each station is behind from 4 address data frames and passes frames on, flooding for unknown stations)
+esp_err_t setup_bridge(bridge_config_t config);
+esp_err_t stop_bridge();
+esp_err_t bridge_send_packet(wifi_mac_data_frame_t* packet, int payload_length, const uint8_t destination[6]); // Fills in the 4 address header and sends through send_packet_simple
+esp_err_t get_bridge_entry(const uint8_t mac[6], bridge_entry_t* entry_holder); // ESP_ERR_NOT_FOUND for stations not heard from or aged out
+esp_err_t get_bridge_stats(bridge_stats_t* stats_holder);
+
 // Individual Field Receive/Send Callback
 esp_err_t set_receive_callback_general(packet_library_simple_callback_t simple_callback);
 esp_err_t set_receive_callback_frame_control(packet_library_frame_control_callback_t simple_callback);
@@ -112,6 +891,13 @@ esp_err_t remove_receive_callback_address_4();
 esp_err_t remove_receive_callback_sequence_control();
 esp_err_t remove_receive_callback_payload();
 
+// Receive Callback Subscriber Functions (several callbacks per field, each with a context pointer, run after the set_receive_callback_* one)
+esp_err_t add_receive_callback_general(packet_library_general_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder); // subscription_holder may be NULL
+esp_err_t add_receive_callback_u16_field(enum packet_library_callback_field field, packet_library_u16_field_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder);
+esp_err_t add_receive_callback_address(enum packet_library_callback_field field, packet_library_address_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder);
+esp_err_t add_receive_callback_payload(packet_library_payload_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder);
+esp_err_t remove_receive_callback_subscription(callback_subscription_t subscription); // Returns once no other task is still running the callback, so ctx may be freed then. ESP_ERR_INVALID_STATE (nothing removed) only when called from callbacks nested in each other
+
 
 esp_err_t set_send_callback_general(packet_library_simple_callback_t simple_callback);
 esp_err_t set_send_callback_frame_control(packet_library_frame_control_callback_t simple_callback);
@@ -135,9 +921,19 @@ esp_err_t remove_send_callback_address_4();
 esp_err_t remove_send_callback_sequence_control();
 esp_err_t remove_send_callback_payload();
 
+// Send Callback Subscriber Functions (several callbacks per field, each with a context pointer, run after the set_send_callback_* one)
+esp_err_t add_send_callback_general(packet_library_general_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder);
+esp_err_t add_send_callback_u16_field(enum packet_library_callback_field field, packet_library_u16_field_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder);
+esp_err_t add_send_callback_address(enum packet_library_callback_field field, packet_library_address_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder);
+esp_err_t add_send_callback_payload(packet_library_payload_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder);
+esp_err_t remove_send_callback_subscription(callback_subscription_t subscription); // Same as remove_receive_callback_subscription
+
 // General Helper Functions
 esp_err_t log_packet_annotated(wifi_mac_data_frame_t* packet, int payload_length, const char * TAG); // LOC: 15
 esp_err_t log_packet_hex(wifi_mac_data_frame_t* packet, int payload_length, const char * TAG);
+int format_payload_hex(const uint8_t* bytes, int length, char* output_buffer, int output_buffer_size); // Returns characters written, never allocates
+esp_err_t set_log_payload_max_length(int max_length);
+int get_log_payload_max_length();
 wifi_mac_data_frame_t* alloc_packet_custom(uint16_t frame_control, uint16_t duration_id, uint8_t address_1[6], uint8_t address_2[6], uint8_t address_3[6], uint16_t sequence_control, uint8_t address_4[6], int payload_length, uint8_t* payload); // LOC: 10
 wifi_mac_data_frame_t* alloc_packet_default_payload(int payload_length, uint8_t *payload);
 wifi_mac_data_frame_t* alloc_packet_default(int payload_length);
@@ -145,4 +941,62 @@ esp_err_t get_current_mac(uint8_t mac_output_holder[6]);
 esp_err_t get_current_ap_mac(uint8_t mac_output_holder[6]);  
 esp_err_t get_current_ap_connected_sta_macs(uint8_t station_macs_holder[10][6], int* number_valid_stations_holder); // LOC: 15
 
+// Fuzzer Functions (sends mutated copies of a seed corpus, see fuzzer_config_t)
+esp_err_t setup_fuzzer(fuzzer_config_t config);
+esp_err_t add_fuzzer_seed(const uint8_t* frame, int frame_length); // Raw 802.11 frame without the FCS, copied
+esp_err_t start_fuzzer();
+esp_err_t stop_fuzzer(); // Keeps the corpus and log, start_fuzzer carries on with the next mutation ID
+esp_err_t disable_fuzzer(); // Frees the corpus, batches and log
+esp_err_t generate_fuzzer_mutation(uint32_t mutation_id, uint8_t frame_holder[], int* frame_length_holder); // frame_holder needs max_frame_length bytes
+esp_err_t replay_fuzzer_mutation(uint32_t mutation_id);
+int read_fuzzer_log(fuzzer_log_entry_t entry_holder[], int max_entries); // Returns the number of entries copied out, oldest first
+esp_err_t get_fuzzer_stats(fuzzer_stats_t* stats_holder);
+
+// Frame View Functions
+esp_err_t parse_frame_view(uint8_t* frame, int frame_length, bool has_fcs, wifi_frame_view_t* view_holder); // ESP_ERR_INVALID_SIZE if the frame is shorter than its header
+
+// Binary Log Functions
+esp_err_t setup_binary_log(int record_slots); // Rounded up to a power of two
+int read_binary_log_records(binary_log_record_t record_holder[], int max_records); // Returns the number of records copied out, oldest first
+esp_err_t start_binary_log_printer(UBaseType_t task_priority, BaseType_t task_core); // Low priority task that prints the records with ESP_LOGI
+esp_err_t log_binary_record(const binary_log_record_t* record, const char * TAG);
+esp_err_t get_binary_log_stats(binary_log_stats_t* stats_holder);
+
+// Capture Functions (pcap with radiotap headers, readable by Wireshark, or the same records compressed)
+esp_err_t setup_capture_sink(capture_sink_config_t config); // Writes the pcap (or compressed capture) header, then every received frame until stop_capture_sink
+esp_err_t stop_capture_sink(); // Writes out the partly filled block (and the compressed capture index) and stops the capture task
+esp_err_t get_capture_stats(capture_stats_t* stats_holder);
+esp_err_t capture_output_file(void* context, const uint8_t* data, size_t length); // context is a FILE* (regular file, VFS path, or /dev/uart/N)
+esp_err_t setup_capture_memory_ring(capture_memory_ring_t* ring, size_t size);
+esp_err_t capture_output_memory_ring(void* context, const uint8_t* data, size_t length); // context is a capture_memory_ring_t*
+size_t read_capture_memory_ring(capture_memory_ring_t* ring, uint8_t* output_buffer, size_t max_length);
+
+// Compressed Capture Functions (the CAPTURE_FORMAT_COMPRESSED blocks, also used on the host to read and write them)
+esp_err_t compress_capture_block(const uint8_t* records, size_t records_length, uint32_t linktype, uint32_t block_number, uint8_t* workspace, uint8_t* output, size_t* output_length_holder); // 'output' holds sizeof(compressed_capture_block_header_t) + records_length
+esp_err_t decompress_capture_block(const compressed_capture_block_header_t* header, const uint8_t* data, uint32_t linktype, uint8_t* workspace, uint8_t* output, size_t output_size); // ESP_ERR_INVALID_RESPONSE if the block is corrupt
+bool compressed_capture_may_contain_address(const uint8_t address_filter[COMPRESSED_CAPTURE_ADDRESS_FILTER_BYTES], const uint8_t address[6]); // False only if the address is not there
+esp_err_t setup_compressed_capture_index(compressed_capture_index_t* index, uint32_t capacity);
+esp_err_t add_compressed_capture_index_block(compressed_capture_index_t* index, const compressed_capture_block_header_t* header, uint64_t offset);
+esp_err_t write_compressed_capture_index(const compressed_capture_index_t* index, uint64_t index_offset, capture_output_write_t write, void* context); // Entries and trailer, 'index_offset' is where they start in the output
+void free_compressed_capture_index(compressed_capture_index_t* index);
+
+// Event Trace Functions (fixed size events in an overwrite ring per core, host/trace/trace_export turns a written trace into Chrome trace JSON)
+esp_err_t setup_event_trace(int events_per_core); // Rounded up to a power of two, the newest events of each core are kept
+esp_err_t stop_event_trace();
+int read_event_trace(event_trace_event_t events_holder[], int max_events); // The newest 'max_events' events of all cores in timestamp order, returns how many were copied
+esp_err_t write_event_trace(capture_output_write_t write, void* context); // Header and read_event_trace events, e.g. to capture_output_file
+uint32_t get_event_trace_frame_id(const uint8_t* frame, int frame_length);
+
+// Pooled Packet Functions
+esp_err_t setup_frame_pool(frame_pool_config_t config);
+esp_err_t get_frame_pool_stats(frame_pool_stats_t* stats_holder);
+wifi_mac_data_frame_t* alloc_packet_custom_pooled(uint16_t frame_control, uint16_t duration_id, uint8_t address_1[6], uint8_t address_2[6], uint8_t address_3[6], uint16_t sequence_control, uint8_t address_4[6], int payload_length, uint8_t* payload);
+wifi_mac_data_frame_t* alloc_packet_default_payload_pooled(int payload_length, uint8_t *payload);
+wifi_mac_data_frame_t* alloc_packet_default_pooled(int payload_length);
+esp_err_t free_packet_pooled(wifi_mac_data_frame_t* packet); // Works for any packet from the alloc_packet_*_pooled methods, including heap fallbacks
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
\ No newline at end of file
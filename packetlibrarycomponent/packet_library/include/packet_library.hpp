@@ -0,0 +1,400 @@
+#ifndef PACKET_LIBRARY_HPP
+#define PACKET_LIBRARY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <utility>
+#include "packet_library.h"
+
+/*
+    C++ interface over packet_library.h (C++17, header only, nothing to build).
+    - Frame control values and headers are built by constexpr functions instead of writing 0x0208/0x0108 by hand.
+    - stack_frame<N> is a wifi_mac_data_frame_t with room for N payload bytes on the stack (or in a static), in place of the
+      heap frame alloc_packet_custom returns. It goes to send_packet_simple as is.
+    - callback_set takes any number of functors and registers one context callback whose body calls all of them, so the
+      compiler inlines them into a single function instead of the dispatch table calling each through a function pointer.
+    Frames keep the component's fixed 30 byte wifi_mac_data_frame_t header: as with the C API, the address_4 bytes go out at the
+    start of the body of a frame that is not 4 address.
+*/
+
+namespace packet_library
+{
+
+// Frame control
+enum class frame_type : uint8_t { management = 0, control = 1, data = 2, extension = 3 };
+
+// The ToDS/FromDS bits of the frame control field, which decide what the addresses mean
+enum class ds_direction : uint16_t { none = 0x0000, to_ds = 0x0100, from_ds = 0x0200, wds = 0x0300 };
+
+namespace frame_control_flag
+{
+constexpr uint16_t more_fragments = 0x0400;
+constexpr uint16_t retry = 0x0800;
+constexpr uint16_t power_management = 0x1000;
+constexpr uint16_t more_data = 0x2000;
+constexpr uint16_t protected_frame = 0x4000;
+constexpr uint16_t order = 0x8000;
+}
+
+namespace data_subtype
+{
+constexpr uint8_t data = 0;
+constexpr uint8_t null = 4;
+constexpr uint8_t qos_data = 8;
+constexpr uint8_t qos_null = 12;
+}
+
+namespace management_subtype
+{
+constexpr uint8_t association_request = 0;
+constexpr uint8_t association_response = 1;
+constexpr uint8_t reassociation_request = 2;
+constexpr uint8_t reassociation_response = 3;
+constexpr uint8_t probe_request = 4;
+constexpr uint8_t probe_response = 5;
+constexpr uint8_t beacon = 8;
+constexpr uint8_t disassociation = 10;
+constexpr uint8_t authentication = 11;
+constexpr uint8_t deauthentication = 12;
+constexpr uint8_t action = 13;
+}
+
+// Frame control as the uint16_t in wifi_mac_data_frame_t: protocol version 0, type and subtype in the low byte, the flags above it
+constexpr uint16_t make_frame_control(frame_type type, uint8_t subtype, ds_direction direction = ds_direction::none, uint16_t flags = 0)
+{
+    return static_cast<uint16_t>((static_cast<uint16_t>(type) << 2) | ((subtype & 0x0F) << 4) | static_cast<uint16_t>(direction) | flags);
+}
+
+namespace frame_control
+{
+constexpr uint16_t data = make_frame_control(frame_type::data, data_subtype::data);
+constexpr uint16_t data_to_ds = make_frame_control(frame_type::data, data_subtype::data, ds_direction::to_ds);
+constexpr uint16_t data_from_ds = make_frame_control(frame_type::data, data_subtype::data, ds_direction::from_ds);
+constexpr uint16_t data_wds = make_frame_control(frame_type::data, data_subtype::data, ds_direction::wds);
+constexpr uint16_t qos_data(ds_direction direction) { return make_frame_control(frame_type::data, data_subtype::qos_data, direction); }
+constexpr uint16_t management(uint8_t subtype) { return make_frame_control(frame_type::management, subtype); }
+}
+
+// The values the C helpers write by hand
+static_assert(frame_control::data_to_ds == 0x0108, "STA to AP data frame control");
+static_assert(frame_control::data_from_ds == 0x0208, "AP to STA data frame control");
+static_assert(frame_control::data_wds == 0x0308, "4 address data frame control");
+
+// Headers
+struct mac_address
+{
+    uint8_t octets[6];
+
+    constexpr bool is_group() const { return (octets[0] & 0x01) != 0; }
+    constexpr bool operator==(const mac_address& other) const
+    {
+        for(int i = 0; i < 6; i++)
+        {
+            if(octets[i] != other.octets[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    constexpr bool operator!=(const mac_address& other) const { return !(*this == other); }
+    static mac_address from(const uint8_t address[6])
+    {
+        mac_address result{};
+        std::memcpy(result.octets, address, 6);
+        return result;
+    }
+};
+
+constexpr mac_address broadcast_address{ { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF } };
+
+// The header fields of a wifi_mac_data_frame_t, plus the QoS control of QoS data frames
+struct frame_header
+{
+    uint16_t frame_control = 0;
+    uint16_t duration_id = 0;
+    mac_address address_1{};
+    mac_address address_2{};
+    mac_address address_3{};
+    uint16_t sequence_control = 0; // Overwritten by the driver unless sent with en_sys_seq false
+    mac_address address_4{};
+    bool has_qos_control = false;
+    uint16_t qos_control = 0;
+
+    constexpr ds_direction direction() const { return static_cast<ds_direction>(frame_control & 0x0300); }
+    // Bytes the header puts ahead of the payload inside wifi_mac_data_frame_t::payload: a 4 address QoS frame's QoS control.
+    // 3 address QoS frames carry it in the first 2 address_4 bytes, where it sits on air.
+    constexpr std::size_t payload_offset() const { return has_qos_control && direction() == ds_direction::wds ? 2 : 0; }
+
+    // Serializes into the first sizeof(wifi_mac_data_frame_t) + payload_offset() bytes of 'frame', little endian as on air
+    constexpr void write_to(uint8_t* frame) const
+    {
+        frame[0] = static_cast<uint8_t>(frame_control);
+        frame[1] = static_cast<uint8_t>(frame_control >> 8);
+        frame[2] = static_cast<uint8_t>(duration_id);
+        frame[3] = static_cast<uint8_t>(duration_id >> 8);
+        for(int i = 0; i < 6; i++)
+        {
+            frame[4 + i] = address_1.octets[i];
+            frame[10 + i] = address_2.octets[i];
+            frame[16 + i] = address_3.octets[i];
+            frame[24 + i] = address_4.octets[i];
+        }
+        frame[22] = static_cast<uint8_t>(sequence_control);
+        frame[23] = static_cast<uint8_t>(sequence_control >> 8);
+        if(has_qos_control)
+        {
+            std::size_t qos_offset = direction() == ds_direction::wds ? 30 : 24;
+            frame[qos_offset] = static_cast<uint8_t>(qos_control);
+            frame[qos_offset + 1] = static_cast<uint8_t>(qos_control >> 8);
+        }
+    }
+};
+
+// Data frame between stations of an IBSS or a monitor setup (ToDS 0, FromDS 0): address 1 destination, 2 source, 3 BSSID
+constexpr frame_header data_header(mac_address destination, mac_address source, mac_address bssid, uint16_t duration_id = 0xFA)
+{
+    frame_header header{};
+    header.frame_control = frame_control::data;
+    header.duration_id = duration_id;
+    header.address_1 = destination;
+    header.address_2 = source;
+    header.address_3 = bssid;
+    return header;
+}
+
+// Station to access point (ToDS 1): address 1 BSSID, 2 source, 3 final destination
+constexpr frame_header data_to_ds_header(mac_address bssid, mac_address source, mac_address destination, uint16_t duration_id = 0xFA)
+{
+    frame_header header = data_header(bssid, source, destination, duration_id);
+    header.frame_control = frame_control::data_to_ds;
+    return header;
+}
+
+// Access point to station (FromDS 1): address 1 destination, 2 BSSID, 3 original source
+constexpr frame_header data_from_ds_header(mac_address destination, mac_address bssid, mac_address source, uint16_t duration_id = 0xFA)
+{
+    frame_header header = data_header(destination, bssid, source, duration_id);
+    header.frame_control = frame_control::data_from_ds;
+    return header;
+}
+
+// 4 address relay frame (ToDS 1, FromDS 1): receiver, transmitter, final destination, original source
+constexpr frame_header data_wds_header(mac_address receiver, mac_address transmitter, mac_address destination, mac_address source, uint16_t duration_id = 0xFA)
+{
+    frame_header header = data_header(receiver, transmitter, destination, duration_id);
+    header.frame_control = frame_control::data_wds;
+    header.address_4 = source;
+    return header;
+}
+
+// Turns a data header into the QoS data frame of traffic identifier 'tid' (0 to 7), keeping its addresses
+constexpr frame_header with_qos(frame_header header, uint8_t tid, bool no_ack = false)
+{
+    header.frame_control = static_cast<uint16_t>((header.frame_control & ~0x00F0) | (data_subtype::qos_data << 4));
+    header.has_qos_control = true;
+    header.qos_control = static_cast<uint16_t>((tid & 0x0F) | (no_ack ? 0x0020 : 0));
+    return header;
+}
+
+// Management frame (beacon, probe, action...): address 1 destination, 2 source, 3 BSSID. The fixed fields and elements go in the payload.
+constexpr frame_header management_header(uint8_t subtype, mac_address destination, mac_address source, mac_address bssid, uint16_t duration_id = 0)
+{
+    frame_header header = data_header(destination, source, bssid, duration_id);
+    header.frame_control = frame_control::management(subtype);
+    return header;
+}
+
+// Frames
+template <std::size_t PayloadCapacity>
+class stack_frame
+{
+    static_assert(PayloadCapacity <= PACKET_LIBRARY_MAX_PAYLOAD_LENGTH, "payload larger than an 802.11 MSDU");
+
+public:
+    static constexpr std::size_t payload_capacity = PayloadCapacity;
+
+    // Only the header bytes are written, the payload is left as it is so a frame costs nothing to make until it is filled
+    stack_frame() : payload_offset_(0)
+    {
+        std::memset(bytes_, 0, sizeof(wifi_mac_data_frame_t) + 2);
+    }
+    explicit stack_frame(const frame_header& header) : payload_offset_(header.payload_offset())
+    {
+        header.write_to(bytes_);
+    }
+
+    // Writes a new header, the payload bytes stay
+    void set_header(const frame_header& header)
+    {
+        header.write_to(bytes_);
+        payload_offset_ = header.payload_offset();
+    }
+
+    wifi_mac_data_frame_t* packet() { return reinterpret_cast<wifi_mac_data_frame_t*>(bytes_); }
+    const wifi_mac_data_frame_t* packet() const { return reinterpret_cast<const wifi_mac_data_frame_t*>(bytes_); }
+    uint8_t* payload() { return &bytes_[sizeof(wifi_mac_data_frame_t) + payload_offset_]; }
+
+    // Through send_packet_simple, so the send callbacks and prints run as for any other packet
+    esp_err_t send(int payload_length)
+    {
+        if(payload_length < 0 || static_cast<std::size_t>(payload_length) > PayloadCapacity)
+        {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        return send_packet_simple(packet(), static_cast<int>(payload_offset_) + payload_length);
+    }
+
+    esp_err_t send(const uint8_t* payload_bytes, int payload_length)
+    {
+        if(payload_length < 0 || static_cast<std::size_t>(payload_length) > PayloadCapacity)
+        {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        std::memcpy(payload(), payload_bytes, payload_length);
+        return send(payload_length);
+    }
+
+    // Straight to esp_wifi_80211_tx without the callbacks, 'en_sys_seq' false keeps the header's sequence control
+    esp_err_t send_raw(int payload_length, bool en_sys_seq = true)
+    {
+        if(payload_length < 0 || static_cast<std::size_t>(payload_length) > PayloadCapacity)
+        {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        return send_packet_raw_no_callback(bytes_, static_cast<int>(sizeof(wifi_mac_data_frame_t) + payload_offset_) + payload_length, en_sys_seq);
+    }
+
+private:
+    alignas(wifi_mac_data_frame_t) uint8_t bytes_[sizeof(wifi_mac_data_frame_t) + 2 + PayloadCapacity]; // 2 for a 4 address QoS control
+    std::size_t payload_offset_;
+};
+
+// Callbacks
+// Field handlers run only when the frame's header has the field, as the C context callbacks do
+template <int Offset, std::size_t Size>
+constexpr bool frame_has_field(const wifi_frame_view_t& view)
+{
+    int available = view.header_length < view.frame_length ? view.header_length : view.frame_length;
+    return Offset + static_cast<int>(Size) <= available;
+}
+
+template <typename Function>
+struct frame_control_handler
+{
+    Function function; // void(uint16_t& frame_control, const wifi_frame_view_t& view)
+    void operator()(const wifi_frame_view_t& view)
+    {
+        if(frame_has_field<offsetof(wifi_mac_data_frame_t, frame_control), sizeof(uint16_t)>(view))
+        {
+            function(reinterpret_cast<wifi_mac_data_frame_t*>(view.frame)->frame_control, view);
+        }
+    }
+};
+
+template <typename Function>
+struct sequence_control_handler
+{
+    Function function; // void(uint16_t& sequence_control, const wifi_frame_view_t& view)
+    void operator()(const wifi_frame_view_t& view)
+    {
+        if(frame_has_field<offsetof(wifi_mac_data_frame_t, sequence_control), sizeof(uint16_t)>(view))
+        {
+            function(reinterpret_cast<wifi_mac_data_frame_t*>(view.frame)->sequence_control, view);
+        }
+    }
+};
+
+// Address is 1 to 4
+template <int Address, typename Function>
+struct address_handler
+{
+    static_assert(Address >= 1 && Address <= 4, "802.11 headers have addresses 1 to 4");
+    static constexpr int offset = Address == 4 ? 24 : 4 + 6 * (Address - 1);
+    Function function; // void(uint8_t* address, const wifi_frame_view_t& view)
+    void operator()(const wifi_frame_view_t& view)
+    {
+        if(frame_has_field<offset, 6>(view))
+        {
+            function(view.frame + offset, view);
+        }
+    }
+};
+
+template <typename Function>
+struct payload_handler
+{
+    Function function; // void(uint8_t* payload, int payload_length, const wifi_frame_view_t& view), the frame body after the real header
+    void operator()(const wifi_frame_view_t& view) { function(view.payload, view.payload_length, view); }
+};
+
+template <typename Function> frame_control_handler<Function> on_frame_control(Function function) { return { std::move(function) }; }
+template <typename Function> sequence_control_handler<Function> on_sequence_control(Function function) { return { std::move(function) }; }
+template <int Address, typename Function> address_handler<Address, Function> on_address(Function function) { return { std::move(function) }; }
+template <typename Function> payload_handler<Function> on_payload(Function function) { return { std::move(function) }; }
+
+/*
+    Any number of handlers, each called with the frame view (const wifi_frame_view_t&), run in order by one registered callback.
+    Plain lambdas run on every frame; wrap them with on_frame_control, on_address<N>, on_sequence_control or on_payload to get
+    that field instead. The set is registered by address, so it cannot be copied or moved and must outlive its subscription.
+    unsubscribe() and the destructor return once no other task is still running the handlers, so the set can go out of scope
+    while frames keep arriving. Handlers running in the calling task are not waited for, so a set must not be destroyed from
+    inside one of its own handlers.
+*/
+template <typename... Handlers>
+class callback_set
+{
+public:
+    explicit callback_set(Handlers... handlers) : handlers_(std::move(handlers)...) {}
+    callback_set(const callback_set&) = delete;
+    callback_set& operator=(const callback_set&) = delete;
+    ~callback_set() { unsubscribe(); }
+
+    esp_err_t subscribe_receive() { return subscribe(CALLBACK_DIRECTION_RECEIVE_SET); }
+    esp_err_t subscribe_send() { return subscribe(CALLBACK_DIRECTION_SEND_SET); }
+
+    esp_err_t unsubscribe()
+    {
+        if(subscription_ == 0)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+        esp_err_t status = direction_ == CALLBACK_DIRECTION_RECEIVE_SET ? remove_receive_callback_subscription(subscription_) : remove_send_callback_subscription(subscription_);
+        // With ESP_ERR_INVALID_STATE nothing was removed (see remove_receive_callback_subscription), so it is kept to be removed again
+        if(status != ESP_ERR_INVALID_STATE)
+        {
+            subscription_ = 0;
+        }
+        return status;
+    }
+
+    // The registered callback, callable directly to run the handlers on a view
+    static void dispatch(const wifi_frame_view_t* view, void* ctx)
+    {
+        callback_set* self = static_cast<callback_set*>(ctx);
+        std::apply([view](Handlers&... handlers) { (handlers(*view), ...); }, self->handlers_);
+    }
+
+private:
+    enum direction { CALLBACK_DIRECTION_RECEIVE_SET, CALLBACK_DIRECTION_SEND_SET };
+
+    esp_err_t subscribe(direction subscribe_direction)
+    {
+        if(subscription_ != 0)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+        direction_ = subscribe_direction;
+        return subscribe_direction == CALLBACK_DIRECTION_RECEIVE_SET ? add_receive_callback_general(&dispatch, this, &subscription_) : add_send_callback_general(&dispatch, this, &subscription_);
+    }
+
+    std::tuple<Handlers...> handlers_;
+    callback_subscription_t subscription_ = 0;
+    direction direction_ = CALLBACK_DIRECTION_RECEIVE_SET;
+};
+
+}
+
+#endif
@@ -1,86 +1,166 @@
 #include "packet_library.h"
+#include "packet_library_internal.h"
+#include <esp_timer.h>
 
 // Private helper static types
-static callback_setup_t promisc_callback_setup; // This type manages the callback pointers for the general and individual callbacks along with other helper values that only the component needs to worry about.
-static callback_setup_t send_callback_setup; // This type manages the callback pointers for the general and individual callbacks along with other helper values that only the component needs to worry about.
+// The print options for one direction, the callbacks themselves are kept in the dispatch tables (packet_library_callback_dispatch.c)
+typedef struct {
+    enum callback_print_option precallback_print;
+    enum callback_print_option postcallback_print;
+} callback_setup_t;
+
+static callback_setup_t promisc_callback_setup; // Print options for received packets
+static callback_setup_t send_callback_setup; // Print options for sent packets
 static configuration_settings_t configuration_holder; // This is a general configuration holder that handles information like what wifi interface is being used, the devices MAC, and whether the device is connected to an AP.
 
-/* 
-    This is the callback the component uses to provide general and field specific callbacks to the code using it.
-    It is the callback that is passed to the underlying ESP-IDF API for received packet callback.
-    The general flow is to get the packet data we need for the component provided callbacks, running the general
-    callback, and running the individual field callbacks.
-*/
-static void promisc_simple_callback(void *buf, wifi_promiscuous_pkt_type_t type)
+// Gives the other component source files read access to the configuration holder
+const configuration_settings_t *get_configuration_holder()
 {
-    const wifi_promiscuous_pkt_t *pkt = (wifi_promiscuous_pkt_t *)buf;
-    int payload_length = pkt->rx_ctrl.sig_len - sizeof(wifi_promiscuous_pkt_t);
-    wifi_mac_data_frame_t *frame = (wifi_mac_data_frame_t *)pkt->payload;
+    return &configuration_holder;
+}
 
-    if(promisc_callback_setup.precallback_print != DISABLE)
+/*
+    This runs the pre-callback print, the general callback, the individual field callbacks and the post-callback print for a received packet.
+    It is shared by the inline promiscuous callback below and the deferred RX worker task (packet_library_deferred_rx.c), so both modes behave the same for the code using the component.
+    'rx_ctrl' is the driver metadata for the frame and 'frame_length' the number of frame bytes available at 'frame', which is rx_ctrl->sig_len (FCS included) unless the frame was cut short.
+*/
+void promisc_run_callbacks(const wifi_pkt_rx_ctrl_t *rx_ctrl, uint8_t *frame_bytes, int frame_length)
+{
+    // Capture the frame as received, before any callback gets to change it
+    if(atomic_load_explicit(&capture_sink_active, memory_order_relaxed))
     {
-        ESP_LOGI(LOGGING_TAG, "PROM PRECALL START");
-        if(promisc_callback_setup.precallback_print == ANNOTATED)
-        {
-            log_packet_annotated(frame, payload_length, LOGGING_TAG);
-        } 
-        else if(promisc_callback_setup.precallback_print == HEX)
-        {
-            log_packet_hex(frame, payload_length, LOGGING_TAG);
-        }
-        ESP_LOGI(LOGGING_TAG, "PROM PRECALL END");
+        capture_record_frame(rx_ctrl, frame_bytes, frame_length);
     }
 
-    // Do the simple callback and then each individual callback action
-    if (promisc_callback_setup.general_callback_is_set)
-    {
-        promisc_callback_setup.general_callback(frame, payload_length);
-    }
-    if (promisc_callback_setup.frame_control_callback_is_set)
+    // Decode the frame once for every callback. A cut short frame has lost its FCS along with the end of the payload.
+    wifi_frame_view_t view;
+    bool truncated = frame_length < rx_ctrl->sig_len;
+    parse_frame_view(frame_bytes, frame_length, !truncated, &view);
+    view.truncated = truncated;
+    view.rx_ctrl = rx_ctrl;
+    view.channel = rx_ctrl->channel != 0 ? rx_ctrl->channel : channel_hopper_channel;
+    if(atomic_load_explicit(&channel_hopper_active, memory_order_relaxed))
     {
-        promisc_callback_setup.frame_control_callback(&frame->frame_control);
+        channel_hopper_record_frame(&view);
     }
-    if (promisc_callback_setup.duration_id_callback_is_set)
+    if(atomic_load_explicit(&station_table_active, memory_order_relaxed))
     {
-        promisc_callback_setup.duration_id_callback(&frame->duration_id);
+        station_table_record_frame(&view);
     }
-    if (promisc_callback_setup.address_1_callback_is_set)
+    if(atomic_load_explicit(&fuzzer_monitoring, memory_order_relaxed))
     {
-        promisc_callback_setup.address_1_callback(frame->address_1);
+        fuzzer_record_frame(&view);
     }
-    if (promisc_callback_setup.address_2_callback_is_set)
+    // Duplicates are dropped here when duplicate detection is set to, after capture and the station table have seen them
+    if(atomic_load_explicit(&duplicate_detection_active, memory_order_relaxed) && duplicate_detection_check(&view))
     {
-        promisc_callback_setup.address_2_callback(frame->address_2);
+        stats_count_receive_drop(RX_DROP_DUPLICATE);
+        return;
     }
-    if (promisc_callback_setup.address_3_callback_is_set)
+    // Frames with a forwarding route are sent on from here, and skip the prints and callbacks unless deliver_forwarded is set
+    if(atomic_load_explicit(&forwarding_active, memory_order_relaxed) && forwarding_forward_frame(&view))
     {
-        promisc_callback_setup.address_3_callback(frame->address_3);
+        return;
     }
-    if (promisc_callback_setup.sequence_control_callback_is_set)
+    // The bridge learns stations from data frames and passes 4 address frames on toward their destination
+    if(atomic_load_explicit(&bridge_active, memory_order_relaxed) && bridge_handle_frame(&view))
     {
-        promisc_callback_setup.sequence_control_callback(&frame->sequence_control);
+        return;
     }
-    if (promisc_callback_setup.address_4_callback_is_set)
+    // The set_* callbacks and prints keep the fixed wifi_mac_data_frame_t layout, so their payload is whatever follows the 30 byte header, without the FCS
+    wifi_mac_data_frame_t *frame = (wifi_mac_data_frame_t *)frame_bytes;
+    int payload_length = view.frame_length - (int)sizeof(wifi_mac_data_frame_t);
+    if(payload_length < 0)
     {
-        promisc_callback_setup.address_4_callback(frame->address_4);
+        payload_length = 0;
     }
-    if (promisc_callback_setup.payload_callback_is_set)
+
+    if(promisc_callback_setup.precallback_print != DISABLE)
     {
-        promisc_callback_setup.payload_callback(frame->payload, payload_length);
+        PROFILE_STAGE_BEGIN(print_start);
+        if(promisc_callback_setup.precallback_print == BINARY)
+        {
+            binary_log_record(BINARY_LOG_RX_PRECALLBACK, frame, payload_length);
+        }
+        else
+        {
+            ESP_LOGI(LOGGING_TAG, "PROM PRECALL START");
+            if(promisc_callback_setup.precallback_print == ANNOTATED)
+            {
+                log_packet_annotated(frame, payload_length, LOGGING_TAG);
+            } 
+            else if(promisc_callback_setup.precallback_print == HEX)
+            {
+                log_packet_hex(frame, payload_length, LOGGING_TAG);
+            }
+            ESP_LOGI(LOGGING_TAG, "PROM PRECALL END");
+        }
+        PROFILE_STAGE_END(PROFILE_STAGE_RX_PRECALLBACK_PRINT, print_start);
     }
 
+    // Run the general callback and then each field callback, from the compacted dispatch table (packet_library_callback_dispatch.c)
+    callback_dispatch_run(CALLBACK_DIRECTION_RECEIVE, &view, payload_length);
+
     if(promisc_callback_setup.postcallback_print != DISABLE)
     {
-        ESP_LOGI(LOGGING_TAG, "PROM POSTCALL PRINT START");
-        if(promisc_callback_setup.postcallback_print == ANNOTATED)
+        PROFILE_STAGE_BEGIN(print_start);
+        if(promisc_callback_setup.postcallback_print == BINARY)
         {
-            log_packet_annotated(frame, payload_length, LOGGING_TAG);
-        } 
-        else if(promisc_callback_setup.postcallback_print == HEX)
+            binary_log_record(BINARY_LOG_RX_POSTCALLBACK, frame, payload_length);
+        }
+        else
         {
-            log_packet_hex(frame, payload_length, LOGGING_TAG);
+            ESP_LOGI(LOGGING_TAG, "PROM POSTCALL PRINT START");
+            if(promisc_callback_setup.postcallback_print == ANNOTATED)
+            {
+                log_packet_annotated(frame, payload_length, LOGGING_TAG);
+            } 
+            else if(promisc_callback_setup.postcallback_print == HEX)
+            {
+                log_packet_hex(frame, payload_length, LOGGING_TAG);
+            }
+            ESP_LOGI(LOGGING_TAG, "PROM POSTCALL PRINT END");
         }
-        ESP_LOGI(LOGGING_TAG, "PROM POSTCALL PRINT END");
+        PROFILE_STAGE_END(PROFILE_STAGE_RX_POSTCALLBACK_PRINT, print_start);
+    }
+}
+
+/* 
+    This is the callback the component uses to provide general and field specific callbacks to the code using it.
+    It is the callback that is passed to the underlying ESP-IDF API for received packet callback.
+    The general flow is to get the packet data we need for the component provided callbacks, running the general
+    callback, and running the individual field callbacks.
+*/
+void promisc_simple_callback(void *buf, wifi_promiscuous_pkt_type_t type)
+{
+    wifi_promiscuous_pkt_t *pkt = (wifi_promiscuous_pkt_t *)buf;
+    stats_count_receive(&pkt->rx_ctrl, pkt->payload, (int)pkt->rx_ctrl.sig_len - 4);
+    // The frame ID is taken before the callbacks, which can change the header
+    uint32_t trace_frame_id = atomic_load_explicit(&event_trace_active, memory_order_relaxed) ? get_event_trace_frame_id(pkt->payload, (int)pkt->rx_ctrl.sig_len - 4) : 0;
+    if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
+    {
+        event_trace_record(EVENT_TRACE_RX_DRIVER, trace_frame_id, pkt->rx_ctrl.sig_len, 0);
+    }
+    // Frames the frame filters reject stop here, before capture, prints, or callbacks
+    if(!frame_filter_accepts(&pkt->rx_ctrl, pkt->payload, (int)pkt->rx_ctrl.sig_len - 4))
+    {
+        stats_count_receive_drop(RX_DROP_FRAME_FILTER);
+        if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
+        {
+            event_trace_record(EVENT_TRACE_RX_DROPPED, trace_frame_id, pkt->rx_ctrl.sig_len, RX_DROP_FRAME_FILTER);
+        }
+        return;
+    }
+    if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
+    {
+        event_trace_record(EVENT_TRACE_RX_CALLBACKS_BEGIN, trace_frame_id, pkt->rx_ctrl.sig_len, 0);
+    }
+    PROFILE_STAGE_BEGIN(frame_start);
+    promisc_run_callbacks(&pkt->rx_ctrl, pkt->payload, pkt->rx_ctrl.sig_len);
+    PROFILE_STAGE_END(PROFILE_STAGE_RX_FRAME, frame_start);
+    if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
+    {
+        event_trace_record(EVENT_TRACE_RX_CALLBACKS_END, trace_frame_id, pkt->rx_ctrl.sig_len, 0);
     }
 }
 
@@ -115,9 +195,13 @@ esp_err_t setup_wifi_custom(wifi_init_config_t config, bool as_station) // LOC:
     {
         netif = esp_netif_create_default_wifi_ap();
     }
-    assert(netif);
+    if(netif == NULL)
+    {
+        return ESP_FAIL;
+    }
     ESP_ERROR_CHECK(esp_wifi_init(&config));
     ESP_ERROR_CHECK(esp_wifi_get_mac(WIFI_IF_STA, configuration_holder.mac_addr));
+    configuration_holder.configuration_generation++;
     ESP_LOGI(LOGGING_TAG, "WIFI INITIALIZED");
     return ESP_OK;
 }
@@ -129,6 +213,7 @@ esp_err_t setup_sta_default() // LOC: 2
     ESP_ERROR_CHECK(esp_wifi_start());
     configuration_holder.wifi_interface = WIFI_IF_STA;
     configuration_holder.wifi_interface_set = true;
+    configuration_holder.configuration_generation++;
     return ESP_OK;
 }
 
@@ -162,16 +247,18 @@ esp_err_t setup_promiscuous_simple() // LOC: 2
 // This enables the packet reception capabilities similar to 'setup_promiscuous_simple', but also sets a general callback up for use in the components managed callback system. 
 esp_err_t setup_promiscuous_simple_with_general_callback(packet_library_simple_callback_t simple_callback) // LOC: 0 + 2 = 2
 {
-    promisc_callback_setup.general_callback = simple_callback;
-    promisc_callback_setup.general_callback_is_set = true;
+    esp_err_t status = set_receive_callback_general(simple_callback);
+    if(status != ESP_OK)
+    {
+        return status;
+    }
     return setup_promiscuous_simple();
 }
 
 // This disables the general callback
 esp_err_t disable_promiscuous_general_callback() // LOC: 0
 {
-    promisc_callback_setup.general_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_GENERAL, (callback_dispatch_handler_t){ .general = NULL }, false);
 }
 
 // This allows for the manual toggling of the promiscuous packet reception, and therefore the packet received callback running
@@ -188,6 +275,7 @@ esp_err_t setup_sta_and_promiscuous_simple() // LOC: 5
     configuration_holder.wifi_interface = WIFI_IF_STA;
     configuration_holder.wifi_interface_set = true;
     ESP_ERROR_CHECK(esp_wifi_get_mac(WIFI_IF_STA, configuration_holder.mac_addr));
+    configuration_holder.configuration_generation++;
     ESP_ERROR_CHECK(esp_wifi_start());
     ESP_ERROR_CHECK(esp_wifi_set_promiscuous(true));
     return ESP_OK;
@@ -196,8 +284,11 @@ esp_err_t setup_sta_and_promiscuous_simple() // LOC: 5
 // This sets the general promiscuous callback up and then sets up the ESP-32 for station+promiscuous use via 'setup_sta_and_promiscuous_simple'.
 esp_err_t setup_sta_and_promiscuous_simple_with_promisc_general_callback(packet_library_simple_callback_t simple_callback) // LOC: 0 + 5
 {
-    promisc_callback_setup.general_callback = simple_callback;
-    promisc_callback_setup.general_callback_is_set = true;
+    esp_err_t status = set_receive_callback_general(simple_callback);
+    if(status != ESP_OK)
+    {
+        return status;
+    }
     return setup_sta_and_promiscuous_simple();
 }
 
@@ -213,6 +304,7 @@ esp_err_t setup_wpa_ap(wifi_ap_config_t ap_configuration) // LOC: 6
     esp_wifi_set_protocol(configuration_holder.wifi_interface, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N);
     ESP_ERROR_CHECK(esp_wifi_set_config(configuration_holder.wifi_interface, &config));
     ESP_ERROR_CHECK(esp_wifi_get_mac(WIFI_IF_AP, configuration_holder.mac_addr));
+    configuration_holder.configuration_generation++;
     ESP_ERROR_CHECK(esp_wifi_start());
     return ESP_OK;
 }
@@ -244,6 +336,7 @@ esp_err_t setup_wpa_sta(wifi_sta_config_t station_connection_configuration) // L
     if(status == ESP_OK)
     {
         configuration_holder.wifi_connected_to_ap = true;
+        configuration_holder.configuration_generation++;
         return ESP_OK;
     }
     return status;
@@ -259,114 +352,197 @@ esp_err_t send_packet_raw_no_callback(const void* buffer, int length, bool en_sy
     {
         return ESP_ERR_WIFI_IF;
     }
-    esp_wifi_80211_tx(configuration_holder.wifi_interface, buffer, length, en_sys_seq);
-    return ESP_OK;
-}
-
-// Sends a packet conforming to the component provided wifi_mac_data_frame_t, along with running all enabled callbacks on the packet before sending.
-esp_err_t send_packet_simple(wifi_mac_data_frame_t* packet, int payload_length) // LOC: 12 (Counted check at top, callback execution lines, and send) 
-{
-    int length = sizeof(wifi_mac_data_frame_t) + payload_length;
-    if(configuration_holder.wifi_interface_set != true)
+    uint32_t trace_frame_id = atomic_load_explicit(&event_trace_active, memory_order_relaxed) ? get_event_trace_frame_id(buffer, length) : 0;
+    if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
     {
-        return ESP_ERR_WIFI_IF;
+        event_trace_record(EVENT_TRACE_TX_DRIVER_BEGIN, trace_frame_id, length, 0);
     }
+    PROFILE_STAGE_BEGIN(driver_start);
+    esp_err_t status = esp_wifi_80211_tx(configuration_holder.wifi_interface, buffer, length, en_sys_seq);
+    PROFILE_STAGE_END(PROFILE_STAGE_TX_DRIVER, driver_start);
+    if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
+    {
+        event_trace_record(EVENT_TRACE_TX_DRIVER_END, trace_frame_id, length, status);
+    }
+    stats_count_send(buffer, length, status);
+    return status;
+}
 
+// Runs the pre-callback print, general callback, field callbacks, and post-callback print on a packet that is about to be sent.
+void send_run_callbacks(wifi_mac_data_frame_t* packet, int payload_length)
+{
     if(send_callback_setup.precallback_print != DISABLE)
     {
-        ESP_LOGI(LOGGING_TAG, "SEND PRECALL START");
-        if(send_callback_setup.precallback_print == ANNOTATED)
+        PROFILE_STAGE_BEGIN(print_start);
+        if(send_callback_setup.precallback_print == BINARY)
         {
-            log_packet_annotated(packet, payload_length, LOGGING_TAG);
-        } 
-        else if(send_callback_setup.precallback_print == HEX)
+            binary_log_record(BINARY_LOG_TX_PRECALLBACK, packet, payload_length);
+        }
+        else
         {
-            log_packet_hex(packet, payload_length, LOGGING_TAG);
+            ESP_LOGI(LOGGING_TAG, "SEND PRECALL START");
+            if(send_callback_setup.precallback_print == ANNOTATED)
+            {
+                log_packet_annotated(packet, payload_length, LOGGING_TAG);
+            } 
+            else if(send_callback_setup.precallback_print == HEX)
+            {
+                log_packet_hex(packet, payload_length, LOGGING_TAG);
+            }
+            ESP_LOGI(LOGGING_TAG, "SEND PRECALL END");
         }
-        ESP_LOGI(LOGGING_TAG, "SEND PRECALL END");
+        PROFILE_STAGE_END(PROFILE_STAGE_TX_PRECALLBACK_PRINT, print_start);
     }
 
-    // Do the simple callback and then each individual callback action
-    if (send_callback_setup.general_callback_is_set)
+    // Do the simple callback and then each individual callback action, the context taking callbacks get the packet decoded as it goes out on air
+    wifi_frame_view_t view;
+    parse_frame_view((uint8_t *)packet, sizeof(wifi_mac_data_frame_t) + payload_length, false, &view);
+    callback_dispatch_run(CALLBACK_DIRECTION_SEND, &view, payload_length);
+
+    if(send_callback_setup.postcallback_print != DISABLE)
     {
-        send_callback_setup.general_callback(packet, payload_length);
+        PROFILE_STAGE_BEGIN(print_start);
+        if(send_callback_setup.postcallback_print == BINARY)
+        {
+            binary_log_record(BINARY_LOG_TX_POSTCALLBACK, packet, payload_length);
+        }
+        else
+        {
+            ESP_LOGI(LOGGING_TAG, "SEND POSTCALL START");
+            if(send_callback_setup.postcallback_print == ANNOTATED)
+            {
+                log_packet_annotated(packet, payload_length, LOGGING_TAG);
+            } 
+            else if(send_callback_setup.postcallback_print == HEX)
+            {
+                log_packet_hex(packet, payload_length, LOGGING_TAG);
+            }
+            ESP_LOGI(LOGGING_TAG, "SEND POSTCALL END");
+        }
+        PROFILE_STAGE_END(PROFILE_STAGE_TX_POSTCALLBACK_PRINT, print_start);
     }
-    if (send_callback_setup.frame_control_callback_is_set)
+}
+
+// Whether sending a packet can change its header, i.e. the general callback or any header field send callback is set. Payload callbacks do not count.
+bool send_callbacks_may_modify_header()
+{
+    return callback_dispatch_modifies_header(CALLBACK_DIRECTION_SEND);
+}
+
+// Sends a packet conforming to the component provided wifi_mac_data_frame_t, along with running all enabled callbacks on the packet before sending.
+esp_err_t send_packet_simple(wifi_mac_data_frame_t* packet, int payload_length) // LOC: 12 (Counted check at top, callback execution lines, and send) 
+{
+    int length = sizeof(wifi_mac_data_frame_t) + payload_length;
+    if(configuration_holder.wifi_interface_set != true)
     {
-        send_callback_setup.frame_control_callback(&packet->frame_control);
+        return ESP_ERR_WIFI_IF;
     }
-    if (send_callback_setup.duration_id_callback_is_set)
+
+    // The frame ID is taken before the send callbacks, which can change the header
+    uint32_t trace_frame_id = atomic_load_explicit(&event_trace_active, memory_order_relaxed) ? get_event_trace_frame_id((const uint8_t *)packet, length) : 0;
+    if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
     {
-        send_callback_setup.duration_id_callback(&packet->duration_id);
+        event_trace_record(EVENT_TRACE_TX_BEGIN, trace_frame_id, length, 0);
     }
-    if (send_callback_setup.address_1_callback_is_set)
+
+    send_run_callbacks(packet, payload_length);
+
+    if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
     {
-        send_callback_setup.address_1_callback(packet->address_1);
+        event_trace_record(EVENT_TRACE_TX_DRIVER_BEGIN, trace_frame_id, length, 0);
     }
-    if (send_callback_setup.address_2_callback_is_set)
+    PROFILE_STAGE_BEGIN(driver_start);
+    esp_err_t status = esp_wifi_80211_tx(configuration_holder.wifi_interface, (void *)packet, length, true);
+    PROFILE_STAGE_END(PROFILE_STAGE_TX_DRIVER, driver_start);
+    stats_count_send((const uint8_t *)packet, length, status);
+    if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
     {
-        send_callback_setup.address_2_callback(packet->address_2);
+        event_trace_record(EVENT_TRACE_TX_DRIVER_END, trace_frame_id, length, status);
+        event_trace_record(EVENT_TRACE_TX_END, trace_frame_id, length, status);
     }
-    if (send_callback_setup.address_3_callback_is_set)
+    return status;
+}
+
+/*
+    Sends 'packet_count' packets back to back, or spaced 'pacing.inter_frame_interval_us' apart.
+    The interface check and the send callbacks run for the whole batch before the first transmit, so the transmit loop itself
+    only waits for the next send time and calls esp_wifi_80211_tx. Send times are measured with esp_timer (microseconds) from
+    the start of the batch, so a late frame does not push back the rest of the schedule. Waits longer than a couple of ticks
+    sleep with vTaskDelay for most of the wait and busy wait only for the remainder.
+    If 'results_holder' is not NULL, it gets the esp_wifi_80211_tx result of each packet. The method returns ESP_OK only if every packet was sent.
+    With SEND_BATCH_CALLBACKS_NONE the packets can be any 802.11 frame: a payload length is only added to sizeof(wifi_mac_data_frame_t), so frames shorter than a data header have a negative one.
+*/
+esp_err_t send_packet_batch(wifi_mac_data_frame_t* packets[], int payload_lengths[], int packet_count, send_batch_pacing_t pacing, esp_err_t results_holder[])
+{
+    if(configuration_holder.wifi_interface_set != true)
     {
-        send_callback_setup.address_3_callback(packet->address_3);
+        return ESP_ERR_WIFI_IF;
     }
-    if (send_callback_setup.sequence_control_callback_is_set)
+    if(packets == NULL || payload_lengths == NULL || packet_count < 0)
     {
-        send_callback_setup.sequence_control_callback(&packet->sequence_control);
+        return ESP_ERR_INVALID_ARG;
     }
-    if (send_callback_setup.address_4_callback_is_set)
+
+    if(pacing.callbacks == SEND_BATCH_CALLBACKS_EACH_PACKET)
     {
-        send_callback_setup.address_4_callback(packet->address_4);
+        for(int index = 0; index < packet_count; index++)
+        {
+            send_run_callbacks(packets[index], payload_lengths[index]);
+        }
     }
-    if (send_callback_setup.payload_callback_is_set && &packet->payload)
+    else if(pacing.callbacks == SEND_BATCH_CALLBACKS_FIRST_PACKET && packet_count > 0)
     {
-        send_callback_setup.payload_callback(packet->payload, payload_length);
+        send_run_callbacks(packets[0], payload_lengths[0]);
     }
 
-    if(send_callback_setup.postcallback_print != DISABLE)
+    esp_err_t batch_status = ESP_OK;
+    int64_t batch_start = esp_timer_get_time();
+    const int64_t tick_us = portTICK_PERIOD_MS * 1000;
+    for(int index = 0; index < packet_count; index++)
     {
-        ESP_LOGI(LOGGING_TAG, "SEND POSTCALL START");
-        if(send_callback_setup.postcallback_print == ANNOTATED)
+        if(pacing.inter_frame_interval_us > 0 && index > 0)
         {
-            log_packet_annotated(packet, payload_length, LOGGING_TAG);
-        } 
-        else if(send_callback_setup.postcallback_print == HEX)
+            int64_t send_time = batch_start + (int64_t)index * pacing.inter_frame_interval_us;
+            int64_t remaining = send_time - esp_timer_get_time();
+            if(remaining > 2 * tick_us)
+            {
+                vTaskDelay((remaining / tick_us) - 1);
+            }
+            while(esp_timer_get_time() < send_time)
+            {
+            }
+        }
+        int length = sizeof(wifi_mac_data_frame_t) + payload_lengths[index];
+        uint32_t trace_frame_id = atomic_load_explicit(&event_trace_active, memory_order_relaxed) ? get_event_trace_frame_id((const uint8_t *)packets[index], length) : 0;
+        if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
         {
-            log_packet_hex(packet, payload_length, LOGGING_TAG);
+            event_trace_record(EVENT_TRACE_TX_DRIVER_BEGIN, trace_frame_id, length, 0);
+        }
+        PROFILE_STAGE_BEGIN(driver_start);
+        esp_err_t status = esp_wifi_80211_tx(configuration_holder.wifi_interface, (void *)packets[index], length, !pacing.keep_sequence_control);
+        PROFILE_STAGE_END(PROFILE_STAGE_TX_DRIVER, driver_start);
+        if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
+        {
+            event_trace_record(EVENT_TRACE_TX_DRIVER_END, trace_frame_id, length, status);
+        }
+        stats_count_send((const uint8_t *)packets[index], length, status);
+        if(results_holder != NULL)
+        {
+            results_holder[index] = status;
+        }
+        if(status != ESP_OK)
+        {
+            batch_status = ESP_FAIL;
         }
-        ESP_LOGI(LOGGING_TAG, "SEND POSTCALL END");
     }
-
-    esp_wifi_80211_tx(configuration_holder.wifi_interface, (void *)packet, length, true);
-    return ESP_OK;
+    return batch_status;
 }
 
 // This is an AP helper method to send a packet to a specific station, based on the target stations MAC address, with the component manages everything but the payload and finding the target stations MAC addr
+// The header is built once per station and kept in the frame template cache (packet_library_frame_template.c)
 esp_err_t send_payload_ap_to_station(uint8_t payload[], int payload_length, uint8_t station_addr[6]) // LOC: 5 + 10 + 12 = 27 (alloc_packet_custom counted as 10)
 {
-    if(configuration_holder.wifi_interface_set == false)
-    {
-        return ESP_ERR_WIFI_NOT_INIT;
-    }
-    if(configuration_holder.wifi_interface != WIFI_IF_AP)
-    {
-        return ESP_ERR_WIFI_MODE;
-    }
-    wifi_mac_data_frame_t* pkt = alloc_packet_custom(
-        0x0208, // Always send as a data packet, also set To DS 0/From DS 1.
-        0xFA, // Set the duration ID
-        station_addr,
-        configuration_holder.mac_addr,
-        configuration_holder.mac_addr,
-        0x00, // This is managed by the chip and gets overwritten on simple send
-        (uint8_t []){ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
-        payload_length,
-        payload
-    );
-    send_packet_simple(pkt, payload_length);
-    free(pkt);
-    return ESP_OK;
+    return send_payload_cached_template(FRAME_TEMPLATE_AP_TO_STATION, station_addr, payload, payload_length);
 }
 
 // This is an AP helper method to broadcast a packet, with the component manages everything but the payload
@@ -378,55 +554,13 @@ esp_err_t send_payload_ap_broadcast(uint8_t payload[], int payload_length) // LO
 // This is a station helper method for when connected to an AP for sending a payload to the AP, with the component managing the MAC address fiels and packet allocation.
 esp_err_t send_payload_sta_to_access_point(uint8_t payload[], int payload_length) // LOC: 5 + 10 + 12 = 27
 {
-    if(configuration_holder.wifi_interface_set == false || configuration_holder.wifi_connected_to_ap == false)
-    {
-        return ESP_ERR_WIFI_NOT_INIT;
-    }
-    if(configuration_holder.wifi_interface != WIFI_IF_STA)
-    {
-        return ESP_ERR_WIFI_MODE;
-    }
-    wifi_mac_data_frame_t* pkt = alloc_packet_custom(
-        0x0108, // Always send as a data packet, also set To DS 1/From DS 0
-        0xFA, // Set the duration ID
-        configuration_holder.connected_ap_record.bssid,
-        configuration_holder.mac_addr,
-        configuration_holder.connected_ap_record.bssid,
-        0x00, // This is managed by the chip and gets overwritten on simple send
-        (uint8_t []){ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
-        payload_length,
-        payload
-    );
-    send_packet_simple(pkt, payload_length);
-    free(pkt);
-    return ESP_OK;
+    return send_payload_cached_template(FRAME_TEMPLATE_STA_TO_ACCESS_POINT, configuration_holder.connected_ap_record.bssid, payload, payload_length);
 }
 
 // This is a station helper method for sending a packet to a target MAC through the connected access point, with the component managing the AP and this ESP-32 address fields, and packet allocation.
 esp_err_t send_payload_sta_through_access_point(uint8_t payload[], int payload_length, uint8_t target_mac[6]) // LOC: 5 + 10 + 12 = 27
 {
-    if(configuration_holder.wifi_interface_set == false || configuration_holder.wifi_connected_to_ap == false)
-    {
-        return ESP_ERR_WIFI_NOT_INIT;
-    }
-    if(configuration_holder.wifi_interface != WIFI_IF_STA)
-    {
-        return ESP_ERR_WIFI_MODE;
-    }
-    wifi_mac_data_frame_t* pkt = alloc_packet_custom(
-        0x0108, // Always send as a data packet, also set To DS 1/From DS 0
-        0xFA, // Set the duration ID
-        configuration_holder.connected_ap_record.bssid,
-        configuration_holder.mac_addr,
-        target_mac,
-        0x00, // This is managed by the chip and gets overwritten on simple send
-        (uint8_t []){ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
-        payload_length,
-        payload
-    );
-    send_packet_simple(pkt, payload_length);
-    free(pkt);
-    return ESP_OK;
+    return send_payload_cached_template(FRAME_TEMPLATE_STA_THROUGH_ACCESS_POINT, target_mac, payload, payload_length);
 }
 
 // **************************************************
@@ -436,64 +570,46 @@ esp_err_t send_payload_sta_through_access_point(uint8_t payload[], int payload_l
 // **************************************************
 esp_err_t set_receive_callback_general(packet_library_simple_callback_t simple_callback)
 {
-    promisc_callback_setup.general_callback = simple_callback;
-    promisc_callback_setup.general_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_GENERAL, (callback_dispatch_handler_t){ .general = simple_callback }, true);
 }
 
 esp_err_t set_receive_callback_frame_control(packet_library_frame_control_callback_t simple_callback)
 {
-    promisc_callback_setup.frame_control_callback = simple_callback;
-    promisc_callback_setup.frame_control_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_FRAME_CONTROL, (callback_dispatch_handler_t){ .u16_field = simple_callback }, true);
 }
 
 esp_err_t set_receive_callback_duration_id(packet_library_duration_id_callback_t simple_callback)
 {
-    promisc_callback_setup.duration_id_callback = simple_callback;
-    promisc_callback_setup.duration_id_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_DURATION_ID, (callback_dispatch_handler_t){ .u16_field = simple_callback }, true);
 }
 
 esp_err_t set_receive_callback_address_1(packet_library_address_1_callback_t simple_callback)
 {
-    promisc_callback_setup.address_1_callback = simple_callback;
-    promisc_callback_setup.address_1_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_ADDRESS_1, (callback_dispatch_handler_t){ .address = simple_callback }, true);
 }
 
 esp_err_t set_receive_callback_address_2(packet_library_address_2_callback_t simple_callback)
 {
-    promisc_callback_setup.address_2_callback = simple_callback;
-    promisc_callback_setup.address_2_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_ADDRESS_2, (callback_dispatch_handler_t){ .address = simple_callback }, true);
 }
 
 esp_err_t set_receive_callback_address_3(packet_library_address_3_callback_t simple_callback)
 {
-    promisc_callback_setup.address_3_callback = simple_callback;
-    promisc_callback_setup.address_3_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_ADDRESS_3, (callback_dispatch_handler_t){ .address = simple_callback }, true);
 }
 
 esp_err_t set_receive_callback_address_4(packet_library_address_4_callback_t simple_callback)
 {
-    promisc_callback_setup.address_4_callback = simple_callback;
-    promisc_callback_setup.address_4_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_ADDRESS_4, (callback_dispatch_handler_t){ .address = simple_callback }, true);
 }
 
 esp_err_t set_receive_callback_sequence_control(packet_library_sequence_control_callback_t simple_callback)
 {
-    promisc_callback_setup.sequence_control_callback = simple_callback;
-    promisc_callback_setup.sequence_control_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_SEQUENCE_CONTROL, (callback_dispatch_handler_t){ .u16_field = simple_callback }, true);
 }
 
 esp_err_t set_receive_callback_payload(packet_library_payload_callback_t simple_callback){
-    promisc_callback_setup.payload_callback = simple_callback;
-    promisc_callback_setup.payload_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_PAYLOAD, (callback_dispatch_handler_t){ .payload = simple_callback }, true);
 }
 
 esp_err_t set_receive_pre_callback_print(enum callback_print_option option)
@@ -510,56 +626,84 @@ esp_err_t set_receive_post_callback_print(enum callback_print_option option)
 
 esp_err_t remove_receive_callback_general()
 {
-    promisc_callback_setup.general_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_GENERAL, (callback_dispatch_handler_t){ .general = NULL }, false);
 }
 
 esp_err_t remove_receive_callback_frame_control()
 {
-    promisc_callback_setup.frame_control_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_FRAME_CONTROL, (callback_dispatch_handler_t){ .u16_field = NULL }, false);
 }
 
 esp_err_t remove_receive_callback_duration_id()
 {
-    promisc_callback_setup.duration_id_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_DURATION_ID, (callback_dispatch_handler_t){ .u16_field = NULL }, false);
 }
 
 esp_err_t remove_receive_callback_address_1()
 {
-    promisc_callback_setup.address_1_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_ADDRESS_1, (callback_dispatch_handler_t){ .address = NULL }, false);
 }
 
 esp_err_t remove_receive_callback_address_2()
 {
-    promisc_callback_setup.address_2_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_ADDRESS_2, (callback_dispatch_handler_t){ .address = NULL }, false);
 }
 
 esp_err_t remove_receive_callback_address_3()
 {
-    promisc_callback_setup.address_3_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_ADDRESS_3, (callback_dispatch_handler_t){ .address = NULL }, false);
 }
 
 esp_err_t remove_receive_callback_address_4()
 {
-    promisc_callback_setup.address_4_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_ADDRESS_4, (callback_dispatch_handler_t){ .address = NULL }, false);
 }
 
 esp_err_t remove_receive_callback_sequence_control()
 {
-    promisc_callback_setup.sequence_control_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_SEQUENCE_CONTROL, (callback_dispatch_handler_t){ .u16_field = NULL }, false);
 }
 
 esp_err_t remove_receive_callback_payload()
 {
-    promisc_callback_setup.payload_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_PAYLOAD, (callback_dispatch_handler_t){ .payload = NULL }, false);
+}
+
+// The add methods below register callbacks that take a context pointer. Any number can be added per field (up to PACKET_LIBRARY_MAX_CALLBACK_SUBSCRIBERS in total),
+// they run after the set_receive_callback_* callback of the same field in the order they were added, and are removed with the subscription they return.
+esp_err_t add_receive_callback_general(packet_library_general_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder)
+{
+    return callback_dispatch_add(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_GENERAL, (callback_dispatch_handler_t){ .general_ctx = callback }, ctx, subscription_holder);
+}
+
+// 'field' is CALLBACK_FIELD_FRAME_CONTROL, CALLBACK_FIELD_DURATION_ID or CALLBACK_FIELD_SEQUENCE_CONTROL
+esp_err_t add_receive_callback_u16_field(enum packet_library_callback_field field, packet_library_u16_field_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder)
+{
+    if(field != CALLBACK_FIELD_FRAME_CONTROL && field != CALLBACK_FIELD_DURATION_ID && field != CALLBACK_FIELD_SEQUENCE_CONTROL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return callback_dispatch_add(CALLBACK_DIRECTION_RECEIVE, field, (callback_dispatch_handler_t){ .u16_field_ctx = callback }, ctx, subscription_holder);
+}
+
+// 'field' is one of CALLBACK_FIELD_ADDRESS_1 to CALLBACK_FIELD_ADDRESS_4
+esp_err_t add_receive_callback_address(enum packet_library_callback_field field, packet_library_address_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder)
+{
+    if(field != CALLBACK_FIELD_ADDRESS_1 && field != CALLBACK_FIELD_ADDRESS_2 && field != CALLBACK_FIELD_ADDRESS_3 && field != CALLBACK_FIELD_ADDRESS_4)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return callback_dispatch_add(CALLBACK_DIRECTION_RECEIVE, field, (callback_dispatch_handler_t){ .address_ctx = callback }, ctx, subscription_holder);
+}
+
+esp_err_t add_receive_callback_payload(packet_library_payload_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder)
+{
+    return callback_dispatch_add(CALLBACK_DIRECTION_RECEIVE, CALLBACK_FIELD_PAYLOAD, (callback_dispatch_handler_t){ .payload_ctx = callback }, ctx, subscription_holder);
+}
+
+esp_err_t remove_receive_callback_subscription(callback_subscription_t subscription)
+{
+    return callback_dispatch_remove(CALLBACK_DIRECTION_RECEIVE, subscription);
 }
 
 
@@ -571,65 +715,47 @@ esp_err_t remove_receive_callback_payload()
 
 esp_err_t set_send_callback_general(packet_library_simple_callback_t simple_callback)
 {
-    send_callback_setup.general_callback = simple_callback;
-    send_callback_setup.general_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_GENERAL, (callback_dispatch_handler_t){ .general = simple_callback }, true);
 }
 
 esp_err_t set_send_callback_frame_control(packet_library_frame_control_callback_t simple_callback)
 {
-    send_callback_setup.frame_control_callback = simple_callback;
-    send_callback_setup.frame_control_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_FRAME_CONTROL, (callback_dispatch_handler_t){ .u16_field = simple_callback }, true);
 }
 
 esp_err_t set_send_callback_duration_id(packet_library_duration_id_callback_t simple_callback)
 {
-    send_callback_setup.duration_id_callback = simple_callback;
-    send_callback_setup.duration_id_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_DURATION_ID, (callback_dispatch_handler_t){ .u16_field = simple_callback }, true);
 }
 
 esp_err_t set_send_callback_address_1(packet_library_address_1_callback_t simple_callback)
 {
-    send_callback_setup.address_1_callback = simple_callback;
-    send_callback_setup.address_1_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_ADDRESS_1, (callback_dispatch_handler_t){ .address = simple_callback }, true);
 }
 
 esp_err_t set_send_callback_address_2(packet_library_address_2_callback_t simple_callback)
 {
-    send_callback_setup.address_2_callback = simple_callback;
-    send_callback_setup.address_2_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_ADDRESS_2, (callback_dispatch_handler_t){ .address = simple_callback }, true);
 }
 
 esp_err_t set_send_callback_address_3(packet_library_address_3_callback_t simple_callback)
 {
-    send_callback_setup.address_3_callback = simple_callback;
-    send_callback_setup.address_3_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_ADDRESS_3, (callback_dispatch_handler_t){ .address = simple_callback }, true);
 }
 
 esp_err_t set_send_callback_address_4(packet_library_address_4_callback_t simple_callback)
 {
-    send_callback_setup.address_4_callback = simple_callback;
-    send_callback_setup.address_4_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_ADDRESS_4, (callback_dispatch_handler_t){ .address = simple_callback }, true);
 }
 
 esp_err_t set_send_callback_sequence_control(packet_library_sequence_control_callback_t simple_callback)
 {
-    send_callback_setup.sequence_control_callback = simple_callback;
-    send_callback_setup.sequence_control_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_SEQUENCE_CONTROL, (callback_dispatch_handler_t){ .u16_field = simple_callback }, true);
 }
 
 esp_err_t set_send_callback_payload(packet_library_payload_callback_t simple_callback)
 {
-    send_callback_setup.payload_callback = simple_callback;
-    send_callback_setup.payload_callback_is_set = true;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_PAYLOAD, (callback_dispatch_handler_t){ .payload = simple_callback }, true);
 }
 
 esp_err_t set_send_pre_callback_print(enum callback_print_option option)
@@ -646,56 +772,84 @@ esp_err_t set_send_post_callback_print(enum callback_print_option option)
 
 esp_err_t remove_send_callback_general()
 {
-    send_callback_setup.general_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_GENERAL, (callback_dispatch_handler_t){ .general = NULL }, false);
 }
 
 esp_err_t remove_send_callback_frame_control()
 {
-    send_callback_setup.frame_control_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_FRAME_CONTROL, (callback_dispatch_handler_t){ .u16_field = NULL }, false);
 }
 
 esp_err_t remove_send_callback_duration_id()
 {
-    send_callback_setup.duration_id_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_DURATION_ID, (callback_dispatch_handler_t){ .u16_field = NULL }, false);
 }
 
 esp_err_t remove_send_callback_address_1()
 {
-    send_callback_setup.address_1_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_ADDRESS_1, (callback_dispatch_handler_t){ .address = NULL }, false);
 }
 
 esp_err_t remove_send_callback_address_2()
 {
-    send_callback_setup.address_2_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_ADDRESS_2, (callback_dispatch_handler_t){ .address = NULL }, false);
 }
 
 esp_err_t remove_send_callback_address_3()
 {
-    send_callback_setup.address_3_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_ADDRESS_3, (callback_dispatch_handler_t){ .address = NULL }, false);
 }
 
 esp_err_t remove_send_callback_address_4()
 {
-    send_callback_setup.address_4_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_ADDRESS_4, (callback_dispatch_handler_t){ .address = NULL }, false);
 }
 
 esp_err_t remove_send_callback_sequence_control()
 {
-    send_callback_setup.sequence_control_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_SEQUENCE_CONTROL, (callback_dispatch_handler_t){ .u16_field = NULL }, false);
 }
 
 esp_err_t remove_send_callback_payload()
 {
-    send_callback_setup.payload_callback_is_set = false;
-    return ESP_OK;
+    return callback_dispatch_set_handler(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_PAYLOAD, (callback_dispatch_handler_t){ .payload = NULL }, false);
+}
+
+// The add methods below register callbacks that take a context pointer. Any number can be added per field (up to PACKET_LIBRARY_MAX_CALLBACK_SUBSCRIBERS in total),
+// they run after the set_send_callback_* callback of the same field in the order they were added, and are removed with the subscription they return.
+esp_err_t add_send_callback_general(packet_library_general_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder)
+{
+    return callback_dispatch_add(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_GENERAL, (callback_dispatch_handler_t){ .general_ctx = callback }, ctx, subscription_holder);
+}
+
+// 'field' is CALLBACK_FIELD_FRAME_CONTROL, CALLBACK_FIELD_DURATION_ID or CALLBACK_FIELD_SEQUENCE_CONTROL
+esp_err_t add_send_callback_u16_field(enum packet_library_callback_field field, packet_library_u16_field_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder)
+{
+    if(field != CALLBACK_FIELD_FRAME_CONTROL && field != CALLBACK_FIELD_DURATION_ID && field != CALLBACK_FIELD_SEQUENCE_CONTROL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return callback_dispatch_add(CALLBACK_DIRECTION_SEND, field, (callback_dispatch_handler_t){ .u16_field_ctx = callback }, ctx, subscription_holder);
+}
+
+// 'field' is one of CALLBACK_FIELD_ADDRESS_1 to CALLBACK_FIELD_ADDRESS_4
+esp_err_t add_send_callback_address(enum packet_library_callback_field field, packet_library_address_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder)
+{
+    if(field != CALLBACK_FIELD_ADDRESS_1 && field != CALLBACK_FIELD_ADDRESS_2 && field != CALLBACK_FIELD_ADDRESS_3 && field != CALLBACK_FIELD_ADDRESS_4)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return callback_dispatch_add(CALLBACK_DIRECTION_SEND, field, (callback_dispatch_handler_t){ .address_ctx = callback }, ctx, subscription_holder);
+}
+
+esp_err_t add_send_callback_payload(packet_library_payload_ctx_callback_t callback, void* ctx, callback_subscription_t* subscription_holder)
+{
+    return callback_dispatch_add(CALLBACK_DIRECTION_SEND, CALLBACK_FIELD_PAYLOAD, (callback_dispatch_handler_t){ .payload_ctx = callback }, ctx, subscription_holder);
+}
+
+esp_err_t remove_send_callback_subscription(callback_subscription_t subscription)
+{
+    return callback_dispatch_remove(CALLBACK_DIRECTION_SEND, subscription);
 }
 
 // **************************************************
@@ -714,18 +868,19 @@ esp_err_t log_packet_annotated(wifi_mac_data_frame_t* packet, int payload_length
         packet->address_4[0], packet->address_4[1], packet->address_4[2], packet->address_4[3], packet->address_4[4], packet->address_4[5]
     );
 
-    if(payload_length){
-        uint8_t* payload_buffer = (uint8_t*)malloc(payload_length*2); // Times 2 for 2 hex per byte
-        char temp_buffer[3];
-        // Generate the payload string
-        for(int counter = 0; counter < payload_length; counter++)
+    if(payload_length > 0){
+        // Generate the payload string on the stack, long payloads are cut at the configured maximum
+        char payload_buffer[PACKET_LIBRARY_LOG_PAYLOAD_MAX_BYTES * 2 + 1];
+        int printed_length = payload_length < get_log_payload_max_length() ? payload_length : get_log_payload_max_length();
+        format_payload_hex(packet->payload, printed_length, payload_buffer, sizeof(payload_buffer));
+        if(printed_length < payload_length)
         {
-            snprintf(temp_buffer, 3, "%02X", (packet->payload)[counter]);
-            memcpy(&payload_buffer[counter*2], temp_buffer, 2);
+            ESP_LOGI(TAG, "Payload: 0x%s... (%d of %d bytes)", payload_buffer, printed_length, payload_length);
+        }
+        else
+        {
+            ESP_LOGI(TAG, "Payload: 0x%s", payload_buffer);
         }
-
-        ESP_LOGI(TAG, "Payload: 0x%.*s", payload_length*2, payload_buffer);
-        free(payload_buffer);
     }
     return ESP_OK;    
 }
@@ -742,18 +897,19 @@ esp_err_t log_packet_hex(wifi_mac_data_frame_t* packet, int payload_length, cons
         packet->address_4[0], packet->address_4[1], packet->address_4[2], packet->address_4[3], packet->address_4[4], packet->address_4[5]
     );
     
-    if(payload_length){
-        uint8_t* payload_buffer = (uint8_t*)malloc(payload_length*2); // Times 2 for 2 hex per byte
-        char temp_buffer[3];
-        // Generate the payload string
-        for(int counter = 0; counter < payload_length; counter++)
+    if(payload_length > 0){
+        // Generate the payload string on the stack, long payloads are cut at the configured maximum
+        char payload_buffer[PACKET_LIBRARY_LOG_PAYLOAD_MAX_BYTES * 2 + 1];
+        int printed_length = payload_length < get_log_payload_max_length() ? payload_length : get_log_payload_max_length();
+        format_payload_hex(packet->payload, printed_length, payload_buffer, sizeof(payload_buffer));
+        if(printed_length < payload_length)
         {
-            snprintf(temp_buffer, 3, "%02X", packet->payload[counter]);
-            memcpy(&payload_buffer[counter*2], temp_buffer, 2);
+            ESP_LOGI(TAG, "%s... (%d of %d bytes)", payload_buffer, printed_length, payload_length);
+        }
+        else
+        {
+            ESP_LOGI(TAG, "%s", payload_buffer);
         }
-
-        ESP_LOGI(TAG, "%.*s", payload_length*2, payload_buffer);
-        free(payload_buffer);
     }
     return ESP_OK;    
 }
@@ -763,6 +919,14 @@ esp_err_t log_packet_hex(wifi_mac_data_frame_t* packet, int payload_length, cons
 wifi_mac_data_frame_t* alloc_packet_custom(uint16_t frame_control, uint16_t duration_id, uint8_t address_1[6], uint8_t address_2[6], uint8_t address_3[6], uint16_t sequence_control, uint8_t address_4[6], int payload_length, uint8_t* payload) // LOC: 10
 {
     wifi_mac_data_frame_t* pkt = calloc(1, sizeof(wifi_mac_data_frame_t) + payload_length);
+    fill_packet_custom(pkt, frame_control, duration_id, address_1, address_2, address_3, sequence_control, address_4, payload_length, payload);
+    return pkt;
+}
+
+// Writes the static fields and the payload into an already allocated packet, shared by the heap and pooled alloc_packet methods.
+// When 'payload' is NULL the payload area is left as is, so callers that need it cleared must provide zeroed memory.
+void fill_packet_custom(wifi_mac_data_frame_t* pkt, uint16_t frame_control, uint16_t duration_id, uint8_t address_1[6], uint8_t address_2[6], uint8_t address_3[6], uint16_t sequence_control, uint8_t address_4[6], int payload_length, uint8_t* payload)
+{
     pkt->frame_control = frame_control;
     pkt->duration_id = duration_id;
     memcpy(pkt->address_1, address_1, sizeof(uint8_t[6]));
@@ -770,10 +934,9 @@ wifi_mac_data_frame_t* alloc_packet_custom(uint16_t frame_control, uint16_t dura
     memcpy(pkt->address_3, address_3, sizeof(uint8_t[6]));
     pkt->sequence_control = sequence_control;
     memcpy(pkt->address_4, address_4, sizeof(uint8_t[6]));
-    if(payload_length > 0){
+    if(payload_length > 0 && payload != NULL){
         memcpy(&pkt->payload, payload, payload_length);
     }
-    return pkt;
 }
 
 // This allocates a packet while only setting the payload (all other values are set to zero). From here, any individual value can be modified as desired
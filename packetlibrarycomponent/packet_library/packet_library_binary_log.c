@@ -0,0 +1,217 @@
+#include <stdatomic.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Binary deferred logging.
+    With the BINARY print option, the receive/send paths copy a fixed-size record (timestamp, header fields, first payload
+    bytes) into a bounded ring instead of formatting text. The ring takes records from several tasks at once (the WiFi driver
+    or deferred RX task for received packets, any sending task for sent packets), so every slot carries a sequence number that
+    says whose turn it is: a writer claims a slot by advancing 'write_position' with a compare-and-swap and publishes it by
+    storing the next sequence number. Formatting happens later, in the printer task or wherever 'read_binary_log_records' is called.
+*/
+
+typedef struct {
+    _Atomic uint32_t sequence;
+    binary_log_record_t record;
+} binary_log_slot_t;
+
+static binary_log_slot_t *binary_log_slots;
+static uint32_t binary_log_mask;
+static _Atomic uint32_t binary_log_write_position;
+static _Atomic uint32_t binary_log_read_position;
+static _Atomic uint32_t binary_log_records_written;
+static _Atomic uint32_t binary_log_records_lost;
+static _Atomic uint32_t binary_log_records_read;
+static TaskHandle_t binary_log_printer_task;
+
+void binary_log_record(enum binary_log_source source, const wifi_mac_data_frame_t* packet, int payload_length)
+{
+    if(binary_log_slots == NULL)
+    {
+        atomic_fetch_add_explicit(&binary_log_records_lost, 1, memory_order_relaxed);
+        return;
+    }
+
+    binary_log_slot_t *slot;
+    uint32_t position = atomic_load_explicit(&binary_log_write_position, memory_order_relaxed);
+    while(true)
+    {
+        slot = &binary_log_slots[position & binary_log_mask];
+        int32_t difference = (int32_t)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - position);
+        if(difference == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&binary_log_write_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if(difference < 0)
+        {
+            // The reader has not freed this slot yet, the ring is full
+            atomic_fetch_add_explicit(&binary_log_records_lost, 1, memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            position = atomic_load_explicit(&binary_log_write_position, memory_order_relaxed);
+        }
+    }
+
+    binary_log_record_t *record = &slot->record;
+    int captured_length = payload_length < BINARY_LOG_PAYLOAD_BYTES ? payload_length : BINARY_LOG_PAYLOAD_BYTES;
+    if(captured_length < 0)
+    {
+        captured_length = 0;
+    }
+    record->timestamp_us = esp_timer_get_time();
+    record->source = (uint8_t)source;
+    record->captured_payload_length = (uint8_t)captured_length;
+    record->payload_length = payload_length > 0 ? (uint16_t)payload_length : 0;
+    memcpy(record->header, packet, sizeof(record->header));
+    memcpy(record->payload, packet->payload, captured_length);
+
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    atomic_fetch_add_explicit(&binary_log_records_written, 1, memory_order_relaxed);
+}
+
+// This allocates the binary log ring. It has to be called before any print option is set to BINARY, records made before it are counted as lost.
+esp_err_t setup_binary_log(int record_slots)
+{
+    if(binary_log_slots != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(record_slots <= 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t capacity = 1;
+    while(capacity < (uint32_t)record_slots)
+    {
+        capacity <<= 1;
+    }
+    binary_log_slot_t *slots = calloc(capacity, sizeof(binary_log_slot_t));
+    if(slots == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    for(uint32_t index = 0; index < capacity; index++)
+    {
+        atomic_init(&slots[index].sequence, index);
+    }
+    binary_log_mask = capacity - 1;
+    atomic_store(&binary_log_write_position, 0);
+    atomic_store(&binary_log_read_position, 0);
+    atomic_store_explicit((_Atomic(binary_log_slot_t *) *)&binary_log_slots, slots, memory_order_release);
+    ESP_LOGI(LOGGING_TAG, "BINARY LOG READY (%u RECORDS)", (unsigned)capacity);
+    return ESP_OK;
+}
+
+// Copies up to 'max_records' of the oldest records into 'record_holder' and frees their slots. Safe to call from more than one task.
+int read_binary_log_records(binary_log_record_t record_holder[], int max_records)
+{
+    if(binary_log_slots == NULL || record_holder == NULL)
+    {
+        return 0;
+    }
+    int count = 0;
+    uint32_t position = atomic_load_explicit(&binary_log_read_position, memory_order_relaxed);
+    while(count < max_records)
+    {
+        binary_log_slot_t *slot = &binary_log_slots[position & binary_log_mask];
+        int32_t difference = (int32_t)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - (position + 1));
+        if(difference == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&binary_log_read_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                record_holder[count++] = slot->record;
+                atomic_store_explicit(&slot->sequence, position + binary_log_mask + 1, memory_order_release);
+                position++;
+            }
+        }
+        else if(difference < 0)
+        {
+            break; // Nothing more has been published
+        }
+        else
+        {
+            position = atomic_load_explicit(&binary_log_read_position, memory_order_relaxed);
+        }
+    }
+    atomic_fetch_add_explicit(&binary_log_records_read, count, memory_order_relaxed);
+    return count;
+}
+
+// This logs one binary log record with its source and timestamp, in the same layout as 'log_packet_annotated'
+esp_err_t log_binary_record(const binary_log_record_t* record, const char * TAG)
+{
+    static const char *source_names[] = { "PROM PRECALL", "PROM POSTCALL", "SEND PRECALL", "SEND POSTCALL" };
+    wifi_mac_data_frame_t packet;
+    memcpy(&packet, record->header, sizeof(packet));
+    char payload_buffer[BINARY_LOG_PAYLOAD_BYTES * 2 + 1];
+    format_payload_hex(record->payload, record->captured_payload_length, payload_buffer, sizeof(payload_buffer));
+
+    ESP_LOGI(TAG, "%s @%lld us\nFrame Control: %04X\nDuration_ID: %04X\nPacket Addr1: %02X:%02X:%02X:%02X:%02X:%02X\nAddr2: %02X:%02X:%02X:%02X:%02X:%02X\nAddr3 %02X:%02X:%02X:%02X:%02X:%02X\nSequence Control: %04X\nAddr4 %02X:%02X:%02X:%02X:%02X:%02X\nPayload (%d bytes): 0x%s%s",
+        record->source < 4 ? source_names[record->source] : "UNKNOWN", (long long)record->timestamp_us,
+        packet.frame_control, packet.duration_id,
+        packet.address_1[0], packet.address_1[1], packet.address_1[2], packet.address_1[3], packet.address_1[4], packet.address_1[5],
+        packet.address_2[0], packet.address_2[1], packet.address_2[2], packet.address_2[3], packet.address_2[4], packet.address_2[5],
+        packet.address_3[0], packet.address_3[1], packet.address_3[2], packet.address_3[3], packet.address_3[4], packet.address_3[5],
+        packet.sequence_control,
+        packet.address_4[0], packet.address_4[1], packet.address_4[2], packet.address_4[3], packet.address_4[4], packet.address_4[5],
+        record->payload_length, payload_buffer, record->captured_payload_length < record->payload_length ? "..." : ""
+    );
+    return ESP_OK;
+}
+
+// Printer task body, drains a few records at a time and yields while the ring is empty
+static void binary_log_printer(void *arg)
+{
+    binary_log_record_t records[8];
+    uint32_t reported_lost = 0;
+    while(true)
+    {
+        int count = read_binary_log_records(records, 8);
+        for(int index = 0; index < count; index++)
+        {
+            log_binary_record(&records[index], LOGGING_TAG);
+        }
+        uint32_t lost = atomic_load_explicit(&binary_log_records_lost, memory_order_relaxed);
+        if(lost != reported_lost)
+        {
+            ESP_LOGI(LOGGING_TAG, "BINARY LOG LOST %u RECORDS", (unsigned)(lost - reported_lost));
+            reported_lost = lost;
+        }
+        if(count == 0)
+        {
+            vTaskDelay(pdMS_TO_TICKS(20));
+        }
+    }
+}
+
+// Starts a task that prints the binary log records in the background. Give it a low priority so it only runs when the packet paths are idle.
+esp_err_t start_binary_log_printer(UBaseType_t task_priority, BaseType_t task_core)
+{
+    if(binary_log_slots == NULL || binary_log_printer_task != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(xTaskCreatePinnedToCore(&binary_log_printer, "pl_binary_log", 4096, NULL, task_priority, &binary_log_printer_task, task_core) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t get_binary_log_stats(binary_log_stats_t* stats_holder)
+{
+    stats_holder->records_written = atomic_load_explicit(&binary_log_records_written, memory_order_relaxed);
+    stats_holder->records_lost = atomic_load_explicit(&binary_log_records_lost, memory_order_relaxed);
+    stats_holder->records_read = atomic_load_explicit(&binary_log_records_read, memory_order_relaxed);
+    stats_holder->ring_capacity = binary_log_slots != NULL ? binary_log_mask + 1 : 0;
+    return ESP_OK;
+}
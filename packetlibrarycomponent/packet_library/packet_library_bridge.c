@@ -0,0 +1,475 @@
+#include <stdatomic.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Learning bridge.
+    Relays pass frames on in the 4 address data format (ToDS and FromDS set: receiver, transmitter, destination, source), so the
+    original source and final destination stay in the frame over every hop. Every data frame heard teaches the bridge which
+    neighbor (transmitter) its source is behind, and a 4 address frame sent to this device or to the broadcast address is passed
+    on in place: to the neighbor of a known destination, to the broadcast address for group and unknown destinations, or dropped
+    when the destination is behind the neighbor it came from. Frames keep their sequence control over the hops and each station
+    remembers the sequence numbers it sent recently, the newest with a 64 bit window of the ones before it like duplicate
+    detection keeps, so a flooded frame that comes round again is dropped instead of looping even when the source has sent
+    newer frames since or copies arrive over several paths out of order.
+    Stations live in a fixed 4 way set associative table, so learning and every forwarding decision look at one set of 4 entries.
+    Entries not heard from for max_age_ms no longer count and are the first to be replaced. Only the receive path writes the
+    table; each entry has a sequence count that is odd while it is being written, so bridge_send_packet and get_bridge_entry read
+    it without a lock, as the station table does.
+*/
+
+#define BRIDGE_WAYS 4
+#define BRIDGE_SEQUENCE_WINDOW 64
+#define BRIDGE_SEQUENCE_MODULO 4096
+
+typedef struct {
+    _Atomic uint32_t sequence; // Odd while the receive path is writing the entry
+    bool in_use;
+    uint8_t mac[6];
+    uint8_t neighbor[6];
+    uint8_t channel;
+    bool sequence_known; // A 4 address frame from this station was heard, the fields below are set
+    uint8_t last_fragment;
+    uint16_t last_sequence; // Newest sequence number of the 4 address frames from this station
+    uint32_t last_seen_ms;
+    uint64_t sequence_window; // Bit n set when sequence number last_sequence - n was heard
+} bridge_slot_t;
+
+typedef struct {
+    bridge_config_t config;
+    bridge_slot_t *slots;
+    uint32_t set_mask;
+    // Receive path owned counters
+    _Atomic uint32_t frames_bridged;
+    _Atomic uint32_t frames_flooded;
+    _Atomic uint32_t frames_filtered;
+    _Atomic uint32_t frames_looped;
+    _Atomic uint32_t frames_dropped_unknown;
+    _Atomic uint32_t stations_learned;
+    _Atomic uint32_t stations_moved;
+    _Atomic uint32_t evictions;
+    _Atomic uint32_t send_errors;
+} bridge_t;
+
+static bridge_t bridge;
+// Set and cleared with seq_cst, as is bridge_callers_busy: a caller counts itself in before it checks the flag and stop_bridge
+// clears the flag before it checks the count, so one of the two always sees the other
+_Atomic bool bridge_active;
+static _Atomic uint32_t bridge_callers_busy; // The receive path in bridge_handle_frame and tasks in bridge_send_packet or get_bridge_entry, so stop_bridge does not free the table under them. Outside bridge so setup_bridge does not clear it.
+
+// Counts the calling task in while the bridge runs, false (and not counted in) once it is stopped
+static bool bridge_enter()
+{
+    atomic_fetch_add(&bridge_callers_busy, 1);
+    if(!atomic_load(&bridge_active))
+    {
+        atomic_fetch_sub(&bridge_callers_busy, 1);
+        return false;
+    }
+    return true;
+}
+
+static void bridge_leave()
+{
+    atomic_fetch_sub(&bridge_callers_busy, 1);
+}
+
+static const uint8_t bridge_broadcast[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+static inline void count_bridge(_Atomic uint32_t *counter)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+static inline uint32_t bridge_now_ms()
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// The first of the 4 entries 'mac' can be in, from a Fibonacci hash of the 48 bit MAC
+static inline bridge_slot_t *bridge_set(const uint8_t mac[6])
+{
+    uint64_t key = ((uint64_t)mac[0] << 40) | ((uint64_t)mac[1] << 32) | ((uint64_t)mac[2] << 24) | ((uint64_t)mac[3] << 16) | ((uint64_t)mac[4] << 8) | mac[5];
+    uint32_t set = (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & bridge.set_mask;
+    return &bridge.slots[set * BRIDGE_WAYS];
+}
+
+static inline bool bridge_slot_live(const bridge_slot_t *slot, uint32_t now_ms)
+{
+    return slot->in_use && now_ms - slot->last_seen_ms <= bridge.config.max_age_ms;
+}
+
+// Receive path lookup, it is the only writer so it reads the entries directly
+static const bridge_slot_t *find_bridge_slot(const uint8_t mac[6], uint32_t now_ms)
+{
+    bridge_slot_t *set = bridge_set(mac);
+    for(int way = 0; way < BRIDGE_WAYS; way++)
+    {
+        if(bridge_slot_live(&set[way], now_ms) && memcmp(set[way].mac, mac, 6) == 0)
+        {
+            return &set[way];
+        }
+    }
+    return NULL;
+}
+
+// Copies the live entry for 'mac' out of the table for a task other than the receive path. Returns false if there is none.
+static bool read_bridge_slot(const uint8_t mac[6], bridge_slot_t *slot_holder)
+{
+    uint32_t now_ms = bridge_now_ms();
+    bridge_slot_t *set = bridge_set(mac);
+    for(int way = 0; way < BRIDGE_WAYS; way++)
+    {
+        bridge_slot_t *slot = &set[way];
+        uint32_t sequence;
+        do
+        {
+            sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+            if(sequence & 1)
+            {
+                continue;
+            }
+            slot_holder->in_use = slot->in_use;
+            memcpy(slot_holder->mac, slot->mac, 6);
+            memcpy(slot_holder->neighbor, slot->neighbor, 6);
+            slot_holder->channel = slot->channel;
+            slot_holder->last_seen_ms = slot->last_seen_ms;
+            atomic_thread_fence(memory_order_acquire);
+        } while((sequence & 1) || atomic_load_explicit(&slot->sequence, memory_order_relaxed) != sequence);
+        if(bridge_slot_live(slot_holder, now_ms) && memcmp(slot_holder->mac, mac, 6) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether a 4 address frame with this sequence and fragment number was already heard from the station
+static bool bridge_sequence_seen(const bridge_slot_t *slot, uint16_t sequence, uint8_t fragment)
+{
+    if(!slot->sequence_known)
+    {
+        return false;
+    }
+    uint32_t behind = (slot->last_sequence - sequence) & (BRIDGE_SEQUENCE_MODULO - 1);
+    if(behind == 0)
+    {
+        return fragment <= slot->last_fragment;
+    }
+    return behind < BRIDGE_SEQUENCE_WINDOW && (slot->sequence_window & (1ull << behind));
+}
+
+// Adds a sequence and fragment number bridge_sequence_seen returned false for to the station's window. Called with the entry being written.
+static void bridge_record_sequence(bridge_slot_t *slot, uint16_t sequence, uint8_t fragment)
+{
+    uint32_t ahead = (sequence - slot->last_sequence) & (BRIDGE_SEQUENCE_MODULO - 1);
+    uint32_t behind = BRIDGE_SEQUENCE_MODULO - ahead;
+    if(!slot->sequence_known || (ahead >= BRIDGE_SEQUENCE_MODULO / 2 && behind >= BRIDGE_SEQUENCE_WINDOW))
+    {
+        // First frame, or too far back to be a copy: the station restarted its sequence numbers
+        slot->sequence_known = true;
+        slot->last_sequence = sequence;
+        slot->last_fragment = fragment;
+        slot->sequence_window = 1;
+    }
+    else if(ahead == 0)
+    {
+        slot->last_fragment = fragment;
+    }
+    else if(ahead < BRIDGE_SEQUENCE_MODULO / 2)
+    {
+        slot->sequence_window = ahead < BRIDGE_SEQUENCE_WINDOW ? (slot->sequence_window << ahead) | 1 : 1;
+        slot->last_sequence = sequence;
+        slot->last_fragment = fragment;
+    }
+    else
+    {
+        // An older frame heard for the first time, copies can take different paths and arrive out of order
+        slot->sequence_window |= 1ull << behind;
+    }
+}
+
+// Learns the frame's source as being behind its transmitter. Returns true if the frame is a 4 address frame the source already sent, which has come round a loop.
+static bool bridge_learn(const wifi_frame_view_t *view, bool four_address, uint32_t now_ms)
+{
+    bridge_slot_t *set = bridge_set(view->source);
+    bridge_slot_t *slot = NULL;
+    for(int way = 0; way < BRIDGE_WAYS && slot == NULL; way++)
+    {
+        if(set[way].in_use && memcmp(set[way].mac, view->source, 6) == 0)
+        {
+            slot = &set[way];
+        }
+    }
+    if(slot != NULL && bridge_slot_live(slot, now_ms))
+    {
+        if(four_address && bridge_sequence_seen(slot, view->sequence_number, view->fragment_number))
+        {
+            return true;
+        }
+        if(memcmp(slot->neighbor, view->transmitter, 6) != 0)
+        {
+            count_bridge(&bridge.stations_moved);
+        }
+    }
+    else
+    {
+        if(slot == NULL)
+        {
+            // Take an unused or aged out entry of the set, or else replace the one heard from longest ago
+            slot = &set[0];
+            for(int way = 0; way < BRIDGE_WAYS; way++)
+            {
+                if(!bridge_slot_live(&set[way], now_ms))
+                {
+                    slot = &set[way];
+                    break;
+                }
+                if(now_ms - set[way].last_seen_ms > now_ms - slot->last_seen_ms)
+                {
+                    slot = &set[way];
+                }
+            }
+            if(bridge_slot_live(slot, now_ms))
+            {
+                count_bridge(&bridge.evictions);
+            }
+        }
+        count_bridge(&bridge.stations_learned);
+    }
+    bool new_station = !bridge_slot_live(slot, now_ms) || memcmp(slot->mac, view->source, 6) != 0;
+
+    atomic_store_explicit(&slot->sequence, atomic_load_explicit(&slot->sequence, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->in_use = true;
+    memcpy(slot->mac, view->source, 6);
+    memcpy(slot->neighbor, view->transmitter, 6);
+    slot->channel = view->channel;
+    if(new_station)
+    {
+        // A replaced or aged out entry's window belongs to the station that had it
+        slot->sequence_known = false;
+    }
+    if(four_address)
+    {
+        bridge_record_sequence(slot, view->sequence_number, view->fragment_number);
+    }
+    slot->last_seen_ms = now_ms;
+    atomic_store_explicit(&slot->sequence, atomic_load_explicit(&slot->sequence, memory_order_relaxed) + 1, memory_order_release);
+    return false;
+}
+
+// Rewrites the receiver and transmitter in place and sends the frame with its sequence control kept, so the next bridge can spot it coming round again.
+// esp_wifi_80211_tx copies the frame, so the two addresses are put back afterwards for the callbacks.
+static void bridge_transmit(const wifi_frame_view_t *view, const uint8_t receiver[6], const uint8_t own_mac[6], _Atomic uint32_t *counter)
+{
+    uint8_t received_addresses[12];
+    memcpy(received_addresses, &view->frame[4], 12);
+    memcpy(&view->frame[4], receiver, 6);
+    memcpy(&view->frame[10], own_mac, 6);
+    if(send_packet_raw_no_callback(view->frame, view->frame_length, false) == ESP_OK)
+    {
+        count_bridge(counter);
+    }
+    else
+    {
+        count_bridge(&bridge.send_errors);
+    }
+    memcpy(&view->frame[4], received_addresses, 12);
+}
+
+// Learns from a received data frame and passes 4 address frames on. Returns whether the frame is to be dropped before the prints and callbacks.
+bool bridge_handle_frame(wifi_frame_view_t *view)
+{
+    if(!bridge_enter())
+    {
+        return false;
+    }
+    const uint8_t *own_mac = get_configuration_holder()->mac_addr;
+    if(view->type != WIFI_FRAME_TYPE_DATA || view->source == NULL || view->transmitter == NULL || memcmp(view->transmitter, own_mac, 6) == 0)
+    {
+        bridge_leave();
+        return false;
+    }
+    uint32_t now_ms = bridge_now_ms();
+    bool four_address = view->to_ds && view->from_ds;
+    // A frame this device sent that another bridge flooded back is not learned from, the loop ends here
+    bool looped = memcmp(view->source, own_mac, 6) == 0 ? four_address : bridge_learn(view, four_address, now_ms);
+    if(!four_address || view->truncated || (memcmp(view->receiver, own_mac, 6) != 0 && memcmp(view->receiver, bridge_broadcast, 6) != 0))
+    {
+        bridge_leave();
+        return false;
+    }
+    if(looped)
+    {
+        count_bridge(&bridge.frames_looped);
+        bridge_leave();
+        return true;
+    }
+
+    bool drop = false;
+    const uint8_t *destination = view->destination;
+    if(destination[0] & 0x01)
+    {
+        // Group addressed frames go on to every neighbor and are also for this device
+        bridge_transmit(view, bridge_broadcast, own_mac, &bridge.frames_flooded);
+    }
+    else if(memcmp(destination, own_mac, 6) != 0)
+    {
+        const bridge_slot_t *slot = find_bridge_slot(destination, now_ms);
+        if(slot != NULL && memcmp(slot->neighbor, view->transmitter, 6) == 0)
+        {
+            count_bridge(&bridge.frames_filtered);
+            drop = true;
+        }
+        else if(slot != NULL)
+        {
+            bridge_transmit(view, slot->neighbor, own_mac, &bridge.frames_bridged);
+            drop = !bridge.config.deliver_bridged;
+        }
+        else if(bridge.config.flood_unknown)
+        {
+            bridge_transmit(view, bridge_broadcast, own_mac, &bridge.frames_flooded);
+            drop = !bridge.config.deliver_bridged;
+        }
+        else
+        {
+            count_bridge(&bridge.frames_dropped_unknown);
+            drop = true;
+        }
+    }
+    bridge_leave();
+    return drop;
+}
+
+// This allocates the bridge table and starts learning from received data frames. The send interface has to be set up, its MAC is the one the bridge answers to.
+esp_err_t setup_bridge(bridge_config_t config)
+{
+    if(atomic_load(&bridge_active))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(config.capacity <= 0 || config.max_age_ms == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t sets = 1;
+    while(sets * BRIDGE_WAYS < (uint32_t)config.capacity)
+    {
+        sets <<= 1;
+    }
+    memset(&bridge, 0, sizeof(bridge));
+    bridge.slots = calloc(sets * BRIDGE_WAYS, sizeof(bridge_slot_t));
+    if(bridge.slots == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    bridge.set_mask = sets - 1;
+    bridge.config = config;
+    atomic_store(&bridge_active, true);
+    ESP_LOGI(LOGGING_TAG, "BRIDGE STARTED (%u STATIONS)", (unsigned)(sets * BRIDGE_WAYS));
+    return ESP_OK;
+}
+
+esp_err_t stop_bridge()
+{
+    if(!atomic_exchange(&bridge_active, false))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    while(atomic_load(&bridge_callers_busy) > 0)
+    {
+        vTaskDelay(1);
+    }
+    free(bridge.slots);
+    bridge.slots = NULL;
+    return ESP_OK;
+}
+
+/*
+    Sends 'packet' to 'destination' through the bridge: the header becomes a 4 address data frame from this device with the
+    neighbor 'destination' was last heard through as the receiver, or the broadcast address for group addresses and stations
+    the bridge does not know (ESP_ERR_NOT_FOUND instead when flood_unknown is off). The rest goes through send_packet_simple,
+    so the send callbacks run and the driver numbers the frame.
+*/
+esp_err_t bridge_send_packet(wifi_mac_data_frame_t* packet, int payload_length, const uint8_t destination[6])
+{
+    if(packet == NULL || destination == NULL || payload_length < 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(!bridge_enter())
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    bridge_slot_t slot;
+    const uint8_t *receiver = bridge_broadcast;
+    if(!(destination[0] & 0x01) && read_bridge_slot(destination, &slot))
+    {
+        receiver = slot.neighbor;
+    }
+    else if(!(destination[0] & 0x01) && !bridge.config.flood_unknown)
+    {
+        bridge_leave();
+        return ESP_ERR_NOT_FOUND;
+    }
+    bridge_leave();
+
+    const uint8_t *own_mac = get_configuration_holder()->mac_addr;
+    packet->frame_control = 0x0308; // Data, ToDS and FromDS
+    memcpy(packet->address_1, receiver, 6);
+    memcpy(packet->address_2, own_mac, 6);
+    memcpy(packet->address_3, destination, 6);
+    memcpy(packet->address_4, own_mac, 6);
+    return send_packet_simple(packet, payload_length);
+}
+
+esp_err_t get_bridge_entry(const uint8_t mac[6], bridge_entry_t* entry_holder)
+{
+    if(mac == NULL || entry_holder == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(!bridge_enter())
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    bridge_slot_t slot;
+    bool found = read_bridge_slot(mac, &slot);
+    bridge_leave();
+    if(!found)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    memcpy(entry_holder->mac, slot.mac, 6);
+    memcpy(entry_holder->neighbor, slot.neighbor, 6);
+    entry_holder->channel = slot.channel;
+    entry_holder->age_ms = bridge_now_ms() - slot.last_seen_ms;
+    return ESP_OK;
+}
+
+// Copies the counters into 'stats_holder'. They are read while frames keep arriving, so they can be a few frames apart from each other.
+esp_err_t get_bridge_stats(bridge_stats_t* stats_holder)
+{
+    if(!atomic_load(&bridge_active))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(stats_holder == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stats_holder->frames_bridged = atomic_load_explicit(&bridge.frames_bridged, memory_order_relaxed);
+    stats_holder->frames_flooded = atomic_load_explicit(&bridge.frames_flooded, memory_order_relaxed);
+    stats_holder->frames_filtered = atomic_load_explicit(&bridge.frames_filtered, memory_order_relaxed);
+    stats_holder->frames_looped = atomic_load_explicit(&bridge.frames_looped, memory_order_relaxed);
+    stats_holder->frames_dropped_unknown = atomic_load_explicit(&bridge.frames_dropped_unknown, memory_order_relaxed);
+    stats_holder->stations_learned = atomic_load_explicit(&bridge.stations_learned, memory_order_relaxed);
+    stats_holder->stations_moved = atomic_load_explicit(&bridge.stations_moved, memory_order_relaxed);
+    stats_holder->evictions = atomic_load_explicit(&bridge.evictions, memory_order_relaxed);
+    stats_holder->send_errors = atomic_load_explicit(&bridge.send_errors, memory_order_relaxed);
+    return ESP_OK;
+}
@@ -0,0 +1,374 @@
+#include <stdatomic.h>
+#include <stddef.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Callback dispatch tables for the receive and send paths.
+    Every handler (the single set_*_callback_* one per field, and any number of add_*_callback_* subscribers with a context pointer)
+    is kept in a registry ordered by field. Each change rebuilds a dense table holding only the active handlers, each entry with the
+    offset of its field in the frame and how to call it, so dispatching a frame is one pass over the handlers that are actually set.
+    Tables are rebuilt into one of three buffers and published with a single atomic store. A dispatch pins the table it runs
+    through in a reader slot (packet_library_table_readers.c), a rebuild only reuses a buffer no dispatch pins, and a change that
+    drops a handler returns once the dispatches still running through the older table are done, so the handler and its context
+    are no longer in use by another task. Changes are serialized by a lock created on first use.
+*/
+
+#define CALLBACK_DISPATCH_TABLES 3
+
+// How an entry is called, the field family combined with whether it takes a context pointer
+enum callback_dispatch_kind {
+    CALLBACK_KIND_GENERAL,
+    CALLBACK_KIND_GENERAL_CTX,
+    CALLBACK_KIND_U16,
+    CALLBACK_KIND_U16_CTX,
+    CALLBACK_KIND_ADDRESS,
+    CALLBACK_KIND_ADDRESS_CTX,
+    CALLBACK_KIND_PAYLOAD,
+    CALLBACK_KIND_PAYLOAD_CTX
+};
+
+typedef struct {
+    uint8_t field; // enum packet_library_callback_field
+    uint8_t kind; // enum callback_dispatch_kind
+    uint16_t field_offset; // Offset of the field in wifi_mac_data_frame_t
+    callback_dispatch_handler_t handler;
+    void* ctx;
+    callback_subscription_t subscription; // 0 for the set_*_callback_* handler of the field
+} callback_dispatch_entry_t;
+
+typedef struct {
+    callback_dispatch_entry_t entries[PACKET_LIBRARY_MAX_CALLBACK_SUBSCRIBERS];
+    int entry_count;
+    bool modifies_header; // Any handler other than a set_* payload one, see send_callbacks_may_modify_header
+} callback_dispatch_table_t;
+
+typedef struct {
+    callback_dispatch_entry_t registry[PACKET_LIBRARY_MAX_CALLBACK_SUBSCRIBERS]; // Ordered by field, set_* handler first, then subscribers in the order they were added
+    int registry_count;
+    callback_dispatch_table_t tables[CALLBACK_DISPATCH_TABLES];
+    _Atomic(callback_dispatch_table_t *) active_table;
+    table_readers_t readers;
+} callback_dispatch_t;
+
+static const uint16_t callback_field_offsets[CALLBACK_FIELD_COUNT] = {
+    [CALLBACK_FIELD_GENERAL] = 0,
+    [CALLBACK_FIELD_FRAME_CONTROL] = offsetof(wifi_mac_data_frame_t, frame_control),
+    [CALLBACK_FIELD_DURATION_ID] = offsetof(wifi_mac_data_frame_t, duration_id),
+    [CALLBACK_FIELD_ADDRESS_1] = offsetof(wifi_mac_data_frame_t, address_1),
+    [CALLBACK_FIELD_ADDRESS_2] = offsetof(wifi_mac_data_frame_t, address_2),
+    [CALLBACK_FIELD_ADDRESS_3] = offsetof(wifi_mac_data_frame_t, address_3),
+    [CALLBACK_FIELD_SEQUENCE_CONTROL] = offsetof(wifi_mac_data_frame_t, sequence_control),
+    [CALLBACK_FIELD_ADDRESS_4] = offsetof(wifi_mac_data_frame_t, address_4),
+    [CALLBACK_FIELD_PAYLOAD] = offsetof(wifi_mac_data_frame_t, payload)
+};
+
+static callback_dispatch_t callback_dispatch[2]; // Indexed by enum callback_direction
+static _Atomic(SemaphoreHandle_t) callback_dispatch_lock;
+static _Atomic uint32_t callback_dispatch_next_subscription = 1;
+
+// The lock is created on first use. Two tasks racing here both create one, and the loser deletes its own.
+static SemaphoreHandle_t get_callback_dispatch_lock()
+{
+    SemaphoreHandle_t lock = atomic_load_explicit(&callback_dispatch_lock, memory_order_acquire);
+    if(lock == NULL)
+    {
+        SemaphoreHandle_t created = xSemaphoreCreateMutex();
+        if(created == NULL)
+        {
+            return NULL;
+        }
+        if(atomic_compare_exchange_strong_explicit(&callback_dispatch_lock, &lock, created, memory_order_acq_rel, memory_order_acquire))
+        {
+            lock = created;
+        }
+        else
+        {
+            vSemaphoreDelete(created);
+        }
+    }
+    return lock;
+}
+
+static enum callback_dispatch_kind callback_field_kind(enum packet_library_callback_field field, bool has_ctx)
+{
+    enum callback_dispatch_kind kind;
+    switch(field)
+    {
+        case CALLBACK_FIELD_GENERAL:
+            kind = CALLBACK_KIND_GENERAL;
+            break;
+        case CALLBACK_FIELD_FRAME_CONTROL:
+        case CALLBACK_FIELD_DURATION_ID:
+        case CALLBACK_FIELD_SEQUENCE_CONTROL:
+            kind = CALLBACK_KIND_U16;
+            break;
+        case CALLBACK_FIELD_PAYLOAD:
+            kind = CALLBACK_KIND_PAYLOAD;
+            break;
+        default:
+            kind = CALLBACK_KIND_ADDRESS;
+            break;
+    }
+    return has_ctx ? kind + 1 : kind;
+}
+
+// Takes the lock once a table buffer is free to rebuild into, waiting out other tasks' dispatches if each one is pinned.
+// Returns the buffer with the lock held, or NULL with the lock released if only the calling task's own dispatch pins them.
+static callback_dispatch_table_t *take_callback_dispatch_buffer(callback_dispatch_t *dispatch, SemaphoreHandle_t lock)
+{
+    while(true)
+    {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        bool pinned_by_caller;
+        callback_dispatch_table_t *table = table_readers_free_buffer(&dispatch->readers, dispatch->tables, sizeof(dispatch->tables[0]),
+            CALLBACK_DISPATCH_TABLES, atomic_load_explicit(&dispatch->active_table, memory_order_relaxed), &pinned_by_caller);
+        if(table != NULL)
+        {
+            return table;
+        }
+        xSemaphoreGive(lock);
+        if(pinned_by_caller)
+        {
+            return NULL;
+        }
+        vTaskDelay(1);
+    }
+}
+
+// Copies the registry into a free table buffer and publishes it. Called with the lock held.
+static void rebuild_callback_dispatch_table(callback_dispatch_t *dispatch, callback_dispatch_table_t *table)
+{
+    table->modifies_header = false;
+    for(int i = 0; i < dispatch->registry_count; i++)
+    {
+        table->entries[i] = dispatch->registry[i];
+        // A view payload starts inside wifi_mac_data_frame_t for frames with a shorter header, so only set_* payload handlers leave the header alone
+        table->modifies_header |= dispatch->registry[i].kind != CALLBACK_KIND_PAYLOAD;
+    }
+    table->entry_count = dispatch->registry_count;
+    atomic_store_explicit(&dispatch->active_table, table, memory_order_seq_cst);
+}
+
+// Inserts after the last entry for the same or an earlier field, keeping the registry in run order. Called with the lock held.
+static esp_err_t insert_callback_dispatch_entry(callback_dispatch_t *dispatch, callback_dispatch_entry_t entry, bool before_subscribers)
+{
+    if(dispatch->registry_count == PACKET_LIBRARY_MAX_CALLBACK_SUBSCRIBERS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    int position = 0;
+    while(position < dispatch->registry_count && (dispatch->registry[position].field < entry.field
+        || (dispatch->registry[position].field == entry.field && !before_subscribers)))
+    {
+        position++;
+    }
+    for(int i = dispatch->registry_count; i > position; i--)
+    {
+        dispatch->registry[i] = dispatch->registry[i - 1];
+    }
+    dispatch->registry[position] = entry;
+    dispatch->registry_count++;
+    return ESP_OK;
+}
+
+static void remove_callback_dispatch_entry(callback_dispatch_t *dispatch, int position)
+{
+    for(int i = position; i < dispatch->registry_count - 1; i++)
+    {
+        dispatch->registry[i] = dispatch->registry[i + 1];
+    }
+    dispatch->registry_count--;
+}
+
+esp_err_t callback_dispatch_set_handler(enum callback_direction direction, enum packet_library_callback_field field, callback_dispatch_handler_t handler, bool is_set)
+{
+    SemaphoreHandle_t lock = get_callback_dispatch_lock();
+    if(lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    callback_dispatch_t *dispatch = &callback_dispatch[direction];
+    callback_dispatch_table_t *table = take_callback_dispatch_buffer(dispatch, lock);
+    if(table == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    bool replaced = false;
+    for(int i = 0; i < dispatch->registry_count; i++)
+    {
+        if(dispatch->registry[i].field == field && dispatch->registry[i].subscription == 0)
+        {
+            remove_callback_dispatch_entry(dispatch, i);
+            replaced = true;
+            break;
+        }
+    }
+    esp_err_t status = ESP_OK;
+    if(is_set)
+    {
+        callback_dispatch_entry_t entry = {
+            .field = field,
+            .kind = callback_field_kind(field, false),
+            .field_offset = callback_field_offsets[field],
+            .handler = handler,
+            .ctx = NULL,
+            .subscription = 0
+        };
+        status = insert_callback_dispatch_entry(dispatch, entry, true);
+    }
+    rebuild_callback_dispatch_table(dispatch, table);
+    xSemaphoreGive(lock);
+    if(replaced)
+    {
+        table_readers_synchronize(&dispatch->readers, table);
+    }
+    return status;
+}
+
+esp_err_t callback_dispatch_add(enum callback_direction direction, enum packet_library_callback_field field, callback_dispatch_handler_t handler, void* ctx, callback_subscription_t* subscription_holder)
+{
+    if(field >= CALLBACK_FIELD_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    SemaphoreHandle_t lock = get_callback_dispatch_lock();
+    if(lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    callback_dispatch_t *dispatch = &callback_dispatch[direction];
+    callback_dispatch_entry_t entry = {
+        .field = field,
+        .kind = callback_field_kind(field, true),
+        .field_offset = callback_field_offsets[field],
+        .handler = handler,
+        .ctx = ctx,
+        .subscription = atomic_fetch_add_explicit(&callback_dispatch_next_subscription, 1, memory_order_relaxed)
+    };
+    callback_dispatch_table_t *table = take_callback_dispatch_buffer(dispatch, lock);
+    if(table == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t status = insert_callback_dispatch_entry(dispatch, entry, false);
+    if(status == ESP_OK)
+    {
+        rebuild_callback_dispatch_table(dispatch, table);
+    }
+    xSemaphoreGive(lock);
+    if(status == ESP_OK && subscription_holder != NULL)
+    {
+        *subscription_holder = entry.subscription;
+    }
+    return status;
+}
+
+esp_err_t callback_dispatch_remove(enum callback_direction direction, callback_subscription_t subscription)
+{
+    SemaphoreHandle_t lock = get_callback_dispatch_lock();
+    if(lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    callback_dispatch_t *dispatch = &callback_dispatch[direction];
+    esp_err_t status = ESP_ERR_NOT_FOUND;
+    callback_dispatch_table_t *table = take_callback_dispatch_buffer(dispatch, lock);
+    if(table == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for(int i = 0; i < dispatch->registry_count && subscription != 0; i++)
+    {
+        if(dispatch->registry[i].subscription == subscription)
+        {
+            remove_callback_dispatch_entry(dispatch, i);
+            rebuild_callback_dispatch_table(dispatch, table);
+            status = ESP_OK;
+            break;
+        }
+    }
+    xSemaphoreGive(lock);
+    if(status == ESP_OK)
+    {
+        // The handler's context may be freed once this returns, so no other task may still be calling it
+        table_readers_synchronize(&dispatch->readers, table);
+    }
+    return status;
+}
+
+// Whether the header of the viewed frame has the field at 'field_offset', which the context taking field handlers are only called for
+static bool frame_view_has_field(const wifi_frame_view_t *view, int field_offset, int field_size)
+{
+    int available = view->header_length < view->frame_length ? view->header_length : view->frame_length;
+    return field_offset + field_size <= available;
+}
+
+void callback_dispatch_run(enum callback_direction direction, const wifi_frame_view_t *view, int payload_length)
+{
+    callback_dispatch_t *dispatch = &callback_dispatch[direction];
+    if(atomic_load_explicit(&dispatch->active_table, memory_order_relaxed) == NULL)
+    {
+        return;
+    }
+    table_reader_slot_t *reader = table_readers_claim(&dispatch->readers);
+    const callback_dispatch_table_t *table;
+    TABLE_READERS_PIN(reader, &dispatch->active_table, table);
+    wifi_mac_data_frame_t *frame = (wifi_mac_data_frame_t *)view->frame;
+    const callback_dispatch_entry_t *entry = table->entries;
+    const callback_dispatch_entry_t *end = entry + table->entry_count;
+    for(; entry < end; entry++)
+    {
+        PROFILE_STAGE_BEGIN(handler_start);
+        uint8_t *field = (uint8_t *)frame + entry->field_offset;
+        switch(entry->kind)
+        {
+            case CALLBACK_KIND_GENERAL:
+                entry->handler.general(frame, payload_length);
+                break;
+            case CALLBACK_KIND_GENERAL_CTX:
+                entry->handler.general_ctx(view, entry->ctx);
+                break;
+            case CALLBACK_KIND_U16:
+                entry->handler.u16_field((uint16_t *)field);
+                break;
+            case CALLBACK_KIND_U16_CTX:
+                if(frame_view_has_field(view, entry->field_offset, sizeof(uint16_t)))
+                {
+                    entry->handler.u16_field_ctx((uint16_t *)field, view, entry->ctx);
+                }
+                break;
+            case CALLBACK_KIND_ADDRESS:
+                entry->handler.address(field);
+                break;
+            case CALLBACK_KIND_ADDRESS_CTX:
+                if(frame_view_has_field(view, entry->field_offset, sizeof(uint8_t[6])))
+                {
+                    entry->handler.address_ctx(field, view, entry->ctx);
+                }
+                break;
+            case CALLBACK_KIND_PAYLOAD:
+                entry->handler.payload(field, payload_length);
+                break;
+            case CALLBACK_KIND_PAYLOAD_CTX:
+                entry->handler.payload_ctx(view->payload, view->payload_length, view, entry->ctx);
+                break;
+        }
+        PROFILE_STAGE_END((direction == CALLBACK_DIRECTION_RECEIVE ? PROFILE_STAGE_RX_CALLBACK : PROFILE_STAGE_TX_CALLBACK) + entry->field, handler_start);
+    }
+    table_readers_release(reader);
+}
+
+bool callback_dispatch_modifies_header(enum callback_direction direction)
+{
+    callback_dispatch_t *dispatch = &callback_dispatch[direction];
+    table_reader_slot_t *reader = table_readers_claim(&dispatch->readers);
+    const callback_dispatch_table_t *table;
+    TABLE_READERS_PIN(reader, &dispatch->active_table, table);
+    bool modifies_header = table != NULL && table->modifies_header;
+    table_readers_release(reader);
+    return modifies_header;
+}
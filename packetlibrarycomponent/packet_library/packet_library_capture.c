@@ -0,0 +1,461 @@
+#include <stdatomic.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Streaming pcap capture.
+    Every received frame is appended, with a radiotap header built from its rx_ctrl metadata, to one of two block buffers.
+    When the active block is full it is handed to the capture task, which passes it to the configured output in one write,
+    while the receive path keeps filling the other block. Only the receive path (the WiFi driver task, or the deferred RX worker)
+    appends records, so the active block needs no lock, only the hand over flags.
+    The output is standard pcap (LINKTYPE_IEEE802_11_RADIOTAP) and opens in Wireshark/tcpdump as is.
+    With CAPTURE_FORMAT_COMPRESSED the capture task compresses each block before writing it (packet_library_compressed_capture.c)
+    and keeps the block in the index, which stop_capture_sink writes at the end. The receive path does the same work either way.
+*/
+
+#define PCAP_MAGIC 0xA1B2C3D4
+#define PCAP_LINKTYPE_IEEE802_11_RADIOTAP 127
+#define PCAP_SNAPLEN 65535
+#define PCAP_RECORD_HEADER_LENGTH 16
+
+// Radiotap present bits used by the capture
+#define RADIOTAP_TSFT (1 << 0)
+#define RADIOTAP_FLAGS (1 << 1)
+#define RADIOTAP_RATE (1 << 2)
+#define RADIOTAP_CHANNEL (1 << 3)
+#define RADIOTAP_DBM_ANTSIGNAL (1 << 5)
+#define RADIOTAP_DBM_ANTNOISE (1 << 6)
+#define RADIOTAP_ANTENNA (1 << 11)
+#define RADIOTAP_MCS (1 << 19)
+#define RADIOTAP_FLAGS_FCS_AT_END 0x10
+#define RADIOTAP_CHANNEL_CCK 0x0020
+#define RADIOTAP_CHANNEL_OFDM 0x0040
+#define RADIOTAP_CHANNEL_2GHZ 0x0080
+#define RADIOTAP_MAX_LENGTH 28
+
+// rx_ctrl.rate (wifi_phy_rate_t) to radiotap rate in 500 kbps units, for legacy (non HT) frames
+static const uint8_t legacy_rate_500kbps[16] = { 2, 4, 11, 22, 0, 4, 11, 22, 96, 48, 24, 12, 108, 72, 36, 18 };
+
+typedef struct {
+    capture_sink_config_t config;
+    uint8_t *blocks[2];
+    size_t block_fill[2]; // Bytes to write for a handed over block
+    _Atomic bool block_pending[2]; // Handed to the capture task and not written yet
+    int active_block; // Receive path owned
+    size_t active_fill; // Receive path owned
+    uint32_t last_timestamp; // Receive path owned, used to extend the 32 bit rx_ctrl timestamp
+    uint32_t timestamp_wraps;
+    uint8_t *workspace; // CAPTURE_FORMAT_COMPRESSED only, capture task owned from here to 'index'
+    uint8_t *compressed_block;
+    uint32_t block_number;
+    uint64_t output_offset;
+    compressed_capture_index_t index;
+    TaskHandle_t task;
+    _Atomic bool flush_requested;
+    _Atomic bool stop_requested;
+    _Atomic bool task_stopped;
+    _Atomic uint32_t frames_captured;
+    _Atomic uint32_t frames_truncated;
+    _Atomic uint32_t frames_dropped;
+    _Atomic uint32_t blocks_written;
+    _Atomic uint32_t write_errors;
+    _Atomic uint64_t bytes_written;
+    _Atomic uint64_t bytes_captured;
+} capture_sink_t;
+
+// Set and cleared with seq_cst, as is capture_sink_producers_busy: the receive path counts itself in before it checks the flag and
+// stop_capture_sink clears the flag before it checks the count, so one of the two always sees the other
+_Atomic bool capture_sink_active;
+static _Atomic uint32_t capture_sink_producers_busy; // Receive paths inside capture_record_frame, so stop_capture_sink does not free the blocks under them. Outside capture_sink so setup_capture_sink does not clear it.
+static capture_sink_t capture_sink;
+
+static inline void put_le16(uint8_t *output, uint16_t value)
+{
+    output[0] = value & 0xFF;
+    output[1] = value >> 8;
+}
+
+static inline void put_le32(uint8_t *output, uint32_t value)
+{
+    put_le16(output, value & 0xFFFF);
+    put_le16(output + 2, value >> 16);
+}
+
+static inline void put_le64(uint8_t *output, uint64_t value)
+{
+    put_le32(output, value & 0xFFFFFFFF);
+    put_le32(output + 4, value >> 32);
+}
+
+// Builds the radiotap header for a frame into 'output' (at least RADIOTAP_MAX_LENGTH bytes) and returns its length.
+// Field order and alignment follow the radiotap spec: TSFT (8, aligned 8), flags, rate, channel (aligned 2), signal, noise, antenna, MCS.
+// 'fcs_present' is false when the end of the frame, and with it the FCS, was cut off before the capture.
+static int build_radiotap_header(const wifi_pkt_rx_ctrl_t *rx_ctrl, uint64_t timestamp_us, bool fcs_present, uint8_t *output)
+{
+    bool is_ht = rx_ctrl->sig_mode != 0;
+    uint32_t present = RADIOTAP_TSFT | RADIOTAP_FLAGS | RADIOTAP_CHANNEL | RADIOTAP_DBM_ANTSIGNAL | RADIOTAP_DBM_ANTNOISE | RADIOTAP_ANTENNA;
+    present |= is_ht ? RADIOTAP_MCS : RADIOTAP_RATE;
+
+    int offset = 8;
+    put_le64(&output[offset], timestamp_us);
+    offset += 8;
+    output[offset++] = fcs_present ? RADIOTAP_FLAGS_FCS_AT_END : 0; // The driver hands over frames with the FCS still attached
+    if(!is_ht)
+    {
+        output[offset++] = legacy_rate_500kbps[rx_ctrl->rate & 0x0F];
+    }
+    if(offset & 1)
+    {
+        output[offset++] = 0; // Pad so the channel field is 2 byte aligned
+    }
+    uint16_t channel = rx_ctrl->channel;
+    uint16_t frequency = channel == 14 ? 2484 : 2407 + 5 * channel;
+    bool is_cck = !is_ht && (rx_ctrl->rate <= 7);
+    put_le16(&output[offset], frequency);
+    put_le16(&output[offset + 2], RADIOTAP_CHANNEL_2GHZ | (is_cck ? RADIOTAP_CHANNEL_CCK : RADIOTAP_CHANNEL_OFDM));
+    offset += 4;
+    output[offset++] = (uint8_t)(int8_t)rx_ctrl->rssi;
+    output[offset++] = (uint8_t)(int8_t)rx_ctrl->noise_floor;
+    output[offset++] = rx_ctrl->ant;
+    if(is_ht)
+    {
+        output[offset++] = 0x07; // Known: bandwidth, MCS index, guard interval
+        output[offset++] = (rx_ctrl->cwb ? 0x01 : 0x00) | (rx_ctrl->sgi ? 0x04 : 0x00);
+        output[offset++] = rx_ctrl->mcs;
+    }
+
+    output[0] = 0; // Version
+    output[1] = 0; // Pad
+    put_le16(&output[2], offset);
+    put_le32(&output[4], present);
+    return offset;
+}
+
+// Hands the active block to the capture task and switches to the other one. Returns false if the other block is still being written.
+static bool capture_switch_block()
+{
+    int next_block = capture_sink.active_block ^ 1;
+    if(atomic_load_explicit(&capture_sink.block_pending[next_block], memory_order_acquire))
+    {
+        return false;
+    }
+    capture_sink.block_fill[capture_sink.active_block] = capture_sink.active_fill;
+    atomic_store_explicit(&capture_sink.block_pending[capture_sink.active_block], true, memory_order_release);
+    xTaskNotifyGive(capture_sink.task);
+    capture_sink.active_block = next_block;
+    capture_sink.active_fill = 0;
+    return true;
+}
+
+void capture_record_frame(const wifi_pkt_rx_ctrl_t *rx_ctrl, const uint8_t *frame, int frame_length)
+{
+    atomic_fetch_add(&capture_sink_producers_busy, 1);
+    if(!atomic_load(&capture_sink_active))
+    {
+        atomic_fetch_sub(&capture_sink_producers_busy, 1);
+        return;
+    }
+
+    // rx_ctrl.timestamp is a 32 bit microsecond counter, extend it so the capture timeline does not jump back every ~71 minutes
+    uint32_t timestamp = rx_ctrl->timestamp;
+    if(timestamp < capture_sink.last_timestamp)
+    {
+        capture_sink.timestamp_wraps++;
+    }
+    capture_sink.last_timestamp = timestamp;
+    uint64_t timestamp_us = ((uint64_t)capture_sink.timestamp_wraps << 32) | timestamp;
+
+    // A frame the deferred RX slot cut short arrives without its FCS
+    size_t captured_length = frame_length > 0 ? frame_length : 0;
+    uint8_t radiotap[RADIOTAP_MAX_LENGTH];
+    int radiotap_length = build_radiotap_header(rx_ctrl, timestamp_us, captured_length >= rx_ctrl->sig_len, radiotap);
+    size_t record_room = capture_sink.config.block_size - PCAP_RECORD_HEADER_LENGTH - radiotap_length;
+    if(captured_length > record_room)
+    {
+        captured_length = record_room;
+        atomic_fetch_add_explicit(&capture_sink.frames_truncated, 1, memory_order_relaxed);
+        build_radiotap_header(rx_ctrl, timestamp_us, false, radiotap); // Same length, only the FCS flag changes
+    }
+    size_t record_length = PCAP_RECORD_HEADER_LENGTH + radiotap_length + captured_length;
+
+    bool flush = atomic_load_explicit(&capture_sink.flush_requested, memory_order_relaxed) && capture_sink.active_fill > 0;
+    if(capture_sink.active_fill + record_length > capture_sink.config.block_size || flush)
+    {
+        if(!capture_switch_block())
+        {
+            atomic_fetch_add_explicit(&capture_sink.frames_dropped, 1, memory_order_relaxed);
+            atomic_fetch_sub(&capture_sink_producers_busy, 1);
+            return;
+        }
+        atomic_store_explicit(&capture_sink.flush_requested, false, memory_order_relaxed);
+    }
+
+    uint8_t *record = capture_sink.blocks[capture_sink.active_block] + capture_sink.active_fill;
+    uint32_t record_header[4] = {
+        (uint32_t)(timestamp_us / 1000000),
+        (uint32_t)(timestamp_us % 1000000),
+        (uint32_t)(radiotap_length + captured_length),
+        (uint32_t)(radiotap_length + rx_ctrl->sig_len) // Length on air, so readers see when the record holds less
+    };
+    memcpy(record, record_header, PCAP_RECORD_HEADER_LENGTH);
+    memcpy(record + PCAP_RECORD_HEADER_LENGTH, radiotap, radiotap_length);
+    memcpy(record + PCAP_RECORD_HEADER_LENGTH + radiotap_length, frame, captured_length);
+    capture_sink.active_fill += record_length;
+    atomic_fetch_add_explicit(&capture_sink.frames_captured, 1, memory_order_relaxed);
+    atomic_fetch_sub(&capture_sink_producers_busy, 1);
+}
+
+static void capture_write_block(int block)
+{
+    const uint8_t *data = capture_sink.blocks[block];
+    size_t length = capture_sink.block_fill[block];
+    if(capture_sink.config.format == CAPTURE_FORMAT_COMPRESSED)
+    {
+        // A block that fails to compress is counted as a write error and left out of the output and the index
+        if(compress_capture_block(data, length, PCAP_LINKTYPE_IEEE802_11_RADIOTAP, capture_sink.block_number, capture_sink.workspace, capture_sink.compressed_block, &length) != ESP_OK)
+        {
+            atomic_fetch_add_explicit(&capture_sink.write_errors, 1, memory_order_relaxed);
+            return;
+        }
+        data = capture_sink.compressed_block;
+    }
+    esp_err_t status = capture_sink.config.write(capture_sink.config.context, data, length);
+    if(status == ESP_OK)
+    {
+        if(capture_sink.config.format == CAPTURE_FORMAT_COMPRESSED)
+        {
+            add_compressed_capture_index_block(&capture_sink.index, (const compressed_capture_block_header_t *)capture_sink.compressed_block, capture_sink.output_offset);
+            capture_sink.output_offset += length;
+            capture_sink.block_number++;
+        }
+        atomic_fetch_add_explicit(&capture_sink.blocks_written, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&capture_sink.bytes_written, length, memory_order_relaxed);
+        atomic_fetch_add_explicit(&capture_sink.bytes_captured, capture_sink.block_fill[block], memory_order_relaxed);
+    }
+    else
+    {
+        atomic_fetch_add_explicit(&capture_sink.write_errors, 1, memory_order_relaxed);
+    }
+}
+
+// Capture task body, writes handed over blocks oldest first and asks the receive path to hand over partial blocks on the flush interval
+static void capture_task(void *arg)
+{
+    TickType_t wait = capture_sink.config.flush_interval_ms > 0 ? pdMS_TO_TICKS(capture_sink.config.flush_interval_ms) : portMAX_DELAY;
+    int next_block = 0;
+    while(!capture_sink.stop_requested)
+    {
+        if(ulTaskNotifyTake(pdTRUE, wait) == 0 && capture_sink.config.flush_interval_ms > 0)
+        {
+            atomic_store_explicit(&capture_sink.flush_requested, true, memory_order_relaxed);
+        }
+        // Blocks are handed over alternately, so writing in turn keeps the file in capture order
+        while(atomic_load_explicit(&capture_sink.block_pending[next_block], memory_order_acquire))
+        {
+            capture_write_block(next_block);
+            atomic_store_explicit(&capture_sink.block_pending[next_block], false, memory_order_release);
+            next_block ^= 1;
+        }
+    }
+    capture_sink.task_stopped = true;
+    vTaskDelete(NULL);
+}
+
+static void free_capture_buffers()
+{
+    free(capture_sink.blocks[0]);
+    free(capture_sink.blocks[1]);
+    free(capture_sink.workspace);
+    free(capture_sink.compressed_block);
+    free_compressed_capture_index(&capture_sink.index);
+    capture_sink.blocks[0] = NULL;
+    capture_sink.blocks[1] = NULL;
+    capture_sink.workspace = NULL;
+    capture_sink.compressed_block = NULL;
+}
+
+// Writes the header the capture format starts with
+static esp_err_t capture_write_file_header()
+{
+    if(capture_sink.config.format == CAPTURE_FORMAT_COMPRESSED)
+    {
+        compressed_capture_file_header_t file_header = {
+            .magic = COMPRESSED_CAPTURE_FILE_MAGIC,
+            .version = COMPRESSED_CAPTURE_VERSION,
+            .header_size = sizeof(compressed_capture_file_header_t),
+            .linktype = PCAP_LINKTYPE_IEEE802_11_RADIOTAP,
+            .block_size = capture_sink.config.block_size
+        };
+        capture_sink.output_offset = sizeof(file_header);
+        return capture_sink.config.write(capture_sink.config.context, (const uint8_t *)&file_header, sizeof(file_header));
+    }
+    uint32_t file_header[6] = { PCAP_MAGIC, 2 | (4 << 16), 0, 0, PCAP_SNAPLEN, PCAP_LINKTYPE_IEEE802_11_RADIOTAP }; // Version 2.4, little endian on both ESP32 and host
+    return capture_sink.config.write(capture_sink.config.context, (const uint8_t *)file_header, sizeof(file_header));
+}
+
+// This allocates the two capture blocks, writes the file header to the output and starts capturing every received frame.
+// Frames are captured from the component promiscuous callback, so promiscuous mode has to be setup with one of the setup_promiscuous_simple* or setup_promiscuous_deferred methods.
+// CAPTURE_FORMAT_COMPRESSED also allocates a compressed block, the compression workspace and the index: about 2.4 x block_size + 10 KB + 64 bytes per index entry.
+esp_err_t setup_capture_sink(capture_sink_config_t config)
+{
+    if(atomic_load(&capture_sink_active))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(config.write == NULL || config.block_size < PCAP_RECORD_HEADER_LENGTH + RADIOTAP_MAX_LENGTH + sizeof(wifi_mac_data_frame_t))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(config.format == CAPTURE_FORMAT_COMPRESSED && (config.block_size > COMPRESSED_CAPTURE_MAX_BLOCK_SIZE || config.index_entries < 2))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(&capture_sink, 0, sizeof(capture_sink));
+    capture_sink.config = config;
+    capture_sink.blocks[0] = malloc(config.block_size);
+    capture_sink.blocks[1] = malloc(config.block_size);
+    bool allocated = capture_sink.blocks[0] != NULL && capture_sink.blocks[1] != NULL;
+    if(allocated && config.format == CAPTURE_FORMAT_COMPRESSED)
+    {
+        capture_sink.workspace = malloc(COMPRESSED_CAPTURE_WORKSPACE_SIZE(config.block_size));
+        capture_sink.compressed_block = malloc(sizeof(compressed_capture_block_header_t) + config.block_size);
+        allocated = capture_sink.workspace != NULL && capture_sink.compressed_block != NULL && setup_compressed_capture_index(&capture_sink.index, config.index_entries) == ESP_OK;
+    }
+    if(!allocated)
+    {
+        free_capture_buffers();
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t status = capture_write_file_header();
+    if(status != ESP_OK)
+    {
+        free_capture_buffers();
+        return status;
+    }
+
+    if(xTaskCreatePinnedToCore(&capture_task, "pl_capture", 3072, NULL, config.task_priority, &capture_sink.task, config.task_core) != pdPASS)
+    {
+        free_capture_buffers();
+        return ESP_ERR_NO_MEM;
+    }
+    atomic_store(&capture_sink_active, true);
+    ESP_LOGI(LOGGING_TAG, "CAPTURE STARTED (2 x %u BYTE BLOCKS%s)", (unsigned)config.block_size, config.format == CAPTURE_FORMAT_COMPRESSED ? ", COMPRESSED" : "");
+    return ESP_OK;
+}
+
+// Stops capturing new frames, writes out everything still buffered (and the index of a compressed capture), and frees the blocks. The output itself (e.g. the FILE*) is left for the caller to close.
+esp_err_t stop_capture_sink()
+{
+    if(!atomic_exchange(&capture_sink_active, false))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    while(atomic_load(&capture_sink_producers_busy) > 0)
+    {
+        vTaskDelay(1);
+    }
+    capture_sink.stop_requested = true;
+    xTaskNotifyGive(capture_sink.task);
+    while(!capture_sink.task_stopped)
+    {
+        vTaskDelay(1);
+    }
+
+    // The block handed over last is older than the active one
+    int older_block = capture_sink.active_block ^ 1;
+    if(atomic_load(&capture_sink.block_pending[older_block]))
+    {
+        capture_write_block(older_block);
+    }
+    if(capture_sink.active_fill > 0)
+    {
+        capture_sink.block_fill[capture_sink.active_block] = capture_sink.active_fill;
+        capture_write_block(capture_sink.active_block);
+    }
+    if(capture_sink.config.format == CAPTURE_FORMAT_COMPRESSED &&
+       write_compressed_capture_index(&capture_sink.index, capture_sink.output_offset, capture_sink.config.write, capture_sink.config.context) != ESP_OK)
+    {
+        atomic_fetch_add_explicit(&capture_sink.write_errors, 1, memory_order_relaxed);
+    }
+    free_capture_buffers();
+    ESP_LOGI(LOGGING_TAG, "CAPTURE STOPPED (%u FRAMES)", (unsigned)atomic_load(&capture_sink.frames_captured));
+    return ESP_OK;
+}
+
+esp_err_t get_capture_stats(capture_stats_t* stats_holder)
+{
+    stats_holder->frames_captured = atomic_load_explicit(&capture_sink.frames_captured, memory_order_relaxed);
+    stats_holder->frames_truncated = atomic_load_explicit(&capture_sink.frames_truncated, memory_order_relaxed);
+    stats_holder->frames_dropped = atomic_load_explicit(&capture_sink.frames_dropped, memory_order_relaxed);
+    stats_holder->blocks_written = atomic_load_explicit(&capture_sink.blocks_written, memory_order_relaxed);
+    stats_holder->write_errors = atomic_load_explicit(&capture_sink.write_errors, memory_order_relaxed);
+    stats_holder->bytes_written = atomic_load_explicit(&capture_sink.bytes_written, memory_order_relaxed);
+    stats_holder->bytes_captured = atomic_load_explicit(&capture_sink.bytes_captured, memory_order_relaxed);
+    return ESP_OK;
+}
+
+// Capture output for a FILE* opened by the caller ("wb"). Works for regular files on the host, VFS mounted storage (SPIFFS, FAT, SD), and /dev/uart/N.
+esp_err_t capture_output_file(void* context, const uint8_t* data, size_t length)
+{
+    FILE *file = (FILE *)context;
+    if(fwrite(data, 1, length, file) != length)
+    {
+        return ESP_FAIL;
+    }
+    fflush(file);
+    return ESP_OK;
+}
+
+// Sets up a byte ring the capture output can write into, for reading the pcap stream back out from application code (e.g. to send over the network)
+esp_err_t setup_capture_memory_ring(capture_memory_ring_t* ring, size_t size)
+{
+    if(ring == NULL || size == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(ring, 0, sizeof(capture_memory_ring_t));
+    ring->buffer = malloc(size);
+    if(ring->buffer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    ring->size = size;
+    return ESP_OK;
+}
+
+// Capture output that copies whole blocks into a capture_memory_ring_t. A block that does not fit is dropped entirely.
+esp_err_t capture_output_memory_ring(void* context, const uint8_t* data, size_t length)
+{
+    capture_memory_ring_t *ring = (capture_memory_ring_t *)context;
+    size_t head = ring->head;
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    size_t used = head >= tail ? head - tail : ring->size - tail + head;
+    if(ring->size - used - 1 < length)
+    {
+        ring->bytes_dropped += length;
+        return ESP_ERR_NO_MEM;
+    }
+    size_t first_part = ring->size - head < length ? ring->size - head : length;
+    memcpy(ring->buffer + head, data, first_part);
+    memcpy(ring->buffer, data + first_part, length - first_part);
+    __atomic_store_n(&ring->head, (head + length) % ring->size, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+// Copies up to 'max_length' buffered pcap bytes out of the ring and returns how many were copied
+size_t read_capture_memory_ring(capture_memory_ring_t* ring, uint8_t* output_buffer, size_t max_length)
+{
+    size_t tail = ring->tail;
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t available = head >= tail ? head - tail : ring->size - tail + head;
+    size_t length = available < max_length ? available : max_length;
+    size_t first_part = ring->size - tail < length ? ring->size - tail : length;
+    memcpy(output_buffer, ring->buffer + tail, first_part);
+    memcpy(output_buffer + first_part, ring->buffer, length - first_part);
+    __atomic_store_n(&ring->tail, (tail + length) % ring->size, __ATOMIC_RELEASE);
+    return length;
+}
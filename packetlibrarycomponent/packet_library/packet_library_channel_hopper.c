@@ -0,0 +1,346 @@
+#include <stdatomic.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Channel hopper.
+    An esp_timer one shot timer moves the radio to the next configured channel and is started again with that channel's dwell.
+    The receive path counts the frames heard on each channel, and the new transmitters: ones not among the last few hundred
+    different transmitters heard there. They are remembered as transmitter address hashes in two bitmaps per channel, and once
+    the current one has CHANNEL_HOPPER_SEEN_WINDOW set it becomes the previous one and the oldest is cleared, so the bitmaps
+    never fill up (at most a quarter of the bits are set, which bounds how often a collision hides a new transmitter) and a
+    channel whose transmitters keep changing is counted at its real rate. When a visit ends its
+    frame and new transmitter rates go into per channel moving averages, and every channel's next dwell is placed between the
+    configured bounds by how active it is compared to the busiest channel, where activity is the frame rate plus the new
+    transmitter rate times 'new_transmitter_weight'. Channels nothing was heard on keep the minimum dwell and are still visited,
+    so traffic that starts later is found. A channel's first visit uses the middle of the bounds.
+    Only the receive path writes the frame counters and only the timer writes the rest, under the hopper lock so the stats can be
+    copied out whole.
+*/
+
+#define CHANNEL_HOPPER_SEEN_BITS 2048
+#define CHANNEL_HOPPER_SEEN_WINDOW (CHANNEL_HOPPER_SEEN_BITS / 8) // Transmitters in the current bitmap before it is rotated out
+
+typedef struct {
+    _Atomic uint32_t frames; // Receive path owned
+    _Atomic uint32_t new_transmitters; // Receive path owned
+    uint32_t seen[2][CHANNEL_HOPPER_SEEN_BITS / 32]; // Receive path owned, [seen_current] is filling and the other one is the previous window
+    uint8_t seen_current;
+    uint16_t seen_count; // Bits set in seen[seen_current]
+} channel_hopper_counters_t;
+
+typedef struct {
+    channel_hopper_config_t config;
+    channel_hopper_counters_t *counters; // Indexed by channel number - 1
+    esp_timer_handle_t timer;
+    int position; // Index into config.channels of the channel being visited
+    int64_t visit_start_us;
+    uint32_t visit_start_frames;
+    uint32_t visit_start_new_transmitters;
+    bool visited[CHANNEL_HOPPER_MAX_CHANNELS];
+    channel_hopper_stats_t stats;
+} channel_hopper_t;
+
+static channel_hopper_t channel_hopper;
+static _Atomic(SemaphoreHandle_t) channel_hopper_lock = NULL;
+// Set and cleared with seq_cst, as is channel_hopper_producers_busy: the receive path counts itself in before it checks the flag and
+// stop_channel_hopper clears the flag before it checks the count, so one of the two always sees the other
+_Atomic bool channel_hopper_active;
+volatile uint8_t channel_hopper_channel;
+// Receive paths inside channel_hopper_record_frame and the timer callback inside channel_hop, so stop_channel_hopper does not free the counters under them. Outside channel_hopper so setup_channel_hopper does not clear them.
+static _Atomic uint32_t channel_hopper_producers_busy;
+static _Atomic bool channel_hopper_hop_busy;
+
+static SemaphoreHandle_t get_channel_hopper_lock()
+{
+    SemaphoreHandle_t lock = atomic_load_explicit(&channel_hopper_lock, memory_order_acquire);
+    if(lock == NULL)
+    {
+        SemaphoreHandle_t created = xSemaphoreCreateMutex();
+        if(created == NULL)
+        {
+            return NULL;
+        }
+        if(atomic_compare_exchange_strong_explicit(&channel_hopper_lock, &lock, created, memory_order_acq_rel, memory_order_acquire))
+        {
+            lock = created;
+        }
+        else
+        {
+            vSemaphoreDelete(created);
+        }
+    }
+    return lock;
+}
+
+// Counts a received frame towards its channel, and its transmitter when that is not in either seen bitmap of the channel
+void channel_hopper_record_frame(const wifi_frame_view_t *view)
+{
+    atomic_fetch_add(&channel_hopper_producers_busy, 1);
+    if(!atomic_load(&channel_hopper_active) || view->channel < 1 || view->channel > CHANNEL_HOPPER_MAX_CHANNELS)
+    {
+        atomic_fetch_sub(&channel_hopper_producers_busy, 1);
+        return;
+    }
+    channel_hopper_counters_t *counters = &channel_hopper.counters[view->channel - 1];
+    atomic_store_explicit(&counters->frames, atomic_load_explicit(&counters->frames, memory_order_relaxed) + 1, memory_order_relaxed);
+    if(view->transmitter != NULL)
+    {
+        const uint8_t *mac = view->transmitter;
+        uint32_t hash = ((mac[2] << 24) | (mac[3] << 16) | (mac[4] << 8) | mac[5]) * 2654435761u ^ ((mac[0] << 8) | mac[1]);
+        uint32_t bit = (hash >> 16) % CHANNEL_HOPPER_SEEN_BITS;
+        uint32_t *current = counters->seen[counters->seen_current];
+        uint32_t *previous = counters->seen[counters->seen_current ^ 1];
+        if(!(current[bit / 32] & (1u << (bit % 32))))
+        {
+            current[bit / 32] |= 1u << (bit % 32);
+            if(!(previous[bit / 32] & (1u << (bit % 32))))
+            {
+                atomic_store_explicit(&counters->new_transmitters, atomic_load_explicit(&counters->new_transmitters, memory_order_relaxed) + 1, memory_order_relaxed);
+            }
+            if(++counters->seen_count == CHANNEL_HOPPER_SEEN_WINDOW)
+            {
+                counters->seen_current ^= 1;
+                memset(counters->seen[counters->seen_current], 0, sizeof(counters->seen[0]));
+                counters->seen_count = 0;
+            }
+        }
+    }
+    atomic_fetch_sub(&channel_hopper_producers_busy, 1);
+}
+
+// Places every visited channel's next dwell between the bounds by its activity compared to the busiest channel
+static void update_channel_hopper_dwells()
+{
+    channel_hopper_config_t *config = &channel_hopper.config;
+    uint64_t activity[CHANNEL_HOPPER_MAX_CHANNELS];
+    uint64_t peak = 0;
+    for(int index = 0; index < config->channel_count; index++)
+    {
+        channel_hopper_channel_stats_t *channel = &channel_hopper.stats.channels[index];
+        activity[index] = channel->frames_per_second + (uint64_t)channel->new_transmitters_per_second * config->new_transmitter_weight;
+        if(channel_hopper.visited[index] && activity[index] > peak)
+        {
+            peak = activity[index];
+        }
+    }
+    for(int index = 0; index < config->channel_count; index++)
+    {
+        if(!channel_hopper.visited[index])
+        {
+            continue;
+        }
+        uint32_t span = config->max_dwell_us - config->min_dwell_us;
+        channel_hopper.stats.channels[index].next_dwell_us = config->min_dwell_us + (peak == 0 ? 0 : (uint32_t)(span * activity[index] / peak));
+    }
+}
+
+static inline uint32_t average_channel_hopper_rate(uint32_t average, uint32_t rate, bool first, int shift)
+{
+    if(first)
+    {
+        return rate;
+    }
+    return (uint32_t)((int64_t)average + (((int64_t)rate - (int64_t)average) >> shift));
+}
+
+// Timer callback: ends the visit to the current channel, moves to the next one and starts the timer with its dwell
+static void channel_hop(void *arg)
+{
+    atomic_store(&channel_hopper_hop_busy, true);
+    SemaphoreHandle_t lock = get_channel_hopper_lock();
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if(!atomic_load(&channel_hopper_active))
+    {
+        xSemaphoreGive(lock);
+        atomic_store(&channel_hopper_hop_busy, false);
+        return;
+    }
+
+    channel_hopper_config_t *config = &channel_hopper.config;
+    int64_t now = esp_timer_get_time();
+    int position = channel_hopper.position;
+    channel_hopper_channel_stats_t *visit = &channel_hopper.stats.channels[position];
+    channel_hopper_counters_t *counters = &channel_hopper.counters[visit->channel - 1];
+    uint32_t frames = atomic_load_explicit(&counters->frames, memory_order_relaxed);
+    uint32_t new_transmitters = atomic_load_explicit(&counters->new_transmitters, memory_order_relaxed);
+    uint64_t elapsed_us = now - channel_hopper.visit_start_us;
+    if(elapsed_us > 0)
+    {
+        uint32_t frame_rate = (uint32_t)((uint64_t)(frames - channel_hopper.visit_start_frames) * 1000000 / elapsed_us);
+        uint32_t new_transmitter_rate = (uint32_t)((uint64_t)(new_transmitters - channel_hopper.visit_start_new_transmitters) * 1000000 / elapsed_us);
+        bool first = !channel_hopper.visited[position];
+        visit->frames_per_second = average_channel_hopper_rate(visit->frames_per_second, frame_rate, first, config->average_shift);
+        visit->new_transmitters_per_second = average_channel_hopper_rate(visit->new_transmitters_per_second, new_transmitter_rate, first, config->average_shift);
+    }
+    visit->visits++;
+    visit->time_us += elapsed_us;
+    visit->frames = frames;
+    visit->new_transmitters = new_transmitters;
+    channel_hopper.visited[position] = true;
+    update_channel_hopper_dwells();
+
+    position = (position + 1) % config->channel_count;
+    channel_hopper_channel_stats_t *next = &channel_hopper.stats.channels[position];
+    if(esp_wifi_set_channel(next->channel, WIFI_SECOND_CHAN_NONE) == ESP_OK)
+    {
+        channel_hopper_channel = next->channel;
+    }
+    else
+    {
+        channel_hopper.stats.channel_errors++;
+    }
+    counters = &channel_hopper.counters[next->channel - 1];
+    channel_hopper.position = position;
+    channel_hopper.visit_start_us = esp_timer_get_time();
+    channel_hopper.visit_start_frames = atomic_load_explicit(&counters->frames, memory_order_relaxed);
+    channel_hopper.visit_start_new_transmitters = atomic_load_explicit(&counters->new_transmitters, memory_order_relaxed);
+    channel_hopper.stats.hops++;
+    esp_timer_start_once(channel_hopper.timer, next->next_dwell_us);
+    xSemaphoreGive(lock);
+    atomic_store(&channel_hopper_hop_busy, false);
+}
+
+/*
+    Starts cycling the radio over 'config.channels', beginning with the first one. Promiscuous mode is set up separately, the hopper
+    only changes the channel, and frames are counted whichever receive mode (inline or deferred) is used.
+*/
+esp_err_t setup_channel_hopper(channel_hopper_config_t config)
+{
+    if(atomic_load(&channel_hopper_active))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(config.channel_count <= 0 || config.channel_count > CHANNEL_HOPPER_MAX_CHANNELS || config.min_dwell_us == 0 || config.max_dwell_us < config.min_dwell_us || config.average_shift < 0 || config.average_shift > 16)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for(int index = 0; index < config.channel_count; index++)
+    {
+        if(config.channels[index] < 1 || config.channels[index] > CHANNEL_HOPPER_MAX_CHANNELS)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    SemaphoreHandle_t lock = get_channel_hopper_lock();
+    if(lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t status = esp_wifi_set_channel(config.channels[0], WIFI_SECOND_CHAN_NONE);
+    if(status != ESP_OK)
+    {
+        return status;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    memset(&channel_hopper, 0, sizeof(channel_hopper));
+    channel_hopper.counters = calloc(CHANNEL_HOPPER_MAX_CHANNELS, sizeof(channel_hopper_counters_t));
+    if(channel_hopper.counters == NULL)
+    {
+        xSemaphoreGive(lock);
+        return ESP_ERR_NO_MEM;
+    }
+    esp_timer_create_args_t timer_arguments = {
+        .callback = &channel_hop,
+        .name = "channel_hopper"
+    };
+    status = esp_timer_create(&timer_arguments, &channel_hopper.timer);
+    if(status != ESP_OK)
+    {
+        free(channel_hopper.counters);
+        channel_hopper.counters = NULL;
+        xSemaphoreGive(lock);
+        return status;
+    }
+    channel_hopper.config = config;
+    channel_hopper.stats.channel_count = config.channel_count;
+    uint32_t first_dwell_us = config.min_dwell_us + (config.max_dwell_us - config.min_dwell_us) / 2;
+    for(int index = 0; index < config.channel_count; index++)
+    {
+        channel_hopper.stats.channels[index].channel = config.channels[index];
+        channel_hopper.stats.channels[index].next_dwell_us = first_dwell_us;
+    }
+    channel_hopper_channel = config.channels[0];
+    channel_hopper.visit_start_us = esp_timer_get_time();
+    atomic_store(&channel_hopper_active, true);
+    status = esp_timer_start_once(channel_hopper.timer, first_dwell_us);
+    if(status != ESP_OK)
+    {
+        atomic_store(&channel_hopper_active, false);
+        channel_hopper_channel = 0;
+        while(atomic_load(&channel_hopper_producers_busy) > 0)
+        {
+            vTaskDelay(1);
+        }
+        esp_timer_delete(channel_hopper.timer);
+        free(channel_hopper.counters);
+        channel_hopper.counters = NULL;
+        xSemaphoreGive(lock);
+        return status;
+    }
+    xSemaphoreGive(lock);
+    ESP_LOGI(LOGGING_TAG, "CHANNEL HOPPER STARTED (%d CHANNELS)", config.channel_count);
+    return ESP_OK;
+}
+
+// Stops hopping, the radio stays on the channel it was last moved to
+esp_err_t stop_channel_hopper()
+{
+    SemaphoreHandle_t lock = get_channel_hopper_lock();
+    if(lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if(!atomic_exchange(&channel_hopper_active, false))
+    {
+        xSemaphoreGive(lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_timer_stop(channel_hopper.timer);
+    xSemaphoreGive(lock);
+    // A hop that already fired sees the hopper stopped and does not start the timer again
+    while(atomic_load(&channel_hopper_hop_busy) || atomic_load(&channel_hopper_producers_busy) > 0)
+    {
+        vTaskDelay(1);
+    }
+    esp_timer_delete(channel_hopper.timer);
+    channel_hopper_channel = 0;
+    free(channel_hopper.counters);
+    channel_hopper.counters = NULL;
+    return ESP_OK;
+}
+
+// Copies the per channel dwell and yield stats into 'stats_holder'. The frame counts of the channel being visited are up to date, the rates and dwells are as of the last hop.
+esp_err_t get_channel_hopper_stats(channel_hopper_stats_t* stats_holder)
+{
+    if(stats_holder == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    SemaphoreHandle_t lock = get_channel_hopper_lock();
+    if(lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if(!atomic_load(&channel_hopper_active))
+    {
+        xSemaphoreGive(lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    *stats_holder = channel_hopper.stats;
+    for(int index = 0; index < stats_holder->channel_count; index++)
+    {
+        channel_hopper_counters_t *counters = &channel_hopper.counters[stats_holder->channels[index].channel - 1];
+        stats_holder->channels[index].frames = atomic_load_explicit(&counters->frames, memory_order_relaxed);
+        stats_holder->channels[index].new_transmitters = atomic_load_explicit(&counters->new_transmitters, memory_order_relaxed);
+    }
+    xSemaphoreGive(lock);
+    return ESP_OK;
+}
@@ -0,0 +1,641 @@
+#include <string.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Compressed capture blocks.
+    A block of pcap records is compressed in two passes, both of which keep the block independent of every other block:
+    - The MAC addresses in each 802.11 header are replaced by a one byte index into a dictionary the block builds as it goes,
+      with 0xFF and the six bytes the first time an address shows up (or once the dictionary is full). Captures repeat a handful
+      of BSSIDs and stations over and over, so most addresses become one byte. The same pass collects the block header's
+      timestamps, frame count and address filter.
+    - The result goes through an LZ4 style byte oriented LZ coder (greedy, 4096 entry hash of the next 4 bytes, 16 bit offsets),
+      which takes the rest of the repetition out of the record headers, radiotap headers and payloads.
+    A block that does not get smaller is stored as it was. The workspace holds the match finder, the dictionary and the
+    transformed block, so one block costs its workspace and the output buffer, whatever the capture length.
+    The index keeps a fixed number of entries; when it fills, each pair of neighbouring entries is merged into one, so an index
+    of N entries covers any number of blocks at a coarser grain.
+*/
+
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5 // The last bytes of a block are always literals
+#define LZ_MATCH_LIMIT 12 // No match starts in the last bytes of a block
+#define LZ_MAX_OFFSET 65535
+
+#define ADDRESS_DICTIONARY_SIZE 254
+#define ADDRESS_TOKEN_LITERAL 0xFF
+#define PCAP_RECORD_HEADER_LENGTH 16
+#define PCAP_LINKTYPE_IEEE802_11 105
+#define PCAP_LINKTYPE_IEEE802_11_RADIOTAP 127
+
+typedef struct {
+    uint8_t addresses[ADDRESS_DICTIONARY_SIZE][6];
+    uint8_t lookup[256]; // Address hash to dictionary index + 1, 0 is empty
+    int count;
+} address_dictionary_t;
+
+_Static_assert(sizeof(address_dictionary_t) <= 2048, "dictionary has 2048 workspace bytes");
+_Static_assert(sizeof(compressed_capture_block_header_t) == 72, "block header layout is part of the file format");
+_Static_assert(sizeof(compressed_capture_index_entry_t) == 64, "index entry layout is part of the file format");
+
+// Workspace layout: match finder hash table, address dictionary, transformed block
+#define WORKSPACE_HASH_TABLE(workspace) ((uint16_t *)(workspace))
+#define WORKSPACE_DICTIONARY(workspace) ((address_dictionary_t *)((workspace) + 8192))
+#define WORKSPACE_TRANSFORMED(workspace) ((workspace) + 8192 + 2048)
+#define TRANSFORMED_BOUND(raw_length) ((raw_length) + (raw_length) / 6 + 64)
+
+static inline uint16_t read_le16(const uint8_t *bytes)
+{
+    return bytes[0] | (bytes[1] << 8);
+}
+
+static inline uint32_t read_le32(const uint8_t *bytes)
+{
+    return read_le16(bytes) | ((uint32_t)read_le16(bytes + 2) << 16);
+}
+
+static inline uint32_t address_hash(const uint8_t address[6])
+{
+    uint32_t hash = 2166136261u;
+    for(int i = 0; i < 6; i++)
+    {
+        hash = (hash ^ address[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Two bits of the 256 bit filter per address
+static inline void address_filter_add(uint8_t filter[COMPRESSED_CAPTURE_ADDRESS_FILTER_BYTES], const uint8_t address[6])
+{
+    uint32_t hash = address_hash(address);
+    filter[(hash & 0xFF) >> 3] |= 1 << (hash & 7);
+    filter[((hash >> 16) & 0xFF) >> 3] |= 1 << ((hash >> 16) & 7);
+}
+
+bool compressed_capture_may_contain_address(const uint8_t address_filter[COMPRESSED_CAPTURE_ADDRESS_FILTER_BYTES], const uint8_t address[6])
+{
+    uint32_t hash = address_hash(address);
+    return (address_filter[(hash & 0xFF) >> 3] & (1 << (hash & 7))) && (address_filter[((hash >> 16) & 0xFF) >> 3] & (1 << ((hash >> 16) & 7)));
+}
+
+// Offsets of the addresses an 802.11 header of this frame control has, as far as they fit in 'frame_length'. Returns how many.
+static int get_address_offsets(const uint8_t *frame, int frame_length, int offsets_holder[4])
+{
+    if(frame_length < 10)
+    {
+        return 0;
+    }
+    uint16_t frame_control = read_le16(frame);
+    int type = (frame_control >> 2) & 0x3;
+    int subtype = (frame_control >> 4) & 0xF;
+    static const int data_offsets[4] = { 4, 10, 16, 24 };
+    int candidates;
+    if(type == 0)
+    {
+        candidates = 3;
+    }
+    else if(type == 1)
+    {
+        candidates = (subtype == 7 || subtype == 12 || subtype == 13) ? 1 : 2; // Control wrapper, CTS and ACK only have a receiver
+    }
+    else if(type == 2)
+    {
+        candidates = (frame_control & 0x0300) == 0x0300 ? 4 : 3;
+    }
+    else
+    {
+        return 0;
+    }
+    int count = 0;
+    for(int i = 0; i < candidates; i++)
+    {
+        if(data_offsets[i] + 6 <= frame_length)
+        {
+            offsets_holder[count++] = data_offsets[i];
+        }
+    }
+    return count;
+}
+
+// Bytes of linktype header (radiotap) ahead of the 802.11 frame in a record, or -1 if the record's frame is not 802.11
+static int get_record_frame_offset(const uint8_t *record_data, uint32_t captured_length, uint32_t linktype)
+{
+    if(linktype == PCAP_LINKTYPE_IEEE802_11)
+    {
+        return 0;
+    }
+    if(linktype == PCAP_LINKTYPE_IEEE802_11_RADIOTAP && captured_length >= 4)
+    {
+        uint16_t radiotap_length = read_le16(record_data + 2);
+        return radiotap_length <= captured_length ? radiotap_length : -1;
+    }
+    return -1;
+}
+
+// Replaces the addresses of every record with dictionary tokens and fills the block header's summary. Returns the transformed length.
+static size_t transform_records(const uint8_t *records, size_t length, uint32_t linktype, address_dictionary_t *dictionary, uint8_t *output, compressed_capture_block_header_t *header)
+{
+    memset(dictionary->lookup, 0, sizeof(dictionary->lookup));
+    dictionary->count = 0;
+    size_t position = 0;
+    size_t output_length = 0;
+    while(position < length)
+    {
+        uint32_t captured_length = length - position >= PCAP_RECORD_HEADER_LENGTH ? read_le32(records + position + 8) : 0;
+        if(length - position < PCAP_RECORD_HEADER_LENGTH || captured_length > length - position - PCAP_RECORD_HEADER_LENGTH)
+        {
+            // Not a whole record, kept as it is
+            memcpy(output + output_length, records + position, length - position);
+            output_length += length - position;
+            break;
+        }
+        const uint8_t *record = records + position;
+        uint64_t timestamp_us = (uint64_t)read_le32(record) * 1000000 + read_le32(record + 4);
+        if(header->frame_count == 0 || timestamp_us < header->first_timestamp_us)
+        {
+            header->first_timestamp_us = timestamp_us;
+        }
+        if(header->frame_count == 0 || timestamp_us > header->last_timestamp_us)
+        {
+            header->last_timestamp_us = timestamp_us;
+        }
+        header->frame_count++;
+
+        int frame_offset = get_record_frame_offset(record + PCAP_RECORD_HEADER_LENGTH, captured_length, linktype);
+        int offsets[4];
+        int address_count = 0;
+        if(frame_offset >= 0)
+        {
+            address_count = get_address_offsets(record + PCAP_RECORD_HEADER_LENGTH + frame_offset, captured_length - frame_offset, offsets);
+        }
+        size_t cursor = 0; // In the record
+        size_t record_length = PCAP_RECORD_HEADER_LENGTH + captured_length;
+        for(int i = 0; i < address_count; i++)
+        {
+            size_t address_offset = PCAP_RECORD_HEADER_LENGTH + frame_offset + offsets[i];
+            memcpy(output + output_length, record + cursor, address_offset - cursor);
+            output_length += address_offset - cursor;
+            cursor = address_offset + 6;
+
+            const uint8_t *address = record + address_offset;
+            uint32_t slot = address_hash(address) & 0xFF;
+            while(dictionary->lookup[slot] != 0 && memcmp(dictionary->addresses[dictionary->lookup[slot] - 1], address, 6) != 0)
+            {
+                slot = (slot + 1) & 0xFF;
+            }
+            if(dictionary->lookup[slot] != 0)
+            {
+                output[output_length++] = dictionary->lookup[slot] - 1;
+                continue;
+            }
+            output[output_length++] = ADDRESS_TOKEN_LITERAL;
+            memcpy(output + output_length, address, 6);
+            output_length += 6;
+            address_filter_add(header->address_filter, address);
+            if(dictionary->count < ADDRESS_DICTIONARY_SIZE)
+            {
+                memcpy(dictionary->addresses[dictionary->count], address, 6);
+                dictionary->lookup[slot] = ++dictionary->count;
+            }
+        }
+        memcpy(output + output_length, record + cursor, record_length - cursor);
+        output_length += record_length - cursor;
+        position += record_length;
+    }
+    header->address_count = dictionary->count;
+    return output_length;
+}
+
+// Undoes transform_records, reading at most 'input_length' bytes and writing exactly 'raw_length'. Returns false if the block is corrupt.
+static bool restore_records(const uint8_t *input, size_t input_length, uint32_t linktype, address_dictionary_t *dictionary, uint8_t *output, size_t raw_length)
+{
+    dictionary->count = 0;
+    size_t input_position = 0;
+    size_t position = 0;
+    while(position < raw_length)
+    {
+        size_t available = input_length - input_position;
+        const uint8_t *record = input + input_position;
+        uint32_t captured_length = 0;
+        if(raw_length - position >= PCAP_RECORD_HEADER_LENGTH)
+        {
+            if(available < PCAP_RECORD_HEADER_LENGTH)
+            {
+                return false;
+            }
+            captured_length = read_le32(record + 8);
+        }
+        if(raw_length - position < PCAP_RECORD_HEADER_LENGTH || captured_length > raw_length - position - PCAP_RECORD_HEADER_LENGTH)
+        {
+            if(available < raw_length - position)
+            {
+                return false;
+            }
+            memcpy(output + position, record, raw_length - position);
+            input_position += raw_length - position;
+            position = raw_length;
+            break;
+        }
+
+        // Everything up to the first address is as it was, so the radiotap length and frame control can be read from the input
+        size_t record_length = PCAP_RECORD_HEADER_LENGTH + captured_length;
+        int frame_offset = -1;
+        if(available >= PCAP_RECORD_HEADER_LENGTH + (captured_length < 4 ? captured_length : 4))
+        {
+            frame_offset = get_record_frame_offset(record + PCAP_RECORD_HEADER_LENGTH, captured_length, linktype);
+        }
+        int offsets[4];
+        int address_count = 0;
+        if(frame_offset >= 0 && available >= PCAP_RECORD_HEADER_LENGTH + (size_t)frame_offset + 2)
+        {
+            // get_address_offsets reads only the frame control, the length decides which addresses fit
+            address_count = get_address_offsets(record + PCAP_RECORD_HEADER_LENGTH + frame_offset, captured_length - frame_offset, offsets);
+        }
+        size_t cursor = 0; // In the restored record
+        for(int i = 0; i < address_count; i++)
+        {
+            size_t address_offset = PCAP_RECORD_HEADER_LENGTH + frame_offset + offsets[i];
+            size_t copy_length = address_offset - cursor;
+            if(input_length - input_position < copy_length + 1)
+            {
+                return false;
+            }
+            memcpy(output + position + cursor, input + input_position, copy_length);
+            input_position += copy_length;
+            cursor = address_offset + 6;
+
+            uint8_t token = input[input_position++];
+            if(token == ADDRESS_TOKEN_LITERAL)
+            {
+                if(input_length - input_position < 6)
+                {
+                    return false;
+                }
+                memcpy(output + position + address_offset, input + input_position, 6);
+                input_position += 6;
+                if(dictionary->count < ADDRESS_DICTIONARY_SIZE)
+                {
+                    memcpy(dictionary->addresses[dictionary->count++], input + input_position - 6, 6);
+                }
+            }
+            else if(token < dictionary->count)
+            {
+                memcpy(output + position + address_offset, dictionary->addresses[token], 6);
+            }
+            else
+            {
+                return false;
+            }
+        }
+        if(input_length - input_position < record_length - cursor)
+        {
+            return false;
+        }
+        memcpy(output + position + cursor, input + input_position, record_length - cursor);
+        input_position += record_length - cursor;
+        position += record_length;
+    }
+    return input_position == input_length;
+}
+
+// Writes a length continuation (the part of a literal or match length over 15) and returns the new output position
+static inline uint8_t *lz_write_length(uint8_t *output, size_t length)
+{
+    while(length >= 255)
+    {
+        *output++ = 255;
+        length -= 255;
+    }
+    *output++ = (uint8_t)length;
+    return output;
+}
+
+// Room a sequence of 'literal_length' literals and a match needs at most
+static inline size_t lz_sequence_bound(size_t literal_length, size_t match_length)
+{
+    return 1 + literal_length / 255 + 1 + literal_length + 2 + match_length / 255 + 1;
+}
+
+// Compresses 'input' into 'output', returns the compressed length or 0 if it would take more than 'output_limit' bytes
+static size_t lz_compress(const uint8_t *input, size_t length, uint16_t *hash_table, uint8_t *output, size_t output_limit)
+{
+    memset(hash_table, 0, sizeof(uint16_t) << LZ_HASH_BITS);
+    uint8_t *output_position = output;
+    uint8_t *output_end = output + output_limit;
+    size_t anchor = 0;
+    size_t position = 0;
+    while(length > LZ_MATCH_LIMIT && position <= length - LZ_MATCH_LIMIT)
+    {
+        uint32_t sequence;
+        memcpy(&sequence, input + position, 4);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t reference = hash_table[hash];
+        hash_table[hash] = position;
+        uint32_t candidate;
+        memcpy(&candidate, input + reference, 4);
+        if(reference >= position || position - reference > LZ_MAX_OFFSET || candidate != sequence)
+        {
+            position += 1 + ((position - anchor) >> 6); // Step up through data that does not match
+            continue;
+        }
+        size_t match_length = LZ_MIN_MATCH;
+        while(position + match_length < length - LZ_LAST_LITERALS && input[reference + match_length] == input[position + match_length])
+        {
+            match_length++;
+        }
+        size_t literal_length = position - anchor;
+        if((size_t)(output_end - output_position) < lz_sequence_bound(literal_length, match_length))
+        {
+            return 0;
+        }
+        uint8_t *token = output_position++;
+        *token = (literal_length >= 15 ? 15 : literal_length) << 4;
+        if(literal_length >= 15)
+        {
+            output_position = lz_write_length(output_position, literal_length - 15);
+        }
+        memcpy(output_position, input + anchor, literal_length);
+        output_position += literal_length;
+        uint16_t offset = position - reference;
+        *output_position++ = offset & 0xFF;
+        *output_position++ = offset >> 8;
+        size_t match_code = match_length - LZ_MIN_MATCH;
+        *token |= match_code >= 15 ? 15 : match_code;
+        if(match_code >= 15)
+        {
+            output_position = lz_write_length(output_position, match_code - 15);
+        }
+        position += match_length;
+        anchor = position;
+    }
+    size_t literal_length = length - anchor;
+    if((size_t)(output_end - output_position) < 1 + literal_length / 255 + 1 + literal_length)
+    {
+        return 0;
+    }
+    *output_position++ = (literal_length >= 15 ? 15 : literal_length) << 4;
+    if(literal_length >= 15)
+    {
+        output_position = lz_write_length(output_position, literal_length - 15);
+    }
+    memcpy(output_position, input + anchor, literal_length);
+    output_position += literal_length;
+    return output_position - output;
+}
+
+// Reads a length continuation, false if the input ends inside it
+static inline bool lz_read_length(const uint8_t **input, const uint8_t *input_end, size_t *length)
+{
+    uint8_t byte;
+    do
+    {
+        if(*input >= input_end)
+        {
+            return false;
+        }
+        byte = *(*input)++;
+        *length += byte;
+    } while(byte == 255);
+    return true;
+}
+
+// Decompresses into 'output', returns the decompressed length or -1 if the input is corrupt or does not fit 'output_size'
+static int lz_decompress(const uint8_t *input, size_t length, uint8_t *output, size_t output_size)
+{
+    const uint8_t *input_end = input + length;
+    uint8_t *output_position = output;
+    uint8_t *output_end = output + output_size;
+    while(input < input_end)
+    {
+        uint8_t token = *input++;
+        size_t literal_length = token >> 4;
+        if(literal_length == 15 && !lz_read_length(&input, input_end, &literal_length))
+        {
+            return -1;
+        }
+        if((size_t)(input_end - input) < literal_length || (size_t)(output_end - output_position) < literal_length)
+        {
+            return -1;
+        }
+        memcpy(output_position, input, literal_length);
+        input += literal_length;
+        output_position += literal_length;
+        if(input == input_end)
+        {
+            break; // The last sequence has no match
+        }
+        if(input_end - input < 2)
+        {
+            return -1;
+        }
+        size_t offset = input[0] | (input[1] << 8);
+        input += 2;
+        size_t match_length = token & 0x0F;
+        if(match_length == 15 && !lz_read_length(&input, input_end, &match_length))
+        {
+            return -1;
+        }
+        match_length += LZ_MIN_MATCH;
+        if(offset == 0 || offset > (size_t)(output_position - output) || (size_t)(output_end - output_position) < match_length)
+        {
+            return -1;
+        }
+        const uint8_t *match = output_position - offset;
+        if(offset >= match_length)
+        {
+            memcpy(output_position, match, match_length);
+            output_position += match_length;
+        }
+        else
+        {
+            // Overlapping match, repeats the last 'offset' bytes
+            for(size_t i = 0; i < match_length; i++)
+            {
+                *output_position++ = match[i];
+            }
+        }
+    }
+    return output_position - output;
+}
+
+// Compresses one block of whole pcap records (record header then frame, linktype 'linktype') into 'output' as a block header and its data.
+// 'workspace' holds COMPRESSED_CAPTURE_WORKSPACE_SIZE(records_length) bytes.
+esp_err_t compress_capture_block(const uint8_t* records, size_t records_length, uint32_t linktype, uint32_t block_number, uint8_t* workspace, uint8_t* output, size_t* output_length_holder)
+{
+    if(records == NULL || workspace == NULL || output == NULL || output_length_holder == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(records_length > COMPRESSED_CAPTURE_MAX_BLOCK_SIZE)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    compressed_capture_block_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = COMPRESSED_CAPTURE_BLOCK_MAGIC;
+    header.raw_length = records_length;
+    header.block_number = block_number;
+    uint8_t *transformed = WORKSPACE_TRANSFORMED(workspace);
+    size_t transformed_length = transform_records(records, records_length, linktype, WORKSPACE_DICTIONARY(workspace), transformed, &header);
+
+    uint8_t *data = output + sizeof(compressed_capture_block_header_t);
+    size_t compressed_length = lz_compress(transformed, transformed_length, WORKSPACE_HASH_TABLE(workspace), data, records_length);
+    if(compressed_length == 0 || compressed_length >= records_length)
+    {
+        memcpy(data, records, records_length);
+        compressed_length = records_length;
+        header.flags |= COMPRESSED_CAPTURE_BLOCK_STORED;
+    }
+    header.compressed_length = compressed_length;
+    memcpy(output, &header, sizeof(header));
+    *output_length_holder = sizeof(header) + compressed_length;
+    return ESP_OK;
+}
+
+// Decodes the 'header->compressed_length' bytes of 'data' into 'header->raw_length' bytes of pcap records.
+// 'workspace' holds COMPRESSED_CAPTURE_WORKSPACE_SIZE of the file header's block_size.
+esp_err_t decompress_capture_block(const compressed_capture_block_header_t* header, const uint8_t* data, uint32_t linktype, uint8_t* workspace, uint8_t* output, size_t output_size)
+{
+    if(header == NULL || data == NULL || workspace == NULL || output == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(header->magic != COMPRESSED_CAPTURE_BLOCK_MAGIC || header->raw_length > COMPRESSED_CAPTURE_MAX_BLOCK_SIZE)
+    {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if(header->raw_length > output_size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if(header->flags & COMPRESSED_CAPTURE_BLOCK_STORED)
+    {
+        if(header->compressed_length != header->raw_length)
+        {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        memcpy(output, data, header->raw_length);
+        return ESP_OK;
+    }
+    uint8_t *transformed = WORKSPACE_TRANSFORMED(workspace);
+    int transformed_length = lz_decompress(data, header->compressed_length, transformed, TRANSFORMED_BOUND(header->raw_length));
+    if(transformed_length < 0 || !restore_records(transformed, transformed_length, linktype, WORKSPACE_DICTIONARY(workspace), output, header->raw_length))
+    {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    return ESP_OK;
+}
+
+// 'capacity' is rounded down to an even number (at least 2) so entries always merge in pairs
+esp_err_t setup_compressed_capture_index(compressed_capture_index_t* index, uint32_t capacity)
+{
+    if(index == NULL || capacity < 2)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(index, 0, sizeof(compressed_capture_index_t));
+    index->capacity = capacity & ~1u;
+    index->entries = calloc(index->capacity, sizeof(compressed_capture_index_entry_t));
+    if(index->entries == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    index->blocks_per_entry = 1;
+    return ESP_OK;
+}
+
+static void merge_index_entry(compressed_capture_index_entry_t *entry, const compressed_capture_index_entry_t *next)
+{
+    if(next->frame_count > 0)
+    {
+        if(entry->frame_count == 0 || next->first_timestamp_us < entry->first_timestamp_us)
+        {
+            entry->first_timestamp_us = next->first_timestamp_us;
+        }
+        if(entry->frame_count == 0 || next->last_timestamp_us > entry->last_timestamp_us)
+        {
+            entry->last_timestamp_us = next->last_timestamp_us;
+        }
+    }
+    entry->block_count += next->block_count;
+    entry->frame_count += next->frame_count;
+    for(int i = 0; i < COMPRESSED_CAPTURE_ADDRESS_FILTER_BYTES; i++)
+    {
+        entry->address_filter[i] |= next->address_filter[i];
+    }
+}
+
+// Adds a block written at 'offset' in the output. Blocks have to be added in file order.
+esp_err_t add_compressed_capture_index_block(compressed_capture_index_t* index, const compressed_capture_block_header_t* header, uint64_t offset)
+{
+    if(index == NULL || index->entries == NULL || header == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    compressed_capture_index_entry_t block_entry = {
+        .offset = offset,
+        .first_timestamp_us = header->first_timestamp_us,
+        .last_timestamp_us = header->last_timestamp_us,
+        .block_count = 1,
+        .frame_count = header->frame_count
+    };
+    memcpy(block_entry.address_filter, header->address_filter, COMPRESSED_CAPTURE_ADDRESS_FILTER_BYTES);
+
+    if(index->block_count % index->blocks_per_entry != 0)
+    {
+        merge_index_entry(&index->entries[index->entry_count - 1], &block_entry);
+    }
+    else
+    {
+        if(index->entry_count == index->capacity)
+        {
+            // Every entry is full here, so the merged ones are full at twice the blocks
+            for(uint32_t entry = 0; entry < index->capacity / 2; entry++)
+            {
+                index->entries[entry] = index->entries[2 * entry];
+                merge_index_entry(&index->entries[entry], &index->entries[2 * entry + 1]);
+            }
+            index->entry_count = index->capacity / 2;
+            index->blocks_per_entry *= 2;
+        }
+        index->entries[index->entry_count++] = block_entry;
+    }
+    index->block_count++;
+    return ESP_OK;
+}
+
+esp_err_t write_compressed_capture_index(const compressed_capture_index_t* index, uint64_t index_offset, capture_output_write_t write, void* context)
+{
+    if(index == NULL || write == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    compressed_capture_index_trailer_t trailer = {
+        .magic = COMPRESSED_CAPTURE_INDEX_MAGIC,
+        .entry_count = index->entry_count,
+        .block_count = index->block_count,
+        .blocks_per_entry = index->blocks_per_entry,
+        .index_offset = index_offset
+    };
+    esp_err_t status = ESP_OK;
+    if(index->entry_count > 0)
+    {
+        status = write(context, (const uint8_t *)index->entries, index->entry_count * sizeof(compressed_capture_index_entry_t));
+    }
+    if(status == ESP_OK)
+    {
+        status = write(context, (const uint8_t *)&trailer, sizeof(trailer));
+    }
+    return status;
+}
+
+void free_compressed_capture_index(compressed_capture_index_t* index)
+{
+    if(index != NULL)
+    {
+        free(index->entries);
+        index->entries = NULL;
+        index->capacity = 0;
+    }
+}
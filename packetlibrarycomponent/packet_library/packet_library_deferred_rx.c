@@ -0,0 +1,341 @@
+#include <stdatomic.h>
+#include <esp_cpu.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Deferred receive mode.
+    The promiscuous callback the WiFi driver calls only copies the frame and its rx_ctrl metadata into a preallocated
+    single-producer/single-consumer ring. A worker task drains the ring in batches and runs the normal component callbacks
+    (promisc_run_callbacks) on the copies, so slow user callbacks and logging no longer hold up the driver.
+    The driver task is the only writer of 'head' and the worker task the only writer of 'tail', so no locks are needed,
+    only acquire/release ordering on the two indexes. Before the worker blocks on an empty ring it sets 'worker_waiting' and
+    looks at 'head' once more, and the producer checks the flag after publishing 'head' (both sequentially consistent), so
+    one of the two always sees the other and no wakeup is lost. disable_promiscuous_deferred pairs 'deferred_rx_enabled' with a
+    count of driver callbacks in the producer the same way, so it never frees the ring under one.
+    This makes a two stage pipeline: stage 1 (count, filter, timestamp, copy) on the core the WiFi task runs on, stage 2
+    (parse, the receive hooks, callbacks and prints) on the worker's core, which DEFERRED_RX_WORKER_CORE picks as the other one.
+    Each stage keeps a running average of its CPU cycles per frame, and the worker measures how long frames sat in the ring.
+*/
+
+#define DEFERRED_RX_AVERAGE_DIVISOR 16 // Running averages move 1/16 of the way to each new sample, and are stored multiplied by this
+
+// One ring entry, the frame bytes follow directly after the header
+typedef struct {
+    wifi_pkt_rx_ctrl_t rx_ctrl;
+    uint16_t stored_length; // Bytes of the frame actually copied into the slot
+    uint16_t type; // wifi_promiscuous_pkt_type_t the driver reported
+    uint32_t queued_us; // esp_timer time (low 32 bits) stage 1 copied the frame
+    uint8_t frame[];
+} deferred_rx_slot_t;
+
+typedef struct {
+    uint8_t *slots; // ring_capacity * slot_stride bytes
+    uint32_t slot_stride;
+    uint32_t slot_size;
+    uint32_t ring_mask; // ring_capacity - 1
+    uint32_t batch_size;
+    _Atomic uint32_t head; // Next slot the producer (driver callback) writes, free running
+    _Atomic uint32_t tail; // Next slot the consumer (worker task) reads, free running
+    TaskHandle_t worker_task;
+    _Atomic bool worker_waiting; // Set by the worker before it blocks on an empty ring, cleared by whoever wakes it
+    _Atomic bool stop_requested;
+    _Atomic bool worker_stopped;
+    // Producer owned counters
+    _Atomic uint32_t frames_received;
+    _Atomic uint32_t frames_dropped;
+    _Atomic uint32_t frames_truncated;
+    _Atomic uint32_t ring_high_water_mark;
+    _Atomic uint32_t driver_stage_cycles;
+    _Atomic int32_t driver_core;
+    // Consumer owned counters
+    _Atomic uint32_t frames_processed;
+    _Atomic uint32_t worker_stage_cycles;
+    _Atomic uint32_t queue_wait_average_us;
+    _Atomic uint32_t queue_wait_max_us;
+    _Atomic int32_t worker_core;
+} deferred_rx_ring_t;
+
+static deferred_rx_ring_t deferred_rx_ring;
+// Set and cleared with seq_cst, as is deferred_rx_producers_busy: the driver callback counts itself in before it checks the flag and
+// disable_promiscuous_deferred clears the flag before it checks the count, so one of the two always sees the other
+static _Atomic bool deferred_rx_enabled;
+static _Atomic uint32_t deferred_rx_producers_busy; // Driver callbacks inside promisc_deferred_callback, so the ring is not freed under a late one. Outside deferred_rx_ring so setup_promiscuous_deferred does not clear it.
+
+static inline deferred_rx_slot_t *deferred_rx_slot_at(uint32_t index)
+{
+    return (deferred_rx_slot_t *)(deferred_rx_ring.slots + (index & deferred_rx_ring.ring_mask) * deferred_rx_ring.slot_stride);
+}
+
+// Moves a running average towards 'sample', starting from the first sample. The average is kept times DEFERRED_RX_AVERAGE_DIVISOR
+// so small samples still move it. Only the stage that owns the average calls this.
+static inline void deferred_rx_average(_Atomic uint32_t *scaled_average, uint32_t sample)
+{
+    uint32_t current = atomic_load_explicit(scaled_average, memory_order_relaxed);
+    current = current == 0 ? sample * DEFERRED_RX_AVERAGE_DIVISOR : current - current / DEFERRED_RX_AVERAGE_DIVISOR + sample;
+    atomic_store_explicit(scaled_average, current, memory_order_relaxed);
+}
+
+// Producer side, runs in the WiFi driver task. Only copies the frame and returns.
+static void deferred_rx_enqueue(void *buf, wifi_promiscuous_pkt_type_t type)
+{
+    esp_cpu_cycle_count_t stage_start = esp_cpu_get_cycle_count();
+    const wifi_promiscuous_pkt_t *pkt = (wifi_promiscuous_pkt_t *)buf;
+    stats_count_receive(&pkt->rx_ctrl, pkt->payload, (int)pkt->rx_ctrl.sig_len - 4);
+    uint32_t trace_frame_id = atomic_load_explicit(&event_trace_active, memory_order_relaxed) ? get_event_trace_frame_id(pkt->payload, (int)pkt->rx_ctrl.sig_len - 4) : 0;
+    if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
+    {
+        event_trace_record(EVENT_TRACE_RX_DRIVER, trace_frame_id, pkt->rx_ctrl.sig_len, 0);
+    }
+    // Frames the frame filters reject never take a slot
+    if(!frame_filter_accepts(&pkt->rx_ctrl, pkt->payload, (int)pkt->rx_ctrl.sig_len - 4))
+    {
+        stats_count_receive_drop(RX_DROP_FRAME_FILTER);
+        if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
+        {
+            event_trace_record(EVENT_TRACE_RX_DROPPED, trace_frame_id, pkt->rx_ctrl.sig_len, RX_DROP_FRAME_FILTER);
+        }
+        return;
+    }
+    uint32_t head = atomic_load_explicit(&deferred_rx_ring.head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&deferred_rx_ring.tail, memory_order_acquire);
+
+    atomic_store_explicit(&deferred_rx_ring.frames_received, atomic_load_explicit(&deferred_rx_ring.frames_received, memory_order_relaxed) + 1, memory_order_relaxed);
+    if(head - tail > deferred_rx_ring.ring_mask)
+    {
+        atomic_store_explicit(&deferred_rx_ring.frames_dropped, atomic_load_explicit(&deferred_rx_ring.frames_dropped, memory_order_relaxed) + 1, memory_order_relaxed);
+        stats_count_receive_drop(RX_DROP_DEFERRED_RING_FULL);
+        if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
+        {
+            event_trace_record(EVENT_TRACE_RX_DROPPED, trace_frame_id, pkt->rx_ctrl.sig_len, RX_DROP_DEFERRED_RING_FULL);
+        }
+        return;
+    }
+
+    deferred_rx_slot_t *slot = deferred_rx_slot_at(head);
+    uint32_t length = pkt->rx_ctrl.sig_len;
+    if(length > deferred_rx_ring.slot_size)
+    {
+        length = deferred_rx_ring.slot_size;
+        atomic_store_explicit(&deferred_rx_ring.frames_truncated, atomic_load_explicit(&deferred_rx_ring.frames_truncated, memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+    slot->rx_ctrl = pkt->rx_ctrl;
+    slot->stored_length = (uint16_t)length;
+    slot->type = (uint16_t)type;
+    slot->queued_us = (uint32_t)esp_timer_get_time();
+    memcpy(slot->frame, pkt->payload, length);
+
+    atomic_store_explicit(&deferred_rx_ring.head, head + 1, memory_order_seq_cst);
+
+    uint32_t occupancy = head + 1 - tail;
+    if(occupancy > atomic_load_explicit(&deferred_rx_ring.ring_high_water_mark, memory_order_relaxed))
+    {
+        atomic_store_explicit(&deferred_rx_ring.ring_high_water_mark, occupancy, memory_order_relaxed);
+    }
+    // Only wake the worker when it is blocked or about to block, it keeps draining on its own otherwise
+    if(atomic_load_explicit(&deferred_rx_ring.worker_waiting, memory_order_seq_cst) &&
+       atomic_exchange_explicit(&deferred_rx_ring.worker_waiting, false, memory_order_seq_cst))
+    {
+        xTaskNotifyGive(deferred_rx_ring.worker_task);
+    }
+    deferred_rx_average(&deferred_rx_ring.driver_stage_cycles, (uint32_t)(esp_cpu_get_cycle_count() - stage_start));
+    atomic_store_explicit(&deferred_rx_ring.driver_core, xPortGetCoreID(), memory_order_relaxed);
+}
+
+// The driver can still be in this callback on the other core after it was swapped for the inline one, a frame arriving that late is dropped
+static void promisc_deferred_callback(void *buf, wifi_promiscuous_pkt_type_t type)
+{
+    atomic_fetch_add(&deferred_rx_producers_busy, 1);
+    if(atomic_load(&deferred_rx_enabled))
+    {
+        deferred_rx_enqueue(buf, type);
+    }
+    atomic_fetch_sub(&deferred_rx_producers_busy, 1);
+}
+
+// Consumer side, drains the ring a batch at a time and runs the component callbacks on each frame
+static void deferred_rx_worker(void *arg)
+{
+    while(!atomic_load(&deferred_rx_ring.stop_requested))
+    {
+        uint32_t tail = atomic_load_explicit(&deferred_rx_ring.tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&deferred_rx_ring.head, memory_order_acquire);
+        if(head == tail)
+        {
+            // Announce the wait, then check once more for a frame published before the producer could see the flag
+            atomic_store_explicit(&deferred_rx_ring.worker_waiting, true, memory_order_seq_cst);
+            if(atomic_load_explicit(&deferred_rx_ring.head, memory_order_seq_cst) == tail)
+            {
+                // The timeout is only a backstop, the producer notifies as soon as it sees the flag
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+            }
+            atomic_store_explicit(&deferred_rx_ring.worker_waiting, false, memory_order_relaxed);
+            continue;
+        }
+
+        uint32_t batch_end = head;
+        if(batch_end - tail > deferred_rx_ring.batch_size)
+        {
+            batch_end = tail + deferred_rx_ring.batch_size;
+        }
+        // Queue wait is measured to when the worker picks up the batch, so it does not include callbacks run on earlier frames of the batch
+        uint32_t batch_start_us = (uint32_t)esp_timer_get_time();
+        uint32_t queue_wait_max_us = atomic_load_explicit(&deferred_rx_ring.queue_wait_max_us, memory_order_relaxed);
+        for(uint32_t index = tail; index != batch_end; index++)
+        {
+            deferred_rx_slot_t *slot = deferred_rx_slot_at(index);
+            uint32_t queue_wait_us = batch_start_us - slot->queued_us;
+            deferred_rx_average(&deferred_rx_ring.queue_wait_average_us, queue_wait_us);
+            if(queue_wait_us > queue_wait_max_us)
+            {
+                queue_wait_max_us = queue_wait_us;
+            }
+        }
+        atomic_store_explicit(&deferred_rx_ring.queue_wait_max_us, queue_wait_max_us, memory_order_relaxed);
+
+        esp_cpu_cycle_count_t stage_start = esp_cpu_get_cycle_count();
+        for(uint32_t index = tail; index != batch_end; index++)
+        {
+            deferred_rx_slot_t *slot = deferred_rx_slot_at(index);
+            // A frame longer than the slot arrives cut short, promisc_run_callbacks sees that from stored_length against sig_len
+            // Traced with the ID the driver side gave it, so the time in the ring shows between the two cores' events
+            uint32_t trace_frame_id = atomic_load_explicit(&event_trace_active, memory_order_relaxed) ? get_event_trace_frame_id(slot->frame, (int)slot->stored_length - 4) : 0;
+            if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
+            {
+                event_trace_record(EVENT_TRACE_RX_CALLBACKS_BEGIN, trace_frame_id, slot->rx_ctrl.sig_len, 0);
+            }
+            PROFILE_STAGE_BEGIN(frame_start);
+            promisc_run_callbacks(&slot->rx_ctrl, slot->frame, slot->stored_length);
+            PROFILE_STAGE_END(PROFILE_STAGE_RX_FRAME, frame_start);
+            if(atomic_load_explicit(&event_trace_active, memory_order_relaxed))
+            {
+                event_trace_record(EVENT_TRACE_RX_CALLBACKS_END, trace_frame_id, slot->rx_ctrl.sig_len, 0);
+            }
+        }
+        deferred_rx_average(&deferred_rx_ring.worker_stage_cycles, (uint32_t)(esp_cpu_get_cycle_count() - stage_start) / (batch_end - tail));
+        atomic_store_explicit(&deferred_rx_ring.worker_core, xPortGetCoreID(), memory_order_relaxed);
+        atomic_store_explicit(&deferred_rx_ring.frames_processed, atomic_load_explicit(&deferred_rx_ring.frames_processed, memory_order_relaxed) + (batch_end - tail), memory_order_relaxed);
+        atomic_store_explicit(&deferred_rx_ring.tail, batch_end, memory_order_release);
+    }
+    atomic_store(&deferred_rx_ring.worker_stopped, true);
+    vTaskDelete(NULL);
+}
+
+// This allocates the receive ring, starts the worker task and enables promiscuous mode with the copy-only driver callback.
+// The component callbacks (general, field and print options) are set the same way as for 'setup_promiscuous_simple'.
+esp_err_t setup_promiscuous_deferred(deferred_rx_config_t config)
+{
+    if(atomic_load(&deferred_rx_enabled))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(config.ring_slots <= 0 || config.batch_size <= 0 || config.slot_size < (int)sizeof(wifi_mac_data_frame_t) || config.slot_size > UINT16_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t capacity = 1;
+    while(capacity < (uint32_t)config.ring_slots)
+    {
+        capacity <<= 1;
+    }
+    uint32_t stride = (sizeof(deferred_rx_slot_t) + config.slot_size + 3) & ~3u; // Keep every slot 4 byte aligned
+
+    memset(&deferred_rx_ring, 0, sizeof(deferred_rx_ring));
+    deferred_rx_ring.slots = calloc(capacity, stride);
+    if(deferred_rx_ring.slots == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    deferred_rx_ring.slot_stride = stride;
+    deferred_rx_ring.slot_size = config.slot_size;
+    deferred_rx_ring.ring_mask = capacity - 1;
+    deferred_rx_ring.batch_size = config.batch_size;
+    atomic_init(&deferred_rx_ring.driver_core, -1);
+    atomic_init(&deferred_rx_ring.worker_core, -1);
+
+    if(xTaskCreatePinnedToCore(&deferred_rx_worker, "pl_deferred_rx", config.task_stack_size, NULL, config.task_priority, &deferred_rx_ring.worker_task, config.task_core) != pdPASS)
+    {
+        free(deferred_rx_ring.slots);
+        deferred_rx_ring.slots = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    atomic_store(&deferred_rx_enabled, true);
+
+    ESP_ERROR_CHECK(esp_wifi_set_promiscuous_rx_cb(&promisc_deferred_callback));
+    ESP_LOGI(LOGGING_TAG, "DEFERRED PROMISCUOUS CALLBACK SET (%u SLOTS)", (unsigned)capacity);
+    ESP_ERROR_CHECK(esp_wifi_set_promiscuous(true));
+    ESP_LOGI(LOGGING_TAG, "DEFERRED PROMISCUOUS STARTED");
+    return ESP_OK;
+}
+
+// This switches back to the inline component callback, stops the worker task and frees the ring. Frames still in the ring are discarded.
+esp_err_t disable_promiscuous_deferred()
+{
+    if(!atomic_exchange(&deferred_rx_enabled, false))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ESP_ERROR_CHECK(setup_promiscuous_simple());
+    while(atomic_load(&deferred_rx_producers_busy) > 0)
+    {
+        vTaskDelay(1);
+    }
+
+    atomic_store(&deferred_rx_ring.stop_requested, true);
+    xTaskNotifyGive(deferred_rx_ring.worker_task);
+    while(!atomic_load(&deferred_rx_ring.worker_stopped))
+    {
+        vTaskDelay(1);
+    }
+    free(deferred_rx_ring.slots);
+    deferred_rx_ring.slots = NULL;
+    return ESP_OK;
+}
+
+// Copies the deferred receive counters into 'stats_holder'. Each counter is read without stopping the ring, so the values can be a few frames apart from each other.
+esp_err_t get_deferred_rx_stats(deferred_rx_stats_t* stats_holder)
+{
+    if(!atomic_load(&deferred_rx_enabled))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint32_t tail = atomic_load_explicit(&deferred_rx_ring.tail, memory_order_acquire);
+    uint32_t head = atomic_load_explicit(&deferred_rx_ring.head, memory_order_acquire);
+    stats_holder->frames_received = atomic_load_explicit(&deferred_rx_ring.frames_received, memory_order_relaxed);
+    stats_holder->frames_dropped = atomic_load_explicit(&deferred_rx_ring.frames_dropped, memory_order_relaxed);
+    stats_holder->frames_truncated = atomic_load_explicit(&deferred_rx_ring.frames_truncated, memory_order_relaxed);
+    stats_holder->frames_processed = atomic_load_explicit(&deferred_rx_ring.frames_processed, memory_order_relaxed);
+    stats_holder->ring_capacity = deferred_rx_ring.ring_mask + 1;
+    stats_holder->ring_occupancy = head - tail;
+    stats_holder->ring_high_water_mark = atomic_load_explicit(&deferred_rx_ring.ring_high_water_mark, memory_order_relaxed);
+    stats_holder->driver_stage_cycles = atomic_load_explicit(&deferred_rx_ring.driver_stage_cycles, memory_order_relaxed) / DEFERRED_RX_AVERAGE_DIVISOR;
+    stats_holder->worker_stage_cycles = atomic_load_explicit(&deferred_rx_ring.worker_stage_cycles, memory_order_relaxed) / DEFERRED_RX_AVERAGE_DIVISOR;
+    stats_holder->queue_wait_average_us = atomic_load_explicit(&deferred_rx_ring.queue_wait_average_us, memory_order_relaxed) / DEFERRED_RX_AVERAGE_DIVISOR;
+    stats_holder->queue_wait_max_us = atomic_load_explicit(&deferred_rx_ring.queue_wait_max_us, memory_order_relaxed);
+    stats_holder->driver_core = atomic_load_explicit(&deferred_rx_ring.driver_core, memory_order_relaxed);
+    stats_holder->worker_core = atomic_load_explicit(&deferred_rx_ring.worker_core, memory_order_relaxed);
+    return ESP_OK;
+}
+
+// Clears the drop/truncation counters, the high-water mark and the stage averages. The counters are owned by the producer, so a frame arriving during the reset may still be counted.
+esp_err_t reset_deferred_rx_stats()
+{
+    if(!atomic_load(&deferred_rx_enabled))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    atomic_store_explicit(&deferred_rx_ring.frames_received, 0, memory_order_relaxed);
+    atomic_store_explicit(&deferred_rx_ring.frames_dropped, 0, memory_order_relaxed);
+    atomic_store_explicit(&deferred_rx_ring.frames_truncated, 0, memory_order_relaxed);
+    atomic_store_explicit(&deferred_rx_ring.frames_processed, 0, memory_order_relaxed);
+    atomic_store_explicit(&deferred_rx_ring.ring_high_water_mark, 0, memory_order_relaxed);
+    atomic_store_explicit(&deferred_rx_ring.driver_stage_cycles, 0, memory_order_relaxed);
+    atomic_store_explicit(&deferred_rx_ring.worker_stage_cycles, 0, memory_order_relaxed);
+    atomic_store_explicit(&deferred_rx_ring.queue_wait_average_us, 0, memory_order_relaxed);
+    atomic_store_explicit(&deferred_rx_ring.queue_wait_max_us, 0, memory_order_relaxed);
+    return ESP_OK;
+}
@@ -0,0 +1,254 @@
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Duplicate detection.
+    Tracks the sequence numbers each transmitter uses, per traffic identifier (QoS TID, plus one stream for non-QoS data and one
+    for management frames, which count separately), in a bounded 4 way set associative table. Every entry keeps the newest
+    sequence number with a 64 bit window of the ones before it that were received, so a retransmission is recognised even when
+    block ack lets frames arrive out of order. A frame is a duplicate when its retry bit is set and its sequence number (and
+    fragment number, for fragmented frames) was already received. Forward jumps in the sequence numbers are counted as gaps.
+    Only the receive path touches the table.
+*/
+
+#define DUPLICATE_DETECTION_WAYS 4
+#define DUPLICATE_DETECTION_WINDOW 64
+#define DUPLICATE_DETECTION_SEQUENCE_MODULO 4096
+#define DUPLICATE_DETECTION_NON_QOS_STREAM 16
+#define DUPLICATE_DETECTION_MANAGEMENT_STREAM 17
+
+typedef struct {
+    uint8_t mac[6];
+    uint8_t stream; // QoS TID (0 to 15), DUPLICATE_DETECTION_NON_QOS_STREAM, or DUPLICATE_DETECTION_MANAGEMENT_STREAM
+    uint8_t last_fragment;
+    bool in_use;
+    uint16_t last_sequence; // Newest sequence number received
+    uint32_t last_used;
+    uint64_t window; // Bit n set when sequence number last_sequence - n was received
+} duplicate_detection_entry_t;
+
+typedef struct {
+    duplicate_detection_entry_t *entries;
+    uint32_t set_mask;
+    uint32_t clock;
+    bool drop_duplicates;
+    // Receive path owned counters
+    _Atomic uint32_t frames_checked;
+    _Atomic uint32_t retries;
+    _Atomic uint32_t duplicates;
+    _Atomic uint32_t sequence_gaps;
+    _Atomic uint32_t out_of_order;
+    _Atomic uint32_t evictions;
+} duplicate_detection_t;
+
+static duplicate_detection_t duplicate_detection;
+// Set and cleared with seq_cst, as is duplicate_detection_producers_busy: the receive path counts itself in before it checks the flag and
+// stop_duplicate_detection clears the flag before it checks the count, so one of the two always sees the other
+_Atomic bool duplicate_detection_active;
+static _Atomic uint32_t duplicate_detection_producers_busy; // Receive paths inside duplicate_detection_check, so stop_duplicate_detection does not free the entries under them. Outside duplicate_detection so setup_duplicate_detection does not clear it.
+
+static inline void count_duplicate_detection(_Atomic uint32_t *counter, uint32_t amount)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+// Finds the entry for the transmitter and stream, or replaces the least recently used one of its set. 'is_new' tells which.
+static duplicate_detection_entry_t *find_duplicate_detection_entry(const uint8_t mac[6], uint8_t stream, bool *is_new)
+{
+    uint32_t hash = (mac[5] | (mac[4] << 8) | (mac[3] << 16)) * 2654435761u + stream;
+    duplicate_detection_entry_t *set = &duplicate_detection.entries[((hash >> 16) & duplicate_detection.set_mask) * DUPLICATE_DETECTION_WAYS];
+    duplicate_detection_entry_t *replace = &set[0];
+    for(int way = 0; way < DUPLICATE_DETECTION_WAYS; way++)
+    {
+        duplicate_detection_entry_t *entry = &set[way];
+        if(entry->in_use && entry->stream == stream && memcmp(entry->mac, mac, 6) == 0)
+        {
+            *is_new = false;
+            return entry;
+        }
+        if(!entry->in_use || (replace->in_use && entry->last_used < replace->last_used))
+        {
+            replace = entry;
+        }
+    }
+    if(replace->in_use)
+    {
+        count_duplicate_detection(&duplicate_detection.evictions, 1);
+    }
+    memcpy(replace->mac, mac, 6);
+    replace->stream = stream;
+    replace->in_use = true;
+    *is_new = true;
+    return replace;
+}
+
+// Checks a received frame against the transmitter's recent sequence numbers, sets view->duplicate, and returns whether the frame should be dropped
+bool duplicate_detection_check(wifi_frame_view_t *view)
+{
+    atomic_fetch_add(&duplicate_detection_producers_busy, 1);
+    if(!atomic_load(&duplicate_detection_active) || view->transmitter == NULL || view->type == WIFI_FRAME_TYPE_CONTROL || view->frame_length < 24)
+    {
+        atomic_fetch_sub(&duplicate_detection_producers_busy, 1);
+        return false;
+    }
+    count_duplicate_detection(&duplicate_detection.frames_checked, 1);
+    if(view->retry)
+    {
+        count_duplicate_detection(&duplicate_detection.retries, 1);
+    }
+
+    uint8_t stream = DUPLICATE_DETECTION_MANAGEMENT_STREAM;
+    if(view->type == WIFI_FRAME_TYPE_DATA)
+    {
+        stream = view->has_qos ? (view->qos_control & 0xF) : DUPLICATE_DETECTION_NON_QOS_STREAM;
+    }
+    bool is_new;
+    duplicate_detection_entry_t *entry = find_duplicate_detection_entry(view->transmitter, stream, &is_new);
+    entry->last_used = ++duplicate_detection.clock;
+
+    uint16_t sequence = view->sequence_number;
+    uint8_t fragment = view->fragment_number;
+    bool duplicate = false;
+    uint32_t ahead = (sequence - entry->last_sequence) & (DUPLICATE_DETECTION_SEQUENCE_MODULO - 1);
+    if(is_new)
+    {
+        entry->last_sequence = sequence;
+        entry->last_fragment = fragment;
+        entry->window = 1;
+    }
+    else if(ahead == 0)
+    {
+        // Same MSDU again: a duplicate unless it is the next fragment
+        if(fragment <= entry->last_fragment)
+        {
+            duplicate = view->retry;
+        }
+        else
+        {
+            entry->last_fragment = fragment;
+        }
+    }
+    else if(ahead < DUPLICATE_DETECTION_SEQUENCE_MODULO / 2)
+    {
+        if(ahead > 1)
+        {
+            count_duplicate_detection(&duplicate_detection.sequence_gaps, ahead - 1);
+        }
+        entry->window = ahead < DUPLICATE_DETECTION_WINDOW ? (entry->window << ahead) | 1 : 1;
+        entry->last_sequence = sequence;
+        entry->last_fragment = fragment;
+    }
+    else
+    {
+        uint32_t behind = DUPLICATE_DETECTION_SEQUENCE_MODULO - ahead;
+        if(behind < DUPLICATE_DETECTION_WINDOW && (entry->window & (1ull << behind)))
+        {
+            duplicate = view->retry;
+        }
+        else if(behind < DUPLICATE_DETECTION_WINDOW)
+        {
+            // Late, but not seen before (block ack reordering), it fills in what was counted as a gap
+            entry->window |= 1ull << behind;
+            count_duplicate_detection(&duplicate_detection.out_of_order, 1);
+        }
+        else
+        {
+            // Too far back to be a retry, the transmitter restarted its sequence numbers
+            entry->last_sequence = sequence;
+            entry->last_fragment = fragment;
+            entry->window = 1;
+        }
+    }
+
+    view->duplicate = duplicate;
+    if(duplicate)
+    {
+        count_duplicate_detection(&duplicate_detection.duplicates, 1);
+    }
+    bool drop = duplicate && duplicate_detection.drop_duplicates;
+    atomic_fetch_sub(&duplicate_detection_producers_busy, 1);
+    return drop;
+}
+
+// Starts tracking the sequence numbers of received frames, for 'config.capacity' transmitter and traffic identifier pairs
+esp_err_t setup_duplicate_detection(duplicate_detection_config_t config)
+{
+    if(atomic_load(&duplicate_detection_active))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(config.capacity <= 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t sets = 1;
+    while(sets * DUPLICATE_DETECTION_WAYS < (uint32_t)config.capacity)
+    {
+        sets <<= 1;
+    }
+    memset(&duplicate_detection, 0, sizeof(duplicate_detection));
+    duplicate_detection.entries = calloc(sets * DUPLICATE_DETECTION_WAYS, sizeof(duplicate_detection_entry_t));
+    if(duplicate_detection.entries == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    duplicate_detection.set_mask = sets - 1;
+    duplicate_detection.drop_duplicates = config.drop_duplicates;
+    atomic_store(&duplicate_detection_active, true);
+    ESP_LOGI(LOGGING_TAG, "DUPLICATE DETECTION STARTED (%u ENTRIES)", (unsigned)(sets * DUPLICATE_DETECTION_WAYS));
+    return ESP_OK;
+}
+
+esp_err_t stop_duplicate_detection()
+{
+    if(!atomic_exchange(&duplicate_detection_active, false))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    while(atomic_load(&duplicate_detection_producers_busy) > 0)
+    {
+        vTaskDelay(1);
+    }
+    free(duplicate_detection.entries);
+    duplicate_detection.entries = NULL;
+    return ESP_OK;
+}
+
+// Copies the counters into 'stats_holder'. They are read while frames keep arriving, so they can be a few frames apart from each other.
+esp_err_t get_duplicate_detection_stats(duplicate_detection_stats_t* stats_holder)
+{
+    if(!atomic_load(&duplicate_detection_active))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(stats_holder == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stats_holder->frames_checked = atomic_load_explicit(&duplicate_detection.frames_checked, memory_order_relaxed);
+    stats_holder->retries = atomic_load_explicit(&duplicate_detection.retries, memory_order_relaxed);
+    stats_holder->duplicates = atomic_load_explicit(&duplicate_detection.duplicates, memory_order_relaxed);
+    stats_holder->sequence_gaps = atomic_load_explicit(&duplicate_detection.sequence_gaps, memory_order_relaxed);
+    stats_holder->out_of_order = atomic_load_explicit(&duplicate_detection.out_of_order, memory_order_relaxed);
+    stats_holder->evictions = atomic_load_explicit(&duplicate_detection.evictions, memory_order_relaxed);
+    return ESP_OK;
+}
+
+// Clears the counters. They are owned by the receive path, so a frame arriving during the reset may still be counted.
+esp_err_t reset_duplicate_detection_stats()
+{
+    if(!atomic_load(&duplicate_detection_active))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    atomic_store_explicit(&duplicate_detection.frames_checked, 0, memory_order_relaxed);
+    atomic_store_explicit(&duplicate_detection.retries, 0, memory_order_relaxed);
+    atomic_store_explicit(&duplicate_detection.duplicates, 0, memory_order_relaxed);
+    atomic_store_explicit(&duplicate_detection.sequence_gaps, 0, memory_order_relaxed);
+    atomic_store_explicit(&duplicate_detection.out_of_order, 0, memory_order_relaxed);
+    atomic_store_explicit(&duplicate_detection.evictions, 0, memory_order_relaxed);
+    return ESP_OK;
+}
@@ -0,0 +1,302 @@
+#include <stdatomic.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Event trace.
+    The receive and send paths record a 16 byte event (timestamp, type, frame ID, core) when a frame reaches the component, when
+    its callbacks start and end, and around esp_wifi_80211_tx and the send helpers, so a frame can be followed from the driver
+    through the callbacks to the transmit it led to. Every core has its own ring, so the cores never write the same cache line.
+    Tasks on the same core can still preempt each other, so a writer claims a position with an atomic add and each slot carries a
+    sequence that is odd while it is being written and 2 * (position + 1) once the event is in. The rings overwrite their oldest
+    events; a reader copies the newest events of each ring, skips any slot rewritten while it looked, and merges the cores by
+    timestamp. write_event_trace writes them with a small header for host/trace/trace_export.
+*/
+
+#define EVENT_TRACE_CACHE_LINE 64
+
+typedef struct {
+    _Atomic uint32_t sequence;
+    event_trace_event_t event;
+} event_trace_slot_t;
+
+typedef struct {
+    _Atomic uint32_t write_position;
+    _Atomic uint32_t writers_busy; // Tasks recording into this ring, so stop_event_trace can wait them out
+    event_trace_slot_t *slots;
+} __attribute__((aligned(EVENT_TRACE_CACHE_LINE))) event_trace_ring_t;
+
+static event_trace_ring_t event_trace_rings[portNUM_PROCESSORS];
+static uint32_t event_trace_mask;
+static _Atomic uint32_t event_trace_readers_busy;
+// Set and cleared with seq_cst, as are the writer and reader counts: a writer or reader counts itself in before it checks the flag
+// and stop_event_trace clears the flag before it checks the counts, so one of the two always sees the other
+_Atomic bool event_trace_active;
+
+// Counts the caller in on 'busy' while the trace runs, false (and not counted in) once it is stopped
+static bool event_trace_enter(_Atomic uint32_t *busy)
+{
+    atomic_fetch_add(busy, 1);
+    if(!atomic_load(&event_trace_active))
+    {
+        atomic_fetch_sub(busy, 1);
+        return false;
+    }
+    return true;
+}
+
+static void event_trace_leave(_Atomic uint32_t *busy)
+{
+    atomic_fetch_sub(busy, 1);
+}
+
+// Folds a 32 bit FNV-1a hash of 'address' into the top 16 bits, with the sequence control below
+uint32_t event_trace_address_frame_id(const uint8_t address[6], uint16_t sequence_control)
+{
+    uint32_t hash = 2166136261u;
+    for(int i = 0; i < 6; i++)
+    {
+        hash = (hash ^ address[i]) * 16777619u;
+    }
+    return (((hash >> 16) ^ (hash & 0xFFFF)) << 16) | sequence_control;
+}
+
+// The frame ID a trace event gets for 'frame': address 2 and the sequence control, so a frame keeps its ID from the driver through the callbacks.
+// Frames too short for address 2 get 0. Sent frames carry whatever sequence control the buffer had, the driver numbers them after this.
+uint32_t get_event_trace_frame_id(const uint8_t* frame, int frame_length)
+{
+    if(frame == NULL || frame_length < 16)
+    {
+        return 0;
+    }
+    uint16_t sequence_control = frame_length >= 24 ? (uint16_t)(frame[22] | (frame[23] << 8)) : 0;
+    return event_trace_address_frame_id(&frame[10], sequence_control);
+}
+
+void event_trace_record(enum event_trace_type type, uint32_t frame_id, int frame_length, int32_t argument)
+{
+    int core = xPortGetCoreID();
+    event_trace_ring_t *ring = &event_trace_rings[core];
+    if(!event_trace_enter(&ring->writers_busy))
+    {
+        return;
+    }
+    uint32_t position = atomic_fetch_add_explicit(&ring->write_position, 1, memory_order_relaxed);
+    event_trace_slot_t *slot = &ring->slots[position & event_trace_mask];
+    atomic_store_explicit(&slot->sequence, 2 * position + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->event.timestamp_us = (uint32_t)esp_timer_get_time();
+    slot->event.frame_id = frame_id;
+    slot->event.argument = argument;
+    slot->event.frame_length = frame_length > 0xFFFF ? 0xFFFF : (uint16_t)(frame_length > 0 ? frame_length : 0);
+    slot->event.type = type;
+    slot->event.core = core;
+    atomic_store_explicit(&slot->sequence, 2 * position + 2, memory_order_release);
+    event_trace_leave(&ring->writers_busy);
+}
+
+// This allocates a ring of 'events_per_core' events for every core and starts recording
+esp_err_t setup_event_trace(int events_per_core)
+{
+    if(atomic_load(&event_trace_active))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(events_per_core <= 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t size = 1;
+    while(size < (uint32_t)events_per_core)
+    {
+        size <<= 1;
+    }
+    for(int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        event_trace_rings[core].slots = calloc(size, sizeof(event_trace_slot_t));
+        if(event_trace_rings[core].slots == NULL)
+        {
+            for(int allocated = 0; allocated < core; allocated++)
+            {
+                free(event_trace_rings[allocated].slots);
+                event_trace_rings[allocated].slots = NULL;
+            }
+            return ESP_ERR_NO_MEM;
+        }
+        atomic_store(&event_trace_rings[core].write_position, 0);
+    }
+    event_trace_mask = size - 1;
+    atomic_store(&event_trace_active, true);
+    ESP_LOGI(LOGGING_TAG, "EVENT TRACE STARTED (%u EVENTS PER CORE)", (unsigned)size);
+    return ESP_OK;
+}
+
+esp_err_t stop_event_trace()
+{
+    if(!atomic_exchange(&event_trace_active, false))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for(int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        while(atomic_load(&event_trace_rings[core].writers_busy) > 0)
+        {
+            vTaskDelay(1);
+        }
+    }
+    while(atomic_load(&event_trace_readers_busy) > 0)
+    {
+        vTaskDelay(1);
+    }
+    for(int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        free(event_trace_rings[core].slots);
+        event_trace_rings[core].slots = NULL;
+    }
+    return ESP_OK;
+}
+
+// Copies the events still in one core's ring into 'events_holder', oldest first. Returns how many, and adds the ones lost to overwriting to 'overwritten'.
+static int read_event_trace_ring(event_trace_ring_t *ring, event_trace_event_t *events_holder, uint32_t *overwritten)
+{
+    uint32_t size = event_trace_mask + 1;
+    uint32_t end = atomic_load_explicit(&ring->write_position, memory_order_acquire);
+    uint32_t start = end > size ? end - size : 0;
+    *overwritten += start;
+    int count = 0;
+    for(uint32_t position = start; position != end; position++)
+    {
+        event_trace_slot_t *slot = &ring->slots[position & event_trace_mask];
+        uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if(sequence != 2 * position + 2)
+        {
+            // Overwritten by a newer event already, or still being written
+            if(sequence > 2 * position + 2)
+            {
+                (*overwritten)++;
+            }
+            continue;
+        }
+        events_holder[count] = slot->event;
+        atomic_thread_fence(memory_order_acquire);
+        if(atomic_load_explicit(&slot->sequence, memory_order_relaxed) != sequence)
+        {
+            (*overwritten)++;
+            continue;
+        }
+        count++;
+    }
+    return count;
+}
+
+// Whether 'a' is later than 'b', timestamps are the low 32 bits of esp_timer so they wrap every 71 minutes
+static inline bool event_trace_later(const event_trace_event_t *a, const event_trace_event_t *b)
+{
+    return (int32_t)(a->timestamp_us - b->timestamp_us) > 0;
+}
+
+/*
+    Reads every ring and merges them by timestamp into a newly allocated array, which the caller frees. Events of the same core keep
+    their ring order when timestamps are equal, so a span that began and ended in the same microsecond stays in order.
+*/
+static event_trace_event_t *collect_event_trace(int *count_holder, uint32_t *overwritten_holder)
+{
+    uint32_t size = event_trace_mask + 1;
+    event_trace_event_t *core_events = malloc(2 * portNUM_PROCESSORS * size * sizeof(event_trace_event_t));
+    if(core_events == NULL)
+    {
+        return NULL;
+    }
+    event_trace_event_t *merged = core_events + portNUM_PROCESSORS * size;
+    int core_counts[portNUM_PROCESSORS];
+    int core_next[portNUM_PROCESSORS];
+    *overwritten_holder = 0;
+    for(int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        core_counts[core] = read_event_trace_ring(&event_trace_rings[core], &core_events[core * size], overwritten_holder);
+        core_next[core] = 0;
+    }
+    int count = 0;
+    while(true)
+    {
+        int earliest = -1;
+        for(int core = 0; core < portNUM_PROCESSORS; core++)
+        {
+            if(core_next[core] < core_counts[core] && (earliest < 0 ||
+               event_trace_later(&core_events[earliest * size + core_next[earliest]], &core_events[core * size + core_next[core]])))
+            {
+                earliest = core;
+            }
+        }
+        if(earliest < 0)
+        {
+            break;
+        }
+        merged[count++] = core_events[earliest * size + core_next[earliest]++];
+    }
+    memmove(core_events, merged, count * sizeof(event_trace_event_t));
+    *count_holder = count;
+    return core_events;
+}
+
+int read_event_trace(event_trace_event_t events_holder[], int max_events)
+{
+    if(events_holder == NULL || max_events <= 0)
+    {
+        return 0;
+    }
+    if(!event_trace_enter(&event_trace_readers_busy))
+    {
+        return 0;
+    }
+    int count;
+    uint32_t overwritten;
+    event_trace_event_t *events = collect_event_trace(&count, &overwritten);
+    event_trace_leave(&event_trace_readers_busy);
+    if(events == NULL)
+    {
+        return 0;
+    }
+    int first = count > max_events ? count - max_events : 0;
+    memcpy(events_holder, &events[first], (count - first) * sizeof(event_trace_event_t));
+    free(events);
+    return count - first;
+}
+
+// Writes the header and every event still in the rings, in timestamp order. Recording goes on while this runs.
+esp_err_t write_event_trace(capture_output_write_t write, void* context)
+{
+    if(write == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(!event_trace_enter(&event_trace_readers_busy))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    int count;
+    uint32_t overwritten;
+    event_trace_event_t *events = collect_event_trace(&count, &overwritten);
+    event_trace_leave(&event_trace_readers_busy);
+    if(events == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    event_trace_file_header_t header = {
+        .magic = EVENT_TRACE_FILE_MAGIC,
+        .version = EVENT_TRACE_FILE_VERSION,
+        .event_size = sizeof(event_trace_event_t),
+        .event_count = count,
+        .events_overwritten = overwritten
+    };
+    esp_err_t status = write(context, (const uint8_t *)&header, sizeof(header));
+    if(status == ESP_OK && count > 0)
+    {
+        status = write(context, (const uint8_t *)events, count * sizeof(event_trace_event_t));
+    }
+    free(events);
+    return status;
+}
@@ -0,0 +1,369 @@
+#include <stdatomic.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    In place forwarding.
+    A received data or management frame whose match_address has a route gets its header rewritten where it lies (the driver's
+    buffer, or the deferred RX slot the worker is on): address 1 becomes the route's next hop, address 2 this device, address 3
+    whatever the route says, and the frame control and duration/ID fields are patched. The same buffer then goes to
+    esp_wifi_80211_tx, so relaying a frame copies nothing. It runs in the receive path after duplicate detection, so a relay does
+    not send retransmissions twice, and before the prints and callbacks, which forwarded frames skip unless deliver_forwarded is set.
+    The routes are kept in one of three tables, published with a single atomic store and pinned by the frame being forwarded like
+    the frame filters, so a route that is removed or replaced is no longer used once the call that changed it returns.
+*/
+
+#define FORWARDING_TABLES 3
+#define FORWARDING_AVERAGE_DIVISOR 16 // The latency average moves 1/16 of the way to each new sample, and is stored multiplied by this
+
+typedef struct {
+    forwarding_route_t routes[FORWARDING_MAX_ROUTES];
+    int route_count;
+} forwarding_table_t;
+
+typedef struct {
+    forwarding_config_t config;
+    int address_offset; // Header offset of match_address
+    // Receive path owned counters
+    _Atomic uint32_t frames_forwarded;
+    _Atomic uint32_t frames_no_route;
+    _Atomic uint32_t frames_truncated;
+    _Atomic uint32_t send_errors;
+    _Atomic int32_t last_send_error;
+    _Atomic uint32_t latency_average_us; // Times FORWARDING_AVERAGE_DIVISOR
+    _Atomic uint32_t latency_max_us;
+} forwarding_t;
+
+static forwarding_t forwarding;
+// Set and cleared with seq_cst, as is forwarding_producers_busy: the receive path counts itself in before it checks the flag and
+// stop_forwarding clears the flag before it checks the count, so one of the two always sees the other
+_Atomic bool forwarding_active;
+static _Atomic uint32_t forwarding_producers_busy; // Receive paths inside forwarding_forward_frame, so stop_forwarding returns only once no frame is being rewritten or sent. Outside forwarding so setup_forwarding does not clear it.
+
+static forwarding_table_t forwarding_registry; // Routes as added, edited with the lock held and copied out to publish
+static forwarding_table_t forwarding_tables[FORWARDING_TABLES];
+static _Atomic(forwarding_table_t *) forwarding_active_table;
+static table_readers_t forwarding_readers;
+static _Atomic(SemaphoreHandle_t) forwarding_lock;
+
+static inline void count_forwarding(_Atomic uint32_t *counter)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// The lock is created on first use. Two tasks racing here both create one, and the loser deletes its own.
+static SemaphoreHandle_t get_forwarding_lock()
+{
+    SemaphoreHandle_t lock = atomic_load_explicit(&forwarding_lock, memory_order_acquire);
+    if(lock == NULL)
+    {
+        SemaphoreHandle_t created = xSemaphoreCreateMutex();
+        if(created == NULL)
+        {
+            return NULL;
+        }
+        if(atomic_compare_exchange_strong_explicit(&forwarding_lock, &lock, created, memory_order_acq_rel, memory_order_acquire))
+        {
+            lock = created;
+        }
+        else
+        {
+            vSemaphoreDelete(created);
+        }
+    }
+    return lock;
+}
+
+// Takes the lock once a table buffer is free to rebuild into, the same as take_callback_dispatch_buffer.
+// Returns the buffer with the lock held, or NULL with the lock released if only the calling task's own forwarding pins them.
+static forwarding_table_t *take_forwarding_buffer(SemaphoreHandle_t lock)
+{
+    while(true)
+    {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        bool pinned_by_caller;
+        forwarding_table_t *table = table_readers_free_buffer(&forwarding_readers, forwarding_tables, sizeof(forwarding_tables[0]),
+            FORWARDING_TABLES, atomic_load_explicit(&forwarding_active_table, memory_order_relaxed), &pinned_by_caller);
+        if(table != NULL)
+        {
+            return table;
+        }
+        xSemaphoreGive(lock);
+        if(pinned_by_caller)
+        {
+            return NULL;
+        }
+        vTaskDelay(1);
+    }
+}
+
+// Copies the registry into a free table buffer and publishes it, or publishes no table once the last route is removed. Called with the lock held.
+static forwarding_table_t *rebuild_forwarding_table(forwarding_table_t *table)
+{
+    *table = forwarding_registry;
+    table = table->route_count > 0 ? table : NULL;
+    atomic_store_explicit(&forwarding_active_table, table, memory_order_seq_cst);
+    return table;
+}
+
+static const forwarding_route_t *find_forwarding_route(const forwarding_table_t *table, const uint8_t destination[6])
+{
+    for(int index = 0; index < table->route_count; index++)
+    {
+        if(memcmp(table->routes[index].destination, destination, 6) == 0)
+        {
+            return &table->routes[index];
+        }
+    }
+    return NULL;
+}
+
+// Rewrites and sends the frame if it has a route in the pinned table. Returns whether the frame was forwarded and the callbacks are to be skipped.
+static bool forward_frame_with_table(const forwarding_table_t *table, wifi_frame_view_t *view)
+{
+    // Only data and management frames have the three address header, address 4 also needs both DS bits. A frame shorter than its
+    // header (parse_frame_view gave ESP_ERR_INVALID_SIZE) has no room for the addresses to be matched or rewritten.
+    if(view->type == WIFI_FRAME_TYPE_CONTROL || view->header_length < 24 || view->frame_length < view->header_length
+        || (forwarding.address_offset == 24 && !(view->to_ds && view->from_ds)))
+    {
+        return false;
+    }
+    uint8_t *frame = view->frame;
+    const uint8_t *own_mac = get_configuration_holder()->mac_addr;
+    if(forwarding.config.only_to_this_device && memcmp(&frame[4], own_mac, 6) != 0)
+    {
+        return false;
+    }
+
+    int64_t start = esp_timer_get_time();
+    const forwarding_route_t *route = find_forwarding_route(table, &frame[forwarding.address_offset]);
+    if(route == NULL)
+    {
+        count_forwarding(&forwarding.frames_no_route);
+        return false;
+    }
+    if(view->truncated)
+    {
+        count_forwarding(&forwarding.frames_truncated);
+        return false;
+    }
+
+    // Address 3 is written first since FORWARD_ADDRESS_3_SOURCE takes it from the address 2 about to be replaced
+    if(route->address_3 == FORWARD_ADDRESS_3_SOURCE)
+    {
+        memcpy(&frame[16], &frame[10], 6);
+    }
+    else if(route->address_3 == FORWARD_ADDRESS_3_DESTINATION)
+    {
+        memcpy(&frame[16], route->destination, 6);
+    }
+    memcpy(&frame[4], route->next_hop, 6);
+    memcpy(&frame[10], own_mac, 6);
+    uint16_t frame_control = (view->frame_control & ~route->frame_control_clear) | route->frame_control_set;
+    frame[0] = frame_control & 0xFF;
+    frame[1] = frame_control >> 8;
+    if(route->duration_id >= 0)
+    {
+        frame[2] = route->duration_id & 0xFF;
+        frame[3] = (route->duration_id >> 8) & 0xFF;
+    }
+
+    esp_err_t result = send_packet_raw_no_callback(frame, view->frame_length, !forwarding.config.keep_sequence_control);
+    if(result == ESP_OK)
+    {
+        count_forwarding(&forwarding.frames_forwarded);
+    }
+    else
+    {
+        count_forwarding(&forwarding.send_errors);
+        atomic_store_explicit(&forwarding.last_send_error, result, memory_order_relaxed);
+    }
+    uint32_t latency_us = (uint32_t)(esp_timer_get_time() - start);
+    uint32_t average = atomic_load_explicit(&forwarding.latency_average_us, memory_order_relaxed);
+    average = average == 0 ? latency_us * FORWARDING_AVERAGE_DIVISOR : average - average / FORWARDING_AVERAGE_DIVISOR + latency_us;
+    atomic_store_explicit(&forwarding.latency_average_us, average, memory_order_relaxed);
+    if(latency_us > atomic_load_explicit(&forwarding.latency_max_us, memory_order_relaxed))
+    {
+        atomic_store_explicit(&forwarding.latency_max_us, latency_us, memory_order_relaxed);
+    }
+
+    bool deliver = forwarding.config.deliver_forwarded;
+    if(deliver && frame_control != view->frame_control)
+    {
+        // The DS bits may have changed the address roles, so decode the header again for the callbacks
+        wifi_frame_view_t received = *view;
+        parse_frame_view(frame, received.frame_length, false, view);
+        view->truncated = received.truncated;
+        view->duplicate = received.duplicate;
+        view->channel = received.channel;
+        view->rx_ctrl = received.rx_ctrl;
+    }
+    return !deliver;
+}
+
+// Rewrites and sends the frame if it has a route. Returns whether the frame was forwarded and the callbacks are to be skipped.
+bool forwarding_forward_frame(wifi_frame_view_t *view)
+{
+    atomic_fetch_add(&forwarding_producers_busy, 1);
+    bool skip_callbacks = false;
+    if(atomic_load(&forwarding_active) && atomic_load_explicit(&forwarding_active_table, memory_order_relaxed) != NULL)
+    {
+        table_reader_slot_t *reader = table_readers_claim(&forwarding_readers);
+        const forwarding_table_t *table;
+        TABLE_READERS_PIN(reader, &forwarding_active_table, table);
+        skip_callbacks = table != NULL && forward_frame_with_table(table, view);
+        table_readers_release(reader);
+    }
+    atomic_fetch_sub(&forwarding_producers_busy, 1);
+    return skip_callbacks;
+}
+
+// This starts forwarding received frames along the routes added with 'add_forwarding_route'. The send interface has to be set up, its MAC is the one written to address 2.
+esp_err_t setup_forwarding(forwarding_config_t config)
+{
+    if(atomic_load(&forwarding_active))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    static const int address_offsets[] = { 4, 10, 16, 24 };
+    if(config.match_address < FRAME_FILTER_ADDRESS_1 || config.match_address > FRAME_FILTER_ADDRESS_4)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(&forwarding, 0, sizeof(forwarding));
+    forwarding.config = config;
+    forwarding.address_offset = address_offsets[config.match_address - FRAME_FILTER_ADDRESS_1];
+    atomic_store(&forwarding_active, true);
+    ESP_LOGI(LOGGING_TAG, "FORWARDING STARTED");
+    return ESP_OK;
+}
+
+esp_err_t stop_forwarding()
+{
+    if(!atomic_exchange(&forwarding_active, false))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    while(atomic_load(&forwarding_producers_busy) > 0)
+    {
+        vTaskDelay(1);
+    }
+    return ESP_OK;
+}
+
+// Adds a route, or replaces the one with the same destination. Routes can be changed while forwarding runs, a replaced route is no longer used once this returns.
+esp_err_t add_forwarding_route(const forwarding_route_t* route)
+{
+    if(route == NULL || route->address_3 > FORWARD_ADDRESS_3_DESTINATION || route->duration_id > UINT16_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    SemaphoreHandle_t lock = get_forwarding_lock();
+    if(lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    forwarding_table_t *table = take_forwarding_buffer(lock);
+    if(table == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    forwarding_route_t *existing = (forwarding_route_t *)find_forwarding_route(&forwarding_registry, route->destination);
+    if(existing != NULL)
+    {
+        *existing = *route;
+    }
+    else if(forwarding_registry.route_count == FORWARDING_MAX_ROUTES)
+    {
+        xSemaphoreGive(lock);
+        return ESP_ERR_NO_MEM;
+    }
+    else
+    {
+        forwarding_registry.routes[forwarding_registry.route_count++] = *route;
+    }
+    table = rebuild_forwarding_table(table);
+    xSemaphoreGive(lock);
+    if(existing != NULL)
+    {
+        table_readers_synchronize(&forwarding_readers, table);
+    }
+    return ESP_OK;
+}
+
+esp_err_t remove_forwarding_route(const uint8_t destination[6])
+{
+    if(destination == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    SemaphoreHandle_t lock = get_forwarding_lock();
+    if(lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    forwarding_table_t *table = take_forwarding_buffer(lock);
+    if(table == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    const forwarding_route_t *removed = find_forwarding_route(&forwarding_registry, destination);
+    if(removed == NULL)
+    {
+        xSemaphoreGive(lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    int index = removed - forwarding_registry.routes;
+    memmove(&forwarding_registry.routes[index], &forwarding_registry.routes[index + 1], (forwarding_registry.route_count - index - 1) * sizeof(forwarding_route_t));
+    forwarding_registry.route_count--;
+    table = rebuild_forwarding_table(table);
+    xSemaphoreGive(lock);
+    table_readers_synchronize(&forwarding_readers, table);
+    return ESP_OK;
+}
+
+// Copies the counters into 'stats_holder'. They are read while frames keep arriving, so they can be a few frames apart from each other.
+esp_err_t get_forwarding_stats(forwarding_stats_t* stats_holder)
+{
+    if(!atomic_load(&forwarding_active))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(stats_holder == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    table_reader_slot_t *reader = table_readers_claim(&forwarding_readers);
+    const forwarding_table_t *table;
+    TABLE_READERS_PIN(reader, &forwarding_active_table, table);
+    stats_holder->route_count = table != NULL ? table->route_count : 0;
+    table_readers_release(reader);
+    stats_holder->frames_forwarded = atomic_load_explicit(&forwarding.frames_forwarded, memory_order_relaxed);
+    stats_holder->frames_no_route = atomic_load_explicit(&forwarding.frames_no_route, memory_order_relaxed);
+    stats_holder->frames_truncated = atomic_load_explicit(&forwarding.frames_truncated, memory_order_relaxed);
+    stats_holder->send_errors = atomic_load_explicit(&forwarding.send_errors, memory_order_relaxed);
+    stats_holder->last_send_error = atomic_load_explicit(&forwarding.last_send_error, memory_order_relaxed);
+    stats_holder->latency_average_us = atomic_load_explicit(&forwarding.latency_average_us, memory_order_relaxed) / FORWARDING_AVERAGE_DIVISOR;
+    stats_holder->latency_max_us = atomic_load_explicit(&forwarding.latency_max_us, memory_order_relaxed);
+    return ESP_OK;
+}
+
+// Clears the counters and latency figures. They are owned by the receive path, so a frame arriving during the reset may still be counted.
+esp_err_t reset_forwarding_stats()
+{
+    if(!atomic_load(&forwarding_active))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    atomic_store_explicit(&forwarding.frames_forwarded, 0, memory_order_relaxed);
+    atomic_store_explicit(&forwarding.frames_no_route, 0, memory_order_relaxed);
+    atomic_store_explicit(&forwarding.frames_truncated, 0, memory_order_relaxed);
+    atomic_store_explicit(&forwarding.send_errors, 0, memory_order_relaxed);
+    atomic_store_explicit(&forwarding.latency_average_us, 0, memory_order_relaxed);
+    atomic_store_explicit(&forwarding.latency_max_us, 0, memory_order_relaxed);
+    return ESP_OK;
+}
@@ -0,0 +1,515 @@
+#include <stdatomic.h>
+#include <stddef.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Frame filters.
+    Each filter added is compiled into a short run of instructions, one per term, each a load of a value from the frame (a header
+    field, a length, payload bytes, or the RSSI) and a masked compare. Terms that only read the fixed part of the header are placed
+    first and the ones that need the header length worked out last, so most frames are rejected after one or two loads.
+    A frame passes when any filter matches it, checked in the order they were added; the first filter that matches counts the hit.
+    The compiled filters are kept in one of three tables, published with a single atomic store and pinned by the frames being
+    checked like the callback dispatch tables, so a buffer is only rebuilt into once no frame is still checked against it.
+*/
+
+#define FRAME_FILTER_TABLES 3
+
+// How an instruction loads its value
+enum frame_filter_op {
+    FRAME_FILTER_OP_HEADER_U16, // Little endian header field, shifted and masked
+    FRAME_FILTER_OP_SEQUENCE_NUMBER, // Same, but only management and data frames have one
+    FRAME_FILTER_OP_HEADER_BYTES, // Bytes at a header offset, compared under a byte mask
+    FRAME_FILTER_OP_FRAME_LENGTH,
+    FRAME_FILTER_OP_RSSI,
+    FRAME_FILTER_OP_PAYLOAD_LENGTH,
+    FRAME_FILTER_OP_PAYLOAD_BYTES
+};
+
+typedef struct {
+    uint8_t op; // enum frame_filter_op
+    uint8_t negate;
+    uint8_t length; // Bytes loaded by the *_BYTES ops
+    uint8_t shift;
+    uint16_t offset; // Header offset, or payload offset for FRAME_FILTER_OP_PAYLOAD_BYTES
+    union {
+        struct {
+            uint32_t mask;
+            int32_t min;
+            int32_t max;
+        } range;
+        struct {
+            uint64_t value; // Already masked
+            uint64_t mask;
+        } bytes;
+    };
+} frame_filter_instruction_t;
+
+typedef struct {
+    frame_filter_id_t id;
+    uint8_t slot; // Index of the hit counter, stays the same while the filter is added
+    uint8_t first_instruction;
+    uint8_t instruction_count;
+} frame_filter_program_t;
+
+typedef struct {
+    frame_filter_program_t programs[PACKET_LIBRARY_MAX_FRAME_FILTERS];
+    int program_count;
+    frame_filter_instruction_t instructions[PACKET_LIBRARY_MAX_FRAME_FILTER_TERMS];
+} frame_filter_table_t;
+
+static frame_filter_table_t frame_filter_registry; // Filters in the order they were added, edited with the lock held and copied out to publish
+static bool frame_filter_slot_used[PACKET_LIBRARY_MAX_FRAME_FILTERS];
+static frame_filter_table_t frame_filter_tables[FRAME_FILTER_TABLES];
+static frame_filter_id_t frame_filter_next_id = 1;
+static _Atomic(frame_filter_table_t *) frame_filter_active_table;
+static table_readers_t frame_filter_readers;
+static _Atomic(SemaphoreHandle_t) frame_filter_lock;
+
+// Written only by the task the driver runs the receive callback in
+static _Atomic uint32_t frame_filter_frames_checked;
+static _Atomic uint32_t frame_filter_frames_rejected;
+static _Atomic uint32_t frame_filter_hits[PACKET_LIBRARY_MAX_FRAME_FILTERS];
+
+// The lock is created on first use. Two tasks racing here both create one, and the loser deletes its own.
+static SemaphoreHandle_t get_frame_filter_lock()
+{
+    SemaphoreHandle_t lock = atomic_load_explicit(&frame_filter_lock, memory_order_acquire);
+    if(lock == NULL)
+    {
+        SemaphoreHandle_t created = xSemaphoreCreateMutex();
+        if(created == NULL)
+        {
+            return NULL;
+        }
+        if(atomic_compare_exchange_strong_explicit(&frame_filter_lock, &lock, created, memory_order_acq_rel, memory_order_acquire))
+        {
+            lock = created;
+        }
+        else
+        {
+            vSemaphoreDelete(created);
+        }
+    }
+    return lock;
+}
+
+// Loads up to 8 frame bytes so they compare with the same layout the term bytes were loaded with
+static inline uint64_t load_frame_filter_bytes(const uint8_t *bytes, int length)
+{
+    uint64_t value = 0;
+    memcpy(&value, bytes, length);
+    return value;
+}
+
+// Turns one term into its instruction. Returns false for a term that cannot be compiled.
+static bool compile_frame_filter_term(const frame_filter_term_t *term, frame_filter_instruction_t *instruction)
+{
+    memset(instruction, 0, sizeof(frame_filter_instruction_t));
+    instruction->negate = term->negate;
+    uint32_t field_mask = 0xFFFF;
+    switch(term->field)
+    {
+        case FRAME_FILTER_TYPE:
+            instruction->op = FRAME_FILTER_OP_HEADER_U16;
+            instruction->shift = 2;
+            field_mask = 0x3;
+            break;
+        case FRAME_FILTER_SUBTYPE:
+            instruction->op = FRAME_FILTER_OP_HEADER_U16;
+            instruction->shift = 4;
+            field_mask = 0xF;
+            break;
+        case FRAME_FILTER_FRAME_CONTROL:
+            instruction->op = FRAME_FILTER_OP_HEADER_U16;
+            break;
+        case FRAME_FILTER_SEQUENCE_NUMBER:
+            instruction->op = FRAME_FILTER_OP_SEQUENCE_NUMBER;
+            instruction->offset = offsetof(wifi_mac_data_frame_t, sequence_control);
+            instruction->shift = 4;
+            field_mask = 0xFFF;
+            break;
+        case FRAME_FILTER_FRAME_LENGTH:
+            instruction->op = FRAME_FILTER_OP_FRAME_LENGTH;
+            field_mask = 0xFFFFFFFF;
+            break;
+        case FRAME_FILTER_PAYLOAD_LENGTH:
+            instruction->op = FRAME_FILTER_OP_PAYLOAD_LENGTH;
+            field_mask = 0xFFFFFFFF;
+            break;
+        case FRAME_FILTER_RSSI:
+            instruction->op = FRAME_FILTER_OP_RSSI;
+            field_mask = 0xFFFFFFFF;
+            break;
+        case FRAME_FILTER_ADDRESS_1:
+        case FRAME_FILTER_ADDRESS_2:
+        case FRAME_FILTER_ADDRESS_3:
+        case FRAME_FILTER_ADDRESS_4:
+        case FRAME_FILTER_PAYLOAD_BYTES:
+        {
+            static const uint16_t address_offsets[] = {
+                offsetof(wifi_mac_data_frame_t, address_1),
+                offsetof(wifi_mac_data_frame_t, address_2),
+                offsetof(wifi_mac_data_frame_t, address_3),
+                offsetof(wifi_mac_data_frame_t, address_4)
+            };
+            if(term->field == FRAME_FILTER_PAYLOAD_BYTES)
+            {
+                if(term->length < 1 || term->length > 8 || term->offset < 0 || term->offset > PACKET_LIBRARY_MAX_PAYLOAD_LENGTH)
+                {
+                    return false;
+                }
+                instruction->op = FRAME_FILTER_OP_PAYLOAD_BYTES;
+                instruction->offset = term->offset;
+                instruction->length = term->length;
+            }
+            else
+            {
+                instruction->op = FRAME_FILTER_OP_HEADER_BYTES;
+                instruction->offset = address_offsets[term->field - FRAME_FILTER_ADDRESS_1];
+                instruction->length = 6;
+            }
+            uint8_t mask[8] = {0};
+            bool mask_set = false;
+            for(int i = 0; i < instruction->length; i++)
+            {
+                mask_set |= term->bytes_mask[i] != 0;
+            }
+            for(int i = 0; i < instruction->length; i++)
+            {
+                mask[i] = mask_set ? term->bytes_mask[i] : 0xFF;
+            }
+            instruction->bytes.mask = load_frame_filter_bytes(mask, instruction->length);
+            instruction->bytes.value = load_frame_filter_bytes(term->bytes, instruction->length) & instruction->bytes.mask;
+            return true;
+        }
+        default:
+            return false;
+    }
+    instruction->range.mask = term->mask != 0 ? (term->mask & field_mask) : field_mask;
+    instruction->range.min = term->min;
+    instruction->range.max = term->max;
+    return true;
+}
+
+// Instructions that need the header length of the frame worked out go last, addresses included since they are bounded by it
+static int frame_filter_instruction_cost(const frame_filter_instruction_t *instruction)
+{
+    switch(instruction->op)
+    {
+        case FRAME_FILTER_OP_HEADER_BYTES:
+        case FRAME_FILTER_OP_PAYLOAD_LENGTH:
+        case FRAME_FILTER_OP_PAYLOAD_BYTES:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Compiles the terms onto the end of the registry instructions, cheapest first. Returns the number of instructions written.
+static int compile_frame_filter(const frame_filter_term_t terms[], int term_count, frame_filter_instruction_t *instructions)
+{
+    int count = 0;
+    for(int cost = 0; cost <= 1; cost++)
+    {
+        for(int i = 0; i < term_count; i++)
+        {
+            frame_filter_instruction_t instruction;
+            if(!compile_frame_filter_term(&terms[i], &instruction))
+            {
+                return -1;
+            }
+            if(frame_filter_instruction_cost(&instruction) == cost)
+            {
+                instructions[count++] = instruction;
+            }
+        }
+    }
+    return count;
+}
+
+// Takes the lock once a table buffer is free to rebuild into, the same as take_callback_dispatch_buffer.
+// Returns the buffer with the lock held, or NULL with the lock released if only the calling task's own filtering pins them.
+static frame_filter_table_t *take_frame_filter_buffer(SemaphoreHandle_t lock)
+{
+    while(true)
+    {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        bool pinned_by_caller;
+        frame_filter_table_t *table = table_readers_free_buffer(&frame_filter_readers, frame_filter_tables, sizeof(frame_filter_tables[0]),
+            FRAME_FILTER_TABLES, atomic_load_explicit(&frame_filter_active_table, memory_order_relaxed), &pinned_by_caller);
+        if(table != NULL)
+        {
+            return table;
+        }
+        xSemaphoreGive(lock);
+        if(pinned_by_caller)
+        {
+            return NULL;
+        }
+        vTaskDelay(1);
+    }
+}
+
+// Copies the registry into a free table buffer and publishes it, or publishes no table once the last filter is removed. Called with the lock held.
+static frame_filter_table_t *rebuild_frame_filter_table(frame_filter_table_t *table)
+{
+    *table = frame_filter_registry;
+    table = table->program_count > 0 ? table : NULL;
+    atomic_store_explicit(&frame_filter_active_table, table, memory_order_seq_cst);
+    return table;
+}
+
+static int frame_filter_registry_instruction_count()
+{
+    if(frame_filter_registry.program_count == 0)
+    {
+        return 0;
+    }
+    const frame_filter_program_t *last = &frame_filter_registry.programs[frame_filter_registry.program_count - 1];
+    return last->first_instruction + last->instruction_count;
+}
+
+// Compiles 'terms' into a filter that matches frames passing all of them. Once a filter is added, received frames that match none of the added filters are dropped.
+esp_err_t add_frame_filter(const frame_filter_term_t terms[], int term_count, frame_filter_id_t* filter_id_holder)
+{
+    if(terms == NULL || term_count < 1)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    SemaphoreHandle_t lock = get_frame_filter_lock();
+    if(lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    frame_filter_table_t *table = take_frame_filter_buffer(lock);
+    if(table == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    int instruction_count = frame_filter_registry_instruction_count();
+    if(frame_filter_registry.program_count == PACKET_LIBRARY_MAX_FRAME_FILTERS || instruction_count + term_count > PACKET_LIBRARY_MAX_FRAME_FILTER_TERMS)
+    {
+        xSemaphoreGive(lock);
+        return ESP_ERR_NO_MEM;
+    }
+    int compiled = compile_frame_filter(terms, term_count, &frame_filter_registry.instructions[instruction_count]);
+    if(compiled < 0)
+    {
+        xSemaphoreGive(lock);
+        return ESP_ERR_INVALID_ARG;
+    }
+    int slot = 0;
+    while(frame_filter_slot_used[slot])
+    {
+        slot++;
+    }
+    frame_filter_slot_used[slot] = true;
+    atomic_store_explicit(&frame_filter_hits[slot], 0, memory_order_relaxed);
+    frame_filter_program_t *program = &frame_filter_registry.programs[frame_filter_registry.program_count++];
+    program->id = frame_filter_next_id++;
+    program->slot = slot;
+    program->first_instruction = instruction_count;
+    program->instruction_count = compiled;
+    rebuild_frame_filter_table(table);
+    if(filter_id_holder != NULL)
+    {
+        *filter_id_holder = program->id;
+    }
+    xSemaphoreGive(lock);
+    return ESP_OK;
+}
+
+// Removes a filter added with 'add_frame_filter', frames go back to passing unfiltered once the last one is removed
+esp_err_t remove_frame_filter(frame_filter_id_t filter_id)
+{
+    SemaphoreHandle_t lock = get_frame_filter_lock();
+    if(lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t status = ESP_ERR_NOT_FOUND;
+    frame_filter_table_t *table = take_frame_filter_buffer(lock);
+    if(table == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for(int i = 0; i < frame_filter_registry.program_count && filter_id != 0; i++)
+    {
+        frame_filter_program_t removed = frame_filter_registry.programs[i];
+        if(removed.id != filter_id)
+        {
+            continue;
+        }
+        // Close the gap in the instructions and in the programs, moving the later programs down
+        int instruction_count = frame_filter_registry_instruction_count();
+        int removed_end = removed.first_instruction + removed.instruction_count;
+        memmove(&frame_filter_registry.instructions[removed.first_instruction], &frame_filter_registry.instructions[removed_end], (instruction_count - removed_end) * sizeof(frame_filter_instruction_t));
+        for(int j = i; j < frame_filter_registry.program_count - 1; j++)
+        {
+            frame_filter_registry.programs[j] = frame_filter_registry.programs[j + 1];
+            frame_filter_registry.programs[j].first_instruction -= removed.instruction_count;
+        }
+        frame_filter_registry.program_count--;
+        frame_filter_slot_used[removed.slot] = false;
+        table = rebuild_frame_filter_table(table);
+        status = ESP_OK;
+        break;
+    }
+    xSemaphoreGive(lock);
+    if(status == ESP_OK)
+    {
+        // The hit counter slot can be handed to the next filter added, so no frame may still count into it
+        table_readers_synchronize(&frame_filter_readers, table);
+    }
+    return status;
+}
+
+esp_err_t get_frame_filter_stats(frame_filter_stats_t* stats_holder)
+{
+    if(stats_holder == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(stats_holder, 0, sizeof(frame_filter_stats_t));
+    stats_holder->frames_checked = atomic_load_explicit(&frame_filter_frames_checked, memory_order_relaxed);
+    stats_holder->frames_rejected = atomic_load_explicit(&frame_filter_frames_rejected, memory_order_relaxed);
+    table_reader_slot_t *reader = table_readers_claim(&frame_filter_readers);
+    const frame_filter_table_t *table;
+    TABLE_READERS_PIN(reader, &frame_filter_active_table, table);
+    if(table != NULL)
+    {
+        stats_holder->filter_count = table->program_count;
+        for(int i = 0; i < table->program_count; i++)
+        {
+            stats_holder->filter_ids[i] = table->programs[i].id;
+            stats_holder->filter_hits[i] = atomic_load_explicit(&frame_filter_hits[table->programs[i].slot], memory_order_relaxed);
+        }
+    }
+    table_readers_release(reader);
+    return ESP_OK;
+}
+
+esp_err_t reset_frame_filter_stats()
+{
+    atomic_store_explicit(&frame_filter_frames_checked, 0, memory_order_relaxed);
+    atomic_store_explicit(&frame_filter_frames_rejected, 0, memory_order_relaxed);
+    for(int i = 0; i < PACKET_LIBRARY_MAX_FRAME_FILTERS; i++)
+    {
+        atomic_store_explicit(&frame_filter_hits[i], 0, memory_order_relaxed);
+    }
+    return ESP_OK;
+}
+
+// Runs one instruction on a frame. 'header_length' is worked out on the first instruction that needs it, -1 until then.
+static inline bool run_frame_filter_instruction(const frame_filter_instruction_t *instruction, const wifi_pkt_rx_ctrl_t *rx_ctrl, const uint8_t *frame, int frame_length, int *header_length)
+{
+    int32_t value;
+    switch(instruction->op)
+    {
+        case FRAME_FILTER_OP_SEQUENCE_NUMBER:
+            if(((frame[0] >> 2) & 0x3) == WIFI_FRAME_TYPE_CONTROL)
+            {
+                return false;
+            }
+            // fall through
+        case FRAME_FILTER_OP_HEADER_U16:
+            if(instruction->offset + 2 > frame_length)
+            {
+                return false;
+            }
+            value = (frame[instruction->offset] | (frame[instruction->offset + 1] << 8)) >> instruction->shift;
+            break;
+        case FRAME_FILTER_OP_FRAME_LENGTH:
+            value = frame_length;
+            break;
+        case FRAME_FILTER_OP_RSSI:
+            value = rx_ctrl->rssi;
+            break;
+        case FRAME_FILTER_OP_HEADER_BYTES:
+        case FRAME_FILTER_OP_PAYLOAD_BYTES:
+        {
+            if(*header_length < 0)
+            {
+                *header_length = frame_header_length(frame[0] | (frame[1] << 8));
+            }
+            int offset = instruction->offset;
+            int limit = frame_length;
+            if(instruction->op == FRAME_FILTER_OP_PAYLOAD_BYTES)
+            {
+                offset += *header_length;
+            }
+            else if(*header_length < limit)
+            {
+                // An address only counts when it is part of the header, address 4 of a three address frame is payload
+                limit = *header_length;
+            }
+            if(offset + instruction->length > limit)
+            {
+                return false;
+            }
+            return (load_frame_filter_bytes(frame + offset, instruction->length) & instruction->bytes.mask) == instruction->bytes.value;
+        }
+        default: // FRAME_FILTER_OP_PAYLOAD_LENGTH
+            if(*header_length < 0)
+            {
+                *header_length = frame_header_length(frame[0] | (frame[1] << 8));
+            }
+            if(*header_length > frame_length)
+            {
+                return false;
+            }
+            value = frame_length - *header_length;
+            break;
+    }
+    value &= instruction->range.mask;
+    return value >= instruction->range.min && value <= instruction->range.max;
+}
+
+// Whether a received frame passes the filters of a pinned table
+static bool frame_filter_table_accepts(const frame_filter_table_t *table, const wifi_pkt_rx_ctrl_t *rx_ctrl, const uint8_t *frame, int frame_length)
+{
+    atomic_store_explicit(&frame_filter_frames_checked, atomic_load_explicit(&frame_filter_frames_checked, memory_order_relaxed) + 1, memory_order_relaxed);
+    if(frame_length >= 2)
+    {
+        int header_length = -1;
+        for(int program_index = 0; program_index < table->program_count; program_index++)
+        {
+            const frame_filter_program_t *program = &table->programs[program_index];
+            const frame_filter_instruction_t *instruction = &table->instructions[program->first_instruction];
+            const frame_filter_instruction_t *end = instruction + program->instruction_count;
+            for(; instruction < end; instruction++)
+            {
+                if(run_frame_filter_instruction(instruction, rx_ctrl, frame, frame_length, &header_length) == instruction->negate)
+                {
+                    break;
+                }
+            }
+            if(instruction == end)
+            {
+                atomic_store_explicit(&frame_filter_hits[program->slot], atomic_load_explicit(&frame_filter_hits[program->slot], memory_order_relaxed) + 1, memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    atomic_store_explicit(&frame_filter_frames_rejected, atomic_load_explicit(&frame_filter_frames_rejected, memory_order_relaxed) + 1, memory_order_relaxed);
+    return false;
+}
+
+// Whether a received frame passes the added filters. 'frame_length' leaves out the FCS. Costs one atomic load when no filter is added.
+bool frame_filter_accepts(const wifi_pkt_rx_ctrl_t *rx_ctrl, const uint8_t *frame, int frame_length)
+{
+    if(atomic_load_explicit(&frame_filter_active_table, memory_order_relaxed) == NULL)
+    {
+        return true;
+    }
+    table_reader_slot_t *reader = table_readers_claim(&frame_filter_readers);
+    const frame_filter_table_t *table;
+    TABLE_READERS_PIN(reader, &frame_filter_active_table, table);
+    bool accepted = table == NULL || frame_filter_table_accepts(table, rx_ctrl, frame, frame_length);
+    table_readers_release(reader);
+    return accepted;
+}
@@ -0,0 +1,242 @@
+#include <stdatomic.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Fixed-size frame pool.
+    Each size class is one contiguous block of equally sized frame buffers with a lock-free free list (a Treiber stack of slot
+    indexes). The stack top and a change counter share one 32 bit word, so acquire/release is a single compare-and-swap in the
+    common case and is safe from any task on either core without a lock. The counter stops a slot that was popped and pushed
+    back between another task's load and its compare-and-swap from being mistaken for an unchanged stack.
+*/
+
+#define FRAME_POOL_EMPTY_INDEX 0xFFFF
+
+typedef struct {
+    uint8_t *block; // frame_count * frame_stride bytes
+    _Atomic uint16_t *next_index; // Free list links, one per slot
+    uint32_t frame_size;
+    uint32_t frame_stride;
+    uint32_t frame_count;
+    _Atomic uint32_t free_top; // (change counter << 16) | index of the first free slot
+    _Atomic uint32_t in_use;
+    _Atomic uint32_t in_use_high_water_mark;
+    _Atomic uint32_t acquired;
+    _Atomic uint32_t exhausted;
+} frame_pool_class_t;
+
+static frame_pool_class_t frame_pool_classes[FRAME_POOL_MAX_SIZE_CLASSES];
+static int frame_pool_class_count;
+static _Atomic uint32_t frame_pool_heap_fallbacks;
+static bool frame_pool_ready;
+
+static void *frame_pool_class_pop(frame_pool_class_t *size_class)
+{
+    uint32_t top = atomic_load_explicit(&size_class->free_top, memory_order_acquire);
+    uint32_t index;
+    do
+    {
+        index = top & 0xFFFF;
+        if(index == FRAME_POOL_EMPTY_INDEX)
+        {
+            return NULL;
+        }
+        uint32_t next = atomic_load_explicit(&size_class->next_index[index], memory_order_relaxed);
+        uint32_t replacement = ((top + 0x10000) & 0xFFFF0000) | next;
+        if(atomic_compare_exchange_weak_explicit(&size_class->free_top, &top, replacement, memory_order_acquire, memory_order_acquire))
+        {
+            break;
+        }
+    } while(true);
+
+    uint32_t in_use = atomic_fetch_add_explicit(&size_class->in_use, 1, memory_order_relaxed) + 1;
+    uint32_t high_water_mark = atomic_load_explicit(&size_class->in_use_high_water_mark, memory_order_relaxed);
+    while(in_use > high_water_mark && !atomic_compare_exchange_weak_explicit(&size_class->in_use_high_water_mark, &high_water_mark, in_use, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+    atomic_fetch_add_explicit(&size_class->acquired, 1, memory_order_relaxed);
+    return size_class->block + index * size_class->frame_stride;
+}
+
+static void frame_pool_class_push(frame_pool_class_t *size_class, uint32_t index)
+{
+    uint32_t top = atomic_load_explicit(&size_class->free_top, memory_order_relaxed);
+    uint32_t replacement;
+    do
+    {
+        atomic_store_explicit(&size_class->next_index[index], (uint16_t)(top & 0xFFFF), memory_order_relaxed);
+        replacement = ((top + 0x10000) & 0xFFFF0000) | index;
+    } while(!atomic_compare_exchange_weak_explicit(&size_class->free_top, &top, replacement, memory_order_release, memory_order_relaxed));
+    atomic_fetch_sub_explicit(&size_class->in_use, 1, memory_order_relaxed);
+}
+
+void *frame_pool_acquire(int frame_length)
+{
+    if(!frame_pool_ready)
+    {
+        return NULL;
+    }
+    for(int class_index = 0; class_index < frame_pool_class_count; class_index++)
+    {
+        frame_pool_class_t *size_class = &frame_pool_classes[class_index];
+        if((uint32_t)frame_length > size_class->frame_size)
+        {
+            continue;
+        }
+        void *buffer = frame_pool_class_pop(size_class);
+        if(buffer != NULL)
+        {
+            return buffer;
+        }
+        atomic_fetch_add_explicit(&size_class->exhausted, 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+bool frame_pool_release(void *buffer)
+{
+    uint8_t *address = (uint8_t *)buffer;
+    for(int class_index = 0; class_index < frame_pool_class_count; class_index++)
+    {
+        frame_pool_class_t *size_class = &frame_pool_classes[class_index];
+        if(address >= size_class->block && address < size_class->block + size_class->frame_count * size_class->frame_stride)
+        {
+            frame_pool_class_push(size_class, (address - size_class->block) / size_class->frame_stride);
+            return true;
+        }
+    }
+    return false;
+}
+
+// This preallocates every size class in 'config'. It is meant to be called once during setup, before any pooled packets are allocated.
+esp_err_t setup_frame_pool(frame_pool_config_t config)
+{
+    if(frame_pool_ready)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    int previous_size = 0;
+    for(int class_index = 0; class_index < FRAME_POOL_MAX_SIZE_CLASSES; class_index++)
+    {
+        frame_pool_size_class_t requested = config.size_classes[class_index];
+        if(requested.frame_count == 0)
+        {
+            continue;
+        }
+        if(requested.frame_count < 0 || requested.frame_count >= FRAME_POOL_EMPTY_INDEX || requested.frame_size < (int)sizeof(wifi_mac_data_frame_t) || requested.frame_size <= previous_size)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        previous_size = requested.frame_size;
+    }
+
+    frame_pool_class_count = 0;
+    for(int class_index = 0; class_index < FRAME_POOL_MAX_SIZE_CLASSES; class_index++)
+    {
+        frame_pool_size_class_t requested = config.size_classes[class_index];
+        if(requested.frame_count == 0)
+        {
+            continue;
+        }
+        frame_pool_class_t *size_class = &frame_pool_classes[frame_pool_class_count];
+        memset(size_class, 0, sizeof(frame_pool_class_t));
+        size_class->frame_size = requested.frame_size;
+        size_class->frame_stride = (requested.frame_size + 3) & ~3u; // Keep every frame 4 byte aligned
+        size_class->frame_count = requested.frame_count;
+        size_class->block = malloc(size_class->frame_count * size_class->frame_stride);
+        size_class->next_index = malloc(size_class->frame_count * sizeof(uint16_t));
+        if(size_class->block == NULL || size_class->next_index == NULL)
+        {
+            free(size_class->block);
+            free((void *)size_class->next_index);
+            for(int created = 0; created < frame_pool_class_count; created++)
+            {
+                free(frame_pool_classes[created].block);
+                free((void *)frame_pool_classes[created].next_index);
+            }
+            frame_pool_class_count = 0;
+            return ESP_ERR_NO_MEM;
+        }
+        // Chain every slot into the free list in address order
+        for(uint32_t index = 0; index < size_class->frame_count; index++)
+        {
+            atomic_init(&size_class->next_index[index], index + 1 < size_class->frame_count ? index + 1 : FRAME_POOL_EMPTY_INDEX);
+        }
+        atomic_init(&size_class->free_top, 0);
+        frame_pool_class_count++;
+    }
+    atomic_store(&frame_pool_heap_fallbacks, 0);
+    frame_pool_ready = true;
+    ESP_LOGI(LOGGING_TAG, "FRAME POOL READY (%d SIZE CLASSES)", frame_pool_class_count);
+    return ESP_OK;
+}
+
+// Copies the per size class usage counters into 'stats_holder'
+esp_err_t get_frame_pool_stats(frame_pool_stats_t* stats_holder)
+{
+    if(!frame_pool_ready)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    memset(stats_holder, 0, sizeof(frame_pool_stats_t));
+    stats_holder->size_class_count = frame_pool_class_count;
+    for(int class_index = 0; class_index < frame_pool_class_count; class_index++)
+    {
+        frame_pool_class_t *size_class = &frame_pool_classes[class_index];
+        stats_holder->size_classes[class_index].frame_size = size_class->frame_size;
+        stats_holder->size_classes[class_index].frame_count = size_class->frame_count;
+        stats_holder->size_classes[class_index].in_use = atomic_load_explicit(&size_class->in_use, memory_order_relaxed);
+        stats_holder->size_classes[class_index].in_use_high_water_mark = atomic_load_explicit(&size_class->in_use_high_water_mark, memory_order_relaxed);
+        stats_holder->size_classes[class_index].acquired = atomic_load_explicit(&size_class->acquired, memory_order_relaxed);
+        stats_holder->size_classes[class_index].exhausted = atomic_load_explicit(&size_class->exhausted, memory_order_relaxed);
+    }
+    stats_holder->heap_fallbacks = atomic_load_explicit(&frame_pool_heap_fallbacks, memory_order_relaxed);
+    return ESP_OK;
+}
+
+// Same as 'alloc_packet_custom', but the packet is taken from the frame pool. If the pool is not setup or has no free frame large enough, the packet is calloc'd instead.
+// The generated packet must be released with 'free_packet_pooled' upon completion of its use
+wifi_mac_data_frame_t* alloc_packet_custom_pooled(uint16_t frame_control, uint16_t duration_id, uint8_t address_1[6], uint8_t address_2[6], uint8_t address_3[6], uint16_t sequence_control, uint8_t address_4[6], int payload_length, uint8_t* payload)
+{
+    wifi_mac_data_frame_t* pkt = frame_pool_acquire(sizeof(wifi_mac_data_frame_t) + payload_length);
+    if(pkt == NULL)
+    {
+        if(frame_pool_ready)
+        {
+            atomic_fetch_add_explicit(&frame_pool_heap_fallbacks, 1, memory_order_relaxed);
+        }
+        return alloc_packet_custom(frame_control, duration_id, address_1, address_2, address_3, sequence_control, address_4, payload_length, payload);
+    }
+    if(payload == NULL && payload_length > 0)
+    {
+        memset(pkt->payload, 0, payload_length); // Match calloc'd packets, pooled frames are reused
+    }
+    fill_packet_custom(pkt, frame_control, duration_id, address_1, address_2, address_3, sequence_control, address_4, payload_length, payload);
+    return pkt;
+}
+
+// This allocates a pooled packet while only setting the payload (all other values are set to zero)
+wifi_mac_data_frame_t* alloc_packet_default_payload_pooled(int payload_length, uint8_t *payload)
+{
+    return alloc_packet_custom_pooled(0, 0, (uint8_t []){0,0,0,0,0,0}, (uint8_t []){0,0,0,0,0,0}, (uint8_t []){0,0,0,0,0,0}, 0, (uint8_t []){0,0,0,0,0,0}, payload_length, payload);
+}
+
+// This allocates a pooled packet with a zeroed payload of 'payload_length' bytes
+wifi_mac_data_frame_t* alloc_packet_default_pooled(int payload_length)
+{
+    return alloc_packet_default_payload_pooled(payload_length, NULL);
+}
+
+// Returns a packet from any of the alloc_packet_*_pooled methods to the pool, or frees it if it was a heap fallback
+esp_err_t free_packet_pooled(wifi_mac_data_frame_t* packet)
+{
+    if(packet == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(!frame_pool_release(packet))
+    {
+        free(packet);
+    }
+    return ESP_OK;
+}
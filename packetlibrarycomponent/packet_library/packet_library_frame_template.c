@@ -0,0 +1,264 @@
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Frame templates.
+    A template keeps the serialized header for one (mode, destination) pair and a send buffer that already holds it, so a send
+    only copies the payload into the buffer. The header is rebuilt when the component configuration changes (new MAC, AP, or
+    interface) and copied back into the buffer after any send whose callbacks may have changed it.
+    The send_payload_* helpers share a small cache of templates keyed by mode and destination MAC.
+*/
+
+typedef struct {
+    frame_template_t frame_template;
+    bool in_use;
+    uint32_t last_used;
+} frame_template_cache_entry_t;
+
+static frame_template_cache_entry_t frame_template_cache[FRAME_TEMPLATE_CACHE_SIZE];
+static uint32_t frame_template_cache_clock;
+static _Atomic(SemaphoreHandle_t) frame_template_cache_lock;
+
+// Same interface/connection checks the send_payload_* helpers have always done for each mode
+static esp_err_t check_frame_template_mode(enum frame_template_mode mode)
+{
+    const configuration_settings_t *configuration = get_configuration_holder();
+    if(mode == FRAME_TEMPLATE_AP_TO_STATION)
+    {
+        if(configuration->wifi_interface_set == false)
+        {
+            return ESP_ERR_WIFI_NOT_INIT;
+        }
+        if(configuration->wifi_interface != WIFI_IF_AP)
+        {
+            return ESP_ERR_WIFI_MODE;
+        }
+        return ESP_OK;
+    }
+    if(configuration->wifi_interface_set == false || configuration->wifi_connected_to_ap == false)
+    {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if(configuration->wifi_interface != WIFI_IF_STA)
+    {
+        return ESP_ERR_WIFI_MODE;
+    }
+    return ESP_OK;
+}
+
+// Serializes the header for the template mode and destination from the current configuration
+static void build_frame_template_header(frame_template_t* frame_template)
+{
+    const configuration_settings_t *configuration = get_configuration_holder();
+    wifi_mac_data_frame_t *header = &frame_template->header;
+    memset(header, 0, sizeof(wifi_mac_data_frame_t));
+    header->duration_id = 0xFA;
+    header->sequence_control = 0x00; // This is managed by the chip and gets overwritten on simple send
+    switch(frame_template->mode)
+    {
+        case FRAME_TEMPLATE_AP_TO_STATION:
+            header->frame_control = 0x0208; // Always send as a data packet, also set To DS 0/From DS 1.
+            memcpy(header->address_1, frame_template->destination, sizeof(uint8_t[6]));
+            memcpy(header->address_2, configuration->mac_addr, sizeof(uint8_t[6]));
+            memcpy(header->address_3, configuration->mac_addr, sizeof(uint8_t[6]));
+            break;
+        case FRAME_TEMPLATE_STA_TO_ACCESS_POINT:
+            header->frame_control = 0x0108; // Always send as a data packet, also set To DS 1/From DS 0
+            memcpy(header->address_1, configuration->connected_ap_record.bssid, sizeof(uint8_t[6]));
+            memcpy(header->address_2, configuration->mac_addr, sizeof(uint8_t[6]));
+            memcpy(header->address_3, configuration->connected_ap_record.bssid, sizeof(uint8_t[6]));
+            break;
+        case FRAME_TEMPLATE_STA_THROUGH_ACCESS_POINT:
+            header->frame_control = 0x0108; // Always send as a data packet, also set To DS 1/From DS 0
+            memcpy(header->address_1, configuration->connected_ap_record.bssid, sizeof(uint8_t[6]));
+            memcpy(header->address_2, configuration->mac_addr, sizeof(uint8_t[6]));
+            memcpy(header->address_3, frame_template->destination, sizeof(uint8_t[6]));
+            break;
+    }
+    frame_template->configuration_generation = configuration->configuration_generation;
+    frame_template->buffer_header_stale = true;
+}
+
+// This builds a template for sending payloads to 'destination' in the given mode, with a send buffer large enough for 'payload_capacity' payload bytes.
+// The template must be released with 'free_frame_template'
+esp_err_t setup_frame_template(frame_template_t* frame_template, enum frame_template_mode mode, uint8_t destination[6], int payload_capacity)
+{
+    if(frame_template == NULL || payload_capacity < 0 || payload_capacity > PACKET_LIBRARY_MAX_PAYLOAD_LENGTH)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(frame_template, 0, sizeof(frame_template_t));
+    frame_template->buffer = calloc(1, sizeof(wifi_mac_data_frame_t) + payload_capacity);
+    if(frame_template->buffer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    frame_template->mode = mode;
+    if(destination != NULL)
+    {
+        memcpy(frame_template->destination, destination, sizeof(uint8_t[6]));
+    }
+    frame_template->payload_capacity = payload_capacity;
+    build_frame_template_header(frame_template);
+    return ESP_OK;
+}
+
+// Sends 'payload' with the template header through 'send_packet_simple'. Only the payload, duration ID, and sequence control are written into the buffer,
+// unless the configuration changed or a send callback may have touched the header on the last send, in which case the whole header is copied back in first.
+esp_err_t send_payload_with_template(frame_template_t* frame_template, uint8_t payload[], int payload_length)
+{
+    esp_err_t status = check_frame_template_mode(frame_template->mode);
+    if(status != ESP_OK)
+    {
+        return status;
+    }
+    if(payload_length < 0 || payload_length > frame_template->payload_capacity)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if(frame_template->configuration_generation != get_configuration_holder()->configuration_generation)
+    {
+        build_frame_template_header(frame_template);
+    }
+
+    wifi_mac_data_frame_t *buffer = frame_template->buffer;
+    if(frame_template->buffer_header_stale)
+    {
+        memcpy(buffer, &frame_template->header, sizeof(wifi_mac_data_frame_t));
+        frame_template->buffer_header_stale = false;
+    }
+    else
+    {
+        buffer->duration_id = frame_template->header.duration_id;
+        buffer->sequence_control = frame_template->header.sequence_control;
+    }
+    if(payload_length > 0)
+    {
+        memcpy(buffer->payload, payload, payload_length);
+    }
+
+    status = send_packet_simple(buffer, payload_length);
+    if(send_callbacks_may_modify_header())
+    {
+        frame_template->buffer_header_stale = true;
+    }
+    return status;
+}
+
+// Frees the send buffer of a template made with 'setup_frame_template'
+esp_err_t free_frame_template(frame_template_t* frame_template)
+{
+    if(frame_template == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    free(frame_template->buffer);
+    frame_template->buffer = NULL;
+    frame_template->payload_capacity = 0;
+    return ESP_OK;
+}
+
+// The cache lock is created on first use. Two tasks racing here both create one, and the loser deletes its own.
+static SemaphoreHandle_t get_frame_template_cache_lock()
+{
+    SemaphoreHandle_t lock = atomic_load_explicit(&frame_template_cache_lock, memory_order_acquire);
+    if(lock == NULL)
+    {
+        SemaphoreHandle_t created = xSemaphoreCreateMutex();
+        if(created == NULL)
+        {
+            return NULL;
+        }
+        if(atomic_compare_exchange_strong_explicit(&frame_template_cache_lock, &lock, created, memory_order_acq_rel, memory_order_acquire))
+        {
+            lock = created;
+        }
+        else
+        {
+            vSemaphoreDelete(created);
+        }
+    }
+    return lock;
+}
+
+// Finds (or builds, replacing the least recently used entry) the cached template for the mode and destination. Called with the cache lock held.
+static frame_template_t *find_cached_frame_template(enum frame_template_mode mode, uint8_t destination[6])
+{
+    frame_template_cache_entry_t *replace = &frame_template_cache[0];
+    for(int index = 0; index < FRAME_TEMPLATE_CACHE_SIZE; index++)
+    {
+        frame_template_cache_entry_t *entry = &frame_template_cache[index];
+        if(entry->in_use && entry->frame_template.mode == mode && memcmp(entry->frame_template.destination, destination, sizeof(uint8_t[6])) == 0)
+        {
+            entry->last_used = ++frame_template_cache_clock;
+            return &entry->frame_template;
+        }
+        if(!entry->in_use || (replace->in_use && entry->last_used < replace->last_used))
+        {
+            replace = entry;
+        }
+    }
+
+    // Keep the old entry's buffer, it is grown on demand in 'send_payload_cached_template'
+    replace->frame_template.mode = mode;
+    memcpy(replace->frame_template.destination, destination, sizeof(uint8_t[6]));
+    build_frame_template_header(&replace->frame_template);
+    replace->in_use = true;
+    replace->last_used = ++frame_template_cache_clock;
+    return &replace->frame_template;
+}
+
+static esp_err_t send_payload_through_cache(enum frame_template_mode mode, uint8_t destination[6], uint8_t payload[], int payload_length)
+{
+    esp_err_t status = check_frame_template_mode(mode);
+    if(status != ESP_OK)
+    {
+        return status;
+    }
+    if(payload_length < 0 || payload_length > PACKET_LIBRARY_MAX_PAYLOAD_LENGTH)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    SemaphoreHandle_t lock = get_frame_template_cache_lock();
+    if(lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    frame_template_t *frame_template = find_cached_frame_template(mode, destination);
+    if(payload_length > frame_template->payload_capacity)
+    {
+        // Cached buffers grow to the largest payload sent to them instead of always reserving the 802.11 maximum
+        wifi_mac_data_frame_t *grown = realloc(frame_template->buffer, sizeof(wifi_mac_data_frame_t) + payload_length);
+        if(grown == NULL)
+        {
+            xSemaphoreGive(lock);
+            return ESP_ERR_NO_MEM;
+        }
+        frame_template->buffer = grown;
+        frame_template->payload_capacity = payload_length;
+        frame_template->buffer_header_stale = true;
+    }
+    status = send_payload_with_template(frame_template, payload, payload_length);
+    xSemaphoreGive(lock);
+    return status;
+}
+
+// The send_payload_* helpers come in here, traced as one span around the send_packet_simple the template send makes
+esp_err_t send_payload_cached_template(enum frame_template_mode mode, uint8_t destination[6], uint8_t payload[], int payload_length)
+{
+    if(!atomic_load_explicit(&event_trace_active, memory_order_relaxed))
+    {
+        return send_payload_through_cache(mode, destination, payload, payload_length);
+    }
+    uint32_t trace_frame_id = event_trace_address_frame_id(destination, 0);
+    int length = sizeof(wifi_mac_data_frame_t) + payload_length;
+    event_trace_record(EVENT_TRACE_TX_PAYLOAD_BEGIN, trace_frame_id, length, 0);
+    esp_err_t status = send_payload_through_cache(mode, destination, payload, payload_length);
+    event_trace_record(EVENT_TRACE_TX_PAYLOAD_END, trace_frame_id, length, status);
+    return status;
+}
@@ -0,0 +1,179 @@
+#include <stddef.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Frame views.
+    wifi_mac_data_frame_t lays every frame out as a 30 byte four address data header, which only matches the four address
+    (ToDS and FromDS) data frames. A frame view is decoded once per frame, in place, from the frame control field: the header
+    length for the frame type, QoS and HT control fields, the address roles the DS bits give addresses 1 to 4, and the body
+    that follows the header with the FCS left off.
+*/
+
+#define FRAME_CONTROL_TO_DS 0x0100
+#define FRAME_CONTROL_FROM_DS 0x0200
+#define FRAME_CONTROL_RETRY 0x0800
+#define FRAME_CONTROL_PROTECTED 0x4000
+#define FRAME_CONTROL_ORDER 0x8000 // HT control field present, for QoS data and management frames
+
+#define FRAME_VIEW_FCS_LENGTH 4
+
+// The address at 'offset' in the frame, or NULL if the frame ends before it
+static uint8_t *frame_view_address(const wifi_frame_view_t *view, int offset)
+{
+    return offset + 6 <= view->frame_length ? view->frame + offset : NULL;
+}
+
+// Header length of a control frame, which only ever carries one or two addresses
+static int control_frame_header_length(uint8_t subtype)
+{
+    switch(subtype)
+    {
+        case 0x6: // Control frame extension
+        case 0xC: // CTS
+        case 0xD: // ACK
+            return 10;
+        default: // Control wrapper (carried frame control and HT control instead of address 2), block ack (request), PS-Poll, RTS, CF-End
+            return 16;
+    }
+}
+
+// Header length the frame control field gives a frame: the base header for its type, plus QoS control and HT control when present
+int frame_header_length(uint16_t frame_control)
+{
+    uint8_t type = (frame_control >> 2) & 0x3;
+    uint8_t subtype = (frame_control >> 4) & 0xF;
+    switch(type)
+    {
+        case WIFI_FRAME_TYPE_MANAGEMENT:
+            return (frame_control & FRAME_CONTROL_ORDER) ? 28 : 24;
+        case WIFI_FRAME_TYPE_CONTROL:
+            return control_frame_header_length(subtype); // The control wrapper carries its HT control inside these 16 bytes
+        case WIFI_FRAME_TYPE_DATA:
+        {
+            int header_length = (frame_control & FRAME_CONTROL_TO_DS) && (frame_control & FRAME_CONTROL_FROM_DS) ? 30 : 24;
+            if(subtype & 0x8)
+            {
+                header_length += (frame_control & FRAME_CONTROL_ORDER) ? 6 : 2;
+            }
+            return header_length;
+        }
+        default: // Extension frames only share the frame control and duration fields
+            return 10;
+    }
+}
+
+// Points the address roles at addresses 1 to 4 of a management or data frame, from the ToDS/FromDS bits
+static void assign_frame_view_addresses(wifi_frame_view_t *view)
+{
+    uint8_t *address_1 = frame_view_address(view, offsetof(wifi_mac_data_frame_t, address_1));
+    uint8_t *address_2 = frame_view_address(view, offsetof(wifi_mac_data_frame_t, address_2));
+    uint8_t *address_3 = frame_view_address(view, offsetof(wifi_mac_data_frame_t, address_3));
+    view->receiver = address_1;
+    view->transmitter = address_2;
+    if(view->type == WIFI_FRAME_TYPE_MANAGEMENT || (!view->to_ds && !view->from_ds))
+    {
+        view->destination = address_1;
+        view->source = address_2;
+        view->bssid = address_3;
+    }
+    else if(view->from_ds && !view->to_ds)
+    {
+        view->destination = address_1;
+        view->bssid = address_2;
+        view->source = address_3;
+    }
+    else if(view->to_ds && !view->from_ds)
+    {
+        view->bssid = address_1;
+        view->source = address_2;
+        view->destination = address_3;
+    }
+    else
+    {
+        // Wireless distribution system (or mesh) frame, the BSSID is not in the header
+        view->destination = address_3;
+        view->source = frame_view_address(view, offsetof(wifi_mac_data_frame_t, address_4));
+    }
+}
+
+// Decodes the frame in place into 'view_holder'. 'has_fcs' says whether the last 4 of the 'frame_length' bytes are the FCS, which is left out of the view.
+// A frame shorter than its header gives ESP_ERR_INVALID_SIZE, with the view still filled in for the fields that are there and an empty payload.
+esp_err_t parse_frame_view(uint8_t* frame, int frame_length, bool has_fcs, wifi_frame_view_t* view_holder)
+{
+    if(frame == NULL || view_holder == NULL || frame_length < 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    wifi_frame_view_t *view = view_holder;
+    memset(view, 0, sizeof(wifi_frame_view_t));
+    view->frame = frame;
+    view->frame_length = frame_length;
+    if(has_fcs)
+    {
+        view->frame_length = frame_length > FRAME_VIEW_FCS_LENGTH ? frame_length - FRAME_VIEW_FCS_LENGTH : 0;
+    }
+    view->payload = frame + view->frame_length;
+    if(view->frame_length < 2)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint16_t frame_control = frame[0] | (frame[1] << 8);
+    view->frame_control = frame_control;
+    view->type = (frame_control >> 2) & 0x3;
+    view->subtype = (frame_control >> 4) & 0xF;
+    view->to_ds = (frame_control & FRAME_CONTROL_TO_DS) != 0;
+    view->from_ds = (frame_control & FRAME_CONTROL_FROM_DS) != 0;
+    view->retry = (frame_control & FRAME_CONTROL_RETRY) != 0;
+    view->protected_frame = (frame_control & FRAME_CONTROL_PROTECTED) != 0;
+
+    int header_length = frame_header_length(frame_control);
+    int qos_offset = view->to_ds && view->from_ds ? 30 : 24;
+    view->header_length = header_length;
+    if(view->type == WIFI_FRAME_TYPE_DATA)
+    {
+        view->has_qos = (view->subtype & 0x8) != 0;
+        view->has_ht_control = view->has_qos && (frame_control & FRAME_CONTROL_ORDER) != 0;
+    }
+    else if(view->type == WIFI_FRAME_TYPE_MANAGEMENT)
+    {
+        view->has_ht_control = (frame_control & FRAME_CONTROL_ORDER) != 0;
+    }
+    else if(view->type == WIFI_FRAME_TYPE_CONTROL)
+    {
+        view->has_ht_control = view->subtype == 0x7;
+    }
+
+    if(view->type == WIFI_FRAME_TYPE_CONTROL)
+    {
+        view->receiver = frame_view_address(view, offsetof(wifi_mac_data_frame_t, address_1));
+        if(header_length == 16 && view->subtype != 0x7)
+        {
+            view->transmitter = frame_view_address(view, offsetof(wifi_mac_data_frame_t, address_2));
+        }
+    }
+    else if(view->type != WIFI_FRAME_TYPE_EXTENSION)
+    {
+        assign_frame_view_addresses(view);
+        if(view->frame_length >= 24)
+        {
+            uint16_t sequence_control = frame[22] | (frame[23] << 8);
+            view->sequence_number = sequence_control >> 4;
+            view->fragment_number = sequence_control & 0xF;
+        }
+        if(view->has_qos && view->frame_length >= qos_offset + 2)
+        {
+            view->qos_control = frame[qos_offset] | (frame[qos_offset + 1] << 8);
+            view->is_amsdu = (view->qos_control & 0x0080) != 0;
+        }
+    }
+
+    if(view->frame_length < header_length)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    view->payload = frame + header_length;
+    view->payload_length = view->frame_length - header_length;
+    return ESP_OK;
+}
@@ -0,0 +1,911 @@
+#include <stdatomic.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Mutation fuzzer.
+    Every mutation ID names one frame: the seed and the ID set up an xorshift64* generator, which picks a corpus frame and
+    stacks 1 to max_mutations_per_frame field aware mutations on a copy of it. Frames are reproducible from the ID alone, so the
+    log only keeps IDs and replay_fuzzer_mutation sends the same frame again.
+    A generator task fills one of two batches of frame buffers (taken from the frame pool when it is set up) while the sender
+    task hands the other to send_packet_batch, so the send loop neither allocates nor builds frames and the driver is kept fed.
+    With a target set, the receive path notes when the target was last heard and logs its management frames as responses to
+    the mutations that may have been sent last: the batch on the air, whose frames the driver takes without telling which one
+    went out when, and the last mutation of the batch before. The sender logs the target going silent for longer than silence_timeout_us, with the range of
+    mutations sent since it was last heard. The log is a bounded ring written by both, in the same way as the binary log.
+*/
+
+#define FUZZER_BATCHES 2
+#define FUZZER_MIN_FRAME_LENGTH 24
+#define FUZZER_MAX_FRAME_LENGTH 1500
+#define FUZZER_MAX_ELEMENTS 32
+#define FUZZER_MUTATORS 7
+
+typedef struct {
+    uint8_t *frame;
+    int frame_length;
+} fuzzer_seed_t;
+
+typedef struct {
+    wifi_mac_data_frame_t **packets; // batch_size frame buffers of max_frame_length bytes
+    int *payload_lengths; // Frame length - sizeof(wifi_mac_data_frame_t), as send_packet_batch takes it
+    esp_err_t *results;
+    uint32_t first_mutation_id;
+    int count;
+    _Atomic bool ready; // Filled by the generator and not sent yet
+} fuzzer_batch_t;
+
+typedef struct {
+    _Atomic uint32_t sequence;
+    fuzzer_log_entry_t entry;
+} fuzzer_log_slot_t;
+
+typedef struct {
+    fuzzer_config_t config;
+    fuzzer_seed_t seeds[FUZZER_MAX_SEEDS];
+    int seed_count;
+    uint8_t enabled_mutators[FUZZER_MUTATORS];
+    int enabled_mutator_count;
+    bool monitor_target;
+    fuzzer_batch_t batches[FUZZER_BATCHES];
+    fuzzer_log_slot_t *log_slots;
+    uint32_t log_mask;
+    _Atomic uint32_t log_write_position;
+    _Atomic uint32_t log_read_position;
+    TaskHandle_t generator_task;
+    TaskHandle_t sender_task;
+    bool started; // Tasks created by start_fuzzer and not yet waited for by stop_fuzzer
+    bool limited; // Stops at end_mutation_id
+    uint32_t end_mutation_id;
+    _Atomic uint32_t next_mutation_id; // Sender owned, the next mutation to send
+    _Atomic uint32_t sending_end_mutation_id; // Sender owned, past the last mutation of the batch being sent, next_mutation_id between batches
+    _Atomic uint32_t last_heard_ms; // esp_timer time the target was last heard
+    _Atomic uint32_t last_heard_mutation_id; // next_mutation_id when the target was last heard
+    _Atomic bool target_silent;
+    _Atomic bool stop_requested;
+    _Atomic bool generator_stopped;
+    _Atomic bool sender_stopped;
+    _Atomic uint32_t mutations_generated;
+    _Atomic uint32_t frames_sent;
+    _Atomic uint32_t send_errors;
+    _Atomic int32_t last_send_error;
+    _Atomic uint32_t batches_sent;
+    _Atomic uint32_t sender_waits;
+    _Atomic uint32_t responses;
+    _Atomic uint32_t silences;
+    _Atomic uint32_t log_entries_lost;
+} fuzzer_t;
+
+static fuzzer_t fuzzer;
+static bool fuzzer_set_up;
+// Set and cleared with seq_cst, as is fuzzer_producers_busy: the receive path counts itself in before it checks the flag and
+// stop_fuzzer clears the flag before it checks the count, so one of the two always sees the other
+_Atomic bool fuzzer_monitoring;
+static _Atomic uint32_t fuzzer_producers_busy; // Receive paths inside fuzzer_record_frame, so the log is not freed under them. Outside fuzzer so setup_fuzzer does not clear it.
+
+static const uint16_t interesting_durations[] = { 0x0000, 0x0001, 0x3FFF, 0x7FFF, 0x8000, 0xC000, 0xFFFF };
+static const uint8_t interesting_bytes[] = { 0x00, 0x01, 0x7F, 0x80, 0xFE, 0xFF };
+static const uint16_t interesting_words[] = { 0x0000, 0x0001, 0x00FF, 0x0100, 0x7FFF, 0x8000, 0xFFFF };
+static const uint8_t interesting_element_ids[] = { 0, 1, 3, 5, 7, 42, 45, 48, 50, 61, 127, 191, 221, 255 }; // SSID, rates, DS, TIM, country, ERP, HT, RSN, extended rates, HT operation, extended capabilities, VHT, vendor, extension
+static const uint8_t interesting_element_lengths[] = { 0, 1, 2, 0x7F, 0x80, 0xFE, 0xFF };
+
+static inline uint64_t next_fuzzer_random(uint64_t *state)
+{
+    uint64_t value = *state;
+    value ^= value >> 12;
+    value ^= value << 25;
+    value ^= value >> 27;
+    *state = value;
+    return value * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform enough below 'bound' without a division
+static inline uint32_t fuzzer_random_below(uint64_t *state, uint32_t bound)
+{
+    return (uint32_t)(((next_fuzzer_random(state) >> 32) * bound) >> 32);
+}
+
+// Spreads the seed and mutation ID over the generator state (splitmix64), so neighbouring IDs give unrelated frames
+static uint64_t mutation_random_state(uint64_t seed, uint32_t mutation_id)
+{
+    uint64_t state = seed + ((uint64_t)mutation_id + 1) * 0x9E3779B97F4A7C15ULL;
+    state = (state ^ (state >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    state = (state ^ (state >> 27)) * 0x94D049BB133111EBULL;
+    state ^= state >> 31;
+    return state != 0 ? state : 0x9E3779B97F4A7C15ULL;
+}
+
+static void fill_fuzzer_random_bytes(uint8_t *output, int length, uint64_t *random)
+{
+    while(length > 0)
+    {
+        uint64_t value = next_fuzzer_random(random);
+        int count = length < 8 ? length : 8;
+        memcpy(output, &value, count);
+        output += count;
+        length -= count;
+    }
+}
+
+// Opens 'count' bytes at 'at' ('at' + 'count' within 'capacity'), dropping whatever the frame buffer has no room for. Returns the new frame length.
+static int open_fuzzer_gap(uint8_t *frame, int frame_length, int capacity, int at, int count)
+{
+    int moved = frame_length - at;
+    if(at + count + moved > capacity)
+    {
+        moved = capacity - at - count;
+    }
+    if(moved > 0)
+    {
+        memmove(frame + at + count, frame + at, moved);
+    }
+    return at + count + (moved > 0 ? moved : 0);
+}
+
+static inline uint16_t get_fuzzer_frame_control(const uint8_t *frame)
+{
+    return frame[0] | (frame[1] << 8);
+}
+
+static void mutate_frame_control(uint8_t *frame, int *frame_length, int capacity, uint64_t *random)
+{
+    if(*frame_length < 2)
+    {
+        return;
+    }
+    switch(fuzzer_random_below(random, 4))
+    {
+        case 0: frame[1] ^= 1 << fuzzer_random_below(random, 8); break; // ToDS, FromDS, more fragments, retry, power management, more data, protected, order
+        case 1: frame[0] = (frame[0] & 0x0F) | (fuzzer_random_below(random, 16) << 4); break;
+        case 2: frame[0] = (frame[0] & 0xF3) | (fuzzer_random_below(random, 4) << 2); break;
+        default: frame[0] = (frame[0] & 0xFC) | fuzzer_random_below(random, 4); break;
+    }
+}
+
+static void mutate_duration(uint8_t *frame, int *frame_length, int capacity, uint64_t *random)
+{
+    if(*frame_length < 4)
+    {
+        return;
+    }
+    uint16_t duration = fuzzer_random_below(random, 2) ? interesting_durations[fuzzer_random_below(random, sizeof(interesting_durations) / sizeof(interesting_durations[0]))] : (uint16_t)next_fuzzer_random(random);
+    frame[2] = duration & 0xFF;
+    frame[3] = duration >> 8;
+}
+
+static void mutate_addresses(uint8_t *frame, int *frame_length, int capacity, uint64_t *random)
+{
+    static const int address_offsets[4] = { 4, 10, 16, 24 };
+    if(*frame_length < 2)
+    {
+        return;
+    }
+    int header_length = frame_header_length(get_fuzzer_frame_control(frame));
+    int limit = header_length < *frame_length ? header_length : *frame_length;
+    int address_count = 0;
+    while(address_count < 4 && address_offsets[address_count] + 6 <= limit)
+    {
+        address_count++;
+    }
+    if(address_count == 0)
+    {
+        return;
+    }
+    uint8_t *address = &frame[address_offsets[fuzzer_random_below(random, address_count)]];
+    switch(fuzzer_random_below(random, 6))
+    {
+        case 0: memset(address, 0xFF, 6); break;
+        case 1: memset(address, 0x00, 6); break;
+        case 2: // The target's address, or a random one without a target
+        case 3:
+            if(fuzzer.monitor_target && fuzzer_random_below(random, 2))
+            {
+                memcpy(address, fuzzer.config.target, 6);
+            }
+            else
+            {
+                fill_fuzzer_random_bytes(address, 6, random);
+                address[0] = (address[0] & 0xFC) | 0x02; // Locally administered unicast
+            }
+            break;
+        case 4: memmove(address, &frame[address_offsets[fuzzer_random_below(random, address_count)]], 6); break;
+        default: address[0] ^= 0x01; break; // Unicast and group swapped
+    }
+}
+
+static void mutate_sequence(uint8_t *frame, int *frame_length, int capacity, uint64_t *random)
+{
+    if(*frame_length < 24 || ((frame[0] >> 2) & 0x3) == WIFI_FRAME_TYPE_CONTROL)
+    {
+        return;
+    }
+    uint16_t sequence_control = frame[22] | (frame[23] << 8);
+    switch(fuzzer_random_below(random, 5))
+    {
+        case 0: sequence_control = (uint16_t)next_fuzzer_random(random); break;
+        case 1: sequence_control &= 0x000F; break;
+        case 2: sequence_control |= 0xFFF0; break;
+        case 3:
+            sequence_control = (sequence_control & 0xFFF0) | (1 + fuzzer_random_below(random, 15));
+            frame[1] |= 0x04; // More fragments
+            break;
+        default:
+            sequence_control -= 0x10; // A retry of the frame before
+            frame[1] |= 0x08;
+            break;
+    }
+    frame[22] = sequence_control & 0xFF;
+    frame[23] = sequence_control >> 8;
+}
+
+static void mutate_length(uint8_t *frame, int *frame_length, int capacity, uint64_t *random)
+{
+    int length = *frame_length;
+    int shortest = length < FUZZER_MIN_FRAME_LENGTH ? length : FUZZER_MIN_FRAME_LENGTH;
+    switch(fuzzer_random_below(random, 3))
+    {
+        case 0:
+            if(length > shortest)
+            {
+                *frame_length = shortest + fuzzer_random_below(random, length - shortest);
+            }
+            break;
+        case 1:
+        {
+            int header_length = length >= 2 ? frame_header_length(get_fuzzer_frame_control(frame)) : length;
+            *frame_length = header_length >= shortest && header_length < length ? header_length : shortest;
+            break;
+        }
+        default:
+            if(length < capacity)
+            {
+                int added = 1 + fuzzer_random_below(random, capacity - length);
+                fill_fuzzer_random_bytes(&frame[length], added, random);
+                *frame_length = length + added;
+            }
+            break;
+    }
+}
+
+static void mutate_payload_bytes(uint8_t *frame, int *frame_length, int capacity, uint64_t *random)
+{
+    int length = *frame_length;
+    if(length == 0)
+    {
+        return;
+    }
+    int start = length >= 2 ? frame_header_length(get_fuzzer_frame_control(frame)) : 0;
+    if(start >= length)
+    {
+        start = 0;
+    }
+    int offset = start + fuzzer_random_below(random, length - start);
+    switch(fuzzer_random_below(random, 4))
+    {
+        case 0: frame[offset] ^= 1 << fuzzer_random_below(random, 8); break;
+        case 1: frame[offset] = interesting_bytes[fuzzer_random_below(random, sizeof(interesting_bytes))]; break;
+        case 2: frame[offset] = (uint8_t)next_fuzzer_random(random); break;
+        default:
+            if(offset + 2 <= length)
+            {
+                uint16_t word = interesting_words[fuzzer_random_below(random, sizeof(interesting_words) / sizeof(interesting_words[0]))];
+                frame[offset] = word & 0xFF;
+                frame[offset + 1] = word >> 8;
+            }
+            break;
+    }
+}
+
+// Bytes of fixed fields between the header and the IEs of a management frame, -1 where the frame carries no IE list the fuzzer knows how to find
+static int management_fixed_fields_length(uint8_t subtype)
+{
+    switch(subtype)
+    {
+        case 0: return 4; // Association request
+        case 1: case 3: return 6; // (Re)association response
+        case 2: return 10; // Reassociation request
+        case 4: return 0; // Probe request
+        case 5: case 8: return 12; // Probe response, beacon
+        case 10: case 12: return 2; // Disassociation, deauthentication
+        case 11: return 6; // Authentication
+        default: return -1;
+    }
+}
+
+// Mutates the IE list of a management frame, other frames get a payload byte mutation instead
+static void mutate_information_elements(uint8_t *frame, int *frame_length, int capacity, uint64_t *random)
+{
+    int length = *frame_length;
+    int fixed_length = length >= 24 && ((frame[0] >> 2) & 0x3) == WIFI_FRAME_TYPE_MANAGEMENT ? management_fixed_fields_length(frame[0] >> 4) : -1;
+    int start = fixed_length >= 0 ? frame_header_length(get_fuzzer_frame_control(frame)) + fixed_length : length + 1;
+    if(start > length)
+    {
+        mutate_payload_bytes(frame, frame_length, capacity, random);
+        return;
+    }
+    // The list may already be broken by an earlier mutation, elements are taken as their lengths say
+    int elements[FUZZER_MAX_ELEMENTS];
+    int element_count = 0;
+    for(int offset = start; offset + 2 <= length && element_count < FUZZER_MAX_ELEMENTS; offset += 2 + frame[offset + 1])
+    {
+        elements[element_count++] = offset;
+    }
+    int element = element_count > 0 ? elements[fuzzer_random_below(random, element_count)] : start;
+    int element_length = element_count > 0 ? 2 + frame[element + 1] : 0;
+    if(element + element_length > length)
+    {
+        element_length = length - element;
+    }
+    switch(element_count > 0 ? fuzzer_random_below(random, 5) : 3)
+    {
+        case 0: // Wrong length, including one past what the element has
+        {
+            uint32_t choice = fuzzer_random_below(random, sizeof(interesting_element_lengths) + 2);
+            frame[element + 1] = choice < sizeof(interesting_element_lengths) ? interesting_element_lengths[choice] : frame[element + 1] + (choice == sizeof(interesting_element_lengths) ? 1 : -1);
+            break;
+        }
+        case 1: // Unexpected ID
+            frame[element] = fuzzer_random_below(random, 2) ? interesting_element_ids[fuzzer_random_below(random, sizeof(interesting_element_ids))] : (uint8_t)next_fuzzer_random(random);
+            break;
+        case 2: // Repeated element, as much of it as fits
+        {
+            int copied = capacity - element - element_length < element_length ? capacity - element - element_length : element_length;
+            if(copied > 0)
+            {
+                *frame_length = open_fuzzer_gap(frame, length, capacity, element + element_length, copied);
+                memcpy(&frame[element + element_length], &frame[element], copied);
+            }
+            break;
+        }
+        case 3: // Oversized element, always declared 255 bytes long even when the buffer only holds part of it
+        {
+            if(capacity - element < 2)
+            {
+                break;
+            }
+            int body_length = capacity - element - 2 < 255 ? capacity - element - 2 : 255;
+            *frame_length = open_fuzzer_gap(frame, length, capacity, element, 2 + body_length);
+            frame[element] = interesting_element_ids[fuzzer_random_below(random, sizeof(interesting_element_ids))];
+            frame[element + 1] = 255;
+            fill_fuzzer_random_bytes(&frame[element + 2], body_length, random);
+            break;
+        }
+        default: // Removed element
+            memmove(&frame[element], &frame[element + element_length], length - element - element_length);
+            *frame_length = length - element_length;
+            break;
+    }
+}
+
+typedef void (* fuzzer_mutator_t)(uint8_t *frame, int *frame_length, int capacity, uint64_t *random);
+
+// Indexed by the bit number of the enum fuzz_mutator value
+static const fuzzer_mutator_t fuzzer_mutators[FUZZER_MUTATORS] = {
+    mutate_frame_control, mutate_duration, mutate_addresses, mutate_sequence, mutate_length, mutate_information_elements, mutate_payload_bytes
+};
+
+// Builds the frame of one mutation ID into 'frame' (max_frame_length bytes)
+static int generate_fuzzer_frame(uint32_t mutation_id, uint8_t *frame)
+{
+    uint64_t random = mutation_random_state(fuzzer.config.seed, mutation_id);
+    int capacity = fuzzer.config.max_frame_length;
+    const fuzzer_seed_t *seed = &fuzzer.seeds[fuzzer_random_below(&random, fuzzer.seed_count)];
+    int frame_length = seed->frame_length < capacity ? seed->frame_length : capacity;
+    memcpy(frame, seed->frame, frame_length);
+    int mutations = 1 + fuzzer_random_below(&random, fuzzer.config.max_mutations_per_frame);
+    for(int mutation = 0; mutation < mutations; mutation++)
+    {
+        fuzzer_mutators[fuzzer.enabled_mutators[fuzzer_random_below(&random, fuzzer.enabled_mutator_count)]](frame, &frame_length, capacity, &random);
+    }
+    return frame_length;
+}
+
+static inline void count_fuzzer(_Atomic uint32_t *counter, uint32_t amount)
+{
+    atomic_fetch_add_explicit(counter, amount, memory_order_relaxed);
+}
+
+static inline uint32_t get_fuzzer_time_ms()
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// Adds an entry to the log ring, counting it as lost when the ring is full. Called from the receive path and the sender task.
+static void write_fuzzer_log(const fuzzer_log_entry_t *entry)
+{
+    fuzzer_log_slot_t *slot;
+    uint32_t position = atomic_load_explicit(&fuzzer.log_write_position, memory_order_relaxed);
+    while(true)
+    {
+        slot = &fuzzer.log_slots[position & fuzzer.log_mask];
+        int32_t difference = (int32_t)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - position);
+        if(difference == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&fuzzer.log_write_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if(difference < 0)
+        {
+            count_fuzzer(&fuzzer.log_entries_lost, 1);
+            return;
+        }
+        else
+        {
+            position = atomic_load_explicit(&fuzzer.log_write_position, memory_order_relaxed);
+        }
+    }
+    slot->entry = *entry;
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+}
+
+// Receive path: notes the target was heard, and logs its management frames other than beacons as responses to the mutations sent last
+void fuzzer_record_frame(const wifi_frame_view_t *view)
+{
+    atomic_fetch_add(&fuzzer_producers_busy, 1);
+    if(!atomic_load(&fuzzer_monitoring) || view->transmitter == NULL || memcmp(view->transmitter, fuzzer.config.target, 6) != 0)
+    {
+        atomic_fetch_sub(&fuzzer_producers_busy, 1);
+        return;
+    }
+    uint32_t next_mutation_id = atomic_load_explicit(&fuzzer.next_mutation_id, memory_order_acquire); // Orders the read of sending_end_mutation_id after it, so the range never runs backwards
+    uint32_t sending_end_mutation_id = atomic_load_explicit(&fuzzer.sending_end_mutation_id, memory_order_relaxed);
+    fuzzer_log_entry_t entry = {
+        .mutation_id = sending_end_mutation_id - 1,
+        .first_suspect_mutation_id = next_mutation_id - 1,
+        .timestamp_us = esp_timer_get_time(),
+        .rssi = view->rx_ctrl != NULL ? view->rx_ctrl->rssi : 0,
+        .frame_control = view->frame_control
+    };
+    atomic_store_explicit(&fuzzer.last_heard_ms, (uint32_t)(entry.timestamp_us / 1000), memory_order_relaxed);
+    atomic_store_explicit(&fuzzer.last_heard_mutation_id, next_mutation_id, memory_order_relaxed);
+    if(atomic_exchange(&fuzzer.target_silent, false))
+    {
+        entry.event = FUZZER_LOG_TARGET_RECOVERED;
+        write_fuzzer_log(&entry);
+    }
+    if(view->type == WIFI_FRAME_TYPE_MANAGEMENT && view->subtype != 8)
+    {
+        entry.event = FUZZER_LOG_RESPONSE;
+        count_fuzzer(&fuzzer.responses, 1);
+        write_fuzzer_log(&entry);
+    }
+    atomic_fetch_sub(&fuzzer_producers_busy, 1);
+}
+
+// Sender task: logs the target going quiet, once until it is heard again
+static void check_fuzzer_target()
+{
+    if(!fuzzer.monitor_target || atomic_load(&fuzzer.target_silent))
+    {
+        return;
+    }
+    uint32_t silent_ms = get_fuzzer_time_ms() - atomic_load_explicit(&fuzzer.last_heard_ms, memory_order_relaxed);
+    if(silent_ms * 1000ULL < fuzzer.config.silence_timeout_us)
+    {
+        return;
+    }
+    bool heard = false;
+    if(atomic_compare_exchange_strong(&fuzzer.target_silent, &heard, true))
+    {
+        fuzzer_log_entry_t entry = {
+            .mutation_id = atomic_load_explicit(&fuzzer.next_mutation_id, memory_order_relaxed) - 1,
+            .first_suspect_mutation_id = atomic_load_explicit(&fuzzer.last_heard_mutation_id, memory_order_relaxed),
+            .timestamp_us = esp_timer_get_time(),
+            .event = FUZZER_LOG_TARGET_SILENT
+        };
+        count_fuzzer(&fuzzer.silences, 1);
+        write_fuzzer_log(&entry);
+    }
+}
+
+// Generator task body, fills the batches in turn as the sender frees them
+static void fuzzer_generator_task(void *arg)
+{
+    uint32_t mutation_id = atomic_load(&fuzzer.next_mutation_id);
+    int next_batch = 0;
+    while(!atomic_load(&fuzzer.stop_requested))
+    {
+        fuzzer_batch_t *batch = &fuzzer.batches[next_batch];
+        if(atomic_load_explicit(&batch->ready, memory_order_acquire))
+        {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+            continue;
+        }
+        int count = fuzzer.config.batch_size;
+        if(fuzzer.limited && fuzzer.end_mutation_id - mutation_id < (uint32_t)count)
+        {
+            count = fuzzer.end_mutation_id - mutation_id;
+        }
+        if(count == 0)
+        {
+            break;
+        }
+        for(int index = 0; index < count; index++)
+        {
+            batch->payload_lengths[index] = generate_fuzzer_frame(mutation_id + index, (uint8_t *)batch->packets[index]) - (int)sizeof(wifi_mac_data_frame_t);
+        }
+        batch->first_mutation_id = mutation_id;
+        batch->count = count;
+        mutation_id += count;
+        count_fuzzer(&fuzzer.mutations_generated, count);
+        atomic_store_explicit(&batch->ready, true, memory_order_release);
+        xTaskNotifyGive(fuzzer.sender_task);
+        next_batch = (next_batch + 1) % FUZZER_BATCHES;
+    }
+    atomic_store(&fuzzer.generator_stopped, true);
+    xTaskNotifyGive(fuzzer.sender_task);
+    vTaskDelete(NULL);
+}
+
+// Sender task body, sends the batches in the order they were generated
+static void fuzzer_sender_task(void *arg)
+{
+    send_batch_pacing_t pacing = {
+        .inter_frame_interval_us = fuzzer.config.inter_frame_interval_us,
+        .callbacks = SEND_BATCH_CALLBACKS_NONE,
+        .keep_sequence_control = true
+    };
+    int next_batch = 0;
+    while(!atomic_load(&fuzzer.stop_requested))
+    {
+        fuzzer_batch_t *batch = &fuzzer.batches[next_batch];
+        if(!atomic_load_explicit(&batch->ready, memory_order_acquire))
+        {
+            // The generator marks its last batch ready before it stops, so a stopped generator and no ready batch means the run is over
+            if(atomic_load(&fuzzer.generator_stopped) && !atomic_load_explicit(&batch->ready, memory_order_acquire))
+            {
+                break;
+            }
+            count_fuzzer(&fuzzer.sender_waits, 1);
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+            check_fuzzer_target();
+            continue;
+        }
+        atomic_store_explicit(&fuzzer.sending_end_mutation_id, batch->first_mutation_id + batch->count, memory_order_relaxed);
+        send_packet_batch(batch->packets, batch->payload_lengths, batch->count, pacing, batch->results);
+        uint32_t sent = 0;
+        for(int index = 0; index < batch->count; index++)
+        {
+            if(batch->results[index] == ESP_OK)
+            {
+                sent++;
+            }
+            else
+            {
+                count_fuzzer(&fuzzer.send_errors, 1);
+                atomic_store_explicit(&fuzzer.last_send_error, batch->results[index], memory_order_relaxed);
+            }
+        }
+        count_fuzzer(&fuzzer.frames_sent, sent);
+        count_fuzzer(&fuzzer.batches_sent, 1);
+        atomic_store_explicit(&fuzzer.next_mutation_id, batch->first_mutation_id + batch->count, memory_order_release);
+        atomic_store_explicit(&batch->ready, false, memory_order_release);
+        xTaskNotifyGive(fuzzer.generator_task);
+        next_batch = (next_batch + 1) % FUZZER_BATCHES;
+        check_fuzzer_target();
+    }
+    atomic_store(&fuzzer_monitoring, false);
+    atomic_store(&fuzzer.sender_stopped, true);
+    vTaskDelete(NULL);
+}
+
+static void free_fuzzer_batches()
+{
+    for(int batch_index = 0; batch_index < FUZZER_BATCHES; batch_index++)
+    {
+        fuzzer_batch_t *batch = &fuzzer.batches[batch_index];
+        if(batch->packets != NULL)
+        {
+            for(int index = 0; index < fuzzer.config.batch_size; index++)
+            {
+                if(batch->packets[index] != NULL && !frame_pool_release(batch->packets[index]))
+                {
+                    free(batch->packets[index]);
+                }
+            }
+        }
+        free(batch->packets);
+        free(batch->payload_lengths);
+        free(batch->results);
+        batch->packets = NULL;
+        batch->payload_lengths = NULL;
+        batch->results = NULL;
+    }
+}
+
+/*
+    Sets up the fuzzer with an empty corpus: allocates both batches of frame buffers (from the frame pool when one is set up and
+    has buffers of max_frame_length, otherwise from the heap) and the log ring. Add seeds with add_fuzzer_seed, then start_fuzzer.
+*/
+esp_err_t setup_fuzzer(fuzzer_config_t config)
+{
+    if(fuzzer_set_up)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if((config.mutators & FUZZ_MUTATE_ALL) == 0 || config.max_mutations_per_frame <= 0 || config.batch_size <= 0 || config.log_capacity <= 0
+        || config.max_frame_length < FUZZER_MIN_FRAME_LENGTH || config.max_frame_length > FUZZER_MAX_FRAME_LENGTH)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(&fuzzer, 0, sizeof(fuzzer));
+    fuzzer.config = config;
+    for(int bit = 0; bit < FUZZER_MUTATORS; bit++)
+    {
+        if(config.mutators & (1 << bit))
+        {
+            fuzzer.enabled_mutators[fuzzer.enabled_mutator_count++] = bit;
+        }
+    }
+    static const uint8_t no_target[6] = { 0 };
+    fuzzer.monitor_target = memcmp(config.target, no_target, 6) != 0;
+    atomic_store(&fuzzer.next_mutation_id, config.first_mutation_id);
+    atomic_store(&fuzzer.sending_end_mutation_id, config.first_mutation_id);
+    atomic_store(&fuzzer.last_heard_mutation_id, config.first_mutation_id);
+
+    for(int batch_index = 0; batch_index < FUZZER_BATCHES; batch_index++)
+    {
+        fuzzer_batch_t *batch = &fuzzer.batches[batch_index];
+        batch->packets = calloc(config.batch_size, sizeof(wifi_mac_data_frame_t *));
+        batch->payload_lengths = calloc(config.batch_size, sizeof(int));
+        batch->results = calloc(config.batch_size, sizeof(esp_err_t));
+        if(batch->packets == NULL || batch->payload_lengths == NULL || batch->results == NULL)
+        {
+            free_fuzzer_batches();
+            return ESP_ERR_NO_MEM;
+        }
+        for(int index = 0; index < config.batch_size; index++)
+        {
+            batch->packets[index] = frame_pool_acquire(config.max_frame_length);
+            if(batch->packets[index] == NULL)
+            {
+                batch->packets[index] = malloc(config.max_frame_length);
+            }
+            if(batch->packets[index] == NULL)
+            {
+                free_fuzzer_batches();
+                return ESP_ERR_NO_MEM;
+            }
+        }
+    }
+
+    uint32_t log_capacity = 1;
+    while(log_capacity < (uint32_t)config.log_capacity)
+    {
+        log_capacity <<= 1;
+    }
+    fuzzer.log_slots = calloc(log_capacity, sizeof(fuzzer_log_slot_t));
+    if(fuzzer.log_slots == NULL)
+    {
+        free_fuzzer_batches();
+        return ESP_ERR_NO_MEM;
+    }
+    for(uint32_t index = 0; index < log_capacity; index++)
+    {
+        atomic_init(&fuzzer.log_slots[index].sequence, index);
+    }
+    fuzzer.log_mask = log_capacity - 1;
+    fuzzer_set_up = true;
+    ESP_LOGI(LOGGING_TAG, "FUZZER READY (2 x %d FRAMES, %u LOG ENTRIES)", config.batch_size, (unsigned)log_capacity);
+    return ESP_OK;
+}
+
+// Adds a copy of a frame to the corpus. Mutation IDs depend on the corpus, so add the same seeds in the same order to replay an earlier run.
+esp_err_t add_fuzzer_seed(const uint8_t* frame, int frame_length)
+{
+    if(!fuzzer_set_up || fuzzer.started)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(frame == NULL || frame_length < 2 || frame_length > fuzzer.config.max_frame_length)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(fuzzer.seed_count == FUZZER_MAX_SEEDS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    uint8_t *copy = malloc(frame_length);
+    if(copy == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, frame, frame_length);
+    fuzzer.seeds[fuzzer.seed_count].frame = copy;
+    fuzzer.seeds[fuzzer.seed_count].frame_length = frame_length;
+    fuzzer.seed_count++;
+    return ESP_OK;
+}
+
+// Starts the generator and sender tasks from the next mutation ID. The WiFi interface has to be set up, and promiscuous mode as well for the target to be watched.
+esp_err_t start_fuzzer()
+{
+    if(!fuzzer_set_up || fuzzer.started || fuzzer.seed_count == 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(!get_configuration_holder()->wifi_interface_set)
+    {
+        return ESP_ERR_WIFI_IF;
+    }
+    uint32_t next_mutation_id = atomic_load(&fuzzer.next_mutation_id);
+    fuzzer.limited = fuzzer.config.frame_count > 0;
+    fuzzer.end_mutation_id = next_mutation_id + fuzzer.config.frame_count;
+    for(int batch_index = 0; batch_index < FUZZER_BATCHES; batch_index++)
+    {
+        atomic_store(&fuzzer.batches[batch_index].ready, false);
+    }
+    atomic_store(&fuzzer.stop_requested, false);
+    atomic_store(&fuzzer.generator_stopped, false);
+    atomic_store(&fuzzer.sender_stopped, false);
+    atomic_store(&fuzzer.target_silent, false);
+    atomic_store(&fuzzer.last_heard_ms, get_fuzzer_time_ms());
+    atomic_store(&fuzzer.last_heard_mutation_id, next_mutation_id);
+
+    // The sender is created first so the generator can notify it from its first batch
+    if(xTaskCreatePinnedToCore(&fuzzer_sender_task, "pl_fuzz_send", 3072, NULL, fuzzer.config.task_priority, &fuzzer.sender_task, fuzzer.config.sender_core) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    if(xTaskCreatePinnedToCore(&fuzzer_generator_task, "pl_fuzz_gen", 3072, NULL, fuzzer.config.task_priority, &fuzzer.generator_task, fuzzer.config.generator_core) != pdPASS)
+    {
+        atomic_store(&fuzzer.stop_requested, true);
+        atomic_store(&fuzzer.generator_stopped, true);
+        while(!atomic_load(&fuzzer.sender_stopped))
+        {
+            vTaskDelay(1);
+        }
+        return ESP_ERR_NO_MEM;
+    }
+    fuzzer.started = true;
+    atomic_store(&fuzzer_monitoring, fuzzer.monitor_target);
+    ESP_LOGI(LOGGING_TAG, "FUZZER STARTED (MUTATION %u)", (unsigned)next_mutation_id);
+    return ESP_OK;
+}
+
+// Stops both tasks, also after a frame_count run has finished by itself. Batches generated but not sent are dropped, start_fuzzer generates them again.
+esp_err_t stop_fuzzer()
+{
+    if(!fuzzer_set_up || !fuzzer.started)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    atomic_store(&fuzzer.stop_requested, true);
+    xTaskNotifyGive(fuzzer.generator_task);
+    xTaskNotifyGive(fuzzer.sender_task);
+    while(!atomic_load(&fuzzer.generator_stopped) || !atomic_load(&fuzzer.sender_stopped))
+    {
+        vTaskDelay(1);
+    }
+    atomic_store(&fuzzer_monitoring, false);
+    while(atomic_load(&fuzzer_producers_busy) > 0)
+    {
+        vTaskDelay(1);
+    }
+    fuzzer.started = false;
+    ESP_LOGI(LOGGING_TAG, "FUZZER STOPPED (NEXT MUTATION %u)", (unsigned)atomic_load(&fuzzer.next_mutation_id));
+    return ESP_OK;
+}
+
+esp_err_t disable_fuzzer()
+{
+    if(!fuzzer_set_up)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(fuzzer.started)
+    {
+        stop_fuzzer();
+    }
+    free_fuzzer_batches();
+    for(int index = 0; index < fuzzer.seed_count; index++)
+    {
+        free(fuzzer.seeds[index].frame);
+    }
+    free(fuzzer.log_slots);
+    fuzzer.log_slots = NULL;
+    fuzzer_set_up = false;
+    return ESP_OK;
+}
+
+// Rebuilds the frame of a mutation ID, from the seed and corpus the fuzzer was set up with
+esp_err_t generate_fuzzer_mutation(uint32_t mutation_id, uint8_t frame_holder[], int* frame_length_holder)
+{
+    if(!fuzzer_set_up || fuzzer.seed_count == 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(frame_holder == NULL || frame_length_holder == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *frame_length_holder = generate_fuzzer_frame(mutation_id, frame_holder);
+    return ESP_OK;
+}
+
+// Sends the frame of a mutation ID once more, e.g. one from the log. Returns what esp_wifi_80211_tx returned.
+esp_err_t replay_fuzzer_mutation(uint32_t mutation_id)
+{
+    if(!fuzzer_set_up || fuzzer.seed_count == 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    wifi_mac_data_frame_t *packet = malloc(fuzzer.config.max_frame_length);
+    if(packet == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    int payload_length = generate_fuzzer_frame(mutation_id, (uint8_t *)packet) - (int)sizeof(wifi_mac_data_frame_t);
+    send_batch_pacing_t pacing = {
+        .inter_frame_interval_us = 0,
+        .callbacks = SEND_BATCH_CALLBACKS_NONE,
+        .keep_sequence_control = true
+    };
+    esp_err_t result = ESP_OK;
+    esp_err_t status = send_packet_batch(&packet, &payload_length, 1, pacing, &result);
+    free(packet);
+    return status == ESP_ERR_WIFI_IF ? status : result;
+}
+
+// Copies up to 'max_entries' of the oldest log entries into 'entry_holder' and frees their slots
+int read_fuzzer_log(fuzzer_log_entry_t entry_holder[], int max_entries)
+{
+    if(!fuzzer_set_up || entry_holder == NULL)
+    {
+        return 0;
+    }
+    int count = 0;
+    uint32_t position = atomic_load_explicit(&fuzzer.log_read_position, memory_order_relaxed);
+    while(count < max_entries)
+    {
+        fuzzer_log_slot_t *slot = &fuzzer.log_slots[position & fuzzer.log_mask];
+        int32_t difference = (int32_t)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - (position + 1));
+        if(difference == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&fuzzer.log_read_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                entry_holder[count++] = slot->entry;
+                atomic_store_explicit(&slot->sequence, position + fuzzer.log_mask + 1, memory_order_release);
+                position++;
+            }
+        }
+        else if(difference < 0)
+        {
+            break;
+        }
+        else
+        {
+            position = atomic_load_explicit(&fuzzer.log_read_position, memory_order_relaxed);
+        }
+    }
+    return count;
+}
+
+esp_err_t get_fuzzer_stats(fuzzer_stats_t* stats_holder)
+{
+    if(!fuzzer_set_up)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(stats_holder == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stats_holder->mutations_generated = atomic_load_explicit(&fuzzer.mutations_generated, memory_order_relaxed);
+    stats_holder->frames_sent = atomic_load_explicit(&fuzzer.frames_sent, memory_order_relaxed);
+    stats_holder->send_errors = atomic_load_explicit(&fuzzer.send_errors, memory_order_relaxed);
+    stats_holder->last_send_error = atomic_load_explicit(&fuzzer.last_send_error, memory_order_relaxed);
+    stats_holder->batches_sent = atomic_load_explicit(&fuzzer.batches_sent, memory_order_relaxed);
+    stats_holder->sender_waits = atomic_load_explicit(&fuzzer.sender_waits, memory_order_relaxed);
+    stats_holder->responses = atomic_load_explicit(&fuzzer.responses, memory_order_relaxed);
+    stats_holder->silences = atomic_load_explicit(&fuzzer.silences, memory_order_relaxed);
+    stats_holder->log_entries_lost = atomic_load_explicit(&fuzzer.log_entries_lost, memory_order_relaxed);
+    stats_holder->next_mutation_id = atomic_load_explicit(&fuzzer.next_mutation_id, memory_order_relaxed);
+    stats_holder->running = fuzzer.started && !atomic_load(&fuzzer.sender_stopped);
+    return ESP_OK;
+}
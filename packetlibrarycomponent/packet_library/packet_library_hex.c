@@ -0,0 +1,102 @@
+#include "packet_library.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+    Allocation-free hex formatting for the logging helpers.
+    Bytes are encoded through a nibble lookup table straight into the caller's buffer. On targets where it is safe, eight output
+    characters are assembled in a register and stored at once (four input bytes per step), and host builds with SSE2 encode
+    sixteen bytes per step. The tail always goes through the plain table loop.
+*/
+
+static const char hex_digits[16] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+static int log_payload_max_length = PACKET_LIBRARY_LOG_PAYLOAD_MAX_BYTES;
+
+#if defined(__SSE2__)
+// Encodes 16 bytes into 32 characters. Each nibble becomes '0' + nibble, plus 7 more for nibbles above 9 to land on 'A'-'F'.
+static inline void format_hex_16(const uint8_t *bytes, char *output)
+{
+    const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+    const __m128i ascii_zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i letter_offset = _mm_set1_epi8('A' - '0' - 10);
+    __m128i input = _mm_loadu_si128((const __m128i *)bytes);
+    __m128i high = _mm_and_si128(_mm_srli_epi16(input, 4), nibble_mask);
+    __m128i low = _mm_and_si128(input, nibble_mask);
+    high = _mm_add_epi8(_mm_add_epi8(high, ascii_zero), _mm_and_si128(_mm_cmpgt_epi8(high, nine), letter_offset));
+    low = _mm_add_epi8(_mm_add_epi8(low, ascii_zero), _mm_and_si128(_mm_cmpgt_epi8(low, nine), letter_offset));
+    _mm_storeu_si128((__m128i *)output, _mm_unpacklo_epi8(high, low));
+    _mm_storeu_si128((__m128i *)(output + 16), _mm_unpackhi_epi8(high, low));
+}
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+// Encodes 4 bytes into 8 characters built up in one 64 bit word, so the buffer sees a single store instead of eight
+static inline void format_hex_4(const uint8_t *bytes, char *output)
+{
+    uint64_t characters = 0;
+    for(int index = 0; index < 4; index++)
+    {
+        characters |= (uint64_t)(uint8_t)hex_digits[bytes[index] >> 4] << (16 * index);
+        characters |= (uint64_t)(uint8_t)hex_digits[bytes[index] & 0x0F] << (16 * index + 8);
+    }
+    memcpy(output, &characters, sizeof(characters));
+}
+#endif
+
+// Writes 'length' bytes as uppercase hex (two characters per byte) into 'output_buffer' and null terminates it.
+// Encodes as many whole bytes as fit in 'output_buffer_size' and returns the number of characters written, not counting the terminator. Never allocates.
+int format_payload_hex(const uint8_t* bytes, int length, char* output_buffer, int output_buffer_size)
+{
+    if(output_buffer == NULL || output_buffer_size <= 0)
+    {
+        return 0;
+    }
+    if(bytes == NULL || length < 0)
+    {
+        length = 0;
+    }
+    if(length > (output_buffer_size - 1) / 2)
+    {
+        length = (output_buffer_size - 1) / 2;
+    }
+
+    int index = 0;
+    char *output = output_buffer;
+#if defined(__SSE2__)
+    for(; index + 16 <= length; index += 16, output += 32)
+    {
+        format_hex_16(&bytes[index], output);
+    }
+#endif
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for(; index + 4 <= length; index += 4, output += 8)
+    {
+        format_hex_4(&bytes[index], output);
+    }
+#endif
+    for(; index < length; index++)
+    {
+        *output++ = hex_digits[bytes[index] >> 4];
+        *output++ = hex_digits[bytes[index] & 0x0F];
+    }
+    *output = '\0';
+    return length * 2;
+}
+
+// Sets how many payload bytes 'log_packet_annotated' and 'log_packet_hex' print before truncating, up to PACKET_LIBRARY_LOG_PAYLOAD_MAX_BYTES
+esp_err_t set_log_payload_max_length(int max_length)
+{
+    if(max_length < 0 || max_length > PACKET_LIBRARY_LOG_PAYLOAD_MAX_BYTES)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    log_payload_max_length = max_length;
+    return ESP_OK;
+}
+
+int get_log_payload_max_length()
+{
+    return log_payload_max_length;
+}
@@ -0,0 +1,159 @@
+#include "packet_library.h"
+
+#ifndef PACKET_LIBRARY_INTERNAL_H
+#define PACKET_LIBRARY_INTERNAL_H
+
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Internal helpers shared between the component source files. These are not part of the component API and are not in the include folder on purpose.
+
+// Read access to the configuration holder owned by packet_library.c
+const configuration_settings_t *get_configuration_holder();
+
+// Whether the send callbacks that are set can change a packet header (packet_library.c)
+bool send_callbacks_may_modify_header();
+
+// Sends through the frame template cache the send_payload_* helpers share (packet_library_frame_template.c)
+esp_err_t send_payload_cached_template(enum frame_template_mode mode, uint8_t destination[6], uint8_t payload[], int payload_length);
+
+// The promiscuous callback setup_promiscuous_simple* registers with the driver, also called directly by the benchmark suite (packet_library.c)
+void promisc_simple_callback(void *buf, wifi_promiscuous_pkt_type_t type);
+
+// Reader slots for the tables that are rebuilt into a few buffers and published with one atomic pointer store (packet_library_table_readers.c).
+// A reader claims a slot and pins the table it reads, the rebuild only reuses a buffer nothing pins, and a change that drops a
+// handler or route waits for the other tasks still reading an older table before returning.
+#define TABLE_READER_SLOTS 8
+
+typedef struct {
+    _Atomic(TaskHandle_t) task; // Owner while claimed, NULL while free
+    _Atomic uint32_t claim_count; // Bumped on every claim, so a wait can tell a new read from the one it is waiting out
+    _Atomic(const void *) table;
+} table_reader_slot_t;
+
+typedef struct {
+    table_reader_slot_t slots[TABLE_READER_SLOTS];
+} table_readers_t;
+
+table_reader_slot_t *table_readers_claim(table_readers_t *readers);
+void table_readers_release(table_reader_slot_t *slot);
+// Pins the table 'active' (an _Atomic pointer) points to into 'table', retrying until the pin is made before the table is replaced
+#define TABLE_READERS_PIN(slot, active, table) do { \
+        (table) = atomic_load_explicit((active), memory_order_seq_cst); \
+        atomic_store_explicit(&(slot)->table, (const void *)(table), memory_order_seq_cst); \
+    } while((table) != atomic_load_explicit((active), memory_order_seq_cst))
+// One of the 'buffer_count' buffers of 'buffer_size' bytes that is not 'active' and that no reader pins, NULL if each one is
+// pinned. Sets 'pinned_by_caller' when the caller's own task pins each of them, since waiting would never free one then.
+void *table_readers_free_buffer(table_readers_t *readers, void *buffers, size_t buffer_size, int buffer_count, const void *active, bool *pinned_by_caller);
+// Waits until every other task that pinned a table other than 'active' has let go of it. Must be called without the lock the
+// table changes take, since a reader can be waiting on that lock. The caller's own pins are skipped, a handler that removes
+// itself still finishes the frame it is running for.
+void table_readers_synchronize(table_readers_t *readers, const void *active);
+
+enum callback_direction { CALLBACK_DIRECTION_RECEIVE, CALLBACK_DIRECTION_SEND };
+
+// Any callback the dispatch table can hold, the member used matches the field and whether a context pointer is taken
+typedef union {
+    packet_library_simple_callback_t general;
+    packet_library_frame_control_callback_t u16_field; // Same signature as the duration/ID and sequence control callbacks
+    packet_library_address_1_callback_t address; // Same signature for all four addresses
+    packet_library_payload_callback_t payload;
+    packet_library_general_ctx_callback_t general_ctx;
+    packet_library_u16_field_ctx_callback_t u16_field_ctx;
+    packet_library_address_ctx_callback_t address_ctx;
+    packet_library_payload_ctx_callback_t payload_ctx;
+} callback_dispatch_handler_t;
+
+// Sets (is_set) or removes the single set_*_callback_* handler of a field (packet_library_callback_dispatch.c)
+esp_err_t callback_dispatch_set_handler(enum callback_direction direction, enum packet_library_callback_field field, callback_dispatch_handler_t handler, bool is_set);
+// Adds a context taking handler after the others of its field
+esp_err_t callback_dispatch_add(enum callback_direction direction, enum packet_library_callback_field field, callback_dispatch_handler_t handler, void* ctx, callback_subscription_t* subscription_holder);
+esp_err_t callback_dispatch_remove(enum callback_direction direction, callback_subscription_t subscription);
+// Runs every active handler for a packet, in field order. The set_* handlers get the frame as wifi_mac_data_frame_t with 'payload_length', the context taking ones the view.
+void callback_dispatch_run(enum callback_direction direction, const wifi_frame_view_t *view, int payload_length);
+// Whether any active handler is for a header field (or the whole packet) rather than the payload
+bool callback_dispatch_modifies_header(enum callback_direction direction);
+
+// Header length of a frame from its frame control field, following the frame view rules (packet_library_frame_view.c)
+int frame_header_length(uint16_t frame_control);
+
+// Whether a received frame passes the frame filters, 'frame_length' without the FCS. Called by the driver side receive callbacks before anything else (packet_library_frame_filter.c)
+bool frame_filter_accepts(const wifi_pkt_rx_ctrl_t *rx_ctrl, const uint8_t *frame, int frame_length);
+
+// Set while a station table is set up, checked on every received frame before calling station_table_record_frame (packet_library_station_table.c)
+extern _Atomic bool station_table_active;
+// Updates the station table entry of the frame's transmitter
+void station_table_record_frame(const wifi_frame_view_t *view);
+
+// Set while duplicate detection runs, checked on every received frame before calling duplicate_detection_check (packet_library_duplicate_detection.c)
+extern _Atomic bool duplicate_detection_active;
+// Marks view->duplicate and returns whether the frame is to be dropped
+bool duplicate_detection_check(wifi_frame_view_t *view);
+
+// Set while the channel hopper runs, checked on every received frame before calling channel_hopper_record_frame (packet_library_channel_hopper.c)
+extern _Atomic bool channel_hopper_active;
+// Channel the hopper last tuned to, 0 when it is not running
+extern volatile uint8_t channel_hopper_channel;
+// Counts a received frame, and its transmitter if new, towards the frame's channel
+void channel_hopper_record_frame(const wifi_frame_view_t *view);
+
+// Set while the fuzzer watches a target, checked on every received frame before calling fuzzer_record_frame (packet_library_fuzzer.c)
+extern _Atomic bool fuzzer_monitoring;
+// Notes the target was heard, and logs its management frames as responses to the last mutation sent
+void fuzzer_record_frame(const wifi_frame_view_t *view);
+
+// Set while forwarding runs, checked on every received frame that is not dropped as a duplicate before calling forwarding_forward_frame (packet_library_forwarding.c)
+extern _Atomic bool forwarding_active;
+// Rewrites the header in place and sends the frame if it has a route, returns whether the callbacks are to be skipped
+bool forwarding_forward_frame(wifi_frame_view_t *view);
+
+// Set while the bridge runs, checked on every received frame that forwarding did not take before calling bridge_handle_frame (packet_library_bridge.c)
+extern _Atomic bool bridge_active;
+// Learns from data frames and passes 4 address frames on, returns whether the callbacks are to be skipped
+bool bridge_handle_frame(wifi_frame_view_t *view);
+
+// Count received frames (before any filtering, 'frame_length' without the FCS), receive drops, and esp_wifi_80211_tx results in the per core traffic counters (packet_library_stats.c)
+void stats_count_receive(const wifi_pkt_rx_ctrl_t *rx_ctrl, const uint8_t *frame, int frame_length);
+void stats_count_receive_drop(enum packet_library_rx_drop_reason reason);
+void stats_count_send(const uint8_t *frame, int frame_length, esp_err_t result);
+
+// Set while the event trace runs, checked before each event_trace_record on the receive and send paths (packet_library_event_trace.c)
+extern _Atomic bool event_trace_active;
+void event_trace_record(enum event_trace_type type, uint32_t frame_id, int frame_length, int32_t argument);
+// Frame ID for an address and sequence control, the send_payload_* helpers trace their destination with it before the header exists
+uint32_t event_trace_address_frame_id(const uint8_t address[6], uint16_t sequence_control);
+
+// Stage timers for the latency histograms (packet_library_profiling.c). Without PACKET_LIBRARY_PROFILING they are empty statements and nothing is read or recorded.
+#if PACKET_LIBRARY_PROFILING
+#include <esp_cpu.h>
+void profile_record(enum packet_library_profile_stage stage, uint32_t cycles);
+#define PROFILE_STAGE_BEGIN(start) esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count()
+#define PROFILE_STAGE_END(stage, start) profile_record((stage), (uint32_t)(esp_cpu_get_cycle_count() - (start)))
+#else
+#define PROFILE_STAGE_BEGIN(start) do { } while(0)
+#define PROFILE_STAGE_END(stage, start) do { } while(0)
+#endif
+
+// Runs the pre-callback print, general callback, field callbacks, and post-callback print for a received packet (packet_library.c)
+void promisc_run_callbacks(const wifi_pkt_rx_ctrl_t *rx_ctrl, uint8_t *frame, int frame_length);
+// The same for a packet that is about to be sent
+void send_run_callbacks(wifi_mac_data_frame_t* packet, int payload_length);
+
+// Writes the static fields and payload of an already allocated packet, the body of alloc_packet_custom (packet_library.c)
+void fill_packet_custom(wifi_mac_data_frame_t* pkt, uint16_t frame_control, uint16_t duration_id, uint8_t address_1[6], uint8_t address_2[6], uint8_t address_3[6], uint16_t sequence_control, uint8_t address_4[6], int payload_length, uint8_t* payload);
+
+// Takes a buffer of at least 'frame_length' bytes from the smallest frame pool class that has one free, or NULL if none can (packet_library_frame_pool.c)
+void *frame_pool_acquire(int frame_length);
+// Returns a buffer to its frame pool class, false if the buffer did not come from the pool
+bool frame_pool_release(void *buffer);
+
+// Copies the header and first payload bytes of a packet into the binary log ring, counting it as lost if the ring is full (packet_library_binary_log.c)
+void binary_log_record(enum binary_log_source source, const wifi_mac_data_frame_t* packet, int payload_length);
+
+// Set while a capture sink is running, checked on every received frame before calling capture_record_frame (packet_library_capture.c)
+extern _Atomic bool capture_sink_active;
+// Appends one received frame with its radiotap metadata to the capture sink's active block
+void capture_record_frame(const wifi_pkt_rx_ctrl_t *rx_ctrl, const uint8_t *frame, int frame_length);
+
+#endif
@@ -0,0 +1,194 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Stage latency histograms.
+    With PACKET_LIBRARY_PROFILING set to 1 the receive and send paths read the cycle counter around the prints, every callback field
+    and esp_wifi_80211_tx, and add the time to that stage's histogram. Buckets are powers of two, so a sample is counted with one
+    count leading zeros and a few relaxed atomic adds, and no lock is taken on either path. The receive and send paths can record
+    into the same stage at once; a histogram read while frames arrive can be a sample or two apart between its fields.
+    Without PACKET_LIBRARY_PROFILING the stage timers compile to nothing, this file keeps no tables, and the functions only
+    return ESP_ERR_NOT_SUPPORTED.
+*/
+
+#if PACKET_LIBRARY_PROFILING
+
+typedef struct {
+    _Atomic uint32_t count;
+    _Atomic uint32_t max_cycles;
+    _Atomic uint32_t total_low; // 64 bit total as two words with a carry, 64 bit atomics are not lock free on the ESP32
+    _Atomic uint32_t total_high;
+    _Atomic uint32_t buckets[PACKET_LIBRARY_PROFILE_BUCKETS];
+} profile_stage_t;
+
+static profile_stage_t profile_stages[PROFILE_STAGE_COUNT];
+
+static const char *const profile_field_names[CALLBACK_FIELD_COUNT] = {
+    "GENERAL", "FRAME CONTROL", "DURATION ID", "ADDRESS 1", "ADDRESS 2", "ADDRESS 3", "SEQUENCE CONTROL", "ADDRESS 4", "PAYLOAD"
+};
+
+static inline int get_profile_bucket(uint32_t cycles)
+{
+    if(cycles == 0)
+    {
+        return 0;
+    }
+    int bucket = 32 - __builtin_clz(cycles);
+    return bucket >= PACKET_LIBRARY_PROFILE_BUCKETS ? PACKET_LIBRARY_PROFILE_BUCKETS - 1 : bucket;
+}
+
+// Adds one sample to a stage, called through PROFILE_STAGE_END
+void profile_record(enum packet_library_profile_stage stage, uint32_t cycles)
+{
+    profile_stage_t *profile = &profile_stages[stage];
+    atomic_fetch_add_explicit(&profile->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&profile->buckets[get_profile_bucket(cycles)], 1, memory_order_relaxed);
+    uint32_t before = atomic_fetch_add_explicit(&profile->total_low, cycles, memory_order_relaxed);
+    if(before + cycles < before)
+    {
+        atomic_fetch_add_explicit(&profile->total_high, 1, memory_order_relaxed);
+    }
+    uint32_t max_cycles = atomic_load_explicit(&profile->max_cycles, memory_order_relaxed);
+    while(cycles > max_cycles && !atomic_compare_exchange_weak_explicit(&profile->max_cycles, &max_cycles, cycles, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+}
+
+static void get_profile_stage_name(enum packet_library_profile_stage stage, char *name_holder, size_t name_size)
+{
+    if(stage == PROFILE_STAGE_RX_FRAME)
+    {
+        snprintf(name_holder, name_size, "RX FRAME");
+    }
+    else if(stage == PROFILE_STAGE_RX_PRECALLBACK_PRINT || stage == PROFILE_STAGE_TX_PRECALLBACK_PRINT)
+    {
+        snprintf(name_holder, name_size, "%s PRECALLBACK PRINT", stage == PROFILE_STAGE_RX_PRECALLBACK_PRINT ? "RX" : "TX");
+    }
+    else if(stage == PROFILE_STAGE_RX_POSTCALLBACK_PRINT || stage == PROFILE_STAGE_TX_POSTCALLBACK_PRINT)
+    {
+        snprintf(name_holder, name_size, "%s POSTCALLBACK PRINT", stage == PROFILE_STAGE_RX_POSTCALLBACK_PRINT ? "RX" : "TX");
+    }
+    else if(stage == PROFILE_STAGE_TX_DRIVER)
+    {
+        snprintf(name_holder, name_size, "TX DRIVER");
+    }
+    else if(stage < PROFILE_STAGE_RX_POSTCALLBACK_PRINT)
+    {
+        snprintf(name_holder, name_size, "RX %s CALLBACK", profile_field_names[stage - PROFILE_STAGE_RX_CALLBACK]);
+    }
+    else
+    {
+        snprintf(name_holder, name_size, "TX %s CALLBACK", profile_field_names[stage - PROFILE_STAGE_TX_CALLBACK]);
+    }
+}
+
+// Upper limit of the bucket holding the sample 'percent' of the way through the histogram
+static uint32_t get_profile_percentile(const profile_histogram_t *histogram, uint32_t percent)
+{
+    uint64_t wanted = ((uint64_t)histogram->count * percent + 99) / 100;
+    uint64_t seen = 0;
+    for(int bucket = 0; bucket < PACKET_LIBRARY_PROFILE_BUCKETS; bucket++)
+    {
+        seen += histogram->buckets[bucket];
+        if(seen >= wanted && seen > 0)
+        {
+            return bucket == PACKET_LIBRARY_PROFILE_BUCKETS - 1 ? histogram->max_cycles : (uint32_t)((1ull << bucket) - 1);
+        }
+    }
+    return histogram->max_cycles;
+}
+
+esp_err_t get_profile_histogram(enum packet_library_profile_stage stage, profile_histogram_t* histogram_holder)
+{
+    if(stage < 0 || stage >= PROFILE_STAGE_COUNT || histogram_holder == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    profile_stage_t *profile = &profile_stages[stage];
+    histogram_holder->count = atomic_load_explicit(&profile->count, memory_order_relaxed);
+    histogram_holder->max_cycles = atomic_load_explicit(&profile->max_cycles, memory_order_relaxed);
+    uint32_t high;
+    uint32_t low;
+    do
+    {
+        high = atomic_load_explicit(&profile->total_high, memory_order_relaxed);
+        low = atomic_load_explicit(&profile->total_low, memory_order_relaxed);
+    } while(high != atomic_load_explicit(&profile->total_high, memory_order_relaxed));
+    histogram_holder->total_cycles = ((uint64_t)high << 32) | low;
+    for(int bucket = 0; bucket < PACKET_LIBRARY_PROFILE_BUCKETS; bucket++)
+    {
+        histogram_holder->buckets[bucket] = atomic_load_explicit(&profile->buckets[bucket], memory_order_relaxed);
+    }
+    return ESP_OK;
+}
+
+// Clears every stage. Samples recorded while this runs can be partly cleared.
+esp_err_t reset_profile_histograms()
+{
+    for(int stage = 0; stage < PROFILE_STAGE_COUNT; stage++)
+    {
+        profile_stage_t *profile = &profile_stages[stage];
+        atomic_store_explicit(&profile->count, 0, memory_order_relaxed);
+        atomic_store_explicit(&profile->max_cycles, 0, memory_order_relaxed);
+        atomic_store_explicit(&profile->total_low, 0, memory_order_relaxed);
+        atomic_store_explicit(&profile->total_high, 0, memory_order_relaxed);
+        for(int bucket = 0; bucket < PACKET_LIBRARY_PROFILE_BUCKETS; bucket++)
+        {
+            atomic_store_explicit(&profile->buckets[bucket], 0, memory_order_relaxed);
+        }
+    }
+    return ESP_OK;
+}
+
+// Logs one line per stage with samples, then its non-empty buckets as "<upper limit>:count"
+esp_err_t log_profile_histograms(const char * TAG)
+{
+    ESP_LOGI(TAG, "PROFILE START (CYCLES)");
+    for(int stage = 0; stage < PROFILE_STAGE_COUNT; stage++)
+    {
+        profile_histogram_t histogram;
+        get_profile_histogram(stage, &histogram);
+        if(histogram.count == 0)
+        {
+            continue;
+        }
+        char name[40];
+        get_profile_stage_name(stage, name, sizeof(name));
+        ESP_LOGI(TAG, "%s: COUNT %u AVERAGE %u MAX %u P50 %u P90 %u P99 %u", name, (unsigned)histogram.count,
+                 (unsigned)(histogram.total_cycles / histogram.count), (unsigned)histogram.max_cycles, (unsigned)get_profile_percentile(&histogram, 50),
+                 (unsigned)get_profile_percentile(&histogram, 90), (unsigned)get_profile_percentile(&histogram, 99));
+        char buckets[PACKET_LIBRARY_PROFILE_BUCKETS * 24];
+        int used = 0;
+        for(int bucket = 0; bucket < PACKET_LIBRARY_PROFILE_BUCKETS; bucket++)
+        {
+            if(histogram.buckets[bucket] != 0)
+            {
+                used += snprintf(&buckets[used], sizeof(buckets) - used, " <%u:%u", (unsigned)(1u << bucket), (unsigned)histogram.buckets[bucket]);
+            }
+        }
+        ESP_LOGI(TAG, "   %s", buckets);
+    }
+    ESP_LOGI(TAG, "PROFILE END");
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t get_profile_histogram(enum packet_library_profile_stage stage, profile_histogram_t* histogram_holder)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t reset_profile_histograms()
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t log_profile_histograms(const char * TAG)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
@@ -0,0 +1,429 @@
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Station table.
+    Every received frame with a transmitter address updates the entry for that MAC: last seen time, frame and byte counters by
+    frame type, an RSSI moving average, the last sequence number, and the BSSID it was heard with. Entries live in a fixed array
+    allocated by setup_station_table and never move; an open addressing index (linear probing, at most half full) maps a MAC to
+    its entry. When the array is full the least recently heard station is evicted, kept track of with a doubly linked LRU list.
+    Only the receive path writes the table. Readers never take a lock: each entry has a sequence count that is odd while the
+    receive path writes it, and a lookup retries if an insert or eviction moved the index under it, so reading the table never
+    holds up received frames.
+*/
+
+#define STATION_TABLE_NO_ENTRY 0xFFFF
+
+typedef struct {
+    _Atomic uint32_t sequence; // Odd while the receive path is writing the entry
+    uint16_t lru_newer; // Neighbours in the LRU list, STATION_TABLE_NO_ENTRY at the ends
+    uint16_t lru_older;
+    bool rssi_seeded; // The first frame with an RSSI sets the average outright
+    int16_t rssi_average_x16; // Moving average in 1/16 dBm
+    station_table_entry_t entry;
+} station_table_slot_t;
+
+typedef struct {
+    station_table_slot_t *slots;
+    _Atomic uint16_t *index; // Entry number per index position, STATION_TABLE_NO_ENTRY when empty
+    uint32_t capacity;
+    uint32_t index_mask;
+    int index_bits;
+    int rssi_average_shift;
+    _Atomic uint32_t index_sequence; // Odd while an insert or eviction changes the index
+    uint16_t lru_newest;
+    uint16_t lru_oldest;
+    uint32_t entry_count;
+    // Receive path owned counters
+    _Atomic uint32_t frames_recorded;
+    _Atomic uint32_t insertions;
+    _Atomic uint32_t evictions;
+} station_table_t;
+
+static station_table_t station_table;
+// Set and cleared with seq_cst, as is station_table_callers_busy: a caller counts itself in before it checks the flag and
+// stop_station_table clears the flag before it checks the count, so one of the two always sees the other
+_Atomic bool station_table_active;
+static _Atomic uint32_t station_table_callers_busy; // The receive path in station_table_record_frame and tasks in get_station_entry, read_station_table or get_station_table_stats, so stop_station_table does not free the table under them. Outside station_table so setup_station_table does not clear it.
+
+// Counts the calling task in while the table is set up, false (and not counted in) once it is stopped
+static bool station_table_enter()
+{
+    atomic_fetch_add(&station_table_callers_busy, 1);
+    if(!atomic_load(&station_table_active))
+    {
+        atomic_fetch_sub(&station_table_callers_busy, 1);
+        return false;
+    }
+    return true;
+}
+
+static void station_table_leave()
+{
+    atomic_fetch_sub(&station_table_callers_busy, 1);
+}
+
+// Fibonacci hash of the 48 bit MAC onto the index
+static inline uint32_t station_table_hash(const uint8_t mac[6])
+{
+    uint64_t key = ((uint64_t)mac[0] << 40) | ((uint64_t)mac[1] << 32) | ((uint64_t)mac[2] << 24) | ((uint64_t)mac[3] << 16) | ((uint64_t)mac[4] << 8) | mac[5];
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> (64 - station_table.index_bits));
+}
+
+// Index position holding the entry for 'mac', or -1
+static int find_station_index_position(const uint8_t mac[6])
+{
+    uint32_t position = station_table_hash(mac);
+    for(uint32_t probes = 0; probes <= station_table.index_mask; probes++)
+    {
+        uint16_t entry_number = atomic_load_explicit(&station_table.index[position], memory_order_acquire);
+        if(entry_number == STATION_TABLE_NO_ENTRY)
+        {
+            return -1;
+        }
+        if(memcmp(station_table.slots[entry_number].entry.mac, mac, 6) == 0)
+        {
+            return position;
+        }
+        position = (position + 1) & station_table.index_mask;
+    }
+    return -1;
+}
+
+static void unlink_station_lru(uint16_t entry_number)
+{
+    station_table_slot_t *slot = &station_table.slots[entry_number];
+    if(slot->lru_newer != STATION_TABLE_NO_ENTRY)
+    {
+        station_table.slots[slot->lru_newer].lru_older = slot->lru_older;
+    }
+    else
+    {
+        station_table.lru_newest = slot->lru_older;
+    }
+    if(slot->lru_older != STATION_TABLE_NO_ENTRY)
+    {
+        station_table.slots[slot->lru_older].lru_newer = slot->lru_newer;
+    }
+    else
+    {
+        station_table.lru_oldest = slot->lru_newer;
+    }
+}
+
+static void push_station_lru_newest(uint16_t entry_number)
+{
+    station_table_slot_t *slot = &station_table.slots[entry_number];
+    slot->lru_newer = STATION_TABLE_NO_ENTRY;
+    slot->lru_older = station_table.lru_newest;
+    if(station_table.lru_newest != STATION_TABLE_NO_ENTRY)
+    {
+        station_table.slots[station_table.lru_newest].lru_newer = entry_number;
+    }
+    else
+    {
+        station_table.lru_oldest = entry_number;
+    }
+    station_table.lru_newest = entry_number;
+}
+
+// Removes an index position, shifting back the entries after it that probed past it so lookups never need tombstones
+static void remove_station_index_position(uint32_t position)
+{
+    uint32_t empty = position;
+    uint32_t next = (position + 1) & station_table.index_mask;
+    for(;;)
+    {
+        uint16_t entry_number = atomic_load_explicit(&station_table.index[next], memory_order_relaxed);
+        if(entry_number == STATION_TABLE_NO_ENTRY)
+        {
+            break;
+        }
+        uint32_t home = station_table_hash(station_table.slots[entry_number].entry.mac);
+        // Move the entry back when its home position is not cyclically within (empty, next]
+        if(((next - home) & station_table.index_mask) >= ((next - empty) & station_table.index_mask))
+        {
+            atomic_store_explicit(&station_table.index[empty], entry_number, memory_order_release);
+            empty = next;
+        }
+        next = (next + 1) & station_table.index_mask;
+    }
+    atomic_store_explicit(&station_table.index[empty], STATION_TABLE_NO_ENTRY, memory_order_release);
+}
+
+// Takes an entry for a station heard for the first time, evicting the least recently heard one if the table is full
+static uint16_t insert_station_entry(const uint8_t mac[6], int64_t now_us)
+{
+    atomic_store_explicit(&station_table.index_sequence, atomic_load_explicit(&station_table.index_sequence, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    uint16_t entry_number;
+    if(station_table.entry_count < station_table.capacity)
+    {
+        entry_number = station_table.entry_count++;
+    }
+    else
+    {
+        entry_number = station_table.lru_oldest;
+        int position = find_station_index_position(station_table.slots[entry_number].entry.mac);
+        if(position >= 0)
+        {
+            remove_station_index_position(position);
+        }
+        unlink_station_lru(entry_number);
+        atomic_store_explicit(&station_table.evictions, atomic_load_explicit(&station_table.evictions, memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+
+    station_table_slot_t *slot = &station_table.slots[entry_number];
+    uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memset(&slot->entry, 0, sizeof(station_table_entry_t));
+    memcpy(slot->entry.mac, mac, 6);
+    slot->entry.first_seen_us = now_us;
+    slot->rssi_average_x16 = 0;
+    slot->rssi_seeded = false;
+    atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+
+    uint32_t position = station_table_hash(mac);
+    while(atomic_load_explicit(&station_table.index[position], memory_order_relaxed) != STATION_TABLE_NO_ENTRY)
+    {
+        position = (position + 1) & station_table.index_mask;
+    }
+    atomic_store_explicit(&station_table.index[position], entry_number, memory_order_release);
+    push_station_lru_newest(entry_number);
+
+    atomic_store_explicit(&station_table.index_sequence, atomic_load_explicit(&station_table.index_sequence, memory_order_relaxed) + 1, memory_order_release);
+    atomic_store_explicit(&station_table.insertions, atomic_load_explicit(&station_table.insertions, memory_order_relaxed) + 1, memory_order_relaxed);
+    return entry_number;
+}
+
+// Updates the entry of the frame's transmitter, called for every received frame while the table is set up (promisc_run_callbacks)
+void station_table_record_frame(const wifi_frame_view_t *view)
+{
+    if(view->transmitter == NULL || !station_table_enter())
+    {
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    uint16_t entry_number;
+    int position = find_station_index_position(view->transmitter);
+    if(position >= 0)
+    {
+        entry_number = atomic_load_explicit(&station_table.index[position], memory_order_relaxed);
+        if(station_table.lru_newest != entry_number)
+        {
+            unlink_station_lru(entry_number);
+            push_station_lru_newest(entry_number);
+        }
+    }
+    else
+    {
+        entry_number = insert_station_entry(view->transmitter, now_us);
+    }
+
+    station_table_slot_t *slot = &station_table.slots[entry_number];
+    uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    station_table_entry_t *entry = &slot->entry;
+    entry->last_seen_us = now_us;
+    entry->frames[view->type]++;
+    entry->bytes[view->type] += view->frame_length;
+    if(view->type != WIFI_FRAME_TYPE_CONTROL)
+    {
+        entry->last_sequence_number = view->sequence_number;
+    }
+    if(view->bssid != NULL)
+    {
+        memcpy(entry->bssid, view->bssid, 6);
+    }
+    if(view->rx_ctrl != NULL)
+    {
+        int16_t rssi_x16 = view->rx_ctrl->rssi * 16;
+        if(!slot->rssi_seeded)
+        {
+            slot->rssi_average_x16 = rssi_x16;
+            slot->rssi_seeded = true;
+        }
+        else
+        {
+            slot->rssi_average_x16 += (rssi_x16 - slot->rssi_average_x16) / (1 << station_table.rssi_average_shift);
+        }
+        entry->rssi_last = view->rx_ctrl->rssi;
+        entry->rssi_average = slot->rssi_average_x16 / 16;
+        entry->channel = view->channel;
+    }
+
+    atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+    atomic_store_explicit(&station_table.frames_recorded, atomic_load_explicit(&station_table.frames_recorded, memory_order_relaxed) + 1, memory_order_relaxed);
+    station_table_leave();
+}
+
+// Copies an entry out, retrying while the receive path is writing it. Returns false if the entry was never used.
+static bool read_station_slot(station_table_slot_t *slot, station_table_entry_t *entry_holder)
+{
+    for(;;)
+    {
+        uint32_t before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if(before & 1)
+        {
+            vTaskDelay(1); // The receive path may be on this core at a lower priority, let it finish the write
+            continue;
+        }
+        memcpy(entry_holder, &slot->entry, sizeof(station_table_entry_t));
+        atomic_thread_fence(memory_order_acquire);
+        if(atomic_load_explicit(&slot->sequence, memory_order_relaxed) == before)
+        {
+            return before != 0;
+        }
+    }
+}
+
+// Allocates a table for 'config.capacity' stations (at most 32767) and starts recording every received frame's transmitter in it
+esp_err_t setup_station_table(station_table_config_t config)
+{
+    if(atomic_load(&station_table_active))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(config.capacity <= 0 || config.capacity >= STATION_TABLE_NO_ENTRY / 2 || config.rssi_average_shift < 0 || config.rssi_average_shift > 8)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Keep the index at most half full so probes stay short
+    uint32_t index_size = 1;
+    int index_bits = 0;
+    while(index_size < (uint32_t)config.capacity * 2)
+    {
+        index_size <<= 1;
+        index_bits++;
+    }
+
+    memset(&station_table, 0, sizeof(station_table));
+    station_table.slots = calloc(config.capacity, sizeof(station_table_slot_t));
+    station_table.index = malloc(index_size * sizeof(uint16_t));
+    if(station_table.slots == NULL || station_table.index == NULL)
+    {
+        free(station_table.slots);
+        free((void *)station_table.index);
+        station_table.slots = NULL;
+        station_table.index = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    memset((void *)station_table.index, 0xFF, index_size * sizeof(uint16_t));
+    station_table.capacity = config.capacity;
+    station_table.index_mask = index_size - 1;
+    station_table.index_bits = index_bits;
+    station_table.rssi_average_shift = config.rssi_average_shift;
+    station_table.lru_newest = STATION_TABLE_NO_ENTRY;
+    station_table.lru_oldest = STATION_TABLE_NO_ENTRY;
+    atomic_store(&station_table_active, true);
+    ESP_LOGI(LOGGING_TAG, "STATION TABLE STARTED (%d ENTRIES)", config.capacity);
+    return ESP_OK;
+}
+
+// Stops recording and frees the table once no frame is being recorded and no other task is reading it
+esp_err_t stop_station_table()
+{
+    if(!atomic_exchange(&station_table_active, false))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    while(atomic_load(&station_table_callers_busy) > 0)
+    {
+        vTaskDelay(1);
+    }
+    free(station_table.slots);
+    free((void *)station_table.index);
+    station_table.slots = NULL;
+    station_table.index = NULL;
+    return ESP_OK;
+}
+
+// Copies the entry for 'mac' into 'entry_holder', ESP_ERR_NOT_FOUND if the station has not been heard (or was evicted)
+esp_err_t get_station_entry(const uint8_t mac[6], station_table_entry_t* entry_holder)
+{
+    if(mac == NULL || entry_holder == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(!station_table_enter())
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for(;;)
+    {
+        uint32_t index_sequence = atomic_load_explicit(&station_table.index_sequence, memory_order_acquire);
+        if(index_sequence & 1)
+        {
+            vTaskDelay(1);
+            continue;
+        }
+        int position = find_station_index_position(mac);
+        bool found = position >= 0;
+        if(found)
+        {
+            uint16_t entry_number = atomic_load_explicit(&station_table.index[position], memory_order_acquire);
+            found = entry_number != STATION_TABLE_NO_ENTRY && read_station_slot(&station_table.slots[entry_number], entry_holder)
+                && memcmp(entry_holder->mac, mac, 6) == 0;
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if(atomic_load_explicit(&station_table.index_sequence, memory_order_relaxed) == index_sequence)
+        {
+            station_table_leave();
+            return found ? ESP_OK : ESP_ERR_NOT_FOUND;
+        }
+    }
+}
+
+/*
+    Copies up to 'max_entries' entries into 'entry_holder' starting at '*cursor' (0 for the first call), and moves the cursor on.
+    Returns the number copied, 0 once the whole table has been read. The table is read in chunks of the caller's size without
+    stopping the receive path, so each entry is consistent on its own but a station evicted and re-added part way through can be
+    skipped or seen twice.
+*/
+int read_station_table(station_table_entry_t entry_holder[], int max_entries, int* cursor)
+{
+    if(entry_holder == NULL || cursor == NULL || max_entries <= 0 || !station_table_enter())
+    {
+        return 0;
+    }
+    int copied = 0;
+    while(copied < max_entries && *cursor >= 0 && (uint32_t)*cursor < station_table.capacity)
+    {
+        if(read_station_slot(&station_table.slots[*cursor], &entry_holder[copied]))
+        {
+            copied++;
+        }
+        (*cursor)++;
+    }
+    station_table_leave();
+    return copied;
+}
+
+esp_err_t get_station_table_stats(station_table_stats_t* stats_holder)
+{
+    if(stats_holder == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(!station_table_enter())
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint32_t insertions = atomic_load_explicit(&station_table.insertions, memory_order_relaxed);
+    stats_holder->capacity = station_table.capacity;
+    stats_holder->entry_count = insertions < station_table.capacity ? insertions : station_table.capacity;
+    stats_holder->frames_recorded = atomic_load_explicit(&station_table.frames_recorded, memory_order_relaxed);
+    stats_holder->insertions = insertions;
+    stats_holder->evictions = atomic_load_explicit(&station_table.evictions, memory_order_relaxed);
+    station_table_leave();
+    return ESP_OK;
+}
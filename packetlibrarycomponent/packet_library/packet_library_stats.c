@@ -0,0 +1,236 @@
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Traffic counters.
+    Every received and sent frame is counted by type/subtype, channel and RSSI bucket, along with receive drops and transmit errors.
+    Counters are kept in one shard per core, each shard on its own cache lines, so the cores never write the same line. Within a
+    shard counters are relaxed atomic adds, which stay correct when two tasks on the same core (or host threads mapped to the same
+    shard) count at once. Byte counters are 64 bit, kept as two 32 bit words with a carry, since 64 bit atomics are not lock free
+    on the ESP32.
+    'packet_library_get_stats' reads each shard until two reads in a row agree (a few tries at most) and adds the shards up.
+*/
+
+#ifndef PACKET_LIBRARY_STATS_SHARDS
+#define PACKET_LIBRARY_STATS_SHARDS portNUM_PROCESSORS
+#endif
+#define PACKET_LIBRARY_STATS_CACHE_LINE 64
+#define PACKET_LIBRARY_STATS_SNAPSHOT_TRIES 4
+
+typedef struct {
+    _Atomic uint32_t low;
+    _Atomic uint32_t high;
+} stats_counter_64_t;
+
+typedef struct {
+    _Atomic uint32_t frames_by_subtype[4][16]; // [enum wifi_frame_type][subtype]
+    stats_counter_64_t bytes_by_type[4];
+    _Atomic uint32_t frames_by_channel[PACKET_LIBRARY_STATS_CHANNELS];
+    _Atomic uint32_t frames_by_rssi[PACKET_LIBRARY_STATS_RSSI_BUCKETS];
+} stats_direction_shard_t;
+
+typedef struct {
+    stats_direction_shard_t receive;
+    stats_direction_shard_t send;
+    _Atomic uint32_t receive_drops[RX_DROP_REASON_COUNT];
+    _Atomic uint32_t send_errors;
+    _Atomic int32_t last_send_error;
+} __attribute__((aligned(PACKET_LIBRARY_STATS_CACHE_LINE))) stats_shard_t;
+
+static stats_shard_t stats_shards[PACKET_LIBRARY_STATS_SHARDS];
+
+static inline stats_shard_t *get_stats_shard()
+{
+    return &stats_shards[xPortGetCoreID() % PACKET_LIBRARY_STATS_SHARDS];
+}
+
+static inline void add_stats_counter(_Atomic uint32_t *counter, uint32_t amount)
+{
+    atomic_fetch_add_explicit(counter, amount, memory_order_relaxed);
+}
+
+static inline void add_stats_counter_64(stats_counter_64_t *counter, uint32_t amount)
+{
+    uint32_t before = atomic_fetch_add_explicit(&counter->low, amount, memory_order_relaxed);
+    if(before + amount < before)
+    {
+        atomic_fetch_add_explicit(&counter->high, 1, memory_order_relaxed);
+    }
+}
+
+static uint64_t read_stats_counter_64(stats_counter_64_t *counter)
+{
+    uint32_t high;
+    uint32_t low;
+    do
+    {
+        high = atomic_load_explicit(&counter->high, memory_order_relaxed);
+        low = atomic_load_explicit(&counter->low, memory_order_relaxed);
+    } while(high != atomic_load_explicit(&counter->high, memory_order_relaxed));
+    return ((uint64_t)high << 32) | low;
+}
+
+// RSSI bucket: 0 for -30 dBm and stronger, then one bucket per 10 dB, the last for anything weaker
+static inline int get_stats_rssi_bucket(int rssi)
+{
+    int bucket = (-30 - rssi + 9) / 10;
+    if(bucket < 0)
+    {
+        return 0;
+    }
+    return bucket >= PACKET_LIBRARY_STATS_RSSI_BUCKETS ? PACKET_LIBRARY_STATS_RSSI_BUCKETS - 1 : bucket;
+}
+
+static inline void count_stats_frame(stats_direction_shard_t *shard, const uint8_t *frame, int frame_length, int channel, int rssi, bool has_rssi)
+{
+    uint8_t type = 0;
+    uint8_t subtype = 0;
+    if(frame_length > 0)
+    {
+        type = (frame[0] >> 2) & 0x3;
+        subtype = (frame[0] >> 4) & 0xF;
+    }
+    add_stats_counter(&shard->frames_by_subtype[type][subtype], 1);
+    add_stats_counter_64(&shard->bytes_by_type[type], frame_length > 0 ? frame_length : 0);
+    add_stats_counter(&shard->frames_by_channel[channel > 0 && channel < PACKET_LIBRARY_STATS_CHANNELS ? channel : 0], 1);
+    if(has_rssi)
+    {
+        add_stats_counter(&shard->frames_by_rssi[get_stats_rssi_bucket(rssi)], 1);
+    }
+}
+
+// Counts a frame the driver handed to the receive callback, before any filtering. 'frame_length' leaves out the FCS.
+void stats_count_receive(const wifi_pkt_rx_ctrl_t *rx_ctrl, const uint8_t *frame, int frame_length)
+{
+    count_stats_frame(&get_stats_shard()->receive, frame, frame_length, rx_ctrl->channel, rx_ctrl->rssi, true);
+}
+
+void stats_count_receive_drop(enum packet_library_rx_drop_reason reason)
+{
+    add_stats_counter(&get_stats_shard()->receive_drops[reason], 1);
+}
+
+// Counts a frame handed to esp_wifi_80211_tx and what it returned. Frames the driver refused only count as errors.
+void stats_count_send(const uint8_t *frame, int frame_length, esp_err_t result)
+{
+    stats_shard_t *shard = get_stats_shard();
+    if(result != ESP_OK)
+    {
+        add_stats_counter(&shard->send_errors, 1);
+        atomic_store_explicit(&shard->last_send_error, result, memory_order_relaxed);
+        return;
+    }
+    count_stats_frame(&shard->send, frame, frame_length, 0, 0, false);
+}
+
+// Reads one shard's counters into 'stats_holder', which starts zeroed
+static void read_stats_shard(stats_shard_t *shard, packet_library_stats_t *stats_holder)
+{
+    stats_direction_shard_t *directions[2] = { &shard->receive, &shard->send };
+    packet_library_direction_stats_t *totals[2] = { &stats_holder->receive, &stats_holder->send };
+    for(int direction = 0; direction < 2; direction++)
+    {
+        for(int type = 0; type < 4; type++)
+        {
+            for(int subtype = 0; subtype < 16; subtype++)
+            {
+                uint32_t frames = atomic_load_explicit(&directions[direction]->frames_by_subtype[type][subtype], memory_order_relaxed);
+                totals[direction]->frames_by_subtype[type][subtype] = frames;
+                totals[direction]->frames_by_type[type] += frames;
+                totals[direction]->frames += frames;
+            }
+            uint64_t bytes = read_stats_counter_64(&directions[direction]->bytes_by_type[type]);
+            totals[direction]->bytes_by_type[type] = bytes;
+            totals[direction]->bytes += bytes;
+        }
+        for(int channel = 0; channel < PACKET_LIBRARY_STATS_CHANNELS; channel++)
+        {
+            totals[direction]->frames_by_channel[channel] = atomic_load_explicit(&directions[direction]->frames_by_channel[channel], memory_order_relaxed);
+        }
+        for(int bucket = 0; bucket < PACKET_LIBRARY_STATS_RSSI_BUCKETS; bucket++)
+        {
+            totals[direction]->frames_by_rssi[bucket] = atomic_load_explicit(&directions[direction]->frames_by_rssi[bucket], memory_order_relaxed);
+        }
+    }
+    for(int reason = 0; reason < RX_DROP_REASON_COUNT; reason++)
+    {
+        stats_holder->receive_drops[reason] = atomic_load_explicit(&shard->receive_drops[reason], memory_order_relaxed);
+    }
+    stats_holder->send_errors = atomic_load_explicit(&shard->send_errors, memory_order_relaxed);
+    stats_holder->last_send_error = atomic_load_explicit(&shard->last_send_error, memory_order_relaxed);
+}
+
+static void add_direction_stats(const packet_library_direction_stats_t *shard_stats, packet_library_direction_stats_t *totals)
+{
+    totals->frames += shard_stats->frames;
+    totals->bytes += shard_stats->bytes;
+    for(int type = 0; type < 4; type++)
+    {
+        totals->frames_by_type[type] += shard_stats->frames_by_type[type];
+        totals->bytes_by_type[type] += shard_stats->bytes_by_type[type];
+        for(int subtype = 0; subtype < 16; subtype++)
+        {
+            totals->frames_by_subtype[type][subtype] += shard_stats->frames_by_subtype[type][subtype];
+        }
+    }
+    for(int channel = 0; channel < PACKET_LIBRARY_STATS_CHANNELS; channel++)
+    {
+        totals->frames_by_channel[channel] += shard_stats->frames_by_channel[channel];
+    }
+    for(int bucket = 0; bucket < PACKET_LIBRARY_STATS_RSSI_BUCKETS; bucket++)
+    {
+        totals->frames_by_rssi[bucket] += shard_stats->frames_by_rssi[bucket];
+    }
+}
+
+/*
+    Copies the traffic counters of all cores into 'stats_holder'. Nothing on the receive or send path is locked: each shard is read
+    until two reads in a row agree, so its counters belong to the same moment, unless frames keep arriving on that core through
+    every try, in which case the last read is used and its counters can be a frame or two apart.
+*/
+esp_err_t packet_library_get_stats(packet_library_stats_t* stats_holder)
+{
+    if(stats_holder == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Two reads of a shard are compared, too large for the caller's stack
+    packet_library_stats_t *reads = malloc(2 * sizeof(packet_library_stats_t));
+    if(reads == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(stats_holder, 0, sizeof(packet_library_stats_t));
+    for(int shard = 0; shard < PACKET_LIBRARY_STATS_SHARDS; shard++)
+    {
+        memset(&reads[0], 0, sizeof(packet_library_stats_t));
+        read_stats_shard(&stats_shards[shard], &reads[0]);
+        for(int tries = 1; tries < PACKET_LIBRARY_STATS_SNAPSHOT_TRIES; tries++)
+        {
+            memset(&reads[1], 0, sizeof(packet_library_stats_t));
+            read_stats_shard(&stats_shards[shard], &reads[1]);
+            bool agree = memcmp(&reads[0], &reads[1], sizeof(packet_library_stats_t)) == 0;
+            reads[0] = reads[1];
+            if(agree)
+            {
+                break;
+            }
+        }
+        add_direction_stats(&reads[0].receive, &stats_holder->receive);
+        add_direction_stats(&reads[0].send, &stats_holder->send);
+        for(int reason = 0; reason < RX_DROP_REASON_COUNT; reason++)
+        {
+            stats_holder->receive_drops[reason] += reads[0].receive_drops[reason];
+        }
+        stats_holder->send_errors += reads[0].send_errors;
+        if(reads[0].last_send_error != ESP_OK)
+        {
+            stats_holder->last_send_error = reads[0].last_send_error;
+        }
+    }
+    free(reads);
+    return ESP_OK;
+}
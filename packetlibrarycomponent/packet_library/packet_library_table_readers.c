@@ -0,0 +1,99 @@
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Reader slots for the callback dispatch, frame filter and forwarding tables, which are rebuilt into one of a few buffers and
+    published with a single atomic pointer store so the receive and send paths never take a lock.
+    A reader claims a slot for its task, pins the table it is about to read and checks the table is still the active one after
+    the pin (TABLE_READERS_PIN), so a rebuild that sees no pin on a buffer knows no reader is in it or can get into it. The pin
+    and the recheck are seq_cst like the publish and the rebuild's scan, which is what orders a pin before a reuse.
+    Each slot remembers its owning task, so a handler that changes a table from inside a dispatch is never waited on by itself.
+*/
+
+table_reader_slot_t *table_readers_claim(table_readers_t *readers)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    while(true)
+    {
+        for(int i = 0; i < TABLE_READER_SLOTS; i++)
+        {
+            table_reader_slot_t *slot = &readers->slots[i];
+            TaskHandle_t expected = NULL;
+            if(atomic_load_explicit(&slot->task, memory_order_relaxed) == NULL
+                && atomic_compare_exchange_strong_explicit(&slot->task, &expected, task, memory_order_acquire, memory_order_relaxed))
+            {
+                atomic_fetch_add_explicit(&slot->claim_count, 1, memory_order_relaxed);
+                return slot;
+            }
+        }
+        // More tasks reading at once than there are slots, wait for one to finish
+        vTaskDelay(1);
+    }
+}
+
+void table_readers_release(table_reader_slot_t *slot)
+{
+    atomic_store_explicit(&slot->table, NULL, memory_order_release);
+    atomic_store_explicit(&slot->task, NULL, memory_order_release);
+}
+
+void *table_readers_free_buffer(table_readers_t *readers, void *buffers, size_t buffer_size, int buffer_count, const void *active, bool *pinned_by_caller)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    *pinned_by_caller = true;
+    for(int i = 0; i < buffer_count; i++)
+    {
+        uint8_t *buffer = (uint8_t *)buffers + i * buffer_size;
+        if(buffer == active)
+        {
+            continue;
+        }
+        bool pinned = false;
+        bool caller_pinned = false;
+        for(int j = 0; j < TABLE_READER_SLOTS; j++)
+        {
+            if(atomic_load_explicit(&readers->slots[j].table, memory_order_seq_cst) == buffer)
+            {
+                pinned = true;
+                caller_pinned |= atomic_load_explicit(&readers->slots[j].task, memory_order_relaxed) == task;
+            }
+        }
+        if(!pinned)
+        {
+            *pinned_by_caller = false;
+            return buffer;
+        }
+        *pinned_by_caller &= caller_pinned;
+    }
+    return NULL;
+}
+
+void table_readers_synchronize(table_readers_t *readers, const void *active)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    const void *old_tables[TABLE_READER_SLOTS];
+    uint32_t claim_counts[TABLE_READER_SLOTS];
+    for(int i = 0; i < TABLE_READER_SLOTS; i++)
+    {
+        table_reader_slot_t *slot = &readers->slots[i];
+        claim_counts[i] = atomic_load_explicit(&slot->claim_count, memory_order_relaxed);
+        old_tables[i] = atomic_load_explicit(&slot->table, memory_order_seq_cst);
+        if(old_tables[i] == active || atomic_load_explicit(&slot->task, memory_order_relaxed) == task)
+        {
+            old_tables[i] = NULL;
+        }
+    }
+    // Only the reads under way now are waited out, a slot that was claimed again since is reading the new table
+    for(int i = 0; i < TABLE_READER_SLOTS; i++)
+    {
+        table_reader_slot_t *slot = &readers->slots[i];
+        while(old_tables[i] != NULL && atomic_load_explicit(&slot->table, memory_order_acquire) == old_tables[i]
+            && atomic_load_explicit(&slot->claim_count, memory_order_relaxed) == claim_counts[i])
+        {
+            vTaskDelay(1);
+        }
+    }
+}
@@ -0,0 +1,457 @@
+#include <stdatomic.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "packet_library.h"
+#include "packet_library_internal.h"
+
+/*
+    Asynchronous send queue.
+    Any task can copy a frame into a bounded ring and get back a frame ID straight away, the sender task takes frames off the
+    ring in order and hands them to esp_wifi_80211_tx. When the driver is out of TX buffers (ESP_ERR_NO_MEM) the sender waits
+    and sends the same frame again, doubling the wait each time, so frames are only dropped after max_retries. Other errors
+    fail the frame at once. An optional token bucket spaces the frames out to rate_limit_fps after a burst.
+    The ring takes frames from several tasks at once, so it uses the same per slot sequence numbers as the binary log, with the
+    sender task as its only reader. The outcome of each frame goes into a status record indexed by frame ID (kept for the last
+    status_history frames) and to the completion callback. A send that finds the ring full returns ESP_ERR_NO_MEM and asks for
+    the space callback, which the sender runs once space_threshold slots are free again, so a producer can block on its own
+    task notification instead of retrying on a timer.
+*/
+
+typedef struct {
+    _Atomic uint32_t sequence;
+    uint16_t length;
+    bool en_sys_seq;
+    uint8_t frame[];
+} tx_queue_slot_t;
+
+typedef struct {
+    _Atomic uint32_t frame_id; // 0 while the record is being rewritten for a newer frame
+    _Atomic uint8_t status; // enum tx_frame_status
+    _Atomic int32_t result;
+} tx_frame_record_t;
+
+typedef struct {
+    tx_queue_config_t config;
+    uint8_t *slots; // capacity * slot_stride bytes
+    uint32_t slot_stride;
+    uint32_t mask; // capacity - 1
+    tx_frame_record_t *records;
+    uint32_t record_mask;
+    _Atomic uint32_t write_position; // Claimed by the sending tasks with a compare-and-swap
+    _Atomic uint32_t read_position; // Sender task owned, the frame it is sending or waiting for
+    int64_t token_time_us; // Token bucket: when the next frame is due if the bucket were empty, sender task owned
+    TaskHandle_t sender_task;
+    _Atomic bool sender_idle; // Set while the sender waits for a frame, the sending task that clears it wakes the sender
+    _Atomic bool space_wanted; // A send found the ring full and the space callback has not run since
+    _Atomic bool stop_requested;
+    _Atomic bool sender_stopped;
+    // Updated by the sending tasks
+    _Atomic uint32_t frames_queued;
+    _Atomic uint32_t frames_rejected;
+    _Atomic uint32_t queue_high_water_mark;
+    // Sender task owned
+    _Atomic uint32_t frames_sent;
+    _Atomic uint32_t frames_dropped_no_mem;
+    _Atomic uint32_t frames_failed;
+    _Atomic int32_t last_error;
+    _Atomic uint32_t retries;
+    _Atomic uint32_t rate_limit_waits;
+    _Atomic uint32_t space_notifications;
+} tx_queue_t;
+
+static tx_queue_t tx_queue;
+// Set and cleared with seq_cst, as is tx_queue_callers_busy: a caller counts itself in before it checks the flag and stop_tx_queue
+// clears the flag before it checks the count, so one of the two always sees the other
+static _Atomic bool tx_queue_active;
+static _Atomic uint32_t tx_queue_callers_busy; // Tasks inside tx_queue_send, get_tx_frame_status or get_tx_queue_stats, so stop_tx_queue does not free the ring and records under them. Outside tx_queue so setup_tx_queue does not clear it.
+
+// Counts the calling task in while the queue is running, false (and not counted in) once it is stopped
+static bool tx_queue_enter()
+{
+    atomic_fetch_add(&tx_queue_callers_busy, 1);
+    if(!atomic_load(&tx_queue_active))
+    {
+        atomic_fetch_sub(&tx_queue_callers_busy, 1);
+        return false;
+    }
+    return true;
+}
+
+static void tx_queue_leave()
+{
+    atomic_fetch_sub(&tx_queue_callers_busy, 1);
+}
+
+static inline tx_queue_slot_t *tx_queue_slot_at(uint32_t position)
+{
+    return (tx_queue_slot_t *)(tx_queue.slots + (position & tx_queue.mask) * tx_queue.slot_stride);
+}
+
+static inline void tx_queue_count(_Atomic uint32_t *counter)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// Sleeps the whole ticks before 'time_us' and busy waits the rest, the same split send_packet_batch uses
+static void tx_queue_wait_until(int64_t time_us)
+{
+    const int64_t tick_us = portTICK_PERIOD_MS * 1000;
+    int64_t remaining = time_us - esp_timer_get_time();
+    if(remaining > tick_us)
+    {
+        vTaskDelay(remaining / tick_us);
+    }
+    while(esp_timer_get_time() < time_us)
+    {
+    }
+}
+
+// Takes a token from the bucket, waiting for one if the burst is used up
+static void tx_queue_take_token()
+{
+    int64_t interval_us = 1000000 / tx_queue.config.rate_limit_fps;
+    int64_t now = esp_timer_get_time();
+    if(tx_queue.token_time_us < now)
+    {
+        tx_queue.token_time_us = now; // Idle time fills the bucket, but only up to the burst
+    }
+    int64_t send_time = tx_queue.token_time_us - (int64_t)(tx_queue.config.rate_limit_burst - 1) * interval_us;
+    if(send_time > now)
+    {
+        tx_queue_count(&tx_queue.rate_limit_waits);
+        tx_queue_wait_until(send_time);
+    }
+    tx_queue.token_time_us += interval_us;
+}
+
+// Runs the space callback if a send asked for it and enough slots are free, called by the sender task
+static void tx_queue_check_space(uint32_t read_position)
+{
+    if(!atomic_load(&tx_queue.space_wanted))
+    {
+        return;
+    }
+    int free_slots = (int)(tx_queue.mask + 1 - (atomic_load(&tx_queue.write_position) - read_position));
+    if(free_slots >= tx_queue.config.space_threshold && atomic_exchange(&tx_queue.space_wanted, false))
+    {
+        tx_queue_count(&tx_queue.space_notifications);
+        if(tx_queue.config.space_callback != NULL)
+        {
+            tx_queue.config.space_callback(free_slots, tx_queue.config.callback_ctx);
+        }
+    }
+}
+
+// Sends one frame, resending it with a growing backoff while the driver has no buffer for it
+static esp_err_t tx_queue_transmit(const tx_queue_slot_t *slot)
+{
+    uint32_t backoff_us = tx_queue.config.retry_backoff_us;
+    for(int attempt = 0; ; attempt++)
+    {
+        esp_err_t result = send_packet_raw_no_callback(slot->frame, slot->length, slot->en_sys_seq);
+        if(result != ESP_ERR_NO_MEM || attempt == tx_queue.config.max_retries || atomic_load(&tx_queue.stop_requested))
+        {
+            return result;
+        }
+        tx_queue_count(&tx_queue.retries);
+        tx_queue_wait_until(esp_timer_get_time() + backoff_us);
+        backoff_us = backoff_us < tx_queue.config.max_retry_backoff_us / 2 ? backoff_us * 2 : tx_queue.config.max_retry_backoff_us;
+    }
+}
+
+static void tx_queue_sender(void *arg)
+{
+    uint32_t position = 0;
+    while(!atomic_load(&tx_queue.stop_requested))
+    {
+        tx_queue_check_space(position);
+        tx_queue_slot_t *slot = tx_queue_slot_at(position);
+        if(atomic_load_explicit(&slot->sequence, memory_order_acquire) != position + 1)
+        {
+            // A sending task either sees sender_idle and notifies, or published its frame before the check below
+            atomic_store(&tx_queue.sender_idle, true);
+            if(atomic_load_explicit(&slot->sequence, memory_order_acquire) != position + 1 && !atomic_load(&tx_queue.space_wanted))
+            {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            }
+            atomic_store(&tx_queue.sender_idle, false);
+            continue;
+        }
+
+        if(tx_queue.config.rate_limit_fps > 0)
+        {
+            tx_queue_take_token();
+        }
+        esp_err_t result = tx_queue_transmit(slot);
+        enum tx_frame_status status = TX_FRAME_SENT;
+        if(result == ESP_OK)
+        {
+            tx_queue_count(&tx_queue.frames_sent);
+        }
+        else
+        {
+            status = result == ESP_ERR_NO_MEM ? TX_FRAME_DROPPED_NO_MEM : TX_FRAME_ERROR;
+            tx_queue_count(status == TX_FRAME_DROPPED_NO_MEM ? &tx_queue.frames_dropped_no_mem : &tx_queue.frames_failed);
+            atomic_store_explicit(&tx_queue.last_error, result, memory_order_relaxed);
+        }
+        uint32_t frame_id = position + 1;
+        tx_frame_record_t *record = &tx_queue.records[frame_id & tx_queue.record_mask];
+        atomic_store(&record->result, result);
+        atomic_store(&record->status, (uint8_t)status);
+        if(tx_queue.config.completion_callback != NULL)
+        {
+            tx_queue.config.completion_callback(frame_id, status, result, tx_queue.config.callback_ctx);
+        }
+
+        atomic_store_explicit(&slot->sequence, position + tx_queue.mask + 1, memory_order_release);
+        position++;
+        atomic_store_explicit(&tx_queue.read_position, position, memory_order_release);
+    }
+    atomic_store(&tx_queue.sender_stopped, true);
+    vTaskDelete(NULL);
+}
+
+// This allocates the queue and status records and starts the sender task. The send interface has to be set up before frames go out, frames sent without one fail with ESP_ERR_WIFI_IF.
+esp_err_t setup_tx_queue(tx_queue_config_t config)
+{
+    if(atomic_load(&tx_queue_active))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(config.queue_depth <= 0 || config.max_frame_length <= 0 || config.max_frame_length > UINT16_MAX || config.status_history <= 0 || config.max_retries < 0
+        || config.max_retry_backoff_us < config.retry_backoff_us || (config.rate_limit_fps > 0 && (config.rate_limit_burst == 0 || config.rate_limit_fps > 1000000)))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t capacity = 1;
+    while(capacity < (uint32_t)config.queue_depth)
+    {
+        capacity <<= 1;
+    }
+    uint32_t history = capacity;
+    while(history < (uint32_t)config.status_history)
+    {
+        history <<= 1;
+    }
+    if(config.space_threshold < 1)
+    {
+        config.space_threshold = 1;
+    }
+    else if(config.space_threshold > (int)capacity)
+    {
+        config.space_threshold = capacity;
+    }
+    uint32_t stride = (sizeof(tx_queue_slot_t) + config.max_frame_length + 3) & ~3u; // Keep every slot 4 byte aligned
+
+    memset(&tx_queue, 0, sizeof(tx_queue));
+    tx_queue.config = config;
+    tx_queue.slots = calloc(capacity, stride);
+    tx_queue.records = calloc(history, sizeof(tx_frame_record_t));
+    if(tx_queue.slots == NULL || tx_queue.records == NULL)
+    {
+        free(tx_queue.slots);
+        free(tx_queue.records);
+        return ESP_ERR_NO_MEM;
+    }
+    tx_queue.slot_stride = stride;
+    tx_queue.mask = capacity - 1;
+    tx_queue.record_mask = history - 1;
+    for(uint32_t position = 0; position < capacity; position++)
+    {
+        atomic_init(&tx_queue_slot_at(position)->sequence, position);
+    }
+
+    if(xTaskCreatePinnedToCore(&tx_queue_sender, "pl_tx_queue", config.task_stack_size, NULL, config.task_priority, &tx_queue.sender_task, config.task_core) != pdPASS)
+    {
+        free(tx_queue.slots);
+        free(tx_queue.records);
+        return ESP_ERR_NO_MEM;
+    }
+    atomic_store(&tx_queue_active, true);
+    ESP_LOGI(LOGGING_TAG, "TX QUEUE STARTED (%u FRAMES)", (unsigned)capacity);
+    return ESP_OK;
+}
+
+// This stops the sender task once the frame it is on is done and frees the queue. Frames still queued are discarded and their status can no longer be read.
+esp_err_t stop_tx_queue()
+{
+    if(!atomic_exchange(&tx_queue_active, false))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    while(atomic_load(&tx_queue_callers_busy) > 0)
+    {
+        vTaskDelay(1);
+    }
+    atomic_store(&tx_queue.stop_requested, true);
+    xTaskNotifyGive(tx_queue.sender_task);
+    while(!atomic_load(&tx_queue.sender_stopped))
+    {
+        vTaskDelay(1);
+    }
+    free(tx_queue.slots);
+    tx_queue.slots = NULL;
+    free(tx_queue.records);
+    tx_queue.records = NULL;
+    ESP_LOGI(LOGGING_TAG, "TX QUEUE STOPPED");
+    return ESP_OK;
+}
+
+// Copies a raw frame into the queue and returns without waiting for it to be sent. Like send_packet_raw_no_callback, no send callbacks run.
+esp_err_t tx_queue_send(const void* frame, int length, bool en_sys_seq, uint32_t* frame_id_holder)
+{
+    if(frame == NULL || length <= 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(!tx_queue_enter())
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(length > tx_queue.config.max_frame_length)
+    {
+        tx_queue_leave();
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    tx_queue_slot_t *slot;
+    uint32_t position = atomic_load_explicit(&tx_queue.write_position, memory_order_relaxed);
+    while(true)
+    {
+        slot = tx_queue_slot_at(position);
+        int32_t difference = (int32_t)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - position);
+        if(difference == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&tx_queue.write_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if(difference < 0)
+        {
+            // The sender has not freed this slot yet, the queue is full. Ask for the space callback and make sure an idle sender sees the request.
+            atomic_fetch_add_explicit(&tx_queue.frames_rejected, 1, memory_order_relaxed);
+            atomic_store(&tx_queue.space_wanted, true);
+            if(atomic_exchange(&tx_queue.sender_idle, false))
+            {
+                xTaskNotifyGive(tx_queue.sender_task);
+            }
+            tx_queue_leave();
+            return ESP_ERR_NO_MEM;
+        }
+        else
+        {
+            position = atomic_load_explicit(&tx_queue.write_position, memory_order_relaxed);
+        }
+    }
+
+    // The record of the frame 'status_history' before this one is done with, since its slot has been freed at least once since
+    uint32_t frame_id = position + 1;
+    tx_frame_record_t *record = &tx_queue.records[frame_id & tx_queue.record_mask];
+    atomic_store(&record->frame_id, 0);
+    atomic_store(&record->status, (uint8_t)TX_FRAME_QUEUED);
+    atomic_store(&record->result, ESP_OK);
+    atomic_store(&record->frame_id, frame_id);
+
+    slot->length = (uint16_t)length;
+    slot->en_sys_seq = en_sys_seq;
+    memcpy(slot->frame, frame, length);
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    atomic_fetch_add_explicit(&tx_queue.frames_queued, 1, memory_order_relaxed);
+
+    // The sender may already be past this frame, so the occupancy is taken from a fresh write position read after the read position
+    uint32_t read_position = atomic_load(&tx_queue.read_position);
+    uint32_t occupancy = atomic_load(&tx_queue.write_position) - read_position;
+    uint32_t high_water_mark = atomic_load_explicit(&tx_queue.queue_high_water_mark, memory_order_relaxed);
+    while(occupancy > high_water_mark && !atomic_compare_exchange_weak_explicit(&tx_queue.queue_high_water_mark, &high_water_mark, occupancy, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+    if(atomic_exchange(&tx_queue.sender_idle, false))
+    {
+        xTaskNotifyGive(tx_queue.sender_task);
+    }
+    tx_queue_leave();
+
+    if(frame_id_holder != NULL)
+    {
+        *frame_id_holder = frame_id;
+    }
+    return ESP_OK;
+}
+
+// Runs the send prints and callbacks on the packet in the calling task, then queues it with the driver numbering the sequence control field, as send_packet_simple does.
+// The callbacks have already run if the queue turns out to be full.
+esp_err_t tx_queue_send_packet(wifi_mac_data_frame_t* packet, int payload_length, uint32_t* frame_id_holder)
+{
+    if(!atomic_load(&tx_queue_active))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if(packet == NULL || payload_length < 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if((int)sizeof(wifi_mac_data_frame_t) + payload_length > tx_queue.config.max_frame_length)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    send_run_callbacks(packet, payload_length);
+    return tx_queue_send(packet, sizeof(wifi_mac_data_frame_t) + payload_length, true, frame_id_holder);
+}
+
+// Reads the status of a queued frame. A frame stays QUEUED while it is waiting, being sent, or being retried.
+esp_err_t get_tx_frame_status(uint32_t frame_id, enum tx_frame_status* status_holder, esp_err_t* result_holder)
+{
+    if(status_holder == NULL || frame_id == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(!tx_queue_enter())
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    tx_frame_record_t *record = &tx_queue.records[frame_id & tx_queue.record_mask];
+    bool found = atomic_load(&record->frame_id) == frame_id;
+    enum tx_frame_status status = (enum tx_frame_status)atomic_load(&record->status);
+    esp_err_t result = atomic_load(&record->result);
+    // A newer frame taking the record clears frame_id first, so a changed ID means the values above may be the newer frame's
+    found &= atomic_load(&record->frame_id) == frame_id;
+    tx_queue_leave();
+    if(!found)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *status_holder = status;
+    if(result_holder != NULL)
+    {
+        *result_holder = result;
+    }
+    return ESP_OK;
+}
+
+// Copies the queue counters into 'stats_holder'. Each counter is read without stopping the queue, so the values can be a few frames apart from each other.
+esp_err_t get_tx_queue_stats(tx_queue_stats_t* stats_holder)
+{
+    if(!tx_queue_enter())
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint32_t read_position = atomic_load_explicit(&tx_queue.read_position, memory_order_acquire);
+    uint32_t write_position = atomic_load_explicit(&tx_queue.write_position, memory_order_acquire);
+    stats_holder->frames_queued = atomic_load_explicit(&tx_queue.frames_queued, memory_order_relaxed);
+    stats_holder->frames_rejected = atomic_load_explicit(&tx_queue.frames_rejected, memory_order_relaxed);
+    stats_holder->frames_sent = atomic_load_explicit(&tx_queue.frames_sent, memory_order_relaxed);
+    stats_holder->frames_dropped_no_mem = atomic_load_explicit(&tx_queue.frames_dropped_no_mem, memory_order_relaxed);
+    stats_holder->frames_failed = atomic_load_explicit(&tx_queue.frames_failed, memory_order_relaxed);
+    stats_holder->last_error = atomic_load_explicit(&tx_queue.last_error, memory_order_relaxed);
+    stats_holder->retries = atomic_load_explicit(&tx_queue.retries, memory_order_relaxed);
+    stats_holder->rate_limit_waits = atomic_load_explicit(&tx_queue.rate_limit_waits, memory_order_relaxed);
+    stats_holder->space_notifications = atomic_load_explicit(&tx_queue.space_notifications, memory_order_relaxed);
+    stats_holder->queue_capacity = tx_queue.mask + 1;
+    stats_holder->queue_occupancy = write_position - read_position;
+    stats_holder->queue_high_water_mark = atomic_load_explicit(&tx_queue.queue_high_water_mark, memory_order_relaxed);
+    tx_queue_leave();
+    return ESP_OK;
+}